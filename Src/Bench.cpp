@@ -0,0 +1,596 @@
+// Bench.cpp
+//
+// The tacentview_bench codec benchmark. Built from the same sources as the viewer so it exercises the real
+// Image::Load and Image::Save paths. It decodes every supported file in a corpus (TestImages by default) and encodes
+// each one with a set of save-parameter presets, reporting timings and memory as CSV and/or JSON.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <System/tCmdLine.h>
+#include <System/tPrint.h>
+#include <System/tFile.h>
+#include "Bench.h"
+#include "CommandStats.h"
+#include "TacentView.h"
+#include "Image.h"
+#include "Resampler.h"
+#include "HDRSource.h"
+
+
+namespace Bench
+{
+	tCmdLine::tOption OptionCorpus		("Corpus directory. Default TestImages/",		"corpus",				1	);
+	tCmdLine::tOption OptionIterations	("Timed iterations per measurement",			"iterations",			1	);
+	tCmdLine::tOption OptionWarmup		("Untimed warm-up iterations",					"warmup",				1	);
+	tCmdLine::tOption OptionCSV			("CSV output file",								"csv",					1	);
+	tCmdLine::tOption OptionJSON		("JSON output file",							"json",					1	);
+	tCmdLine::tOption OptionNoEncode	("Only benchmark decoding",						"noencode"					);
+	tCmdLine::tOption OptionResample	("Check the resampler against its tolerances",	"resample"					);
+	tCmdLine::tOption OptionHDR			("Check HDR reconversion against a reload",		"hdr"						);
+
+	// A save preset is a file type plus a function that sets the corresponding save parameters on an image.
+	struct SavePreset
+	{
+		tSystem::tFileType Type;
+		const char* Name;
+		void (*Apply)(Viewer::Image&);
+	};
+	extern SavePreset SavePresets[];
+	extern int NumSavePresets;
+
+	struct Result : public tLink<Result>
+	{
+		tString Kind;													// "decode" or "encode".
+		tString File;
+		tString Format;
+		tString Preset;
+		int Iterations													= 0;
+		double MinMs													= 0.0;
+		double MedianMs													= 0.0;
+		double MeanMs													= 0.0;
+		double MaxMs													= 0.0;
+		uint64 OutBytes													= 0;
+		int64 ImageMemBytes												= 0;
+
+		// The peak resident size is a process-wide high-water mark, so all that can be attributed to one measurement
+		// is how much it raised that mark. Zero means the measurement stayed under an earlier peak, not that it used
+		// no memory. Bench a single file for an absolute figure.
+		uint64 PeakRSSGrowth											= 0;
+	};
+
+	void FindCorpusFiles(tList<tSystem::tFileInfo>& files, const tString& dir);
+	void Summarize(Result&, double* timesMs, int count, uint64 peakBefore);
+	void BenchDecode(tList<Result>& results, const tSystem::tFileInfo&, int warmup, int iterations);
+	void BenchEncode(tList<Result>& results, const tSystem::tFileInfo&, const tString& tempDir, int warmup, int iterations);
+	void WriteCSV(const tList<Result>& results, const tString& file);
+	void WriteJSON(const tList<Result>& results, const tString& file);
+	void WriteText(const tString& text, const tString& file);
+
+	// Resamples the first frame (at most its central 512x512) of every corpus file down and up with each filter and
+	// edge mode using tPicture::Resample, Viewer::ResamplePicture, and ReferenceResample. Prints the largest
+	// per-channel differences and returns false if any exceeds the tolerances stated in Resampler.h.
+	bool CompareResample(const tList<tSystem::tFileInfo>& files);
+
+	// Loads every HDR corpus file with tImageHDR at a range of gammas and exposures and compares each result with
+	// HDRSource::Convert of the same file. Returns false if any pixel differs or nothing was compared.
+	bool CompareHDR(const tList<tSystem::tFileInfo>& files);
+
+	// A direct evaluation of the weights documented in Resampler.h. Positions and kernel arguments are computed in
+	// float exactly as documented so taps land identically, but weights and sums are double and there is no weight
+	// cache, row blocking, threading, or SIMD. ResamplePicture must match it to within rounding.
+	struct ReferenceTap { int Index; double Weight; };
+	void ReferenceWeights(std::vector<std::vector<ReferenceTap>>&, int srcSize, int dstSize, tImage::tResampleFilter, tImage::tResampleEdgeMode);
+	void ReferenceResample(std::vector<tPixel4b>& dst, const tImage::tPicture& src, int dstW, int dstH, tImage::tResampleFilter, tImage::tResampleEdgeMode);
+}
+
+
+Bench::SavePreset Bench::SavePresets[] =
+{
+	{ tSystem::tFileType::TGA,	"raw",		[](Viewer::Image& i) { i.SaveParamsTGA.Compression = tImage::tImageTGA::tCompression::None; } },
+	{ tSystem::tFileType::TGA,	"rle",		[](Viewer::Image& i) { i.SaveParamsTGA.Compression = tImage::tImageTGA::tCompression::RLE; } },
+	{ tSystem::tFileType::PNG,	"auto",		[](Viewer::Image& i) { i.SaveParamsPNG.Format = tImage::tImagePNG::tFormat::Auto; } },
+	{ tSystem::tFileType::JPG,	"q95",		[](Viewer::Image& i) { i.SaveParamsJPG.Quality = 95; } },
+	{ tSystem::tFileType::JPG,	"q75",		[](Viewer::Image& i) { i.SaveParamsJPG.Quality = 75; } },
+	{ tSystem::tFileType::QOI,	"auto",		[](Viewer::Image& i) { i.SaveParamsQOI.Format = tImage::tImageQOI::tFormat::Auto; } },
+	{ tSystem::tFileType::BMP,	"auto",		[](Viewer::Image& i) { i.SaveParamsBMP.Format = tImage::tImageBMP::tFormat::Auto; } },
+	{ tSystem::tFileType::WEBP,	"lossless",	[](Viewer::Image& i) { i.SaveParamsWEBP.Lossy = false; i.SaveParamsWEBP.QualityCompstr = 90.0f; } },
+	{ tSystem::tFileType::WEBP,	"lossy90",	[](Viewer::Image& i) { i.SaveParamsWEBP.Lossy = true; i.SaveParamsWEBP.QualityCompstr = 90.0f; } },
+	{ tSystem::tFileType::TIFF,	"zlib",		[](Viewer::Image& i) { i.SaveParamsTIFF.UseZLibCompression = true; } },
+	{ tSystem::tFileType::TIFF,	"none",		[](Viewer::Image& i) { i.SaveParamsTIFF.UseZLibCompression = false; } },
+	{ tSystem::tFileType::GIF,	"default",	[](Viewer::Image& i) { i.SaveParamsGIF = tImage::tImageGIF::SaveParams(); } },
+	{ tSystem::tFileType::APNG,	"auto",		[](Viewer::Image& i) { i.SaveParamsAPNG.Format = tImage::tImageAPNG::tFormat::Auto; } }
+};
+int Bench::NumSavePresets = tNumElements(Bench::SavePresets);
+
+
+int Bench::Run()
+{
+	tString corpus = OptionCorpus ? OptionCorpus.Arg1() : tString("TestImages/");
+	if (!corpus.IsEmpty() && (corpus[corpus.Length()-1] != '/'))
+		corpus += "/";
+	int iterations = OptionIterations ? tMath::tMax(OptionIterations.Arg1().AsInt32(), 1) : 5;
+	int warmup = OptionWarmup ? tMath::tMax(OptionWarmup.Arg1().AsInt32(), 0) : 1;
+
+	if (!tSystem::tDirExists(corpus))
+	{
+		tPrintf("Bench | Corpus directory %s not found.\n", corpus.Chr());
+		return 1;
+	}
+
+	tList<tSystem::tFileInfo> files;
+	FindCorpusFiles(files, corpus);
+	if (OptionResample)
+		return CompareResample(files) ? 0 : 1;
+	if (OptionHDR)
+		return CompareHDR(files) ? 0 : 1;
+
+	// Encoded files go in a new scratch directory that is removed at the end. It is never an existing directory.
+	tString tempDir = Command::CreateScratchDir("bench");
+	if (tempDir.IsEmpty())
+	{
+		tPrintf("Bench | Could not create a scratch directory.\n");
+		return 1;
+	}
+
+	tPrintf("Bench | %d files. %d warm-up and %d timed iterations.\n", files.Count(), warmup, iterations);
+
+	tList<Result> results;
+	for (tSystem::tFileInfo* info = files.First(); info; info = info->Next())
+	{
+		tPrintf("Bench | %s\n", info->FileName.Chr());
+		BenchDecode(results, *info, warmup, iterations);
+		if (!OptionNoEncode)
+			BenchEncode(results, *info, tempDir, warmup, iterations);
+	}
+	tSystem::tDeleteDir(tempDir);
+
+	if (OptionCSV)
+		WriteCSV(results, OptionCSV.Arg1());
+	if (OptionJSON)
+		WriteJSON(results, OptionJSON.Arg1());
+	if (!OptionCSV && !OptionJSON)
+		WriteCSV(results, tString());
+
+	tPrintf("Bench | Done. Peak RSS %|64d bytes.\n", Command::GetPeakResidentBytes());
+	return 0;
+}
+
+
+void Bench::FindCorpusFiles(tList<tSystem::tFileInfo>& files, const tString& dir)
+{
+	tSystem::tFindFiles(files, dir, Viewer::FileTypes_Load);
+
+	tList<tStringItem> subDirs;
+	tSystem::tFindDirs(subDirs, dir, false);
+	for (tStringItem* subDir = subDirs.First(); subDir; subDir = subDir->Next())
+		FindCorpusFiles(files, *subDir);
+}
+
+
+void Bench::Summarize(Result& result, double* timesMs, int count, uint64 peakBefore)
+{
+	result.Iterations = count;
+	if (count <= 0)
+		return;
+
+	std::sort(timesMs, timesMs + count);
+	double sum = 0.0;
+	for (int t = 0; t < count; t++)
+		sum += timesMs[t];
+
+	result.MinMs	= timesMs[0];
+	result.MaxMs	= timesMs[count-1];
+	result.MeanMs	= sum / double(count);
+	result.MedianMs	= (count & 1) ? timesMs[count/2] : 0.5*(timesMs[count/2 - 1] + timesMs[count/2]);
+	uint64 peakAfter = Command::GetPeakResidentBytes();
+	result.PeakRSSGrowth = (peakAfter > peakBefore) ? (peakAfter - peakBefore) : 0;
+}
+
+
+void Bench::BenchDecode(tList<Result>& results, const tSystem::tFileInfo& info, int warmup, int iterations)
+{
+	Result* result = new Result;
+	result->Kind	= "decode";
+	result->File	= info.FileName;
+	result->Format	= tSystem::tGetFileTypeName(tSystem::tGetFileType(info.FileName));
+	result->Preset	= "*";
+
+	double* timesMs = new double[iterations];
+	int numTimed = 0;
+	uint64 peakBefore = Command::GetPeakResidentBytes();
+	for (int i = 0; i < warmup + iterations; i++)
+	{
+		Viewer::Image image(info);
+		Command::StatsTimer timer;
+		bool loaded = image.Load(false);
+		double ms = timer.GetWallSeconds() * 1000.0;
+		if (!loaded)
+			break;
+
+		result->ImageMemBytes = image.Info.MemSizeBytes;
+		if (i >= warmup)
+			timesMs[numTimed++] = ms;
+		image.Unload();
+	}
+
+	Summarize(*result, timesMs, numTimed, peakBefore);
+	delete[] timesMs;
+	if (numTimed > 0)
+		results.Append(result);
+	else
+		delete result;
+}
+
+
+void Bench::BenchEncode(tList<Result>& results, const tSystem::tFileInfo& info, const tString& tempDir, int warmup, int iterations)
+{
+	// Decode once. Every preset encodes the same pixels.
+	Viewer::Image image(info);
+	if (!image.Load(false))
+		return;
+
+	double* timesMs = new double[iterations];
+	for (int p = 0; p < NumSavePresets; p++)
+	{
+		const SavePreset& preset = SavePresets[p];
+		tString outFile = tempDir + tSystem::tGetFileBaseName(info.FileName) + "_" + preset.Name + "." + tSystem::tGetExtension(preset.Type);
+		preset.Apply(image);
+
+		int numTimed = 0;
+		uint64 peakBefore = Command::GetPeakResidentBytes();
+		for (int i = 0; i < warmup + iterations; i++)
+		{
+			Command::StatsTimer timer;
+			bool saved = image.Save(outFile, preset.Type, false);
+			double ms = timer.GetWallSeconds() * 1000.0;
+			if (!saved)
+				break;
+			if (i >= warmup)
+				timesMs[numTimed++] = ms;
+		}
+
+		if (numTimed > 0)
+		{
+			Result* result = new Result;
+			result->Kind			= "encode";
+			result->File			= info.FileName;
+			result->Format			= tSystem::tGetFileTypeName(preset.Type);
+			result->Preset			= preset.Name;
+			result->ImageMemBytes	= image.Info.MemSizeBytes;
+
+			tSystem::tFileInfo outInfo;
+			if (tSystem::tGetFileInfo(outInfo, outFile))
+				result->OutBytes = outInfo.FileSize;
+
+			Summarize(*result, timesMs, numTimed, peakBefore);
+			results.Append(result);
+		}
+		tSystem::tDeleteFile(outFile);
+	}
+	delete[] timesMs;
+}
+
+
+void Bench::ReferenceWeights
+(
+	std::vector<std::vector<ReferenceTap>>& weights, int srcSize, int dstSize,
+	tImage::tResampleFilter filter, tImage::tResampleEdgeMode edgeMode
+)
+{
+	auto address = [srcSize, edgeMode](int s) -> int
+	{
+		if (edgeMode == tImage::tResampleEdgeMode::Wrap)
+			return ((s % srcSize) + srcSize) % srcSize;
+		return tMath::tClamp(s, 0, srcSize-1);
+	};
+
+	weights.assign(dstSize, std::vector<ReferenceTap>());
+	float scale = float(dstSize) / float(srcSize);
+	float filterScale = tMath::tMin(scale, 1.0f);
+	float support = Viewer::GetKernelRadius(filter) / filterScale;
+	for (int d = 0; d < dstSize; d++)
+	{
+		std::vector<ReferenceTap>& taps = weights[d];
+		if (filter == tImage::tResampleFilter::Nearest)
+		{
+			taps.push_back({ tMath::tClamp(int((float(d) + 0.5f) / scale), 0, srcSize-1), 1.0 });
+			continue;
+		}
+
+		float centre = (float(d) + 0.5f) / scale - 0.5f;
+		double sum = 0.0;
+		for (int s = int(std::floor(centre - support)); s <= int(std::ceil(centre + support)); s++)
+		{
+			double w = Viewer::EvalKernel(filter, (float(s) - centre) * filterScale);
+			if (w == 0.0)
+				continue;
+			taps.push_back({ address(s), w });
+			sum += w;
+		}
+		if (taps.empty() || (sum == 0.0))
+		{
+			taps.assign(1, { address(int(std::floor(centre + 0.5f))), 1.0 });
+			sum = 1.0;
+		}
+		for (ReferenceTap& tap : taps)
+			tap.Weight /= sum;
+	}
+}
+
+
+void Bench::ReferenceResample
+(
+	std::vector<tPixel4b>& dst, const tImage::tPicture& src, int dstW, int dstH,
+	tImage::tResampleFilter filter, tImage::tResampleEdgeMode edgeMode
+)
+{
+	int srcW = src.GetWidth();
+	int srcH = src.GetHeight();
+	std::vector<std::vector<ReferenceTap>> wx, wy;
+	ReferenceWeights(wx, srcW, dstW, filter, edgeMode);
+	ReferenceWeights(wy, srcH, dstH, filter, edgeMode);
+
+	// Horizontal pass into a double buffer of srcH rows, then the vertical pass.
+	const tPixel4b* pixels = src.GetPixelPointer();
+	std::vector<double> rows(size_t(srcH)*dstW*4, 0.0);
+	for (int y = 0; y < srcH; y++)
+	for (int x = 0; x < dstW; x++)
+	for (const ReferenceTap& tap : wx[x])
+	{
+		const tPixel4b& p = pixels[y*srcW + tap.Index];
+		double* r = &rows[(size_t(y)*dstW + x)*4];
+		r[0] += tap.Weight*p.R;	r[1] += tap.Weight*p.G;	r[2] += tap.Weight*p.B;	r[3] += tap.Weight*p.A;
+	}
+
+	dst.resize(size_t(dstW)*dstH);
+	for (int y = 0; y < dstH; y++)
+	for (int x = 0; x < dstW; x++)
+	{
+		double c[4] = { 0.0, 0.0, 0.0, 0.0 };
+		for (const ReferenceTap& tap : wy[y])
+			for (int e = 0; e < 4; e++)
+				c[e] += tap.Weight*rows[(size_t(tap.Index)*dstW + x)*4 + e];
+
+		uint8 v[4];
+		for (int e = 0; e < 4; e++)
+			v[e] = uint8(tMath::tClamp(int(std::floor(c[e] + 0.5)), 0, 255));
+		dst[y*dstW + x].Set(v[0], v[1], v[2], v[3]);
+	}
+}
+
+
+bool Bench::CompareResample(const tList<tSystem::tFileInfo>& files)
+{
+	// The down scales use the stretched kernel, the up scales the kernel at 1:1.
+	const float scales[] = { 0.5f, 0.37f, 1.6f, 2.0f };
+	const int numScales = tNumElements(scales);
+	const int numFilters = int(tImage::tResampleFilter::NumFilters);
+	const int numEdgeModes = int(tImage::tResampleEdgeMode::NumEdgeModes);
+	std::vector<int> maxError(numFilters*numEdgeModes*numScales, 0);
+	std::vector<int> maxRefError(numFilters*numEdgeModes*numScales, 0);
+
+	int numCompared = 0;
+	for (tSystem::tFileInfo* info = files.First(); info; info = info->Next())
+	{
+		Viewer::Image image(*info);
+		if (!image.Load(false))
+			continue;
+		tImage::tPicture* current = image.GetCurrentPic();
+		if (!current || !current->IsValid())
+			continue;
+
+		// Large pictures are cropped to their centre so the single-threaded double precision reference stays quick.
+		const int maxSize = 512;
+		int cropW = tMath::tMin(current->GetWidth(), maxSize);
+		int cropH = tMath::tMin(current->GetHeight(), maxSize);
+		int cropX = (current->GetWidth() - cropW) / 2;
+		int cropY = (current->GetHeight() - cropH) / 2;
+		std::vector<tPixel4b> cropPixels(cropW*cropH);
+		for (int y = 0; y < cropH; y++)
+			for (int x = 0; x < cropW; x++)
+				cropPixels[y*cropW + x] = current->GetPixelPointer()[(cropY + y)*current->GetWidth() + cropX + x];
+		tImage::tPicture cropped;
+		cropped.Set(cropW, cropH, cropPixels.data(), true);
+		tImage::tPicture* picture = &cropped;
+
+		tPrintf("Bench | Resample %s\n", info->FileName.Chr());
+		numCompared++;
+		std::vector<tPixel4b> refPixels;
+		for (int f = 0; f < numFilters; f++)
+		for (int e = 0; e < numEdgeModes; e++)
+		for (int s = 0; s < numScales; s++)
+		{
+			int w = tMath::tMax(1, int(float(picture->GetWidth())*scales[s]));
+			int h = tMath::tMax(1, int(float(picture->GetHeight())*scales[s]));
+			tImage::tPicture reference; reference.Set(*picture);
+			tImage::tPicture ours; ours.Set(*picture);
+			reference.Resample(w, h, tImage::tResampleFilter(f), tImage::tResampleEdgeMode(e));
+			Viewer::ResamplePicture(ours, w, h, tImage::tResampleFilter(f), tImage::tResampleEdgeMode(e));
+			if ((ours.GetWidth() != w) || (ours.GetHeight() != h))
+				continue;
+
+			const uint8* b = (const uint8*)ours.GetPixelPointer();
+			int cell = (f*numEdgeModes + e)*numScales + s;
+			if ((reference.GetWidth() == w) && (reference.GetHeight() == h))
+			{
+				const uint8* a = (const uint8*)reference.GetPixelPointer();
+				for (int c = 0; c < 4*w*h; c++)
+					maxError[cell] = tMath::tMax(maxError[cell], tMath::tAbs(int(a[c]) - int(b[c])));
+			}
+
+			ReferenceResample(refPixels, *picture, w, h, tImage::tResampleFilter(f), tImage::tResampleEdgeMode(e));
+			const uint8* r = (const uint8*)refPixels.data();
+			for (int c = 0; c < 4*w*h; c++)
+				maxRefError[cell] = tMath::tMax(maxRefError[cell], tMath::tAbs(int(r[c]) - int(b[c])));
+		}
+	}
+
+	// Each cell is the difference from tImage::Resample then, after the slash, from the reference. A * marks a cell
+	// over its tolerance. Downscales have no tImage::Resample tolerance.
+	bool ok = (numCompared > 0);
+	tPrintf("Bench | Largest per-channel difference over %d files. Columns are the scales.\n", numCompared);
+	tPrintf("Bench | tImage::Resample/reference. Tolerances %d (upscales only)/%d.\n", Viewer::ResampleUpscaleTolerance, Viewer::ResampleReferenceTolerance);
+	tPrintf("Bench | %-20s %-8s", "filter", "edge");
+	for (int s = 0; s < numScales; s++)
+		tPrintf(" %8.2f", scales[s]);
+	tPrintf("\n");
+	for (int f = 0; f < numFilters; f++)
+	for (int e = 0; e < numEdgeModes; e++)
+	{
+		tPrintf("Bench | %-20s %-8s", tImage::tResampleFilterNamesSimple[f], tImage::tResampleEdgeModeNamesSimple[e]);
+		for (int s = 0; s < numScales; s++)
+		{
+			int cell = (f*numEdgeModes + e)*numScales + s;
+			bool over =
+				((scales[s] >= 1.0f) && (maxError[cell] > Viewer::ResampleUpscaleTolerance)) ||
+				(maxRefError[cell] > Viewer::ResampleReferenceTolerance);
+			ok = ok && !over;
+			tPrintf(" %3d/%3d%s", maxError[cell], maxRefError[cell], over ? "*" : " ");
+		}
+		tPrintf("\n");
+	}
+
+	tPrintf("Bench | Resample check %s.\n", ok ? "passed" : "FAILED");
+	return ok;
+}
+
+
+bool Bench::CompareHDR(const tList<tSystem::tFileInfo>& files)
+{
+	// Exposures cover the full range the -hdr option accepts. Large ones push exponents past the shifted tables and
+	// wrap the 8-bit exponent, which is where a reconversion is most likely to drift from a reload.
+	const float gammas[] = { 1.0f, 1.8f, 2.2f };
+	const int exposures[] = { -10, -4, -1, 0, 1, 4, 10 };
+
+	bool ok = true;
+	int numCompared = 0;
+	for (tSystem::tFileInfo* info = files.First(); info; info = info->Next())
+	{
+		if (tSystem::tGetFileType(info->FileName) != tSystem::tFileType::HDR)
+			continue;
+
+		Viewer::HDRSource source;
+		if (!source.Load(info->FileName))
+		{
+			tPrintf("Bench | HDR %s could not be parsed.\n", info->FileName.Chr());
+			ok = false;
+			continue;
+		}
+
+		tPrintf("Bench | HDR %s\n", info->FileName.Chr());
+		numCompared++;
+		std::vector<tPixel4b> converted(source.GetWidth()*source.GetHeight());
+		for (float gamma : gammas)
+		for (int exposure : exposures)
+		{
+			tImage::tImageHDR::LoadParams params;
+			params.Gamma = gamma;
+			params.Exposure = exposure;
+			tImage::tImageHDR hdr;
+			if (!hdr.Load(info->FileName, params) || (hdr.GetWidth() != source.GetWidth()) || (hdr.GetHeight() != source.GetHeight()))
+			{
+				tPrintf("Bench | HDR gamma %.1f exposure %d did not load to the same size.\n", gamma, exposure);
+				ok = false;
+				continue;
+			}
+
+			source.Convert(converted.data(), gamma, exposure);
+			tPixel4b* loaded = hdr.StealPixels();
+			int numDiffer = 0;
+			for (int p = 0; p < int(converted.size()); p++)
+				if (converted[p] != loaded[p])
+					numDiffer++;
+			delete[] loaded;
+
+			if (numDiffer)
+			{
+				tPrintf("Bench | HDR gamma %.1f exposure %d: %d pixels differ.\n", gamma, exposure, numDiffer);
+				ok = false;
+			}
+		}
+	}
+
+	ok = ok && (numCompared > 0);
+	tPrintf("Bench | HDR check over %d files %s.\n", numCompared, ok ? "passed" : "FAILED");
+	return ok;
+}
+
+
+void Bench::WriteCSV(const tList<Result>& results, const tString& file)
+{
+	tString csv = "kind,file,format,preset,iterations,min_ms,median_ms,mean_ms,max_ms,out_bytes,image_mem_bytes,peak_rss_growth\n";
+	for (Result* r = results.First(); r; r = r->Next())
+	{
+		tString line;
+		tsPrintf
+		(
+			line, "%s,\"%s\",%s,%s,%d,%.4f,%.4f,%.4f,%.4f,%|64d,%|64d,%|64d\n",
+			r->Kind.Chr(), r->File.Chr(), r->Format.Chr(), r->Preset.Chr(), r->Iterations,
+			r->MinMs, r->MedianMs, r->MeanMs, r->MaxMs, r->OutBytes, r->ImageMemBytes, r->PeakRSSGrowth
+		);
+		csv += line;
+	}
+	WriteText(csv, file);
+}
+
+
+void Bench::WriteJSON(const tList<Result>& results, const tString& file)
+{
+	tString json = "[\n";
+	for (Result* r = results.First(); r; r = r->Next())
+	{
+		// File names use forward slashes so the only character that needs escaping is a quote.
+		tString fileName;
+		for (const char* c = r->File.Chr(); c && *c; c++)
+		{
+			char chr[2] = { *c, '\0' };
+			fileName += (*c == '"') ? "\\\"" : chr;
+		}
+
+		tString entry;
+		tsPrintf
+		(
+			entry,
+			"\t{ \"kind\": \"%s\", \"file\": \"%s\", \"format\": \"%s\", \"preset\": \"%s\", \"iterations\": %d, "
+			"\"minMs\": %.4f, \"medianMs\": %.4f, \"meanMs\": %.4f, \"maxMs\": %.4f, "
+			"\"outBytes\": %|64d, \"imageMemBytes\": %|64d, \"peakRSSGrowth\": %|64d }%s\n",
+			r->Kind.Chr(), fileName.Chr(), r->Format.Chr(), r->Preset.Chr(), r->Iterations,
+			r->MinMs, r->MedianMs, r->MeanMs, r->MaxMs, r->OutBytes, r->ImageMemBytes, r->PeakRSSGrowth,
+			r->Next() ? "," : ""
+		);
+		json += entry;
+	}
+	json += "]\n";
+	WriteText(json, file);
+}
+
+
+void Bench::WriteText(const tString& text, const tString& file)
+{
+	if (file.IsEmpty() || (file == "*"))
+	{
+		tPrintf("%s", text.Chr());
+		return;
+	}
+
+	tSystem::tFileHandle handle = tSystem::tOpenFile(file.Chr(), "wb");
+	if (!handle)
+	{
+		tPrintf("Bench | Could not write %s.\n", file.Chr());
+		return;
+	}
+	tSystem::tWriteFile(handle, text.Chr(), text.Length());
+	tSystem::tCloseFile(handle);
+	tPrintf("Bench | Wrote %s.\n", file.Chr());
+}
@@ -0,0 +1,25 @@
+// Bench.h
+//
+// The tacentview_bench codec benchmark. Built from the same sources as the viewer so it exercises the real
+// Image::Load and Image::Save paths. It decodes every supported file in a corpus (TestImages by default) and encodes
+// each one with a set of save-parameter presets, reporting timings and memory as CSV and/or JSON. With --resample it
+// instead compares Viewer::ResamplePicture with tPicture::Resample over the corpus.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+
+
+namespace Bench
+{
+	// Runs the benchmark using the already-parsed command line. Returns 0 on success.
+	int Run();
+}
@@ -25,6 +25,7 @@
 #include "Image.h"
 #include "TacentView.h"
 #include "Preferences.h"
+#include "EditTask.h"
 #include "Version.cmake.h"
 using namespace tMath;
 
@@ -34,11 +35,11 @@ namespace Viewer
 	float HistogramCallbackBridge(void* data, int index);
 	struct HistogramCallback
 	{
-		HistogramCallback(Image::AdjChan channels, bool logarithmic, tImage::tPicture* picture, int numIndices) : Channels(channels), Logarithmic(logarithmic), Picture(picture), NumIndices(numIndices) { }
+		HistogramCallback(PictureStats::Channel channel, bool logarithmic, const PictureStats* stats, int numIndices) : Channel(channel), Logarithmic(logarithmic), Stats(stats), NumIndices(numIndices) { }
 		float GetCount(int index) const;
-		Image::AdjChan Channels;
+		PictureStats::Channel Channel;
 		bool Logarithmic;
-		tImage::tPicture* Picture;
+		const PictureStats* Stats;
 		int NumIndices;
 	};
 }
@@ -82,10 +83,10 @@ void Viewer::ShowPixelEditorOverlay(bool* popen)
 		{
 			if (live)
 			{
-				CurrImage->Unbind();
 				tColour4b col; col.Set(floatCol);
 
-				// Don't push undo steps if we're dragging around the cursor.
+				// Don't push undo steps if we're dragging around the cursor. No Unbind needed since Bind patches just the
+				// edited pixel into the texture.
 				CurrImage->SetPixelColour(Viewer::CursorX, Viewer::CursorY, col, false, true);
 				CurrImage->Bind();
 				Gutil::SetWindowTitle();
@@ -101,7 +102,6 @@ void Viewer::ShowPixelEditorOverlay(bool* popen)
 		{
 			if (live)
 			{
-				CurrImage->Unbind();
 				tColour4b col; col.Set(floatColReset);
 				CurrImage->SetPixelColour(Viewer::CursorX, Viewer::CursorY, col, true, true);
 				CurrImage->Bind();
@@ -117,7 +117,6 @@ void Viewer::ShowPixelEditorOverlay(bool* popen)
 		ImGui::SameLine();
 		if (!live && ImGui::Button("Apply", tVector2(buttonWidth, 0.0f)))
 		{
-			CurrImage->Unbind();
 			tColour4b col; col.Set(floatCol);
 			CurrImage->SetPixelColour(Viewer::CursorX, Viewer::CursorY, col, true);
 			CurrImage->Bind();
@@ -128,7 +127,6 @@ void Viewer::ShowPixelEditorOverlay(bool* popen)
 	// If we closed the dialog and we're live, set the colour one more time but push to the undo stack.
 	if (popen && (*popen == false) && live)
 	{
-		CurrImage->Unbind();
 		tColour4b col;
 		col.Set(floatColReset);
 		CurrImage->SetPixelColour(Viewer::CursorX, Viewer::CursorY, col, false, true);
@@ -288,21 +286,12 @@ float Viewer::HistogramCallbackBridge(void* data, int index)
 
 float Viewer::HistogramCallback::GetCount(int index) const
 {
-	if (!Picture || (index >= NumIndices))
+	if (!Stats || (index >= NumIndices))
 		return 0.0f;
 
-	int groupIndex = tMath::tLinearInterp(float(index), 0.0f, float(NumIndices-1), 0, tImage::tPicture::NumGroups-1);
-	tiClamp(groupIndex, 0, tImage::tPicture::NumGroups-1);
-	float* table = nullptr;
-	switch (Channels)
-	{
-		case Image::AdjChan::RGB:	table = Picture->HistogramI;	break;
-		case Image::AdjChan::R:		table = Picture->HistogramR;	break;
-		case Image::AdjChan::G:		table = Picture->HistogramG;	break;
-		case Image::AdjChan::B:		table = Picture->HistogramB;	break;
-		case Image::AdjChan::A:		table = Picture->HistogramA;	break;
-	}
-	float count = table[groupIndex];
+	int binIndex = tMath::tLinearInterp(float(index), 0.0f, float(NumIndices-1), 0, PictureStats::NumBins-1);
+	tiClamp(binIndex, 0, PictureStats::NumBins-1);
+	float count = float(Stats->Histogram[Channel][binIndex]);
 	return (Logarithmic && (count > 0)) ? tMath::tLog(count) : count;
 }
 
@@ -329,8 +318,10 @@ void Viewer::DoLevelsModal(bool levelsPressed)
 		ImGui::OpenPopup("Adjust Levels");
 		popupOpen = true;
 
-		// This gets called whenever the levels dialog gets opened.
-		CurrImage->AdjustmentBegin();
+		// This gets called whenever the levels dialog gets opened. The preview proxy need not be bigger than the window.
+		int previewW = 0, previewH = 0;
+		glfwGetFramebufferSize(Viewer::Window, &previewW, &previewH);
+		CurrImage->AdjustmentBegin(previewW, previewH);
 		CurrImage->AdjustGetDefaults(brightness, contrast, levelsBlack, levelsMid, levelsWhite, levelsOutBlack, levelsOutWhite);
 		okPressed = false;
 	}
@@ -340,14 +331,25 @@ void Viewer::DoLevelsModal(bool levelsPressed)
 	{
 		if (popupOpen)
 		{
-			// This gets called whenever the levels dialog gets closed.
-			if (!okPressed)
+			// This gets called whenever the levels dialog gets closed. Only the preview proxy was adjusted while the
+			// dialog was open. On OK the adjustment is applied to the full resolution frames in the background.
+			Image::Adjustment adj = CurrImage->GetPendingAdjustment();
+			CurrImage->AdjustmentEnd();
+			if (okPressed && (adj.Typ != Image::Adjustment::Type::None))
 			{
-				CurrImage->Unbind();
-				CurrImage->AdjustRestoreOriginal();
-				CurrImage->Bind();
+				auto edit = [adj](Image& snapshot, EditTask& task) -> bool
+				{
+					if (adj.AllFrames)
+						return task.ForEachPicture(snapshot, [&adj](tImage::tPicture& picture) { Image::AdjustPicture(picture, adj); });
+
+					tImage::tPicture* picture = snapshot.GetCurrentPic();
+					if (!picture)
+						return false;
+					Image::AdjustPicture(*picture, adj);
+					return true;
+				};
+				StartImageEditTask(CurrImage, adj.GetDesc(), edit, [] { Gutil::SetWindowTitle(); });
 			}
-			CurrImage->AdjustmentEnd();
 		}
 		popupOpen = false;
 		return;
@@ -371,9 +373,7 @@ void Viewer::DoLevelsModal(bool levelsPressed)
 			if (currTab != TabEnum::Levels)
 			{
 				CurrImage->AdjustGetDefaults(brightness, contrast, levelsBlack, levelsMid, levelsWhite, levelsOutBlack, levelsOutWhite);
-				CurrImage->Unbind();
 				CurrImage->AdjustRestoreOriginal();
-				CurrImage->Bind();
 				currTab = TabEnum::Levels;
 			}
 			ImGui::NewLine();
@@ -386,8 +386,7 @@ void Viewer::DoLevelsModal(bool levelsPressed)
 			{
 				if (ImGui::Checkbox("All Frames", &allFrames))
 				{
-					// We need to undo anything that may have either applied to all or one frame. No need to Unbind/Bind as modified true deals with that.
-					CurrImage->AdjustRestoreOriginal();
+					// Only the current frame is previewed so this just changes what gets applied on OK.
 					modified = true;
 				}
 				ImGui::SameLine(); Gutil::HelpMark("If image is animated or otherwise has more than one frame\nsetting this to false allows only the single current frames to be adjusted.\nMake sure the image is stopped on the frame you want before opening the levels dialog.");
@@ -425,25 +424,26 @@ void Viewer::DoLevelsModal(bool levelsPressed)
 			//
 			// The histogram itself.
 			//
+			// The histogram stays empty for the moment it takes the background stats to finish.
 			float max = 0.0f;
 			tVector4 colour = tVector4::one;
-			tImage::tPicture* pic = CurrImage->GetCurrentPic();
-			if (pic)
+			PictureStats::Channel statsChan = PictureStats::Chan_I;
+			switch (channels)
 			{
-				switch (channels)
-				{
-					case int(Image::AdjChan::RGB):	max = pic->MaxICount;	colour.Set(0.9f, 0.9f, 0.9f, 1.8f);		break;
-					case int(Image::AdjChan::R):	max = pic->MaxRCount;	colour.Set(1.0f, 0.2f, 0.2f, 1.0f);		break;
-					case int(Image::AdjChan::G):	max = pic->MaxGCount;	colour.Set(0.2f, 1.0f, 0.2f, 1.0f);		break;
-					case int(Image::AdjChan::B):	max = pic->MaxBCount;	colour.Set(0.3f, 0.3f, 1.0f, 1.0f);		break;
-					case int(Image::AdjChan::A):	max = pic->MaxACount;	colour.Set(0.6f, 0.6f, 0.6f, 1.0f);		break;
-				}
+				case int(Image::AdjChan::RGB):	statsChan = PictureStats::Chan_I;	colour.Set(0.9f, 0.9f, 0.9f, 1.8f);		break;
+				case int(Image::AdjChan::R):	statsChan = PictureStats::Chan_R;	colour.Set(1.0f, 0.2f, 0.2f, 1.0f);		break;
+				case int(Image::AdjChan::G):	statsChan = PictureStats::Chan_G;	colour.Set(0.2f, 1.0f, 0.2f, 1.0f);		break;
+				case int(Image::AdjChan::B):	statsChan = PictureStats::Chan_B;	colour.Set(0.3f, 0.3f, 1.0f, 1.0f);		break;
+				case int(Image::AdjChan::A):	statsChan = PictureStats::Chan_A;	colour.Set(0.6f, 0.6f, 0.6f, 1.0f);		break;
 			}
+			const PictureStats* stats = CurrImage->GetCurrentStats();
+			if (stats)
+				max = float(stats->MaxCount[statsChan]);
 			tString histName;  tsPrintf(histName,  "%s Intensity", channelItems[channels]);
 			tString histLabel; tsPrintf(histLabel, "Max %d\n\nHistogram", int(max));
 			tVector2 histSize = Gutil::GetUIParamScaled(tVector2(256.0f, 80.0f), 2.5f);
-			HistogramCallback histoCB(Image::AdjChan(channels), profile.LevelsLogarithmicHisto, pic, int(histSize.x));
-			if (profile.LevelsLogarithmicHisto)
+			HistogramCallback histoCB(statsChan, profile.LevelsLogarithmicHisto, stats, int(histSize.x));
+			if (profile.LevelsLogarithmicHisto && (max > 0.0f))
 				max = tMath::tLog(max);
 
 			ImGui::PushStyleColor(ImGuiCol_PlotHistogram, colour);
@@ -497,9 +497,7 @@ void Viewer::DoLevelsModal(bool levelsPressed)
 				}
 				tiClampMin(levelsOutWhite, levelsOutBlack);
 
-				CurrImage->Unbind();
 				CurrImage->AdjustLevels(levelsBlack, levelsMid, levelsWhite, levelsOutBlack, levelsOutWhite, profile.LevelsPowerMidGamma, Image::AdjChan(channels), allFrames);
-				CurrImage->Bind();
 			}
 
 			ImGui::EndTabItem();
@@ -513,9 +511,7 @@ void Viewer::DoLevelsModal(bool levelsPressed)
 			if (currTab != TabEnum::Contrast)
 			{
 				CurrImage->AdjustGetDefaults(brightness, contrast, levelsBlack, levelsMid, levelsWhite, levelsOutBlack, levelsOutWhite);
-				CurrImage->Unbind();
 				CurrImage->AdjustRestoreOriginal();
-				CurrImage->Bind();
 				currTab = TabEnum::Contrast;
 			}
 			ImGui::NewLine();
@@ -528,8 +524,7 @@ void Viewer::DoLevelsModal(bool levelsPressed)
 			{
 				if (ImGui::Checkbox("All Frames", &allFrames))
 				{
-					// We need to undo anything that may have either applied to all or one frame. No need to Unbind/Bind as modified true deals with that.
-					CurrImage->AdjustRestoreOriginal();
+					// Only the current frame is previewed so this just changes what gets applied on OK.
 					modified = true;
 				}
 				ImGui::SameLine(); Gutil::HelpMark("If image is animated or otherwise has more than one frame\nsetting this to false allows only the single current frames to be adjusted.\nMake sure the image is stopped on the frame you want before opening the levels dialog.");
@@ -553,9 +548,7 @@ void Viewer::DoLevelsModal(bool levelsPressed)
 			//
 			if (modified)
 			{
-				CurrImage->Unbind();
-				CurrImage->AdjustContrast(contrast, Image::AdjChan(channels));
-				CurrImage->Bind();
+				CurrImage->AdjustContrast(contrast, Image::AdjChan(channels), allFrames);
 			}
 
 			ImGui::EndTabItem();
@@ -569,9 +562,7 @@ void Viewer::DoLevelsModal(bool levelsPressed)
 			if (currTab != TabEnum::Brightness)
 			{
 				CurrImage->AdjustGetDefaults(brightness, contrast, levelsBlack, levelsMid, levelsWhite, levelsOutBlack, levelsOutWhite);
-				CurrImage->Unbind();
 				CurrImage->AdjustRestoreOriginal();
-				CurrImage->Bind();
 				currTab = TabEnum::Brightness;
 			}
 			ImGui::NewLine();
@@ -584,8 +575,7 @@ void Viewer::DoLevelsModal(bool levelsPressed)
 			{
 				if (ImGui::Checkbox("All Frames", &allFrames))
 				{
-					// We need to undo anything that may have either applied to all or one frame. No need to Unbind/Bind as modified true deals with that.
-					CurrImage->AdjustRestoreOriginal();
+					// Only the current frame is previewed so this just changes what gets applied on OK.
 					modified = true;
 				}
 				ImGui::SameLine(); Gutil::HelpMark("If image is animated or otherwise has more than one frame\nsetting this to false allows only the single current frames to be adjusted.\nMake sure the image is stopped on the frame you want before opening the levels dialog.");
@@ -609,9 +599,7 @@ void Viewer::DoLevelsModal(bool levelsPressed)
 			//
 			if (modified)
 			{
-				CurrImage->Unbind();
-				CurrImage->AdjustBrightness(brightness, Image::AdjChan(channels));
-				CurrImage->Bind();
+				CurrImage->AdjustBrightness(brightness, Image::AdjChan(channels), allFrames);
 			}
 
 			ImGui::EndTabItem();
@@ -630,10 +618,7 @@ void Viewer::DoLevelsModal(bool levelsPressed)
 		profile.LevelsAutoMidPoint		= false;
 		profile.LevelsLogarithmicHisto	= true;
 		channels						= int(Image::AdjChan::RGB);
-
-		CurrImage->Unbind();
 		CurrImage->AdjustRestoreOriginal();
-		CurrImage->Bind();
 	}
 
 	if (Gutil::Button("Cancel", tVector2(buttonWidth, 0.0f)))
@@ -16,7 +16,20 @@
 
 #ifdef PLATFORM_WINDOWS
 #include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <process.h>
+#else
+#include <unistd.h>
 #endif
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_set>
+#include <string>
+#include <vector>
 #include <Foundation/tFundamentals.h>
 #include <System/tCmdLine.h>
 #include <System/tPrint.h>
@@ -25,6 +38,7 @@
 #include "Command.h"
 #include "CommandHelp.h"
 #include "CommandOps.h"
+#include "CommandStats.h"
 #include "TacentView.h"
 
 
@@ -67,6 +81,8 @@ namespace Command
 	tCmdLine::tOption OptionAutoName		("Autogenerate output file names",	"autoname",		'a'			);
 	tCmdLine::tOption OptionEarlyExit		("Early exit / no skipping",		"earlyexit",	'e'			);
 	tCmdLine::tOption OptionSkipUnchanged	("Don't save unchanged files",		"skipunchanged",'k'			);
+	tCmdLine::tOption OptionStats			("Performance statistics file",		"stats",				1	);
+	tCmdLine::tOption OptionRecipes			("Recipe job file",					"recipes",				1	);
 
 	void BeginConsoleOutput();
 	void EndConsoleOutput();
@@ -79,6 +95,40 @@ namespace Command
 		~ConsoleOutputScoped()			{ EndConsoleOutput(); }
 	};
 
+	// Reports the stats (if enabled) however Process exits.
+	struct StatsReportScoped
+	{
+		~StatsReportScoped()			{ if (OptionStats) StatsReport(OptionStats.Arg1()); }
+	};
+
+	// Standard input and output streaming. An input item of "-" reads a single image from stdin and the result is
+	// written to stdout. PNG and JPG are decoded straight from the bytes read. The other decoders, and all encoders,
+	// are file based, so those bytes are spooled through a private file in a memory-backed directory when one exists
+	// (/dev/shm on Linux). While streaming, all console text goes to stderr so stdout only ever contains image data.
+	bool StdioRequested();
+	void BeginStdio();
+	void EndStdio();
+	void StderrRedirectCallback(const char* text, int numChars);
+	bool ReadStdin(tSystem::tFileInfo&);
+	tSystem::tFileType SniffFileType(const uint8* data, int numBytes);
+	bool IsAnimatedPNG(const uint8* data, int numBytes);
+	tString GetSpoolFilename(const char* tag, tSystem::tFileType);
+	bool StreamFileToStdout(const tString& file);
+	bool IsStdinImage(const Viewer::Image&);
+
+	struct StdioScoped
+	{
+		StdioScoped()					{ if (StdioRequested()) BeginStdio(); }
+		~StdioScoped()					{ EndStdio(); }
+	};
+
+	bool StdioActive					= false;
+	tString StdinFilename;								// Name of the stdin image. Only a real file if spooled.
+	tSystem::tFileInfo StdinInfo;						// Valid if StdinFilename is set. Read-only once collection starts.
+	bool StdinSpooled					= false;
+	std::string StdinData;								// The stdin bytes when decoded from memory.
+	int SpoolCounter					= 0;
+
 	struct ParamValuePair : public tLink<ParamValuePair>
 	{
 		tString Param;
@@ -86,8 +136,48 @@ namespace Command
 	};
 	int ParseParamValuePairs(tList<ParamValuePair>& pairs, const tString& pairsStr);			// Parsed pairsStr of form "param1=value1,param2=value2,etc".
 
+	// Input files are collected on background threads so processing can begin on the first inputs before a large
+	// manifest or directory tree has been fully enumerated. The producer thread streams the command-line items and
+	// manifest lines into a bounded queue. A small pool of resolver threads stats files and enumerates directories in
+	// parallel. Next hands resolved files back in the original item order so output order is deterministic. The unit
+	// of work is one item, so resolving scales with the number of items (manifests, many files or directories). A
+	// single huge directory is one tFindFiles call and is enumerated by one resolver.
+	struct InputItem : public tLink<InputItem>
+	{
+		InputItem(const tString& item)	: Item(item) { }
+		tString Item;
+		tList<tSystem::tFileInfo> Files;
+		bool Resolved					= false;
+	};
+
+	struct InputCollector
+	{
+		~InputCollector()				{ Stop(); }
+		void Start();
+		tSystem::tFileInfo* Next();																// Blocks. Returns nullptr when there are no more inputs. Caller owns the result.
+		void Stop();
+
+	private:
+		void ProduceItems();
+		void ResolveItems();
+		bool AddItem(const tString& item);														// Returns false if collection is stopping.
+		bool AddItemsFromManifest(const tString& manifestFile);
+
+		const int MaxItemsInFlight						= 4096;
+		std::mutex Mutex;
+		std::condition_variable Changed;
+		tList<InputItem> Items;
+		InputItem* NextToResolve						= nullptr;
+		int NumItems									= 0;
+		bool ProducerDone								= false;
+		bool Stopping									= false;
+		std::thread Producer;
+		int NumResolvers								= 0;
+		std::thread* Resolvers							= nullptr;
+	};
+
 	void DetermineInputTypes();																	// Step 1.
-	void InputFilesAddUnique(const tSystem::tFileInfo&);
+	bool InputFilesAddUnique(tSystem::tFileInfo*);												// Takes ownership. Returns false (and deletes) if already added.
 	void DetermineInputLoadParameters();
 	void ParseLoadParametersASTC();
 	void ParseLoadParametersDDS();
@@ -98,29 +188,67 @@ namespace Command
 	void ParseLoadParametersPKM();
 	void ParseLoadParametersPNG();
 
-	void DetermineInputFiles();																	// Step 2.
-	void GetItemsFromManifest(tList<tStringItem>& manifestItems, const tString& manifestFile);
+	void DetermineInputFiles(InputCollector&);													// Step 2. Starts collection. Does not wait for it.
 	void ParseInputItem(tList<tSystem::tFileInfo>& inputFiles, const tString& item);
 
 	void PopulateOperations();
+	void PopulateOperations(const tList<tStringItem>& opstrings);
 	void PopulatePostOperations();
-	void PopulateImagesList();																	// Step 3.
-	bool ProcessOperationsOnImage(Viewer::Image&);												// Applies all the operations (in order) to the supplied image.
+	Viewer::Image* PopulateNextImage(InputCollector&);											// Step 3. Adds the next unique input to the Images list.
+	bool ProcessOperationsOnImage(Viewer::Image&, const tList<Operation>&);						// Applies all the operations (in order) to the supplied image.
 
 	void DetermineOutputTypes();																// Step 4.
+	void DetermineOutputTypes(const tList<tStringItem>& typestrings);
 	void DetermineOutputNameParameters();														// Step 5.
+	void ParseOutputNameParameters(const tString& params);
 	void DetermineOutputSaveParameters();														// Step 6.
-	void ParseSaveParametersAPNG();
-	void ParseSaveParametersBMP();
-	void ParseSaveParametersGIF();
-	void ParseSaveParametersJPG();
-	void ParseSaveParametersPNG();
-	void ParseSaveParametersQOI();
-	void ParseSaveParametersTGA();
-	void ParseSaveParametersTIFF();
-	void ParseSaveParametersWEBP();
-
-	tString DetermineOutputFilename(const tString& inName, tSystem::tFileType outType);
+	void ParseSaveParametersAPNG(const tString& params);
+	void ParseSaveParametersBMP(const tString& params);
+	void ParseSaveParametersGIF(const tString& params);
+	void ParseSaveParametersJPG(const tString& params);
+	void ParseSaveParametersPNG(const tString& params);
+	void ParseSaveParametersQOI(const tString& params);
+	void ParseSaveParametersTGA(const tString& params);
+	void ParseSaveParametersTIFF(const tString& params);
+	void ParseSaveParametersWEBP(const tString& params);
+
+	// A recipe is a named list of operations along with the output types, output name rules, and save parameters to
+	// use with them. Recipes come from the job file given with --recipes. Each input image is decoded once and every
+	// recipe runs against that single decode. Recipes with operations work on their own copy of the pictures while
+	// recipes that only re-encode read the original directly. Without --recipes the command line is the only recipe.
+	struct Recipe : public tLink<Recipe>
+	{
+		tString Name;
+		tList<Operation> Operations;
+		tSystem::tFileTypes OutTypes;
+		tString OutNamePrefix;
+		tString OutNameSuffix;
+		tString OutNameSearch;
+		tString OutNameReplace;
+
+		tImage::tImageAPNG::SaveParams	SaveParamsAPNG;
+		tImage::tImageBMP::SaveParams	SaveParamsBMP;
+		tImage::tImageGIF::SaveParams	SaveParamsGIF;
+		tImage::tImageJPG::SaveParams	SaveParamsJPG;
+		tImage::tImagePNG::SaveParams	SaveParamsPNG;
+		tImage::tImageQOI::SaveParams	SaveParamsQOI;
+		tImage::tImageTGA::SaveParams	SaveParamsTGA;
+		tImage::tImageTIFF::SaveParams	SaveParamsTIFF;
+		tImage::tImageWEBP::SaveParams	SaveParamsWEBP;
+
+		bool HasOperations() const;																// True if there is at least one valid operation.
+		bool UsesGlobalOutput() const;															// True if any operation reads the global output settings.
+		void Capture();																			// Takes the global operations and copies the global output settings.
+		void Install() const;																	// Copies the output settings (not the operations) to the globals.
+	};
+
+	bool DetermineRecipes();																	// Step 7. Returns false if the recipe file could not be read.
+	bool ParseRecipeFile(const tString& recipeFile);
+	int RunRecipes(Viewer::Image&, bool& somethingFailed);										// Returns ErrorCode_Success unless exiting early.
+	int RunRecipe(Viewer::Image&, const Recipe&, bool& somethingFailed);
+	void SetImageSaveParameters(Viewer::Image&, tSystem::tFileType, const Recipe&);
+
+	tString DetermineOutputFilename(const tString& inName, tSystem::tFileType outType, const Recipe&);
 
 	tImage::tImageAPNG::SaveParams	SaveParamsAPNG;
 	tImage::tImageBMP::SaveParams	SaveParamsBMP;
@@ -145,6 +273,7 @@ namespace Command
 
 	tSystem::tFileTypes InputTypes;
 	tList<tSystem::tFileInfo> InputFiles;
+	std::unordered_set<std::string> InputFilesAdded;											// Keys of InputFiles. Lowercase on Windows.
 	tList<Viewer::Image> Images;
 	tList<Operation> Operations;
 	tList<PostOperation> PostOperations;
@@ -154,6 +283,9 @@ namespace Command
 	tString OutNameSuffix;
 	tString OutNameSearch;
 	tString OutNameReplace;
+
+	tList<Recipe> Recipes;
+	Recipe CommandLineSettings;																	// Only used with --recipes. Output settings from the command line.
 }
 
 
@@ -240,6 +372,201 @@ void Command::EndConsoleOutput()
 }
 
 
+bool Command::StdioRequested()
+{
+	for (tStringItem* item = ParamInputFiles.Values.First(); item; item = item->Next())
+		if (*item == "-")
+			return true;
+	return false;
+}
+
+
+void Command::BeginStdio()
+{
+	#ifdef PLATFORM_WINDOWS
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+	#endif
+	tSystem::tSetStdoutRedirectCallback(StderrRedirectCallback);
+	StdioActive = true;
+}
+
+
+void Command::EndStdio()
+{
+	if (!StdioActive)
+		return;
+
+	if (StdinSpooled)
+		tSystem::tDeleteFile(StdinFilename);
+	StdinFilename.Clear();
+	StdinSpooled = false;
+	StdinData.clear();
+	StdinData.shrink_to_fit();
+	fflush(stdout);
+	tSystem::tSetStdoutRedirectCallback(nullptr);
+	StdioActive = false;
+}
+
+
+void Command::StderrRedirectCallback(const char* text, int numChars)
+{
+	fwrite(text, 1, numChars, stderr);
+}
+
+
+tSystem::tFileType Command::SniffFileType(const uint8* data, int numBytes)
+{
+	auto match = [data, numBytes](int offset, const char* magic, int magicLen) -> bool
+	{
+		return (numBytes >= offset + magicLen) && (memcmp(data + offset, magic, magicLen) == 0);
+	};
+
+	if (match(0, "\x89PNG", 4))								return tSystem::tFileType::PNG;
+	if (match(0, "\xFF\xD8\xFF", 3))						return tSystem::tFileType::JPG;
+	if (match(0, "GIF8", 4))								return tSystem::tFileType::GIF;
+	if (match(0, "RIFF", 4) && match(8, "WEBP", 4))			return tSystem::tFileType::WEBP;
+	if (match(0, "qoif", 4))								return tSystem::tFileType::QOI;
+	if (match(0, "DDS ", 4))								return tSystem::tFileType::DDS;
+	if (match(0, "\xABKTX 11", 7))							return tSystem::tFileType::KTX;
+	if (match(0, "\xABKTX 20", 7))							return tSystem::tFileType::KTX2;
+	if (match(0, "PVR\x03", 4) || match(44, "PVR!", 4))		return tSystem::tFileType::PVR;
+	if (match(0, "\x13\xAB\xA1\x5C", 4))					return tSystem::tFileType::ASTC;
+	if (match(0, "PKM ", 4))								return tSystem::tFileType::PKM;
+	if (match(0, "\x76\x2F\x31\x01", 4))					return tSystem::tFileType::EXR;
+	if (match(0, "#?RADIANCE", 10) || match(0, "#?RGBE", 6))	return tSystem::tFileType::HDR;
+	if (match(0, "II*\0", 4) || match(0, "MM\0*", 4))		return tSystem::tFileType::TIFF;
+	if (match(0, "\0\0\1\0", 4))							return tSystem::tFileType::ICO;
+	if (match(0, "BM", 2))									return tSystem::tFileType::BMP;
+
+	// TGA has no leading magic. It is the fallback.
+	return tSystem::tFileType::TGA;
+}
+
+
+bool Command::IsAnimatedPNG(const uint8* data, int numBytes)
+{
+	// Walks the chunks after the 8 byte signature. An acTL chunk before the first IDAT makes it an APNG.
+	int offset = 8;
+	while (offset + 8 <= numBytes)
+	{
+		uint32 length = (uint32(data[offset]) << 24) | (uint32(data[offset+1]) << 16) | (uint32(data[offset+2]) << 8) | uint32(data[offset+3]);
+		const uint8* type = data + offset + 4;
+		if (memcmp(type, "acTL", 4) == 0)
+			return true;
+		if ((memcmp(type, "IDAT", 4) == 0) || (length > uint32(numBytes)))
+			return false;
+
+		// Length, type, data, and CRC.
+		offset += 12 + int(length);
+	}
+	return false;
+}
+
+
+tString Command::GetSpoolFilename(const char* tag, tSystem::tFileType fileType)
+{
+	tString dir;
+	#ifdef PLATFORM_WINDOWS
+	dir = tSystem::tGetEnvVar("TEMP");
+	int pid = _getpid();
+	#else
+	dir = tSystem::tDirExists("/dev/shm/") ? tString("/dev/shm") : tSystem::tGetEnvVar("TMPDIR");
+	if (dir.IsEmpty())
+		dir = "/tmp";
+	int pid = getpid();
+	#endif
+	dir.Replace('\\', '/');
+	if (dir[dir.Length()-1] != '/')
+		dir += "/";
+
+	tString filename;
+	tsPrintf(filename, "%stacentview_%s_%d_%d.%s", dir.Chr(), tag, pid, SpoolCounter++, tSystem::tGetExtension(fileType).Chr());
+	return filename;
+}
+
+
+bool Command::ReadStdin(tSystem::tFileInfo& info)
+{
+	// Only one stdin image per run. A second "-" would find stdin already at EOF.
+	if (!StdinFilename.IsEmpty())
+		return false;
+
+	std::string data;
+	const int chunkSize = 64*1024;
+	char* chunk = new char[chunkSize];
+	size_t numRead = 0;
+	while ((numRead = fread(chunk, 1, chunkSize, stdin)) > 0)
+		data.append(chunk, numRead);
+	delete[] chunk;
+	if (data.empty())
+	{
+		tPrintfNorm("Warning: Nothing read from stdin.\n");
+		return false;
+	}
+
+	// An explicit single input type wins over sniffing. This is how TGA, which has no magic bytes, is best specified.
+	tSystem::tFileType fileType = (InputTypes.Count() == 1) && OptionInTypes ?
+		InputTypes.First()->FileType : SniffFileType((const uint8*)data.data(), int(data.size()));
+
+	// The name keeps the type for the loader. Animated PNGs need the APNG loader, which only reads files.
+	tString spoolFile = GetSpoolFilename("stdin", fileType);
+	bool animatedPNG = (fileType == tSystem::tFileType::PNG) && LoadParams_DetectAPNGInsidePNG && IsAnimatedPNG((const uint8*)data.data(), int(data.size()));
+	if ((fileType == tSystem::tFileType::JPG) || ((fileType == tSystem::tFileType::PNG) && !animatedPNG))
+	{
+		int numBytes = int(data.size());
+		StdinData.swap(data);
+		StdinFilename = spoolFile;
+		info.FileName = spoolFile;
+		info.FileSize = numBytes;
+		tPrintfFull("Read %d bytes from stdin as %s. Decoding from memory.\n", numBytes, tSystem::tGetFileTypeName(fileType).Chr());
+		return true;
+	}
+
+	tSystem::tFileHandle file = tSystem::tOpenFile(spoolFile.Chr(), "wb");
+	if (!file)
+		return false;
+	int numWritten = tSystem::tWriteFile(file, data.data(), int(data.size()));
+	tSystem::tCloseFile(file);
+	if (numWritten != int(data.size()))
+	{
+		tSystem::tDeleteFile(spoolFile);
+		return false;
+	}
+
+	StdinFilename = spoolFile;
+	StdinSpooled = true;
+	tSystem::tGetFileInfo(info, spoolFile);
+	tPrintfFull("Read %d bytes from stdin as %s.\n", int(data.size()), tSystem::tGetFileTypeName(fileType).Chr());
+	return true;
+}
+
+
+bool Command::StreamFileToStdout(const tString& filename)
+{
+	tSystem::tFileHandle file = tSystem::tOpenFile(filename.Chr(), "rb");
+	if (!file)
+		return false;
+
+	const int chunkSize = 64*1024;
+	char* chunk = new char[chunkSize];
+	bool ok = true;
+	int numRead = 0;
+	while (ok && ((numRead = tSystem::tReadFile(file, chunk, chunkSize)) > 0))
+		ok = (fwrite(chunk, 1, numRead, stdout) == size_t(numRead));
+	delete[] chunk;
+	tSystem::tCloseFile(file);
+	fflush(stdout);
+	return ok;
+}
+
+
+bool Command::IsStdinImage(const Viewer::Image& image)
+{
+	return !StdinFilename.IsEmpty() && (image.Filename == StdinFilename);
+}
+
+
 int Command::ParseParamValuePairs(tList<ParamValuePair>& pairs, const tString& pairsStr)
 {
 	if (pairsStr.IsEmpty())
@@ -310,63 +637,216 @@ void Command::DetermineInputTypes()
 }
 
 
-void Command::InputFilesAddUnique(const tSystem::tFileInfo& infoToAdd)
+bool Command::InputFilesAddUnique(tSystem::tFileInfo* infoToAdd)
 {
-	bool alreadyAdded = false;
-	for (tSystem::tFileInfo* info = InputFiles.First(); info; info = info->Next())
+	std::string key(infoToAdd->FileName.Chr());
+	#ifdef PLATFORM_WINDOWS
+	for (char& c : key)
+		c = char(tolower(c));
+	#endif
+
+	if (!InputFilesAdded.insert(key).second)
 	{
-		#ifdef PLAYFORM_WINDOWS
-		if (info->FileName.IsEqualCI(infoToAdd.FileName))
-		#else
-		if (info->FileName.IsEqual(infoToAdd.FileName))
-		#endif
+		delete infoToAdd;
+		return false;
+	}
+
+	InputFiles.Append(infoToAdd);
+	return true;
+}
+
+
+void Command::InputCollector::Start()
+{
+	NumResolvers = tMath::tClamp(tSystem::tGetNumCores(), 2, 8);
+	Resolvers = new std::thread[NumResolvers];
+	for (int r = 0; r < NumResolvers; r++)
+		Resolvers[r] = std::thread(&InputCollector::ResolveItems, this);
+	Producer = std::thread(&InputCollector::ProduceItems, this);
+}
+
+
+void Command::InputCollector::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		Stopping = true;
+	}
+	Changed.notify_all();
+
+	if (Producer.joinable())
+		Producer.join();
+	for (int r = 0; r < NumResolvers; r++)
+		if (Resolvers[r].joinable())
+			Resolvers[r].join();
+
+	delete[] Resolvers;
+	Resolvers = nullptr;
+	NumResolvers = 0;
+	Items.Empty();
+	NextToResolve = nullptr;
+	NumItems = 0;
+}
+
+
+tSystem::tFileInfo* Command::InputCollector::Next()
+{
+	std::unique_lock<std::mutex> lock(Mutex);
+	while (!Stopping)
+	{
+		InputItem* head = Items.First();
+		if (head && head->Resolved)
 		{
-			alreadyAdded = true;
-			break;
+			tSystem::tFileInfo* info = head->Files.Remove();
+			if (info)
+				return info;
+
+			// Head item exhausted. Retiring it makes room for the producer.
+			Items.Remove(head);
+			delete head;
+			NumItems--;
+			Changed.notify_all();
+			continue;
 		}
+
+		if (!head && ProducerDone)
+			return nullptr;
+
+		Changed.wait(lock);
+	}
+
+	return nullptr;
+}
+
+
+void Command::InputCollector::ProduceItems()
+{
+	// If no input files specified, use the current directory.
+	if (!ParamInputFiles)
+		AddItem(".");
+
+	for (tStringItem* fileItem = ParamInputFiles.Values.First(); fileItem; fileItem = fileItem->Next())
+	{
+		// If the fileItem starts with an 'at' symbol (@), we interpret it as a manifest file.
+		bool keepGoing = (fileItem->Left(1) == "@") ? AddItemsFromManifest(*fileItem) : AddItem(*fileItem);
+		if (!keepGoing)
+			break;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		ProducerDone = true;
 	}
+	Changed.notify_all();
+}
+
 
-	if (!alreadyAdded)
-		InputFiles.Append(new tSystem::tFileInfo(infoToAdd));
+bool Command::InputCollector::AddItem(const tString& item)
+{
+	std::unique_lock<std::mutex> lock(Mutex);
+	Changed.wait(lock, [this]{ return Stopping || (NumItems < MaxItemsInFlight); });
+	if (Stopping)
+		return false;
+
+	InputItem* inputItem = new InputItem(item);
+	Items.Append(inputItem);
+	NumItems++;
+	if (!NextToResolve)
+		NextToResolve = inputItem;
+	lock.unlock();
+
+	Changed.notify_all();
+	return true;
 }
 
 
-void Command::GetItemsFromManifest(tList<tStringItem>& manifestItems, const tString& manifestFile)
+bool Command::InputCollector::AddItemsFromManifest(const tString& manifestFile)
 {
 	// The manifest file still has the @ symbol in it.
 	tString manFile = manifestFile;
 	manFile.ExtractLeft(1);
 	if (!tSystem::tFileExists(manFile))
-		return;
+		return true;
+
+	tSystem::tFileHandle file = tSystem::tOpenFile(manFile.Chr(), "rb");
+	if (!file)
+		return true;
+
+	// The manifest is streamed in fixed-size chunks so huge manifests never need to be fully in memory and
+	// the first items can be resolved while the rest of the file is still being read.
+	const int chunkSize = 64*1024;
+	char* chunk = new char[chunkSize];
+	std::string line;
+	bool keepGoing = true;
+	auto addLine = [this, &line]() -> bool
+	{
+		// Line comments in manifest files start with a semicolon.
+		bool added = (line.empty() || (line[0] == ';')) ? true : AddItem(tString(line.c_str()));
+		line.clear();
+		return added;
+	};
 
-	tString manifest;
-	bool loaded = tSystem::tLoadFile(manFile, manifest);
-	if (!loaded)
-		return;
+	int numRead = 0;
+	while (keepGoing && ((numRead = tSystem::tReadFile(file, chunk, chunkSize)) > 0))
+	{
+		for (int c = 0; keepGoing && (c < numRead); c++)
+		{
+			char ch = chunk[c];
+			if (ch == '\n')
+				keepGoing = addLine();
+			else if (ch != '\r')
+				line += ch;
+		}
+	}
+	if (keepGoing)
+		keepGoing = addLine();
 
-	manifest.Remove('\r');
+	delete[] chunk;
+	tSystem::tCloseFile(file);
+	return keepGoing;
+}
 
-	tList<tStringItem> lines;
-	int numLines = tStd::tExplode(lines, manifest, '\n');
-	if (numLines <= 0)
-		return;
 
-	for (tStringItem* line = lines.First(); line; line = line->Next())
+void Command::InputCollector::ResolveItems()
+{
+	std::unique_lock<std::mutex> lock(Mutex);
+	while (true)
 	{
-		if (line->IsEmpty())
-			continue;
+		Changed.wait(lock, [this]{ return Stopping || NextToResolve || ProducerDone; });
+		if (Stopping || (!NextToResolve && ProducerDone))
+			return;
 
-		// Line comments in manifest files start with a semicolon.
-		if (line->Left(1) == ";")
-			continue;
+		InputItem* item = NextToResolve;
+		NextToResolve = item->Next();
+		lock.unlock();
+
+		// No other thread touches the item's file list until it is marked resolved.
+		ParseInputItem(item->Files, item->Item);
 
-		manifestItems.Append(new tStringItem(*line));
+		lock.lock();
+		item->Resolved = true;
+		Changed.notify_all();
 	}
 }
 
 
 void Command::ParseInputItem(tList<tSystem::tFileInfo>& inputFiles, const tString& item)
 {
+	if (item == ".")
+	{
+		tSystem::tFindFiles(inputFiles, "", InputTypes);
+		return;
+	}
+
+	// Stdin was already read by DetermineInputFiles. Resolver threads only ever read the result. A repeated "-"
+	// yields the same file and is dropped as a duplicate.
+	if (item == "-")
+	{
+		if (!StdinFilename.IsEmpty())
+			inputFiles.Append(new tSystem::tFileInfo(StdinInfo));
+		return;
+	}
+
 	tSystem::tFileInfo info;
 	bool found = tSystem::tGetFileInfo(info, item);
 	if (!found)
@@ -374,10 +854,7 @@ void Command::ParseInputItem(tList<tSystem::tFileInfo>& inputFiles, const tStrin
 
 	if (info.Directory)
 	{
-		if (item == ".")
-			tSystem::tFindFiles(inputFiles, "", InputTypes);
-		else
-			tSystem::tFindFiles(inputFiles, item, InputTypes);
+		tSystem::tFindFiles(inputFiles, item, InputTypes);
 	}
 	else
 	{
@@ -749,70 +1226,54 @@ void Command::ParseLoadParametersPNG()
 }
 
 
-void Command::DetermineInputFiles()
+void Command::DetermineInputFiles(InputCollector& collector)
 {
-	tList<tSystem::tFileInfo> inputFiles;
+	// Stdin is read here, on the main thread, before any resolver threads exist. The stdin globals are not modified
+	// again until EndStdio.
+	if (StdioRequested())
+		ReadStdin(StdinInfo);
 
-	// If no input files specified, use the current directory.
-	if (!ParamInputFiles)
-		tSystem::tFindFiles(inputFiles, "", InputTypes);
-
-	for (tStringItem* fileItem = ParamInputFiles.Values.First(); fileItem; fileItem = fileItem->Next())
-	{
-		// If the fileItem starts with an 'at' symbol (@), we interpret it as a manifest file.
-		if (fileItem->Left(1) == "@")
-		{
-			tList<tStringItem> manifestItems;
-			GetItemsFromManifest(manifestItems, *fileItem);
-			for (tStringItem* manifestItem = manifestItems.First(); manifestItem; manifestItem = manifestItem->Next())
-				ParseInputItem(inputFiles, *manifestItem);
-		}
-		else
-		{
-			ParseInputItem(inputFiles, *fileItem);
-		}
-	}
-
-	for (tSystem::tFileInfo* info = inputFiles.First(); info; info = info->Next())
-	{
-		InputFilesAddUnique(*info);
-	}
-
-	tPrintfFull("Input files:\n");
-	for (tSystem::tFileInfo* info = InputFiles.First(); info; info = info->Next())
-		tPrintfFull("File: %s\n", info->FileName.Chr());
+	// Collection runs in the background. Files are handed out (and printed) as PopulateNextImage requests them.
+	collector.Start();
 }
 
 
-void Command::PopulateImagesList()
+Viewer::Image* Command::PopulateNextImage(InputCollector& collector)
 {
-	// This doesn't actually load the images. It just prepares them on the Images list.
+	// This doesn't actually load the image. It just prepares it on the Images list.
 	// a) Depending of the filetype it may set custom load parameters.
 	// b) It also turns off the undo-stack since we don't use that in CLI mode.
-	for (tSystem::tFileInfo* info = InputFiles.First(); info; info = info->Next())
+	tSystem::tFileInfo* info = collector.Next();
+	while (info && !InputFilesAddUnique(info))
+		info = collector.Next();
+	if (!info)
+		return nullptr;
+
+	tPrintfFull("File: %s\n", info->FileName.Chr());
+	Viewer::Image* newImage = new Viewer::Image(*info);
+	newImage->SetUndoEnabled(false);
+	if (!StdinData.empty() && (info->FileName == StdinFilename))
+		newImage->SetFileData((const uint8*)StdinData.data(), int(StdinData.size()));
+
+	tSystem::tFileType fileType = tSystem::tGetFileType(info->FileName);
+	switch (fileType)
 	{
-		Viewer::Image* newImage = new Viewer::Image(*info);
-		newImage->SetUndoEnabled(false);
-
-		tSystem::tFileType fileType = tSystem::tGetFileType(info->FileName);
-		switch (fileType)
-		{
-			case tSystem::tFileType::ASTC:	newImage->LoadParams_ASTC = LoadParamsASTC;		break;
-			case tSystem::tFileType::DDS:	newImage->LoadParams_DDS  = LoadParamsDDS;		break;
-			case tSystem::tFileType::PVR:	newImage->LoadParams_PVR  = LoadParamsPVR;		break;
-			case tSystem::tFileType::EXR:	newImage->LoadParams_EXR  = LoadParamsEXR;		break;
-			case tSystem::tFileType::HDR:	newImage->LoadParams_HDR  = LoadParamsHDR;		break;
-			case tSystem::tFileType::JPG:	newImage->LoadParams_JPG  = LoadParamsJPG;		break;
-			case tSystem::tFileType::KTX:	newImage->LoadParams_KTX  = LoadParamsKTX;		break;
-			case tSystem::tFileType::PKM:	newImage->LoadParams_PKM  = LoadParamsPKM;		break;
-			case tSystem::tFileType::PNG:
-				newImage->LoadParams_PNG = LoadParamsPNG;
-				newImage->LoadParams_DetectAPNGInsidePNG = LoadParams_DetectAPNGInsidePNG;
-				break;
-		}
-
-		Images.Append(newImage);
+		case tSystem::tFileType::ASTC:	newImage->LoadParams_ASTC = LoadParamsASTC;		break;
+		case tSystem::tFileType::DDS:	newImage->LoadParams_DDS  = LoadParamsDDS;		break;
+		case tSystem::tFileType::PVR:	newImage->LoadParams_PVR  = LoadParamsPVR;		break;
+		case tSystem::tFileType::EXR:	newImage->LoadParams_EXR  = LoadParamsEXR;		break;
+		case tSystem::tFileType::HDR:	newImage->LoadParams_HDR  = LoadParamsHDR;		break;
+		case tSystem::tFileType::JPG:	newImage->LoadParams_JPG  = LoadParamsJPG;		break;
+		case tSystem::tFileType::KTX:	newImage->LoadParams_KTX  = LoadParamsKTX;		break;
+		case tSystem::tFileType::PKM:	newImage->LoadParams_PKM  = LoadParamsPKM;		break;
+		case tSystem::tFileType::PNG:
+			newImage->LoadParams_PNG = LoadParamsPNG;
+			newImage->LoadParams_DetectAPNGInsidePNG = LoadParams_DetectAPNGInsidePNG;
+			break;
 	}
+
+	Images.Append(newImage);
+	return newImage;
 }
 
 
@@ -823,6 +1284,12 @@ void Command::PopulateOperations()
 
 	tList<tStringItem> opstrings;
 	OptionOperation.GetArgs(opstrings);
+	PopulateOperations(opstrings);
+}
+
+
+void Command::PopulateOperations(const tList<tStringItem>& opstrings)
+{
 	for (tStringItem* opstr = opstrings.First(); opstr; opstr = opstr->Next())
 	{
 		// Now we need to parse something of the form: resize[640,*] or rotate[45]
@@ -887,45 +1354,87 @@ void Command::PopulatePostOperations()
 }
 
 
-bool Command::ProcessOperationsOnImage(Viewer::Image& image)
+bool Command::ProcessOperationsOnImage(Viewer::Image& image, const tList<Operation>& operations)
 {
 	if (!image.IsLoaded())
 		return false;
 
 	bool somethingFailed = false;
-	for (Operation* operation = Operations.First(); operation; operation = operation->Next())
+	Operation* operation = operations.First();
+	while (operation)
 	{
 		if (!operation->Valid)
+		{
+			operation = operation->Next();
 			continue;
+		}
+
+		// Runs of two or more consecutive geometric operations (resize, canvas, aspect, crop) are composed into a
+		// single source-window-to-output mapping and executed as one resample. This avoids allocating and filtering
+		// an intermediate image for every step. A single geometric operation is applied the normal way.
+		GeometryChain chain;
+		int numFused = 0;
+		Operation* next = operation;
+		if (chain.Begin(image))
+		{
+			for (; next; next = next->Next())
+			{
+				if (!next->Valid)
+					continue;
+				GeometryChain trial = chain;
+				if (!next->Compose(trial))
+					break;
+				chain = trial;
+				numFused++;
+			}
+		}
+
+		StatsTimer timer;
+		if (numFused >= 2)
+		{
+			if (!chain.Apply(image))
+				somethingFailed = true;
+			StatsRecord("op", "fused", timer);
+			operation = next;
+			continue;
+		}
+
 		bool success = operation->Apply(image);
+		StatsRecord("op", operation->GetName(), timer);
 		if (!success)
 			somethingFailed = true;
+		operation = operation->Next();
 	}
+
 	return !somethingFailed;
 }
 
 
 void Command::DetermineOutputTypes()
 {
+	tList<tStringItem> types;
 	if (OptionOutTypes)
-	{
-		tList<tStringItem> types;
 		OptionOutTypes.GetArgs(types);
-		for (tStringItem* typ = types.First(); typ; typ = typ->Next())
+	DetermineOutputTypes(types);
+}
+
+
+void Command::DetermineOutputTypes(const tList<tStringItem>& types)
+{
+	for (tStringItem* typ = types.First(); typ; typ = typ->Next())
+	{
+		// Each argument will either be a single type, or a comma-sperated list of types.
+		tList<tStringItem> sepTypes;
+		tStd::tExplode(sepTypes, *typ, ',');
+		for (tStringItem* t = sepTypes.First(); t; t = t->Next())
 		{
-			// Each argument will either be a single type, or a comma-sperated list of types.
-			tList<tStringItem> sepTypes;
-			tStd::tExplode(sepTypes, *typ, ',');
-			for (tStringItem* t = sepTypes.First(); t; t = t->Next())
-			{
-				tSystem::tFileType ft = tSystem::tGetFileTypeFromName(*t);
-				if (ft == tSystem::tFileType::Invalid)
-					tPrintfNorm("Warning: Unknown output file type: %s\n", t->Chr());
-				else if (!Viewer::FileTypes_Load.Contains(ft))
-					tPrintfNorm("Warning: Unsupported output image type: %s\n", t->Chr());
-				else
-					OutTypes.Add(ft);
-			}
+			tSystem::tFileType ft = tSystem::tGetFileTypeFromName(*t);
+			if (ft == tSystem::tFileType::Invalid)
+				tPrintfNorm("Warning: Unknown output file type: %s\n", t->Chr());
+			else if (!Viewer::FileTypes_Load.Contains(ft))
+				tPrintfNorm("Warning: Unsupported output image type: %s\n", t->Chr());
+			else
+				OutTypes.Add(ft);
 		}
 	}
 
@@ -936,9 +1445,15 @@ void Command::DetermineOutputTypes()
 
 
 void Command::DetermineOutputNameParameters()
+{
+	ParseOutputNameParameters(OptionOutName.Arg1());
+}
+
+
+void Command::ParseOutputNameParameters(const tString& params)
 {
 	tList<ParamValuePair> pairs;
-	ParseParamValuePairs(pairs, OptionOutName.Arg1());
+	ParseParamValuePairs(pairs, params);
 	for (ParamValuePair* p = pairs.First(); p; p = p->Next())
 	{
 		tString& param = p->Param;
@@ -980,15 +1495,15 @@ void Command::DetermineOutputSaveParameters()
 		tSystem::tFileType fileType = typeItem->FileType;
 		switch (fileType)
 		{
-			case tSystem::tFileType::APNG: ParseSaveParametersAPNG(); break;
-			case tSystem::tFileType::BMP:  ParseSaveParametersBMP();  break;
-			case tSystem::tFileType::GIF:  ParseSaveParametersGIF();  break;
-			case tSystem::tFileType::JPG:  ParseSaveParametersJPG();  break;
-			case tSystem::tFileType::PNG:  ParseSaveParametersPNG();  break;
-			case tSystem::tFileType::QOI:  ParseSaveParametersQOI();  break;
-			case tSystem::tFileType::TGA:  ParseSaveParametersTGA();  break;
-			case tSystem::tFileType::TIFF: ParseSaveParametersTIFF(); break;
-			case tSystem::tFileType::WEBP: ParseSaveParametersWEBP(); break;
+			case tSystem::tFileType::APNG: ParseSaveParametersAPNG(OptionOutAPNG.Arg1());	break;
+			case tSystem::tFileType::BMP:  ParseSaveParametersBMP(OptionOutBMP.Arg1());		break;
+			case tSystem::tFileType::GIF:  ParseSaveParametersGIF(OptionOutGIF.Arg1());		break;
+			case tSystem::tFileType::JPG:  ParseSaveParametersJPG(OptionOutJPG.Arg1());		break;
+			case tSystem::tFileType::PNG:  ParseSaveParametersPNG(OptionOutPNG.Arg1());		break;
+			case tSystem::tFileType::QOI:  ParseSaveParametersQOI(OptionOutQOI.Arg1());		break;
+			case tSystem::tFileType::TGA:  ParseSaveParametersTGA(OptionOutTGA.Arg1());		break;
+			case tSystem::tFileType::TIFF: ParseSaveParametersTIFF(OptionOutTIFF.Arg1());	break;
+			case tSystem::tFileType::WEBP: ParseSaveParametersWEBP(OptionOutWEBP.Arg1());	break;
 		}
 	}
 }
@@ -1012,10 +1527,27 @@ void Command::SetImageSaveParameters(Viewer::Image& image, tSystem::tFileType fi
 }
 
 
-void Command::ParseSaveParametersAPNG()
+void Command::SetImageSaveParameters(Viewer::Image& image, tSystem::tFileType fileType, const Recipe& recipe)
+{
+	switch (fileType)
+	{
+		case tSystem::tFileType::APNG: image.SaveParamsAPNG = recipe.SaveParamsAPNG; break;
+		case tSystem::tFileType::BMP:  image.SaveParamsBMP  = recipe.SaveParamsBMP;  break;
+		case tSystem::tFileType::GIF:  image.SaveParamsGIF  = recipe.SaveParamsGIF;  break;
+		case tSystem::tFileType::JPG:  image.SaveParamsJPG  = recipe.SaveParamsJPG;  break;
+		case tSystem::tFileType::PNG:  image.SaveParamsPNG  = recipe.SaveParamsPNG;  break;
+		case tSystem::tFileType::QOI:  image.SaveParamsQOI  = recipe.SaveParamsQOI;  break;
+		case tSystem::tFileType::TGA:  image.SaveParamsTGA  = recipe.SaveParamsTGA;  break;
+		case tSystem::tFileType::TIFF: image.SaveParamsTIFF = recipe.SaveParamsTIFF; break;
+		case tSystem::tFileType::WEBP: image.SaveParamsWEBP = recipe.SaveParamsWEBP; break;
+	}
+}
+
+
+void Command::ParseSaveParametersAPNG(const tString& params)
 {
 	tList<ParamValuePair> pairs;
-	ParseParamValuePairs(pairs, OptionOutAPNG.Arg1());
+	ParseParamValuePairs(pairs, params);
 	for (ParamValuePair* p = pairs.First(); p; p = p->Next())
 	{
 		tString& param = p->Param;
@@ -1040,10 +1572,10 @@ void Command::ParseSaveParametersAPNG()
 }
 
 
-void Command::ParseSaveParametersBMP()
+void Command::ParseSaveParametersBMP(const tString& params)
 {
 	tList<ParamValuePair> pairs;
-	ParseParamValuePairs(pairs, OptionOutBMP.Arg1());
+	ParseParamValuePairs(pairs, params);
 	for (ParamValuePair* p = pairs.First(); p; p = p->Next())
 	{
 		tString& param = p->Param;
@@ -1064,10 +1596,10 @@ void Command::ParseSaveParametersBMP()
 }
 
 
-void Command::ParseSaveParametersGIF()
+void Command::ParseSaveParametersGIF(const tString& params)
 {
 	tList<ParamValuePair> pairs;
-	ParseParamValuePairs(pairs, OptionOutGIF.Arg1());
+	ParseParamValuePairs(pairs, params);
 	for (ParamValuePair* p = pairs.First(); p; p = p->Next())
 	{
 		tString& param = p->Param;
@@ -1131,10 +1663,10 @@ void Command::ParseSaveParametersGIF()
 }
 
 
-void Command::ParseSaveParametersJPG()
+void Command::ParseSaveParametersJPG(const tString& params)
 {
 	tList<ParamValuePair> pairs;
-	ParseParamValuePairs(pairs, OptionOutJPG.Arg1());
+	ParseParamValuePairs(pairs, params);
 	for (ParamValuePair* p = pairs.First(); p; p = p->Next())
 	{
 		tString& param = p->Param;
@@ -1152,10 +1684,10 @@ void Command::ParseSaveParametersJPG()
 }
 
 
-void Command::ParseSaveParametersPNG()
+void Command::ParseSaveParametersPNG(const tString& params)
 {
 	tList<ParamValuePair> pairs;
-	ParseParamValuePairs(pairs, OptionOutPNG.Arg1());
+	ParseParamValuePairs(pairs, params);
 	for (ParamValuePair* p = pairs.First(); p; p = p->Next())
 	{
 		tString& param = p->Param;
@@ -1176,10 +1708,10 @@ void Command::ParseSaveParametersPNG()
 }
 
 
-void Command::ParseSaveParametersQOI()
+void Command::ParseSaveParametersQOI(const tString& params)
 {
 	tList<ParamValuePair> pairs;
-	ParseParamValuePairs(pairs, OptionOutQOI.Arg1());
+	ParseParamValuePairs(pairs, params);
 	for (ParamValuePair* p = pairs.First(); p; p = p->Next())
 	{
 		tString& param = p->Param;
@@ -1210,10 +1742,10 @@ void Command::ParseSaveParametersQOI()
 }
 
 
-void Command::ParseSaveParametersTGA()
+void Command::ParseSaveParametersTGA(const tString& params)
 {
 	tList<ParamValuePair> pairs;
-	ParseParamValuePairs(pairs, OptionOutTGA.Arg1());
+	ParseParamValuePairs(pairs, params);
 	for (ParamValuePair* p = pairs.First(); p; p = p->Next())
 	{
 		tString& param = p->Param;
@@ -1241,10 +1773,10 @@ void Command::ParseSaveParametersTGA()
 }
 
 
-void Command::ParseSaveParametersTIFF()
+void Command::ParseSaveParametersTIFF(const tString& params)
 {
 	tList<ParamValuePair> pairs;
-	ParseParamValuePairs(pairs, OptionOutTIFF.Arg1());
+	ParseParamValuePairs(pairs, params);
 	for (ParamValuePair* p = pairs.First(); p; p = p->Next())
 	{
 		tString& param = p->Param;
@@ -1273,10 +1805,10 @@ void Command::ParseSaveParametersTIFF()
 }
 
 
-void Command::ParseSaveParametersWEBP()
+void Command::ParseSaveParametersWEBP(const tString& params)
 {
 	tList<ParamValuePair> pairs;
-	ParseParamValuePairs(pairs, OptionOutWEBP.Arg1());
+	ParseParamValuePairs(pairs, params);
 	for (ParamValuePair* p = pairs.First(); p; p = p->Next())
 	{
 		tString& param = p->Param;
@@ -1302,16 +1834,16 @@ void Command::ParseSaveParametersWEBP()
 }
 
 
-tString Command::DetermineOutputFilename(const tString& inName, tSystem::tFileType outType)
+tString Command::DetermineOutputFilename(const tString& inName, tSystem::tFileType outType, const Recipe& recipe)
 {
 	tString baseName = tSystem::tGetFileBaseName(inName);
 
-	if (OutNameSearch.IsValid())
-		baseName.Replace(OutNameSearch.Chr(), OutNameReplace.Chr());
-	if (OutNamePrefix.IsValid())
-		baseName = OutNamePrefix + baseName;
-	if (OutNameSuffix.IsValid())
-		baseName = baseName + OutNameSuffix;
+	if (recipe.OutNameSearch.IsValid())
+		baseName.Replace(recipe.OutNameSearch.Chr(), recipe.OutNameReplace.Chr());
+	if (recipe.OutNamePrefix.IsValid())
+		baseName = recipe.OutNamePrefix + baseName;
+	if (recipe.OutNameSuffix.IsValid())
+		baseName = baseName + recipe.OutNameSuffix;
 
 	tString outExt = tSystem::tGetExtension(outType);
 	tString outName = tSystem::tGetDir(inName) + baseName + "." + outExt;
@@ -1336,9 +1868,451 @@ tString Command::DetermineOutputFilename(const tString& inName, tSystem::tFileTy
 }
 
 
+bool Command::Recipe::HasOperations() const
+{
+	for (Operation* operation = Operations.First(); operation; operation = operation->Next())
+		if (operation->Valid)
+			return true;
+
+	return false;
+}
+
+
+bool Command::Recipe::UsesGlobalOutput() const
+{
+	for (Operation* operation = Operations.First(); operation; operation = operation->Next())
+		if (operation->Valid && operation->UsesGlobalOutput())
+			return true;
+
+	return false;
+}
+
+
+void Command::Recipe::Capture()
+{
+	while (!Command::Operations.IsEmpty())
+		Operations.Append(Command::Operations.Remove());
+
+	OutTypes.Clear();
+	OutTypes.Add(Command::OutTypes);
+	OutNamePrefix	= Command::OutNamePrefix;
+	OutNameSuffix	= Command::OutNameSuffix;
+	OutNameSearch	= Command::OutNameSearch;
+	OutNameReplace	= Command::OutNameReplace;
+
+	SaveParamsAPNG	= Command::SaveParamsAPNG;
+	SaveParamsBMP	= Command::SaveParamsBMP;
+	SaveParamsGIF	= Command::SaveParamsGIF;
+	SaveParamsJPG	= Command::SaveParamsJPG;
+	SaveParamsPNG	= Command::SaveParamsPNG;
+	SaveParamsQOI	= Command::SaveParamsQOI;
+	SaveParamsTGA	= Command::SaveParamsTGA;
+	SaveParamsTIFF	= Command::SaveParamsTIFF;
+	SaveParamsWEBP	= Command::SaveParamsWEBP;
+}
+
+
+void Command::Recipe::Install() const
+{
+	Command::OutTypes.Clear();
+	Command::OutTypes.Add(OutTypes);
+	Command::OutNamePrefix	= OutNamePrefix;
+	Command::OutNameSuffix	= OutNameSuffix;
+	Command::OutNameSearch	= OutNameSearch;
+	Command::OutNameReplace	= OutNameReplace;
+
+	Command::SaveParamsAPNG	= SaveParamsAPNG;
+	Command::SaveParamsBMP	= SaveParamsBMP;
+	Command::SaveParamsGIF	= SaveParamsGIF;
+	Command::SaveParamsJPG	= SaveParamsJPG;
+	Command::SaveParamsPNG	= SaveParamsPNG;
+	Command::SaveParamsQOI	= SaveParamsQOI;
+	Command::SaveParamsTGA	= SaveParamsTGA;
+	Command::SaveParamsTIFF	= SaveParamsTIFF;
+	Command::SaveParamsWEBP	= SaveParamsWEBP;
+}
+
+
+bool Command::DetermineRecipes()
+{
+	// Without a recipe file the command line itself is the one and only recipe.
+	if (!OptionRecipes)
+	{
+		Recipe* recipe = new Recipe;
+		recipe->Name = "default";
+		recipe->Capture();
+		Recipes.Append(recipe);
+		return true;
+	}
+
+	if (OptionOperation || OptionOutTypes)
+		tPrintfNorm("Warning: --op and --out are ignored with --recipes. Put them in the recipe file.\n");
+
+	return ParseRecipeFile(OptionRecipes.Arg1());
+}
+
+
+bool Command::ParseRecipeFile(const tString& recipeFile)
+{
+	tSystem::tFileHandle file = tSystem::tOpenFile(recipeFile.Chr(), "rb");
+	if (!file)
+	{
+		tPrintfNorm("Warning: Cannot open recipe file %s\n", recipeFile.Chr());
+		return false;
+	}
+
+	// Read the lines trimming leading and trailing whitespace. Like manifests, line comments start with a semicolon.
+	// A hash also starts a comment.
+	tList<tStringItem> lines;
+	const int chunkSize = 4096;
+	char chunk[chunkSize];
+	std::string line;
+	auto addLine = [&lines, &line]()
+	{
+		size_t first = line.find_first_not_of(" \t");
+		size_t last = line.find_last_not_of(" \t");
+		if ((first != std::string::npos) && (line[first] != ';') && (line[first] != '#'))
+			lines.Append(new tStringItem(line.substr(first, last - first + 1).c_str()));
+		line.clear();
+	};
+
+	int numRead = 0;
+	while ((numRead = tSystem::tReadFile(file, chunk, chunkSize)) > 0)
+	{
+		for (int c = 0; c < numRead; c++)
+		{
+			char ch = chunk[c];
+			if (ch == '\n')
+				addLine();
+			else if (ch != '\r')
+				line += ch;
+		}
+	}
+	addLine();
+	tSystem::tCloseFile(file);
+
+	// Any --outname and --outXXX save parameters on the command line are the starting point for every recipe. Only
+	// the CLI out types have been parsed so far, so the rest are parsed here.
+	if (OptionOutAPNG)	ParseSaveParametersAPNG(OptionOutAPNG.Arg1());
+	if (OptionOutBMP)	ParseSaveParametersBMP(OptionOutBMP.Arg1());
+	if (OptionOutGIF)	ParseSaveParametersGIF(OptionOutGIF.Arg1());
+	if (OptionOutJPG)	ParseSaveParametersJPG(OptionOutJPG.Arg1());
+	if (OptionOutPNG)	ParseSaveParametersPNG(OptionOutPNG.Arg1());
+	if (OptionOutQOI)	ParseSaveParametersQOI(OptionOutQOI.Arg1());
+	if (OptionOutTGA)	ParseSaveParametersTGA(OptionOutTGA.Arg1());
+	if (OptionOutTIFF)	ParseSaveParametersTIFF(OptionOutTIFF.Arg1());
+	if (OptionOutWEBP)	ParseSaveParametersWEBP(OptionOutWEBP.Arg1());
+	CommandLineSettings.Capture();
+
+	// Each recipe is parsed into the globals, exactly as the command line is, and then captured.
+	Recipe* recipe = nullptr;
+	tList<tStringItem> opstrings;
+	tList<tStringItem> typestrings;
+	auto endRecipe = [&recipe, &opstrings, &typestrings]()
+	{
+		if (!recipe)
+			return;
+
+		OutTypes.Clear();
+		PopulateOperations(opstrings);
+		DetermineOutputTypes(typestrings);
+		recipe->Capture();
+		Recipes.Append(recipe);
+		tPrintfFull("Recipe %s: %d operations, %d output types.\n", recipe->Name.Chr(), recipe->Operations.Count(), recipe->OutTypes.Count());
+
+		recipe = nullptr;
+		opstrings.Clear();
+		typestrings.Clear();
+		CommandLineSettings.Install();
+	};
+
+	for (tStringItem* lineItem = lines.First(); lineItem; lineItem = lineItem->Next())
+	{
+		tString entry = *lineItem;
+
+		// Sections look like [name] and start a new recipe.
+		if (entry[0] == '[')
+		{
+			endRecipe();
+			recipe = new Recipe;
+			entry.ExtractLeft('[');
+			recipe->Name = entry.ExtractLeft(']');
+			if (recipe->Name.IsEmpty())
+				tsPrintf(recipe->Name, "recipe%d", Recipes.Count() + 1);
+			continue;
+		}
+
+		// Everything else is a key and a value separated by whitespace. Keys are the CLI option long names.
+		entry.Replace('\t', ' ');
+		tString key = entry.ExtractLeft(' ');
+		tString value = entry;
+		if (key.IsEmpty())
+		{
+			key = entry;
+			value.Clear();
+		}
+		while (value.Length() > 0 && (value[0] == ' '))
+			value.ExtractLeft(1);
+
+		if (!recipe)
+		{
+			tPrintfNorm("Warning: Recipe file entry %s is not in a [recipe] section. Ignoring.\n", key.Chr());
+			continue;
+		}
+
+		switch (tHash::tHashString(key.Chr()))
+		{
+			case tHash::tHashCT("op"):		opstrings.Append(new tStringItem(value));		break;
+			case tHash::tHashCT("out"):		typestrings.Append(new tStringItem(value));		break;
+			case tHash::tHashCT("outname"):	ParseOutputNameParameters(value);				break;
+			case tHash::tHashCT("outAPNG"):	ParseSaveParametersAPNG(value);					break;
+			case tHash::tHashCT("outBMP"):	ParseSaveParametersBMP(value);					break;
+			case tHash::tHashCT("outGIF"):	ParseSaveParametersGIF(value);					break;
+			case tHash::tHashCT("outJPG"):	ParseSaveParametersJPG(value);					break;
+			case tHash::tHashCT("outPNG"):	ParseSaveParametersPNG(value);					break;
+			case tHash::tHashCT("outQOI"):	ParseSaveParametersQOI(value);					break;
+			case tHash::tHashCT("outTGA"):	ParseSaveParametersTGA(value);					break;
+			case tHash::tHashCT("outTIFF"):	ParseSaveParametersTIFF(value);					break;
+			case tHash::tHashCT("outWEBP"):	ParseSaveParametersWEBP(value);					break;
+			default:
+				tPrintfNorm("Warning: Unknown key %s in recipe %s. Ignoring.\n", key.Chr(), recipe->Name.Chr());
+				break;
+		}
+	}
+	endRecipe();
+
+	if (Recipes.IsEmpty())
+	{
+		tPrintfNorm("Warning: No recipes found in %s\n", recipeFile.Chr());
+		return false;
+	}
+
+	return true;
+}
+
+
+int Command::RunRecipes(Viewer::Image& image, bool& somethingFailed)
+{
+	// A recipe containing an operation that saves using the global output settings (extract) forces the recipes to
+	// run one at a time so that recipe's settings can be installed into the globals while it runs.
+	bool serial = (Recipes.Count() == 1);
+	for (Recipe* recipe = Recipes.First(); recipe && !serial; recipe = recipe->Next())
+		if (recipe->UsesGlobalOutput())
+			serial = true;
+
+	if (serial)
+	{
+		for (Recipe* recipe = Recipes.First(); recipe; recipe = recipe->Next())
+		{
+			// Nothing reads the original after the last recipe so it may modify it directly. Earlier recipes with
+			// operations get a copy.
+			Viewer::Image copy;
+			Viewer::Image* target = &image;
+			if (recipe->HasOperations() && recipe->Next())
+			{
+				copy.SetUndoEnabled(false);
+				copy.LoadFrom(image);
+				target = &copy;
+			}
+
+			bool install = OptionRecipes && recipe->UsesGlobalOutput();
+			if (install)
+				recipe->Install();
+			int result = RunRecipe(*target, *recipe, somethingFailed);
+			if (install)
+				CommandLineSettings.Install();
+
+			copy.Unload(true);
+			if (result != Viewer::ErrorCode_Success)
+				return result;
+		}
+		return Viewer::ErrorCode_Success;
+	}
+
+	// Recipes with operations each run on their own thread against their own copy of the pictures. Recipes without
+	// operations only encode. They read the original directly and run one after another on this thread since every
+	// save writes the save parameters into the image. With no such readers the last writer may take the original.
+	Recipe* lastWriter = nullptr;
+	int numReaders = 0;
+	for (Recipe* recipe = Recipes.First(); recipe; recipe = recipe->Next())
+	{
+		if (recipe->HasOperations())
+			lastWriter = recipe;
+		else
+			numReaders++;
+	}
+
+	int numRecipes = Recipes.Count();
+	std::vector<int> results(numRecipes, Viewer::ErrorCode_Success);
+	std::vector<int> failures(numRecipes, 0);
+	std::vector<Viewer::Image*> copies;
+	std::vector<std::thread> writers;
+	int index = 0;
+	for (Recipe* recipe = Recipes.First(); recipe; recipe = recipe->Next(), index++)
+	{
+		if (!recipe->HasOperations())
+			continue;
+
+		Viewer::Image* target = &image;
+		if ((numReaders > 0) || (recipe != lastWriter))
+		{
+			target = new Viewer::Image;
+			target->SetUndoEnabled(false);
+			target->LoadFrom(image);
+			copies.push_back(target);
+		}
+
+		writers.emplace_back([target, recipe, index, &results, &failures]()
+		{
+			bool failed = false;
+			results[index] = RunRecipe(*target, *recipe, failed);
+			failures[index] = failed ? 1 : 0;
+		});
+	}
+
+	index = 0;
+	for (Recipe* recipe = Recipes.First(); recipe; recipe = recipe->Next(), index++)
+	{
+		if (recipe->HasOperations())
+			continue;
+
+		bool failed = false;
+		results[index] = RunRecipe(image, *recipe, failed);
+		failures[index] = failed ? 1 : 0;
+		if (results[index] != Viewer::ErrorCode_Success)
+			break;
+	}
+
+	for (std::thread& writer : writers)
+		writer.join();
+	for (Viewer::Image* copy : copies)
+	{
+		copy->Unload(true);
+		delete copy;
+	}
+
+	int result = Viewer::ErrorCode_Success;
+	for (int r = 0; r < numRecipes; r++)
+	{
+		if (failures[r])
+			somethingFailed = true;
+		if ((result == Viewer::ErrorCode_Success) && (results[r] != Viewer::ErrorCode_Success))
+			result = results[r];
+	}
+
+	return result;
+}
+
+
+int Command::RunRecipe(Viewer::Image& image, const Recipe& recipe, bool& somethingFailed)
+{
+	// Only one image can be written to stdout.
+	bool toStdout = IsStdinImage(image);
+	if (toStdout && (&recipe != Recipes.First()))
+	{
+		tPrintfNorm("Warning: Only the first recipe is written to stdout. Skipping recipe %s.\n", recipe.Name.Chr());
+		return Viewer::ErrorCode_Success;
+	}
+
+	tString inNameShort = tSystem::tGetFileName(image.Filename);
+	if (OptionRecipes)
+		tPrintfFull("Recipe: %s\n", recipe.Name.Chr());
+
+	// Process the standard operations on the current image.
+	bool processed = ProcessOperationsOnImage(image, recipe.Operations);
+	if (!processed)
+	{
+		somethingFailed = true;
+		return OptionEarlyExit ? Viewer::ErrorCode_CLI_FailImageProcess : Viewer::ErrorCode_Success;
+	}
+
+	// Some operations do not modify the input image at all. For example, the extract operation saves every frame
+	// of the input image but does not modify it. In these cases the image dirty flag is not set so we can
+	// skip saving if OptionSkipUnchanged is true.
+	if (OptionSkipUnchanged && !image.IsDirty())
+	{
+		tPrintfNorm("Skipping unchanged: %s\n", inNameShort.Chr());
+		return Viewer::ErrorCode_Success;
+	}
+
+	// Now we iterate through the output types, saving if needed.
+	tAssert(recipe.OutTypes.Count() >= 1);
+	for (tSystem::tFileTypes::tFileTypeItem* typeItem = recipe.OutTypes.First(); typeItem; typeItem = typeItem->Next())
+	{
+		tSystem::tFileType outType = typeItem->FileType;
+
+		// The stdin image goes to stdout. Only one image can be written there so only the first out type is used.
+		if (toStdout)
+		{
+			if (typeItem != recipe.OutTypes.First())
+			{
+				tPrintfNorm("Warning: Only the first output type is written to stdout.\n");
+				break;
+			}
+
+			SetImageSaveParameters(image, outType, recipe);
+			tString spoolOut = GetSpoolFilename("stdout", outType);
+			StatsTimer saveTimer;
+			bool success = image.Save(spoolOut, outType, false) && StreamFileToStdout(spoolOut);
+			StatsRecord("save", tSystem::tGetFileTypeName(outType).Chr(), saveTimer, 0, success ? tSystem::tGetFileSize(spoolOut) : 0);
+			tSystem::tDeleteFile(spoolOut);
+			if (success)
+			{
+				tPrintfNorm("Saved To: stdout\n");
+			}
+			else
+			{
+				tPrintfNorm("Warning: Failed save to stdout.\n");
+				somethingFailed = true;
+				if (OptionEarlyExit)
+					return Viewer::ErrorCode_CLI_FailImageSave;
+			}
+			continue;
+		}
+
+		// Determine out filename.
+		tString outFilename = DetermineOutputFilename(image.Filename, outType, recipe);
+		tString outNameShort = tSystem::tGetFileName(outFilename);
+		if (!OptionOverwrite && tSystem::tFileExists(outFilename))
+		{
+			tPrintfNorm("Warning: %s exists. No overwrite.\n", outNameShort.Chr());
+			somethingFailed = true;
+			if (OptionEarlyExit)
+				return Viewer::ErrorCode_CLI_FailEarlyExit;
+			continue;
+		}
+
+		// Set the image save parameters correctly. The user may have modified them from the command line.
+		SetImageSaveParameters(image, outType, recipe);
+		StatsTimer saveTimer;
+		bool success = image.Save(outFilename, outType, false);
+		if (StatsEnabled())
+		{
+			tSystem::tFileInfo outInfo;
+			uint64 bytesWritten = (success && tSystem::tGetFileInfo(outInfo, outFilename)) ? outInfo.FileSize : 0;
+			StatsRecord("save", tSystem::tGetFileTypeName(outType).Chr(), saveTimer, 0, bytesWritten);
+		}
+		if (success)
+		{
+			tPrintfNorm("Saved File: %s\n", outNameShort.Chr());
+		}
+		else
+		{
+			tPrintfNorm("Warning: Failed save: %s\n", outNameShort.Chr());
+			somethingFailed = true;
+			if (OptionEarlyExit)
+				return Viewer::ErrorCode_CLI_FailImageSave;
+		}
+	}
+
+	return Viewer::ErrorCode_Success;
+}
+
+
 int Command::Process()
 {
 	ConsoleOutputScoped scopedConsoleOutput;
+	StdioScoped scopedStdio;
 
 	// Default is normal (1) verbosity.
 	int verbLevel = 1;
@@ -1408,15 +2382,19 @@ int Command::Process()
 	DetermineInputTypes();
 	DetermineInputLoadParameters();
 
-	// Collect all input files into a single list.
-	DetermineInputFiles();
+	// The stats report is emitted when this goes out of scope, including on early exit.
+	StatsReportScoped scopedStatsReport;
+	if (OptionStats)
+		StatsBegin();
 
-	// Populates the Images list. Each added image gets its load-parameters set correctly and the undo-stack turned
-	// off. Does not load the images.
-	PopulateImagesList();
+	// Start collecting input files. This happens on background threads and Images is populated incrementally by the
+	// processing loop below. The collector destructor stops and joins the threads on any early exit.
+	InputCollector collector;
+	DetermineInputFiles(collector);
 
-	// Populates the Operations list.
-	PopulateOperations();
+	// Populates the Operations list. With a recipe file the operations come from the recipes instead.
+	if (!OptionRecipes)
+		PopulateOperations();
 
 	// Populates the PostOperations list.
 	PopulatePostOperations();
@@ -1425,15 +2403,24 @@ int Command::Process()
 	DetermineOutputNameParameters();
 	DetermineOutputSaveParameters();
 
+	// Builds the recipe list from the --recipes file or, without one, from the command line.
+	if (!DetermineRecipes())
+		return Viewer::ErrorCode_CLI_FailRecipeFile;
+
 	// Process standard operations.
 	// We do the images one at a time to save memory. That is, we only need to load one image in at a time
 	// and can unload them when done.
+	// Each image added to the Images list gets its load-parameters set correctly and the undo-stack turned off.
 	bool somethingFailed = false;
-	for (Viewer::Image* image = Images.First(); image; image = image->Next())
+	tPrintfFull("Input files:\n");
+	for (Viewer::Image* image = PopulateNextImage(collector); image; image = PopulateNextImage(collector))
 	{
 		// We do not read the config file when using the CLI. All parameters need to com from the command-line.
+		StatsBeginImage(image->Filename);
+		StatsTimer loadTimer;
 		bool loadParamsFromConfig = false;
 		image->Load(loadParamsFromConfig);
+		StatsRecord("load", tSystem::tGetFileTypeName(image->Filetype).Chr(), loadTimer, image->FileSizeB);
 
 		tString inNameShort = tSystem::tGetFileName(image->Filename);
 		if (!image->IsLoaded())
@@ -1445,70 +2432,19 @@ int Command::Process()
 			continue;
 		}
 
-		// Process the standard operations on the current image.
+		// Every recipe runs against this single decode.
 		tPrintfNorm("Processing: %s\n", inNameShort.Chr());
-		bool processed = ProcessOperationsOnImage(*image);
-		if (!processed)
-		{
-			image->Unload();
-			somethingFailed = true;
-			if (OptionEarlyExit)
-				return Viewer::ErrorCode_CLI_FailImageProcess;
-			continue;
-		}
-
-		// Some operations do not modify the input image at all. For example, the extract operation saves every frame
-		// of the input image but does not modify it. In these cases the image dirty flag is not set so we can
-		// skip saving if OptionSkipUnchanged is true.
-		if (OptionSkipUnchanged && !image->IsDirty())
+		int result = RunRecipes(*image, somethingFailed);
+		if (result != Viewer::ErrorCode_Success)
 		{
-			tPrintfNorm("Skipping unchanged: %s\n", inNameShort.Chr());
 			image->Unload();
-			continue;
-		}
-
-		// Now we iterate through the output types, saving if needed.
-		tAssert(OutTypes.Count() >= 1);
-		for (tSystem::tFileTypes::tFileTypeItem* typeItem = OutTypes.First(); typeItem; typeItem = typeItem->Next())
-		{
-			tSystem::tFileType outType = typeItem->FileType;
-
-			// Determine out filename.
-			tString outFilename = DetermineOutputFilename(image->Filename, outType);
-			tString outNameShort = tSystem::tGetFileName(outFilename);
-			if (!OptionOverwrite && tSystem::tFileExists(outFilename))
-			{
-				tPrintfNorm("Warning: %s exists. No overwrite.\n", outNameShort.Chr());
-				somethingFailed = true;
-				if (OptionEarlyExit)
-				{
-					image->Unload();
-					return Viewer::ErrorCode_CLI_FailEarlyExit;
-				}
-				continue;
-			}
-
-			// Set the image save parameters correctly. The user may have modified them from the command line.
-			SetImageSaveParameters(*image, outType);
-			bool success = image->Save(outFilename, outType, false);
-			if (success)
-			{
-				tPrintfNorm("Saved File: %s\n", outNameShort.Chr());
-			}
-			else
-			{
-				tPrintfNorm("Warning: Failed save: %s\n", outNameShort.Chr());
-				somethingFailed = true;
-				if (OptionEarlyExit)
-				{
-					image->Unload();
-					return Viewer::ErrorCode_CLI_FailImageSave;
-				}
-			}
+			return result;
 		}
 		image->Unload();
 	}
 
+	StatsEndImage();
+
 	// Do post save operations here --po. These are operations that take more than a single image as input.
 	// They are separated out into a different pass for efficiency -- if we were to do these as regular inline
 	// operations (--op) we would need to have all input images in memory at the same time. The post-op pass
@@ -1531,7 +2467,9 @@ int Command::Process()
 					continue;
 
 				tPrintfNorm("Processing post operation: %s\n", postop->GetName());
+				StatsTimer postTimer;
 				bool success = postop->Apply(Images);
+				StatsRecord("post", postop->GetName(), postTimer);
 				if (!success)
 				{
 					tPrintfNorm("Warning: Failed post operation: %s\n", postop->GetName());
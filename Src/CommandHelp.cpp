@@ -877,6 +877,14 @@ e.g. @list.txt will load files from a manifest file called list.txt. Each line
 of a manifest file should be the name of a file to process, the name of a dir
 to process, start with a line-comment semicolon, or simply be empty.
 
+A single dash (-) reads one image from stdin and writes the result to stdout
+using the first --out type. This lets tacentview be a step in a pipeline. The
+input type is detected from the image data. TGA has no signature so use -i tga
+for TGA input. PNG and JPG input is decoded from memory. Other types, and the
+output, go through a temporary file. While streaming all messages are written
+to stderr.
+e.g. cat in.png | tacentview -c - --op resize[512,-1] -o webp > out.webp
+
 You may specify what types of input images to process. If you do not specify
 any types, ALL supported imgage types are processed. A type like 'tif' may have
 more than one accepted extension (tif and tiff). The extension is not
@@ -1145,15 +1153,17 @@ or leave it out. Eg. zap[a*,b*] may be called with --op zap[] or just --op zap.
 
 --op rotate[ang,mode*,upft*,dnft*,fill*]
   Rotates an image. Use negative angles for clockwise rotations. At a minimum
-  you must supply the rotation angle in degrees or radians. There is also the
-  ability to specify different sampling filters to get quality results, or
-  preserve original colours for pixel art. After rotation is complete the areas
-  not containing image pixels may be filled with a specified colour, or the
-  image may be cropped and possibly resized back to original dimensions.
+  you must supply the rotation angle in degrees or radians. Each destination
+  pixel is mapped back into the source image and sampled once with a kernel
+  chosen by the upft filter, or colours may be preserved for pixel art. After
+  rotation is complete the areas not containing image pixels may be filled
+  with a specified colour, or the image may be cropped and possibly resized
+  back to original dimensions.
   ang:  Rotation angle. Specified in degrees. Defaults to 0.0* degrees. To
         specify in radians include the letter 'r' after the value. eg. -1.2r.
-        Negatives rotate clockwise. For exact 90 and 180 degree rotations the
-        following strings should be used so it uses a faster exact algorithm:
+        Negatives rotate clockwise. Multiples of 90 degrees always use a
+        faster exact algorithm that only reorders pixels. The following
+        strings may also be used:
         For 90 Degree Anticlockwise :  90  90.0 acw ccw
         For 90 Degree Clockwise     : -90 -90.0 cw
         For 180 Degree Rotation     : 180 180.0
@@ -1166,16 +1176,16 @@ or leave it out. Eg. zap[a*,b*] may be called with --op zap[] or just --op zap.
         image back to the original dimensions. Resampling does lose a little
         quality so this is not the default. Use resize mode when it is
         desireable to preserve the image size.
-  upft: Upsample filter. See below for filter names. Default is bilinear*.
-        Upsampling is used to create a larger image before rotation to give
-        much better results. It is also valid to enter 'none' in which case no
-        scaling-up of the image is performed. In this case all original pixel
-        colours are preserved by using nearest neighbour colours. This is fast
-        and a good choice for pixel-art and sprites.
-  dnft: Downsample filter. Only used if up-filter is not none. This filter is
-        used to restore image size after rotation. Specifying none* here uses
-        a special down-sample method that produces sharper results. Using box
-        filter here is also a good choice. See below for valid filter names.
+  upft: Sampling filter. See below for filter names. Default is bilinear*.
+        The filter picks the kernel used to sample the source image. none and
+        nearest use the nearest source pixel so all original pixel colours are
+        preserved. This is fast and a good choice for pixel-art and sprites.
+        box and bilinear use bilinear sampling. All other filters use bicubic
+        (Catmull-Rom) sampling. In resize mode this filter is also used to
+        resample back to the original dimensions, with nearest used for none.
+  dnft: Accepted so existing command lines keep working, but ignored. The
+        image is sampled once at its original resolution so there is no
+        down-sampling step.
   fill: Fill colour. Only used if mode was fill. Specify the colour using a
         hexadecimal in the form #RRGGBBAA, a single integer spread to RGBA, or
         a predefined name: black*, white, grey, red, green, blue, yellow, cyan,
@@ -1237,7 +1247,7 @@ R"OPERATIONS020(
   chan: The channels the brightness adjustment should be made to. Choices are
         RGB*, R, G, B, and A. Lower-case also works.
 
---op quantize[algo,ncol,xact*,fsam*,dith*]
+--op quantize[algo,ncol,xact*,fsam*,dith*,shrd*]
   Quantize the image to a reduced set of colours using various methods. Specify
   the algorithm, number of colours, and any optional parameters. Quantization
   is based on the colour (RGB) components. The alpha channel, if present, is
@@ -1265,6 +1275,10 @@ R"OPERATIONS020(
         on the image dimensions and number of colours. Otherwise, a value of
         0.1 results in essentially no dither, and at around 20.0 there is
         significant dithering.
+  shrd: Boolean shared palette. Default is false*. If true, all frames of a
+        multiframe image are quantized to one palette built from a sample of
+        every frame, and the frames are remapped to it in parallel. Faster for
+        animations and avoids palette flicker. Dither is not applied.
 
 --op channel[mode*,chan*,col*]
   Channel operations affect components of all pixels. The supported modes
@@ -1324,7 +1338,8 @@ R"OPERATIONS020(
   Extracts frames from a multiframe or animated image. Specify the frame
   numbers to extract, the base filename, and the directory to put them in. The
   output type is specified using -o or --outtype and the output parameters are
-  specified using the --paramsTYPE options. See below.
+  specified using the --paramsTYPE options. See below. Frames are saved in
+  parallel, one per CPU core (up to 8) at a time.
   frms: The frame numbers to extract in range format. In this format you may
         specify multiple ranges separated by a + or U character. A ! means
         exclusive and a - (hyphen) specifies a range. The default is to extract
@@ -1371,6 +1386,10 @@ included in the inputs, the new file is not used by the post operation.
   the source images beforehand if necessary. This can be done in a single
   command if you don't mind overwriting your existing source files with the
   --overwrite flag (see below), or do it as two passes.
+  Combine is not streamed. The encoders need every frame at once, so all
+  frames are held in memory together: about width x height x 4 bytes per
+  frame. For example 10000 1080p frames need around 80GB. Source images are
+  loaded one at a time and unloaded once their frame has been copied.
   durs: Durations for each frame specified in milliseconds. The syntax is a
         sequence of frame-interval:duration pairs separated by + or a U. Frame
         numbers start at 0. If more than one interval overlaps the same frame
@@ -1408,6 +1427,10 @@ included in the inputs, the new file is not used by the post operation.
   format supports it. When there are fewer input images than cols*rows, empty
   pages are needed. These empty pages are filled with a specified fill colour.
   Pages start at the top-left, one line at a time, from left to right.
+  A tga-only sheet is composed a band of rows at a time and written straight
+  to disk, so it may be larger than main memory (up to 65535x65535). Every
+  other output type, or tga alongside other types, needs the whole sheet in
+  memory.
   cols: Specify the number of columns you want in the contact sheet. This value
         should be bigger or equal to 0*. When set to 0 (the default) it will
         be computed for you based on the number of rows entered so that all
@@ -1473,6 +1496,39 @@ saved. This is so easy batch conversions from one type to another may be
 performed. Sometimes you may not want to save unmodified files. An example of
 this is using the extract operation by itself. If you don't want the unmodified
 input image saved, specify -k or --skipunchanged on the command line.
+
+To measure performance use --stats file.json. Wall and CPU time are recorded
+for every load, operation, save, and post-operation along with bytes read and
+written. When processing ends a summary table is printed and a JSON report with
+per-image and aggregate timings, peak memory, and images per second is written
+to the file. Use --stats * to print the JSON instead of saving it.
+
+On Linux many short jobs can share one warmed-up process. Start a daemon with
+tacentview --daemon /tmp/tacentview.sock [--daemonjobs N] and then prefix any
+normal CLI invocation with --client /tmp/tacentview.sock. The job runs in the
+daemon, its stdout and stderr are streamed back separately, and the client
+exits with the job's exit code. If no daemon is listening the client runs the
+job itself. Daemon jobs can't read the client's stdin, so a job with a - input
+is always run by the client.
+
+To convert the same inputs several different ways in one pass use a recipe file
+with --recipes file.txt. Each [name] section is a recipe. Its lines are a CLI
+long option name followed by the value, for example:
+
+[thumb]
+op resize[256,-1]
+out webp
+outWEBP qual=80
+outname suffix=_thumb
+
+[archive]
+out png
+
+The keys are op (may repeat), out, outname, and the --outTTT save parameters.
+Lines starting with ; or # are comments. Each input is loaded once and every
+recipe runs from that single load. Recipes with operations work on their own
+copy and run in parallel. Command-line --op and --out are ignored but --outname
+and --outTTT values are the defaults for every recipe.
 )OUTPUTIMAGES010", outtypes.Chr()
 	);
 	tPrintf
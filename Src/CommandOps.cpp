@@ -24,6 +24,7 @@
 #include "CommandOps.h"
 #include "Command.h"
 #include "MultiFrame.h"
+#include "ContactSheet.h"
 #include "OpenSaveDialogs.h"
 #include "TacentView.h"
 
@@ -95,6 +96,129 @@ bool Command::ParseChannels(comp_t& channels, const tString& chanStr)
 	return false;
 }
 
+bool Command::GeometryChain::Begin(const Viewer::Image& image)
+{
+	if (!image.IsLoaded() || image.IsAltPictureEnabled())
+		return false;
+
+	const tList<tImage::tPicture>& pictures = image.GetPictures();
+	int w = pictures.First()->GetWidth();
+	int h = pictures.First()->GetHeight();
+	for (tImage::tPicture* pic = pictures.First(); pic; pic = pic->Next())
+		if ((pic->GetWidth() != w) || (pic->GetHeight() != h))
+			return false;
+
+	SrcX = 0;	SrcY = 0;	SrcW = w;		SrcH = h;
+	ScaledW = w;			ScaledH = h;
+	PlaceX = 0;				PlaceY = 0;
+	OutW = w;				OutH = h;
+	Padded = false;
+	return (w > 0) && (h > 0);
+}
+
+
+bool Command::GeometryChain::Crop(int newW, int newH, int originX, int originY, const tColour4b& fill)
+{
+	if ((newW <= 0) || (newH <= 0))
+		return false;
+
+	// New output pixel (x,y) is old output pixel (x+originX, y+originY). Anything outside the old output is fill.
+	int placeX = PlaceX - originX;
+	int placeY = PlaceY - originY;
+	bool covered = (placeX <= 0) && (placeY <= 0) && (placeX+ScaledW >= newW) && (placeY+ScaledH >= newH);
+	bool extends = (originX < 0) || (originY < 0) || (originX+newW > OutW) || (originY+newH > OutH);
+
+	// We can only represent a single fill colour.
+	if (!covered && extends && Padded && (fill != FillColour))
+		return false;
+
+	if (!covered && extends && !Padded)
+		FillColour = fill;
+	PlaceX = placeX;
+	PlaceY = placeY;
+	OutW = newW;
+	OutH = newH;
+	Padded = !covered;
+	return true;
+}
+
+
+bool Command::GeometryChain::Crop(int newW, int newH, tImage::tPicture::Anchor anchor, const tColour4b& fill)
+{
+	// These match the origins tPicture::Crop computes for each anchor.
+	int originX = 0;
+	int originY = 0;
+	switch (anchor)
+	{
+		case tImage::tPicture::Anchor::LeftTop:			originX = 0;				originY = OutH-newH;		break;
+		case tImage::tPicture::Anchor::MiddleTop:		originX = OutW/2-newW/2;	originY = OutH-newH;		break;
+		case tImage::tPicture::Anchor::RightTop:		originX = OutW-newW;		originY = OutH-newH;		break;
+		case tImage::tPicture::Anchor::LeftMiddle:		originX = 0;				originY = OutH/2-newH/2;	break;
+		case tImage::tPicture::Anchor::MiddleMiddle:	originX = OutW/2-newW/2;	originY = OutH/2-newH/2;	break;
+		case tImage::tPicture::Anchor::RightMiddle:		originX = OutW-newW;		originY = OutH/2-newH/2;	break;
+		case tImage::tPicture::Anchor::LeftBottom:		originX = 0;				originY = 0;				break;
+		case tImage::tPicture::Anchor::MiddleBottom:	originX = OutW/2-newW/2;	originY = 0;				break;
+		case tImage::tPicture::Anchor::RightBottom:		originX = OutW-newW;		originY = 0;				break;
+		default:										return false;
+	}
+	return Crop(newW, newH, originX, originY, fill);
+}
+
+
+bool Command::GeometryChain::Resample(int newW, int newH, tImage::tResampleFilter filter, tImage::tResampleEdgeMode edgeMode)
+{
+	// Resampling fill pixels would blend them with the image edge, which a single mapping can't reproduce.
+	if (Padded || (newW <= 0) || (newH <= 0))
+		return false;
+
+	bool oneToOne = (ScaledW == SrcW) && (ScaledH == SrcH);
+	if (oneToOne)
+	{
+		// Unscaled, so the (fully covered) output is just a smaller window into the source.
+		SrcX -= PlaceX;
+		SrcY -= PlaceY;
+		SrcW = OutW;
+		SrcH = OutH;
+	}
+	else if ((PlaceX != 0) || (PlaceY != 0) || (OutW != ScaledW) || (OutH != ScaledH))
+	{
+		// A crop of an already resampled image can't be expressed exactly as a single resample of the source.
+		return false;
+	}
+
+	ScaledW = newW;
+	ScaledH = newH;
+	PlaceX = 0;
+	PlaceY = 0;
+	OutW = newW;
+	OutH = newH;
+	Filter = filter;
+	EdgeMode = edgeMode;
+	return true;
+}
+
+
+bool Command::GeometryChain::Apply(Viewer::Image& image) const
+{
+	tPrintfFull
+	(
+		"Fused | ResampleRegion[src:%d,%d %dx%d scaled:%dx%d place:%d,%d dim:%dx%d fill:%02x,%02x,%02x,%02x]\n",
+		SrcX, SrcY, SrcW, SrcH, ScaledW, ScaledH, PlaceX, PlaceY, OutW, OutH,
+		FillColour.R, FillColour.G, FillColour.B, FillColour.A
+	);
+
+	// A chain that composes back to the original image (eg. a canvas grow then the matching crop) is a successful
+	// no-op. Anything else reports whether the resample ran.
+	const tImage::tPicture* first = image.GetPictures().First();
+	bool identity =
+		first && (SrcX == 0) && (SrcY == 0) && (SrcW == first->GetWidth()) && (SrcH == first->GetHeight()) &&
+		(ScaledW == SrcW) && (ScaledH == SrcH) && (PlaceX == 0) && (PlaceY == 0) && (OutW == SrcW) && (OutH == SrcH);
+	if (identity)
+		return true;
+
+	return image.ResampleRegion(SrcX, SrcY, SrcW, SrcH, ScaledW, ScaledH, PlaceX, PlaceY, OutW, OutH, Filter, EdgeMode, FillColour);
+}
+
 
 Command::OperationPixel::OperationPixel(const tString& argsStr)
 {
@@ -219,18 +343,8 @@ bool Command::OperationResize::Apply(Viewer::Image& image)
 	if ((srcW <= 0) || (srcH <= 0))
 		return false;
 
-	float aspect = float(srcW) / float(srcH);
-
-	int dstW = Width;
-	int dstH = Height;
-	if (dstW <= 0)
-		dstW = int( float(dstH) * aspect );
-	else if (dstH <= 0)
-		dstH = int( float(dstW) / aspect );
-
-	tMath::tiClamp(dstW, 4, Viewer::Image::MaxDim);
-	tMath::tiClamp(dstH, 4, Viewer::Image::MaxDim);
-
+	int dstW, dstH;
+	ComputeDims(dstW, dstH, srcW, srcH);
 	if ((srcW == dstW) && (srcH == dstH))
 	{
 		tPrintfFull("Resize not applied. Image already has correct dimensions.\n");
@@ -243,6 +357,37 @@ bool Command::OperationResize::Apply(Viewer::Image& image)
 }
 
 
+bool Command::OperationResize::Compose(GeometryChain& chain) const
+{
+	tAssert(Valid);
+	int srcW = chain.GetWidth();
+	int srcH = chain.GetHeight();
+
+	int dstW, dstH;
+	ComputeDims(dstW, dstH, srcW, srcH);
+	if ((srcW == dstW) && (srcH == dstH))
+		return true;
+
+	return chain.Resample(dstW, dstH, ResampleFilter, EdgeMode);
+}
+
+
+void Command::OperationResize::ComputeDims(int& dstW, int& dstH, int srcW, int srcH) const
+{
+	float aspect = float(srcW) / float(srcH);
+
+	dstW = Width;
+	dstH = Height;
+	if (dstW <= 0)
+		dstW = int( float(dstH) * aspect );
+	else if (dstH <= 0)
+		dstH = int( float(dstW) / aspect );
+
+	tMath::tiClamp(dstW, 4, Viewer::Image::MaxDim);
+	tMath::tiClamp(dstH, 4, Viewer::Image::MaxDim);
+}
+
+
 Command::OperationCanvas::OperationCanvas(const tString& argsStr)
 {
 	tList<tStringItem> args;
@@ -325,18 +470,8 @@ bool Command::OperationCanvas::Apply(Viewer::Image& image)
 	if ((srcW <= 0) || (srcH <= 0))
 		return false;
 
-	float aspect = float(srcW) / float(srcH);
-
-	int dstW = Width;
-	int dstH = Height;
-	if (dstW <= 0)
-		dstW = int( float(dstH) * aspect );
-	else if (dstH <= 0)
-		dstH = int( float(dstW) / aspect );
-
-	tMath::tiClamp(dstW, 4, Viewer::Image::MaxDim);
-	tMath::tiClamp(dstH, 4, Viewer::Image::MaxDim);
-
+	int dstW, dstH;
+	ComputeDims(dstW, dstH, srcW, srcH);
 	if ((srcW == dstW) && (srcH == dstH))
 	{
 		tPrintfFull("Canvas not applied. Image has same dimensions.\n");
@@ -365,6 +500,44 @@ bool Command::OperationCanvas::Apply(Viewer::Image& image)
 }
 
 
+bool Command::OperationCanvas::Compose(GeometryChain& chain) const
+{
+	tAssert(Valid);
+	int srcW = chain.GetWidth();
+	int srcH = chain.GetHeight();
+
+	int dstW, dstH;
+	ComputeDims(dstW, dstH, srcW, srcH);
+	if ((srcW == dstW) && (srcH == dstH))
+		return true;
+
+	if ((AnchorX >= 0) && (AnchorY >= 0))
+	{
+		int originX = (AnchorX * (srcW - dstW)) / srcW;
+		int originY = (AnchorY * (srcH - dstH)) / srcH;
+		return chain.Crop(dstW, dstH, originX, originY, FillColour);
+	}
+
+	return chain.Crop(dstW, dstH, Anchor, FillColour);
+}
+
+
+void Command::OperationCanvas::ComputeDims(int& dstW, int& dstH, int srcW, int srcH) const
+{
+	float aspect = float(srcW) / float(srcH);
+
+	dstW = Width;
+	dstH = Height;
+	if (dstW <= 0)
+		dstW = int( float(dstH) * aspect );
+	else if (dstH <= 0)
+		dstH = int( float(dstW) / aspect );
+
+	tMath::tiClamp(dstW, 4, Viewer::Image::MaxDim);
+	tMath::tiClamp(dstH, 4, Viewer::Image::MaxDim);
+}
+
+
 Command::OperationAspect::OperationAspect(const tString& argsStr)
 {
 	tList<tStringItem> args;
@@ -451,26 +624,8 @@ bool Command::OperationAspect::Apply(Viewer::Image& image)
 	if ((srcW <= 0) || (srcH <= 0))
 		return false;
 
-	int dstH = srcH;
-	int dstW = srcW;
-	float srcAspect = float(srcW)/float(srcH);
-	float dstAspect = float(Num)/float(Den);
-	switch (Mode)
-	{
-		case AspectMode::Crop:
-			if (dstAspect > srcAspect)
-				dstH = tMath::tFloatToInt(float(dstW) / dstAspect);
-			else if (dstAspect < srcAspect)
-				dstW = tMath::tFloatToInt(float(dstH) * dstAspect);
-			break;
-		
-		case AspectMode::Letterbox:
-			if (dstAspect > srcAspect)
-				dstW = tMath::tFloatToInt(float(dstH) * dstAspect);
-			else if (dstAspect < srcAspect)
-				dstH = tMath::tFloatToInt(float(dstW) / dstAspect);
-	}
-
+	int dstW, dstH;
+	ComputeDims(dstW, dstH, srcW, srcH);
 	if ((srcW == dstW) && (srcH == dstH))
 	{
 		tPrintfFull("Aspect not applied. Image has same dimensions.\n");
@@ -499,6 +654,52 @@ bool Command::OperationAspect::Apply(Viewer::Image& image)
 }
 
 
+bool Command::OperationAspect::Compose(GeometryChain& chain) const
+{
+	tAssert(Valid);
+	int srcW = chain.GetWidth();
+	int srcH = chain.GetHeight();
+
+	int dstW, dstH;
+	ComputeDims(dstW, dstH, srcW, srcH);
+	if ((srcW == dstW) && (srcH == dstH))
+		return true;
+
+	if ((AnchorX >= 0) && (AnchorY >= 0))
+	{
+		int originX = (AnchorX * (srcW - dstW)) / srcW;
+		int originY = (AnchorY * (srcH - dstH)) / srcH;
+		return chain.Crop(dstW, dstH, originX, originY, FillColour);
+	}
+
+	return chain.Crop(dstW, dstH, Anchor, FillColour);
+}
+
+
+void Command::OperationAspect::ComputeDims(int& dstW, int& dstH, int srcW, int srcH) const
+{
+	dstH = srcH;
+	dstW = srcW;
+	float srcAspect = float(srcW)/float(srcH);
+	float dstAspect = float(Num)/float(Den);
+	switch (Mode)
+	{
+		case AspectMode::Crop:
+			if (dstAspect > srcAspect)
+				dstH = tMath::tFloatToInt(float(dstW) / dstAspect);
+			else if (dstAspect < srcAspect)
+				dstW = tMath::tFloatToInt(float(dstH) * dstAspect);
+			break;
+		
+		case AspectMode::Letterbox:
+			if (dstAspect > srcAspect)
+				dstW = tMath::tFloatToInt(float(dstH) * dstAspect);
+			else if (dstAspect < srcAspect)
+				dstH = tMath::tFloatToInt(float(dstW) / dstAspect);
+	}
+}
+
+
 Command::OperationDeborder::OperationDeborder(const tString& argsStr)
 {
 	tList<tStringItem> args;
@@ -635,6 +836,21 @@ bool Command::OperationCrop::Apply(Viewer::Image& image)
 }
 
 
+bool Command::OperationCrop::Compose(GeometryChain& chain) const
+{
+	tAssert(Valid);
+
+	int newW = WidthOrMaxX;
+	int newH = HeightOrMaxY;
+	if (Mode == CropMode::Absolute)
+	{
+		newW = WidthOrMaxX+1 - OriginX;
+		newH = HeightOrMaxY+1 - OriginY;
+	}
+	return chain.Crop(newW, newH, OriginX, OriginY, FillColour);
+}
+
+
 Command::OperationFlip::OperationFlip(const tString& argsStr)
 {
 	tList<tStringItem> args;
@@ -818,9 +1034,8 @@ bool Command::OperationRotate::Apply(Viewer::Image& image)
 			return true;
 
 		case ExactMode::R180:
-			tPrintfFull("Rotate | 2X Rotate90[Anticlockwise:true]\n");
-			image.Rotate90(true);
-			image.Rotate90(true);
+			tPrintfFull("Rotate | Rotate180\n");
+			image.Rotate180();
 			return true;
 
 		case ExactMode::Off:
@@ -828,61 +1043,36 @@ bool Command::OperationRotate::Apply(Viewer::Image& image)
 			break;
 	};
 
-	// Not an exact rotation. Rotate the image.
-	int origW = image.GetWidth();
-	int origH = image.GetHeight();
+	// Not an exact rotation. The crop and resize modes are done by the rotation itself so only the part of the
+	// picture that survives the crop is ever resampled.
+	Viewer::RotateFit fit = Viewer::RotateFit::Fill;
+	switch (Mode)
+	{
+		case RotateMode::Fill:		fit = Viewer::RotateFit::Fill;			break;
+		case RotateMode::Crop:		fit = Viewer::RotateFit::Crop;			break;
+		case RotateMode::Resize:	fit = Viewer::RotateFit::CropResize;	break;
+	}
 
 	tPrintfFull
 	(
-		"Rotate | Rotate\n[\n  rad:%f deg:%f\n  upfilt:%s dnfilt:%s\n  fill:%02x,%02x,%02x,%02x\n]\n",
+		"Rotate | Rotate\n[\n  rad:%f deg:%f\n  filt:%s mode:%s\n  fill:%02x,%02x,%02x,%02x\n]\n",
 		Angle, tMath::tRadToDeg(Angle),
 		tImage::tResampleFilterNamesSimple[int(FilterUp)],
-		tImage::tResampleFilterNamesSimple[int(FilterDown)],
+		(Mode == RotateMode::Fill) ? "fill" : ((Mode == RotateMode::Crop) ? "crop" : "resize"),
 		FillColour.R, FillColour.G, FillColour.B, FillColour.A
 	);
-	image.Rotate(Angle, FillColour, FilterUp, FilterDown);
-
-	if ((Mode == RotateMode::Crop) || (Mode == RotateMode::Resize))
-	{
-		// If one of the crop modes is selected we need to crop the edges. Since rectangles are made of lines and there
-		// is symmetry and we can compute the reduced size by subtracting the original size from the rotated size.
-		int rotW = image.GetWidth();
-		int rotH = image.GetHeight();
-		bool aspectFlip = ((origW > origH) && (rotW < rotH)) || ((origW < origH) && (rotW > rotH));
-		if (aspectFlip)
-			tStd::tSwap(origW, origH);
-
-		int dx = rotW - origW;
-		int dy = rotH - origH;
-		int newW = origW - dx;
-		int newH = origH - dy;
-
-		if (dx > origW/2)
-		{
-			newW = origW - origW/2;
-			newH = (newW*origH)/origW;
-		}
-		else if (dy > origH/2)
-		{
-			newH = origH - origH/2;
-			newW = (newH*origW)/origH;
-		}
-
-		// The above code has been tested with a 1x1 input and (newH,newW) result correcty as (1,1).
-		tPrintfFull("Rotate | Crop[w:%d h:%d anc:mm]\n", newW, newH);
-		image.Crop(newW, newH, tImage::tPicture::Anchor::MiddleMiddle);
-	}
+	image.Rotate(Angle, FillColour, FilterUp, fit);
+	return true;
+}
 
-	if (Mode == RotateMode::Resize)
-	{
-		// The crop is done. Now resample. We use nearest neighbour if no up-filter specified so as to preserve colours.
-		tImage::tResampleFilter filter = (FilterUp != tImage::tResampleFilter::None) ? FilterUp : tImage::tResampleFilter::Nearest;
 
-		tPrintfFull("Rotate | Resample[w:%d h:%d filt:%s edge:clamp]\n", origW, origH, tImage::tResampleFilterNamesSimple[int(filter)]);
-		image.Resample(origW, origH, filter, tImage::tResampleEdgeMode::Clamp);
-	}
+bool Command::OperationRotate::Compose(GeometryChain& chain) const
+{
+	tAssert(Valid);
 
-	return true;
+	// Only the zero rotation can be part of a fused chain. It does nothing so it doesn't break the chain either.
+	// All other rotations either transpose or resample about the centre and are applied normally.
+	return (Exact == ExactMode::Zero);
 }
 
 
@@ -1034,9 +1224,17 @@ bool Command::OperationLevels::Apply(Viewer::Image& image)
 		PowerMidGamma, chanStr.Chr(), allFrames
 	);
 
-	image.AdjustmentBegin();
-	image.AdjustLevels(BlackPoint, MidPoint, WhitePoint, OutBlackPoint, OutWhitePoint, PowerMidGamma, Channels, allFrames);
-	image.AdjustmentEnd();
+	Viewer::Image::Adjustment adj;
+	adj.Typ				= Viewer::Image::Adjustment::Type::Levels;
+	adj.Channels		= Channels;
+	adj.AllFrames		= allFrames;
+	adj.BlackPoint		= BlackPoint;
+	adj.MidPoint		= MidPoint;
+	adj.WhitePoint		= WhitePoint;
+	adj.BlackOut		= OutBlackPoint;
+	adj.WhiteOut		= OutWhitePoint;
+	adj.PowerMidGamma	= PowerMidGamma;
+	image.ApplyAdjustment(adj);
 
 	image.FrameNum = origFrameNum;
 	return true;
@@ -1139,9 +1337,12 @@ bool Command::OperationContrast::Apply(Viewer::Image& image)
 		Contrast, chanStr.Chr(), allFrames
 	);
 
-	image.AdjustmentBegin();
-	image.AdjustContrast(Contrast, Channels, allFrames);
-	image.AdjustmentEnd();
+	Viewer::Image::Adjustment adj;
+	adj.Typ				= Viewer::Image::Adjustment::Type::Contrast;
+	adj.Channels		= Channels;
+	adj.AllFrames		= allFrames;
+	adj.Contrast		= Contrast;
+	image.ApplyAdjustment(adj);
 
 	image.FrameNum = origFrameNum;
 	return true;
@@ -1244,9 +1445,12 @@ bool Command::OperationBrightness::Apply(Viewer::Image& image)
 		Brightness, chanStr.Chr(), allFrames
 	);
 
-	image.AdjustmentBegin();
-	image.AdjustBrightness(Brightness, Channels, allFrames);
-	image.AdjustmentEnd();
+	Viewer::Image::Adjustment adj;
+	adj.Typ				= Viewer::Image::Adjustment::Type::Brightness;
+	adj.Channels		= Channels;
+	adj.AllFrames		= allFrames;
+	adj.Brightness		= Brightness;
+	image.ApplyAdjustment(adj);
 
 	image.FrameNum = origFrameNum;
 	return true;
@@ -1346,6 +1550,13 @@ Command::OperationQuantize::OperationQuantize(const tString& argsStr)
 		}
 	}
 
+	// Shared.
+	if (numArgs >= 6)
+	{
+		currArg = currArg->Next();
+		Shared = (*currArg == "*") ? false : currArg->AsBool();
+	}
+
 	Valid = true;
 }
 
@@ -1354,6 +1565,14 @@ bool Command::OperationQuantize::Apply(Viewer::Image& image)
 {
 	tAssert(Valid);
 
+	if (Shared && (image.GetNumFrames() > 1))
+	{
+		int sampleFactor = (Method == tImage::tQuantize::Method::Neu) ? SampFilt : 1;
+		tPrintfFull("Quantize | QuantizeShared[frames:%d numcolours:%d exact:%B]\n", image.GetNumFrames(), NumColours, CheckExact);
+		image.QuantizeShared(Method, NumColours, CheckExact, sampleFactor);
+		return true;
+	}
+
 	switch (Method)
 	{
 		case tImage::tQuantize::Method::Fixed:
@@ -1615,33 +1834,43 @@ bool Command::OperationExtract::Apply(Viewer::Image& image)
 	if (baseName.IsEmpty())
 		baseName = tSystem::tGetFileBaseName(image.Filename);
 
-	// Iterate through the output types saving as we go.
+	// Iterate through the output types saving as we go. The overwrite checks are done up front and the frames are
+	// then encoded in parallel. The image is only read while the frames are saved.
 	for (tSystem::tFileTypes::tFileTypeItem* typeItem = Command::OutTypes.First(); typeItem; typeItem = typeItem->Next())
 	{
 		tSystem::tFileType outType = typeItem->FileType;
 		Command::SetImageSaveParameters(image, outType);
+
+		std::vector<int> frames;
 		for (int frameNum = 0; frameNum < image.GetNumFrames(); frameNum++)
 		{
 			if (!FrameSet.Contains(frameNum))
 				continue;
 
-			// This sets the current frame so that when the image is saved, this frame is used.
-			image.FrameNum = frameNum;
-
 			tString outFile = Viewer::GetFrameFilename(frameNum, destDir, baseName, outType);
-			tString outFileShort = tSystem::tGetFileName(outFile);
 			if (!Command::OptionOverwrite && tSystem::tFileExists(outFile))
 			{
-				tPrintfFull("Extract | File %s%s exists. Not overwriting.\n", subDir.Chr(), outFileShort.Chr());
+				tPrintfFull("Extract | File %s%s exists. Not overwriting.\n", subDir.Chr(), tSystem::tGetFileName(outFile).Chr());
 				continue;
 			}
-
-			bool useConfigSaveParams = false;
-			bool onlyCurrentPic = true;
-
-			tPrintfFull("Extract | Save[file:%s%s]\n", subDir.Chr(), outFileShort.Chr());
-			image.Save(outFile, outType, useConfigSaveParams, onlyCurrentPic);
+			frames.push_back(frameNum);
 		}
+
+		Viewer::FrameExtractor extractor;
+		extractor.Start
+		(
+			frames,
+			[&image, &destDir, &baseName, &subDir, outType](int frameNum) -> bool
+			{
+				tString outFile = Viewer::GetFrameFilename(frameNum, destDir, baseName, outType);
+				tPrintfFull("Extract | Save[file:%s%s]\n", subDir.Chr(), tSystem::tGetFileName(outFile).Chr());
+				bool useConfigSaveParams = false;
+				return image.SaveFrame(outFile, outType, frameNum, useConfigSaveParams);
+			}
+		);
+		extractor.Wait();
+		if (extractor.GetNumFailed() > 0)
+			tPrintfNorm("Extract | Failed to save %d of %d frames.\n", extractor.GetNumFailed(), extractor.GetNumFrames());
 	}
 
 	return true;
@@ -1811,12 +2040,13 @@ bool Command::PostOperationCombine::Apply(tList<Viewer::Image>& images)
 		img->Unload();
 	}
 
-	// Now we loop through all the out types.
+	// Now we loop through all the out types. The tImage encoders need the complete frame list, so the best we can do
+	// for memory is to let the final out type steal the frames rather than copy them.
 	bool somethingFailed = false;
-	bool allowStealFrames = (OutTypes.Count() == 1);
 	for (tSystem::tFileTypes::tFileTypeItem* typeItem = OutTypes.First(); typeItem; typeItem = typeItem->Next())
 	{
 		tSystem::tFileType outType = typeItem->FileType;
+		bool allowStealFrames = (typeItem->Next() == nullptr);
 
 		// Determine the output filename.
 		tString extension = tSystem::tGetExtension(outType);
@@ -2047,67 +2277,50 @@ bool Command::PostOperationContact::Apply(tList<Viewer::Image>& images)
 		return false;
 	}
 
-	// Create the output picture. We only need to do this once rather than for every out type.
-	int contactWidth = frameWidth*cols;
-	int contactHeight = frameHeight*rows;
-	tImage::tPicture outPic(contactWidth, contactHeight);
-	outPic.SetAll(FillColour);
+	// Create the output picture. We only need to do this once rather than for every out type. The first image was
+	// only needed for its dimensions. The shared contact sheet engine loads and releases each source as it's placed.
+	firstImage->Unload();
+	Viewer::ContactSheetParams params;
+	params.NumCols				= cols;
+	params.NumRows				= rows;
+	params.FrameWidth			= frameWidth;
+	params.FrameHeight			= frameHeight;
+	params.FillColour			= FillColour;
+	params.ResampleFrames		= false;
+	params.SkipFailedLoads		= false;
+	params.LoadParamsFromConfig	= false;
+
+	// When TGA is the only output type the sheet is composed a band at a time and streamed to disk so it never needs
+	// the whole sheet in memory. Every other type needs a complete picture for its encoder. If one of them was
+	// requested the sheet is composed once and all types, TGA included, are saved from that picture.
+	bool streamTGA = true;
+	for (tSystem::tFileTypes::tFileTypeItem* typeItem = OutTypes.First(); typeItem; typeItem = typeItem->Next())
+		if (typeItem->FileType != tSystem::tFileType::TGA)
+			streamTGA = false;
 
-	int ix = 0;
-	int iy = 0;
-	int frame = 0;
-	for (Viewer::Image* img = images.First(); img; img = img->Next(), frame++)
+	tImage::tPicture outPic;
+	if (!streamTGA)
 	{
-		if (!img->IsLoaded())
-			img->Load();
-
-		tPrintfFull("Processing frame %d : %s at (%d, %d).\n", frame, img->Filename.Chr(), ix, iy);
-		if ((img->GetWidth() != frameWidth) || (img->GetHeight() != frameHeight))
+		Viewer::ContactResult result = Viewer::ComposeContactSheet(outPic, images, params);
+		if (result != Viewer::ContactResult::Success)
 		{
-			img->Unload();
-			tPrintfNorm("Contact | All input images must be same size.\n");
+			tPrintfNorm("Contact | %s.\n", Viewer::GetContactResultDesc(result));
 			return false;
 		}
 
-		tImage::tPicture* currPic = img->GetCurrentPic();
-
-		// Copy resampled frame into place.
-		for (int y = 0; y < frameHeight; y++)
-		{
-			for (int x = 0; x < frameWidth; x++)
-			{
-				outPic.SetPixel
-				(
-					x + (ix*frameWidth),
-					y + ((rows-1-iy)*frameHeight),
-					currPic->GetPixel(x, y)
-				);
-			}
-		}
-
-		img->Unload();
-		ix++;
-		if (ix >= cols)
+		if (!outPic.IsValid())
 		{
-			ix = 0;
-			iy++;
-			if (iy >= rows)
-				break;
+			tPrintfNorm("Contact | Error generating output picture.\n");
+			return false;
 		}
 	}
 
-	if (!outPic.IsValid())
-	{
-		tPrintfNorm("Contact | Error generating output picture.\n");
-		return false;
-	}
-
-	// Now we iterate all the outtypes.
+	// Now we iterate all the outtypes. The last one is allowed to steal the output picture.
 	bool somethingFailed = false;
-	bool allowStealFrames = (OutTypes.Count() == 1);
 	for (tSystem::tFileTypes::tFileTypeItem* typeItem = OutTypes.First(); typeItem; typeItem = typeItem->Next())
 	{
 		tSystem::tFileType outType = typeItem->FileType;
+		bool allowStealFrames = (typeItem->Next() == nullptr);
 
 		// Determine the output filename.
 		tString extension = tSystem::tGetExtension(outType);
@@ -2145,6 +2358,15 @@ bool Command::PostOperationContact::Apply(tList<Viewer::Image>& images)
 		{
 			case tSystem::tFileType::TGA:
 			{
+				if (streamTGA)
+				{
+					Viewer::ContactResult result = Viewer::SaveContactSheetStreamedTGA(outFile, images, params, SaveParamsTGA.Format, SaveParamsTGA.Compression);
+					if (result != Viewer::ContactResult::Success)
+						tPrintfNorm("Contact | %s.\n", Viewer::GetContactResultDesc(result));
+					success = (result == Viewer::ContactResult::Success);
+					break;
+				}
+
 				tImage::tImageTGA tga(outPic, allowStealFrames);
 				tImage::tImageTGA::tFormat savedFmt = tga.Save(outFile, SaveParamsTGA);
 				success = (savedFmt != tImage::tImageTGA::tFormat::Invalid);
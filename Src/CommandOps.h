@@ -25,10 +25,44 @@ namespace Command
 {
 
 
+// Geometric operations (resize, crop, canvas, aspect) that appear back to back are composed into a single
+// source-to-destination mapping and executed as one resample with one output allocation per picture. The chain tracks
+// a source window, the size it is scaled to, and where it is placed in the output. Coordinates have the origin at the
+// bottom-left, the same as tPicture. A step that cannot be composed exactly leaves the chain unmodified and returns
+// false, in which case the operation is applied normally.
+struct GeometryChain
+{
+	bool Begin(const Viewer::Image&);					// Returns false if the image is not loaded or has mixed picture sizes.
+	int GetWidth() const								{ return OutW; }
+	int GetHeight() const								{ return OutH; }
+	bool Crop(int newW, int newH, int originX, int originY, const tColour4b& fill);
+	bool Crop(int newW, int newH, tImage::tPicture::Anchor, const tColour4b& fill);
+	bool Resample(int newW, int newH, tImage::tResampleFilter, tImage::tResampleEdgeMode);
+	bool Apply(Viewer::Image&) const;
+
+	int SrcX = 0, SrcY = 0, SrcW = 0, SrcH = 0;			// Source window. Always inside the source picture.
+	int ScaledW = 0, ScaledH = 0;						// The size the source window is resampled to.
+	int PlaceX = 0, PlaceY = 0;							// Where the scaled window lands in the output.
+	int OutW = 0, OutH = 0;
+	bool Padded											= false;	// True if some output pixels are fill.
+	tColour4b FillColour								= tColour4b::black;
+	tImage::tResampleFilter Filter						= tImage::tResampleFilter::Bilinear;
+	tImage::tResampleEdgeMode EdgeMode					= tImage::tResampleEdgeMode::Clamp;
+};
+
+
 // Normal operations that are applied to single images.
 struct Operation : public tLink<Operation>
 {
 	virtual bool Apply(Viewer::Image&)					= 0;
+
+	// Geometric operations override this to add themselves to a chain. Returns false if the operation can't be fused.
+	virtual bool Compose(GeometryChain&) const			{ return false; }
+
+	// Operations that save files using the command's global output types and save parameters return true. Recipes
+	// containing them run one at a time with the recipe's output settings installed globally.
+	virtual bool UsesGlobalOutput() const				{ return false; }
+	virtual const char* GetName() const					= 0;
 	virtual ~Operation()								{ }
 	bool Valid											= false;
 };
@@ -43,6 +77,7 @@ struct OperationPixel : public Operation
 	comp_t Channels										= tCompBit_RGBA;							// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "pixel"; }
 };
 
 
@@ -55,6 +90,11 @@ struct OperationResize : public Operation
 	tImage::tResampleEdgeMode EdgeMode					= tImage::tResampleEdgeMode::Clamp;			// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "resize"; }
+	bool Compose(GeometryChain&) const override;
+
+private:
+	void ComputeDims(int& dstW, int& dstH, int srcW, int srcH) const;
 };
 
 
@@ -69,6 +109,11 @@ struct OperationCanvas : public Operation
 	int AnchorY											= -1;										// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "canvas"; }
+	bool Compose(GeometryChain&) const override;
+
+private:
+	void ComputeDims(int& dstW, int& dstH, int srcW, int srcH) const;
 };
 
 
@@ -85,6 +130,11 @@ struct OperationAspect : public Operation
 	int AnchorY											= -1;										// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "aspect"; }
+	bool Compose(GeometryChain&) const override;
+
+private:
+	void ComputeDims(int& dstW, int& dstH, int srcW, int srcH) const;
 };
 
 
@@ -96,6 +146,7 @@ struct OperationDeborder : public Operation
 	comp_t Channels										= tCompBit_RGBA;								// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "deborder"; }
 };
 
 
@@ -111,6 +162,8 @@ struct OperationCrop : public Operation
 	tColour4b FillColour								= tColour4b::transparent;					// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "crop"; }
+	bool Compose(GeometryChain&) const override;
 };
 
 
@@ -121,6 +174,7 @@ struct OperationFlip : public Operation
 	FlipMode Mode										= FlipMode::Horizontal;						// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "flip"; }
 };
 
 
@@ -135,15 +189,16 @@ struct OperationRotate : public Operation
 	enum class RotateMode { Fill, Crop, Resize };
 	RotateMode Mode										= RotateMode::Crop;							// Optional.
 
-	// UpFilter		DownFilter		Description
-	// None			NA				No up/down scaling. Preserves colours. Nearest Neighbour. Fast. Good for pixel art.
-	// Valid		Valid			Up/down scaling. Smooth. Good results with up=bilinear, down=box.
-	// Valid		None			Up/down scaling. Use alternate (sharper) downscaling scheme (possibe pad + 2X ScaleHalf).
+	// FilterUp chooses the sampling kernel. None or Nearest preserves colours and is good for pixel art. Box and
+	// Bilinear sample bilinearly and the remaining filters use a bicubic. The rotation samples the source directly at
+	// 1:1 so there is no down-sampling step. FilterDown is still parsed so existing command lines keep working.
 	tImage::tResampleFilter FilterUp					= tImage::tResampleFilter::Bilinear;		// Optional.
-	tImage::tResampleFilter FilterDown					= tImage::tResampleFilter::None;			// Optional.
+	tImage::tResampleFilter FilterDown					= tImage::tResampleFilter::None;			// Optional. Unused.
 	tColour4b FillColour								= tColour4b::black;							// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "rotate"; }
+	bool Compose(GeometryChain&) const override;
 };
 
 
@@ -160,6 +215,7 @@ struct OperationLevels : public Operation
 	bool PowerMidGamma									= true;
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "levels"; }
 };
 
 
@@ -171,6 +227,7 @@ struct OperationContrast : public Operation
 	Viewer::Image::AdjChan Channels						= Viewer::Image::AdjChan::RGB;
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "contrast"; }
 };
 
 
@@ -182,6 +239,7 @@ struct OperationBrightness : public Operation
 	Viewer::Image::AdjChan Channels						= Viewer::Image::AdjChan::RGB;
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "brightness"; }
 };
 
 
@@ -193,8 +251,10 @@ struct OperationQuantize : public Operation
 	bool CheckExact										= true;							// Optional.
 	int SampFilt										= 0;							// Optional. 0 is invalid.
 	double Dither										= 0.0;							// Optional, 0.0 is auto.
+	bool Shared											= false;						// Optional. One palette for all frames.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "quantize"; }
 };
 
 
@@ -222,6 +282,7 @@ struct OperationChannel : public Operation
 	tColour4b Colour									= tColour4b::black;				// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "channel"; }
 };
 
 
@@ -235,6 +296,7 @@ struct OperationSwizzle : public Operation
 	tComp SwizzleA										= tComp::A;						// Optional.
 
 	bool Apply(Viewer::Image&) override;
+	const char* GetName() const override				{ return "swizzle"; }
 
 private:
 	tComp CharToComp(char);
@@ -250,6 +312,8 @@ struct OperationExtract : public Operation
 	tString BaseName;
 
 	bool Apply(Viewer::Image&) override;
+	bool UsesGlobalOutput() const override				{ return true; }
+	const char* GetName() const override				{ return "extract"; }
 };
 
 
@@ -0,0 +1,376 @@
+// CommandStats.cpp
+//
+// Performance statistics for command line runs. When --stats is specified the CLI records wall and CPU time for every
+// load, operation, save, and post-operation, along with bytes read and written. A summary table is printed and a JSON
+// report is written when processing ends.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifdef PLATFORM_WINDOWS
+#include <windows.h>
+#include <psapi.h>
+#include <process.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#include <chrono>
+#include <mutex>
+#include <Foundation/tList.h>
+#include <System/tPrint.h>
+#include <System/tFile.h>
+#include <System/tMachine.h>
+#include "CommandStats.h"
+
+
+namespace Command
+{
+	struct StageRecord : public tLink<StageRecord>
+	{
+		tString Stage;
+		tString Name;
+		double WallSeconds					= 0.0;
+		double CPUSeconds					= 0.0;
+		uint64 BytesRead					= 0;
+		uint64 BytesWritten					= 0;
+		int Count							= 0;
+	};
+
+	struct ImageRecord : public tLink<ImageRecord>
+	{
+		tString Filename;
+		tList<StageRecord> Stages;
+	};
+
+	double GetWallTime();
+	double GetCPUTime();
+	StageRecord* FindTotal(const tString& stage, const tString& name);
+	tString JsonEscape(const tString&);
+	template<typename... Args> void Appendf(tString& dest, const char* format, Args... args);
+
+	bool StatsActive						= false;
+	StatsTimer* StatsRunTimer				= nullptr;
+	tList<ImageRecord> StatsImages;
+	tList<StageRecord> StatsTotals;										// One per distinct stage/name pair.
+	tList<StageRecord> StatsPost;										// Post-operations aren't attributed to an image.
+	ImageRecord* StatsCurrImage				= nullptr;
+	int StatsNumImages						= 0;
+	std::mutex StatsMutex;												// Guards the record lists in StatsRecord.
+}
+
+
+double Command::GetWallTime()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+
+double Command::GetCPUTime()
+{
+	#ifdef PLATFORM_WINDOWS
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+		return 0.0;
+	uint64 k = (uint64(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+	uint64 u = (uint64(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+	return double(k + u) / 10000000.0;
+
+	#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0.0;
+	return
+		double(usage.ru_utime.tv_sec) + double(usage.ru_utime.tv_usec)/1000000.0 +
+		double(usage.ru_stime.tv_sec) + double(usage.ru_stime.tv_usec)/1000000.0;
+	#endif
+}
+
+
+uint64 Command::GetPeakResidentBytes()
+{
+	#ifdef PLATFORM_WINDOWS
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return uint64(counters.PeakWorkingSetSize);
+
+	#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	#ifdef PLATFORM_MACOS
+	return uint64(usage.ru_maxrss);
+	#else
+	return uint64(usage.ru_maxrss) * 1024;		// Linux reports kilobytes.
+	#endif
+	#endif
+}
+
+
+tString Command::CreateScratchDir(const char* tag)
+{
+	tString dir;
+	#ifdef PLATFORM_WINDOWS
+	dir = tSystem::tGetEnvVar("TEMP");
+	int pid = _getpid();
+	#else
+	dir = tSystem::tGetEnvVar("TMPDIR");
+	if (dir.IsEmpty())
+		dir = "/tmp";
+	int pid = getpid();
+	#endif
+	dir.Replace('\\', '/');
+	if (dir.IsEmpty())
+		return tString();
+	if (dir[dir.Length()-1] != '/')
+		dir += "/";
+
+	// A directory left behind by an earlier run with the same pid is skipped rather than reused.
+	for (int attempt = 0; attempt < 100; attempt++)
+	{
+		tString scratch;
+		tsPrintf(scratch, "%stacentview_%s_%d_%d/", dir.Chr(), tag, pid, attempt);
+		if (tSystem::tDirExists(scratch))
+			continue;
+		return tSystem::tCreateDir(scratch) ? scratch : tString();
+	}
+	return tString();
+}
+
+
+Command::StatsTimer::StatsTimer() :
+	StartWall(GetWallTime()),
+	StartCPU(GetCPUTime())
+{
+}
+
+
+double Command::StatsTimer::GetWallSeconds() const
+{
+	return GetWallTime() - StartWall;
+}
+
+
+double Command::StatsTimer::GetCPUSeconds() const
+{
+	return GetCPUTime() - StartCPU;
+}
+
+
+void Command::StatsBegin()
+{
+	StatsActive = true;
+	delete StatsRunTimer;
+	StatsRunTimer = new StatsTimer();
+	StatsImages.Empty();
+	StatsTotals.Empty();
+	StatsPost.Empty();
+	StatsCurrImage = nullptr;
+	StatsNumImages = 0;
+}
+
+
+bool Command::StatsEnabled()
+{
+	return StatsActive;
+}
+
+
+void Command::StatsBeginImage(const tString& filename)
+{
+	if (!StatsActive)
+		return;
+
+	StatsCurrImage = new ImageRecord;
+	StatsCurrImage->Filename = filename;
+	StatsImages.Append(StatsCurrImage);
+	StatsNumImages++;
+}
+
+
+void Command::StatsRecord(const char* stage, const char* name, const StatsTimer& timer, uint64 bytesRead, uint64 bytesWritten)
+{
+	if (!StatsActive)
+		return;
+
+	StageRecord* record = new StageRecord;
+	record->Stage			= stage;
+	record->Name			= name;
+	record->WallSeconds		= timer.GetWallSeconds();
+	record->CPUSeconds		= timer.GetCPUSeconds();
+	record->BytesRead		= bytesRead;
+	record->BytesWritten	= bytesWritten;
+	record->Count			= 1;
+
+	// Recipes may run on several threads at once.
+	std::lock_guard<std::mutex> lock(StatsMutex);
+	StageRecord* total = FindTotal(record->Stage, record->Name);
+	total->WallSeconds		+= record->WallSeconds;
+	total->CPUSeconds		+= record->CPUSeconds;
+	total->BytesRead		+= record->BytesRead;
+	total->BytesWritten		+= record->BytesWritten;
+	total->Count++;
+
+	if (StatsCurrImage)
+		StatsCurrImage->Stages.Append(record);
+	else
+		StatsPost.Append(record);
+}
+
+
+void Command::StatsEndImage()
+{
+	StatsCurrImage = nullptr;
+}
+
+
+Command::StageRecord* Command::FindTotal(const tString& stage, const tString& name)
+{
+	// There are only ever a handful of distinct stages so a linear search is fine.
+	for (StageRecord* total = StatsTotals.First(); total; total = total->Next())
+		if ((total->Stage == stage) && (total->Name == name))
+			return total;
+
+	StageRecord* total = new StageRecord;
+	total->Stage = stage;
+	total->Name = name;
+	StatsTotals.Append(total);
+	return total;
+}
+
+
+tString Command::JsonEscape(const tString& str)
+{
+	tString escaped;
+	for (const char* c = str.Chr(); c && *c; c++)
+	{
+		switch (*c)
+		{
+			case '"':	escaped += "\\\"";	break;
+			case '\\':	escaped += "\\\\";	break;
+			case '\n':	escaped += "\\n";	break;
+			case '\t':	escaped += "\\t";	break;
+			default:
+			{
+				char chr[2] = { *c, '\0' };
+				escaped += chr;
+				break;
+			}
+		}
+	}
+	return escaped;
+}
+
+
+template<typename... Args> void Command::Appendf(tString& dest, const char* format, Args... args)
+{
+	tString str;
+	tsPrintf(str, format, args...);
+	dest += str;
+}
+
+
+void Command::StatsReport(const tString& jsonFile)
+{
+	if (!StatsActive)
+		return;
+
+	double runWall = StatsRunTimer ? StatsRunTimer->GetWallSeconds() : 0.0;
+	double runCPU = StatsRunTimer ? StatsRunTimer->GetCPUSeconds() : 0.0;
+	uint64 peakRSS = GetPeakResidentBytes();
+	double imagesPerSecond = (runWall > 0.0) ? double(StatsNumImages) / runWall : 0.0;
+	uint64 totalRead = 0;
+	uint64 totalWritten = 0;
+	for (StageRecord* total = StatsTotals.First(); total; total = total->Next())
+	{
+		totalRead += total->BytesRead;
+		totalWritten += total->BytesWritten;
+	}
+
+	// The summary table always prints since it was explicitly asked for.
+	tPrintf("\nSTATISTICS\n");
+	tPrintf("%-8s %-12s %6s %12s %12s %14s %14s\n", "Stage", "Name", "Count", "Wall(s)", "CPU(s)", "Read(B)", "Written(B)");
+	for (StageRecord* t = StatsTotals.First(); t; t = t->Next())
+	{
+		tPrintf
+		(
+			"%-8s %-12s %6d %12.4f %12.4f %14|64d %14|64d\n",
+			t->Stage.Chr(), t->Name.Chr(), t->Count, t->WallSeconds, t->CPUSeconds,
+			t->BytesRead, t->BytesWritten
+		);
+	}
+	tPrintf("Images: %d  Wall: %.4fs  CPU: %.4fs  Images/s: %.3f\n", StatsNumImages, runWall, runCPU, imagesPerSecond);
+	tPrintf("Read: %|64d B  Written: %|64d B  Peak RSS: %|64d B\n", totalRead, totalWritten, peakRSS);
+
+	auto appendStage = [](tString& json, const StageRecord* r, const char* indent, bool last)
+	{
+		Appendf
+		(
+			json, "%s{ \"stage\": \"%s\", \"name\": \"%s\", \"count\": %d, \"wall\": %.6f, \"cpu\": %.6f, \"bytesRead\": %|64d, \"bytesWritten\": %|64d }%s\n",
+			indent, r->Stage.Chr(), r->Name.Chr(), r->Count, r->WallSeconds, r->CPUSeconds,
+			r->BytesRead, r->BytesWritten, last ? "" : ","
+		);
+	};
+
+	tString json;
+	json += "{\n";
+	Appendf(json, "\t\"images\": %d,\n", StatsNumImages);
+	Appendf(json, "\t\"wall\": %.6f,\n", runWall);
+	Appendf(json, "\t\"cpu\": %.6f,\n", runCPU);
+	Appendf(json, "\t\"imagesPerSecond\": %.6f,\n", imagesPerSecond);
+	Appendf(json, "\t\"bytesRead\": %|64d,\n", totalRead);
+	Appendf(json, "\t\"bytesWritten\": %|64d,\n", totalWritten);
+	Appendf(json, "\t\"peakRSS\": %|64d,\n", peakRSS);
+
+	json += "\t\"totals\":\n\t[\n";
+	for (StageRecord* t = StatsTotals.First(); t; t = t->Next())
+		appendStage(json, t, "\t\t", !t->Next());
+	json += "\t],\n";
+
+	json += "\t\"perImage\":\n\t[\n";
+	for (ImageRecord* img = StatsImages.First(); img; img = img->Next())
+	{
+		Appendf(json, "\t\t{\n\t\t\t\"file\": \"%s\",\n\t\t\t\"stages\":\n\t\t\t[\n", JsonEscape(img->Filename).Chr());
+		for (StageRecord* r = img->Stages.First(); r; r = r->Next())
+			appendStage(json, r, "\t\t\t\t", !r->Next());
+		Appendf(json, "\t\t\t]\n\t\t}%s\n", img->Next() ? "," : "");
+	}
+	json += "\t],\n";
+
+	json += "\t\"post\":\n\t[\n";
+	for (StageRecord* r = StatsPost.First(); r; r = r->Next())
+		appendStage(json, r, "\t\t", !r->Next());
+	json += "\t]\n}\n";
+
+	if (jsonFile.IsEmpty() || (jsonFile == "*"))
+	{
+		tPrintf("%s", json.Chr());
+	}
+	else
+	{
+		tSystem::tFileHandle file = tSystem::tOpenFile(jsonFile.Chr(), "wb");
+		if (file)
+		{
+			tSystem::tWriteFile(file, json.Chr(), json.Length());
+			tSystem::tCloseFile(file);
+			tPrintf("Stats JSON: %s\n", jsonFile.Chr());
+		}
+		else
+		{
+			tPrintf("Warning: Could not write stats file %s\n", jsonFile.Chr());
+		}
+	}
+
+	StatsActive = false;
+	delete StatsRunTimer;
+	StatsRunTimer = nullptr;
+}
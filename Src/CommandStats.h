@@ -0,0 +1,56 @@
+// CommandStats.h
+//
+// Performance statistics for command line runs. When --stats is specified the CLI records wall and CPU time for every
+// load, operation, save, and post-operation, along with bytes read and written. A summary table is printed and a JSON
+// report is written when processing ends.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <Foundation/tString.h>
+
+
+namespace Command
+{
+	// Captures the wall and process CPU time at construction. CPU time is for the whole process so work done on
+	// helper threads during a stage is included.
+	struct StatsTimer
+	{
+		StatsTimer();
+		double GetWallSeconds() const;
+		double GetCPUSeconds() const;
+
+	private:
+		double StartWall;
+		double StartCPU;
+	};
+
+	// All the Stats calls do nothing unless StatsBegin has been called.
+	void StatsBegin();
+	bool StatsEnabled();
+
+	// Stage is one of "load", "op", "save", or "post". Name identifies the operation or file type within the stage.
+	// Records made between StatsBeginImage and StatsEndImage are attributed to that image.
+	void StatsBeginImage(const tString& filename);
+	void StatsRecord(const char* stage, const char* name, const StatsTimer&, uint64 bytesRead = 0, uint64 bytesWritten = 0);
+	void StatsEndImage();
+
+	// Prints the summary table and writes the JSON report. If jsonFile is empty or "*" the JSON is printed instead.
+	void StatsReport(const tString& jsonFile);
+
+	// Peak resident set size (working set on Windows) of the process in bytes. Returns 0 if not available.
+	uint64 GetPeakResidentBytes();
+
+	// Creates a new empty directory in the system temp directory, named from the tag and process id, and returns its
+	// path with a trailing slash. Never returns an existing directory, so the caller owns everything in it and may
+	// delete it when done. Returns an empty string on failure.
+	tString CreateScratchDir(const char* tag);
+}
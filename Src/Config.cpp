@@ -30,6 +30,7 @@
 #include "Config.h"
 #include "Image.h"
 #include "FileDialog.h"
+#include "CostModel.h"
 using namespace tMath;
 #define ReadItem(name) case tHash::tHashCT(#name): name = e.Arg1(); break
 #define	WriteItem(name) writer.Comp(#name, name)
@@ -132,6 +133,11 @@ void Config::Save(const tString& filename)
 
 	// Save the file dialog settings.
 	tFileDialog::Save(writer, "FileDialog");
+	writer.CR();
+	writer.CR();
+
+	// Save the machine cost model so the calibration only runs once.
+	CostModel::Save(writer);
 }
 
 
@@ -143,6 +149,7 @@ void Config::Load(const tString& filename)
 		ResetAllProfiles();
 		Current = &MainProfile;
 		tFileDialog::Reset();
+		CostModel::Reset();
 		return;
 	}
 
@@ -152,6 +159,7 @@ void Config::Load(const tString& filename)
 	bool loadedKioskProfile	= false;
 	bool loadedAltProfile	= false;
 	bool loadedFileDialog	= false;
+	bool loadedCostModel	= false;
 	tExprReader reader(filename);
 	for (tExpr e = reader.First(); e.IsValid(); e = e.Next())
 	{
@@ -186,6 +194,11 @@ void Config::Load(const tString& filename)
 				tFileDialog::Load(e, "FileDialog");
 				loadedFileDialog = true;
 				break;
+
+			case tHash::tHashCT("CostModel"):
+				CostModel::Load(e);
+				loadedCostModel = true;
+				break;
 		}
 	}
 
@@ -210,6 +223,9 @@ void Config::Load(const tString& filename)
 	if (!loadedFileDialog)
 		tFileDialog::Reset();
 
+	if (!loadedCostModel)
+		CostModel::Reset();
+
 	// At this point the cfg file exists and has been loaded. However, even without a version number increase we want
 	// to be able to support new operations than may have been added and have the key-bindings assigned. This is
 	// possible in a generic way if the new operations bindings do not conflict with user-specified bindings. That is,
@@ -461,11 +477,15 @@ void Config::ProfileData::Reset(Viewer::Profile profile, uint32 categories)
 	if (categories & Category_System)
 	{
 		MaxImageMemMB				= 2048;
+		MaxFrameTexMemMB			= 1024;
 		MaxCacheFiles				= 8192;
 		MaxUndoSteps				= 16;
+		MaxUndoMemMB				= 512;
+		MaxUndoTotalMemMB			= 2048;
 		StrictLoading				= false;
 		MetaDataOrientLoading		= true;
 		DetectAPNGInsidePNG			= true;
+		RetainHDRSource				= true;
 		MipmapFilter				= int(tImage::tResampleFilter::Bilinear);
 		MipmapChaining				= true;
 		MonitorGamma				= tMath::DefaultGamma;
@@ -631,11 +651,15 @@ void Config::ProfileData::Load(tExpression expr)
 			ReadItem(ResizeAspectUserDen);
 			ReadItem(ResizeAspectMode);
 			ReadItem(MaxImageMemMB);
+			ReadItem(MaxFrameTexMemMB);
 			ReadItem(MaxCacheFiles);
 			ReadItem(MaxUndoSteps);
+			ReadItem(MaxUndoMemMB);
+			ReadItem(MaxUndoTotalMemMB);
 			ReadItem(StrictLoading);
 			ReadItem(MetaDataOrientLoading);
 			ReadItem(DetectAPNGInsidePNG);
+			ReadItem(RetainHDRSource);
 			ReadItem(MipmapFilter);
 			ReadItem(MipmapChaining);
 			ReadItem(AutoPropertyWindow);
@@ -677,8 +701,11 @@ void Config::ProfileData::Load(tExpression expr)
 	tiClamp		(ResizeAspectUserDen, 1, 99);
 	tiClamp		(ResizeAspectMode, 0, 1);
 	tiClampMin	(MaxImageMemMB, 256);
+	tiClampMin	(MaxFrameTexMemMB, 64);
 	tiClampMin	(MaxCacheFiles, 200);	
 	tiClamp		(MaxUndoSteps, 1, 32);
+	tiClampMin	(MaxUndoMemMB, 16);
+	tiClampMin	(MaxUndoTotalMemMB, 16);
 	tiClamp		(MipmapFilter, 0, int(tImage::tResampleFilter::NumFilters));						// None allowed.
 
 	tiClamp		(SaveAllSizeMode, 0, int(SizeModeEnum::NumModes)-1);
@@ -831,11 +858,15 @@ bool Config::ProfileData::Save(tExprWriter& writer) const
 	WriteItem(ResizeAspectUserDen);
 	WriteItem(ResizeAspectMode);
 	WriteItem(MaxImageMemMB);
+	WriteItem(MaxFrameTexMemMB);
 	WriteItem(MaxCacheFiles);
 	WriteItem(MaxUndoSteps);
+	WriteItem(MaxUndoMemMB);
+	WriteItem(MaxUndoTotalMemMB);
 	WriteItem(StrictLoading);
 	WriteItem(MetaDataOrientLoading);
 	WriteItem(DetectAPNGInsidePNG);
+	WriteItem(RetainHDRSource);
 	WriteItem(MipmapFilter);
 	WriteItem(MipmapChaining);
 	WriteItem(AutoPropertyWindow);
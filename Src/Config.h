@@ -180,7 +180,7 @@ struct ProfileData
 	int ResampleFilterContactFinal;							// Matches tImage::tResampleFilter. Used for contact sheet final resizing.
 	int ResampleEdgeModeContactFinal;						// Matches tImage::tResampleEdgeMode. Used for contact sheet final resizing.
 	int ResampleFilterRotateUp;								// Matches tImage::tResampleFilter. Used for image rotations.
-	int ResampleFilterRotateDown;							// Matches tImage::tResampleFilter. Used for image rotations.
+	int ResampleFilterRotateDown;							// Matches tImage::tResampleFilter. No longer used. Rotations sample at 1:1.
 
 	enum class RotateModeEnum
 	{
@@ -302,11 +302,15 @@ struct ProfileData
 	int ResizeAspectMode;									// 0 = Crop Mode. 1 = Letterbox Mode.
 
 	int MaxImageMemMB;										// Max image mem before unloading images.
+	int MaxFrameTexMemMB;									// Max VRAM for the frame textures of one image before releasing the least recently shown.
 	int MaxCacheFiles;										// Max number of cache files before removing oldest.
 	int MaxUndoSteps;
+	int MaxUndoMemMB;										// Undo memory per image before older steps are spilled to disk.
+	int MaxUndoTotalMemMB;									// Undo memory over all images before older steps are spilled to disk.
 	bool StrictLoading;										// No attempt to display ill-formed images.
 	bool MetaDataOrientLoading;								// Reorient images on load if Exif or other meta-data contains orientation information.
 	bool DetectAPNGInsidePNG;								// Look for APNG data (animated) hidden inside a regular PNG file.
+	bool RetainHDRSource;									// Keep the RGBE pixels of HDR files so exposure and gamma changes do not reload.
 	int MipmapFilter;										// Matches tImage::tResampleFilter. Use None for no mipmaps.
 	bool MipmapChaining;									// True for faster mipmap generation. False for a lot slower and slightly better results.
 	bool AutoPropertyWindow;								// Auto display property editor window for supported file types.
@@ -12,13 +12,19 @@
 // AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
 // PERFORMANCE OF THIS SOFTWARE.
 
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <Math/tVector2.h>
+#include <System/tPrint.h>
 #include "imgui.h"
 #include "ContactSheet.h"
 #include "OpenSaveDialogs.h"
 #include "TacentView.h"
 #include "GuiUtil.h"
 #include "Image.h"
+#include "Resampler.h"
 namespace Viewer { extern void DoFillColourInterface(const char* = nullptr, bool = false); }
 using namespace tStd;
 using namespace tMath;
@@ -37,20 +43,49 @@ namespace Viewer
 	);
 
 	bool AnyImageNeedsResize(int frameWidth, int frameHeight);
+
+	// Composes sheet rows [firstRow, firstRow+numRows) into dest, which must be exactly that many frame rows high.
+	// Sources are placed in order starting at sourceCursor, which is advanced past every source used or skipped, so
+	// consecutive bands continue where the previous one stopped. Cells left over get the fill colour.
+	ContactResult ComposeContactRows
+	(
+		tPixel4b* dest, int firstRow, int numRows, Image** sources, int numSources, int& sourceCursor,
+		const ContactSheetParams&
+	);
+
+	// Loads the source if needed and resamples it into resampled if it is not the frame size. On success frame points
+	// at frame-sized pixels that stay valid until ReleaseContactFrame.
+	ContactResult PrepareContactFrame(Image*, bool& wasLoaded, tPicture& resampled, const tPicture*& frame, const ContactSheetParams&);
+	void ReleaseContactFrame(Image*, bool wasLoaded, tPicture& resampled);
+	void CopyContactFrame(tPixel4b* dest, int destX, int destY, const tPicture& frame, const ContactSheetParams&);
+	void FillContactCell(tPixel4b* dest, int destX, int destY, const ContactSheetParams&);
+	bool WriteScanlineTGA(tFileHandle, const tPixel4b* row, int width, int bytesPerPixel, bool rle, uint8* scratch);
 }
 
 
 bool Viewer::AnyImageNeedsResize(int frameWidth, int frameHeight)
 {
+	// The cached dimensions come from the thumbnail and let us avoid a full load. Images we do have to load for the
+	// check are released again so opening the dialog doesn't make every image in the folder resident.
 	bool anyImageNeedsResize = false;
 	for (Image* checkImg = Images.First(); checkImg; checkImg = checkImg->Next())
 	{
-		if (!checkImg->IsLoaded())
-			checkImg->Load();
-		if (!checkImg->IsLoaded())
-			continue;
-		
-		if ((checkImg->GetWidth() != frameWidth) || (checkImg->GetHeight() != frameHeight))
+		int w = checkImg->Cached_PrimaryWidth;
+		int h = checkImg->Cached_PrimaryHeight;
+		if (checkImg->IsLoaded() || (w <= 0) || (h <= 0))
+		{
+			bool wasLoaded = checkImg->IsLoaded();
+			if (!wasLoaded)
+				checkImg->Load();
+			if (!checkImg->IsLoaded())
+				continue;
+			w = checkImg->GetWidth();
+			h = checkImg->GetHeight();
+			if (!wasLoaded)
+				checkImg->Unload();
+		}
+
+		if ((w != frameWidth) || (h != frameHeight))
 		{
 			anyImageNeedsResize = true;
 			break;
@@ -60,6 +95,345 @@ bool Viewer::AnyImageNeedsResize(int frameWidth, int frameHeight)
 }
 
 
+const char* Viewer::GetContactResultDesc(ContactResult result)
+{
+	switch (result)
+	{
+		case ContactResult::Success:		return "Success";
+		case ContactResult::InvalidParams:	return "Invalid columns, rows, or frame size";
+		case ContactResult::LoadFailed:		return "An input image failed to load";
+		case ContactResult::SizeMismatch:	return "All input images must be same size";
+		case ContactResult::TooLarge:		return "Sheet is too large for the output file type";
+		case ContactResult::WriteFailed:	return "Error writing output file";
+	}
+	return "Unknown";
+}
+
+
+Viewer::ContactResult Viewer::ComposeContactSheet(tPicture& outPic, tList<Image>& images, const ContactSheetParams& params)
+{
+	if ((params.NumCols <= 0) || (params.NumRows <= 0) || (params.FrameWidth <= 0) || (params.FrameHeight <= 0))
+		return ContactResult::InvalidParams;
+
+	// Every image is a candidate since skipped images let later ones move up.
+	int numSources = images.Count();
+	Image** sources = new Image*[tMax(numSources, 1)];
+	int numAdded = 0;
+	for (Image* img = images.First(); img && (numAdded < numSources); img = img->Next())
+		sources[numAdded++] = img;
+
+	// Every pixel is written exactly once by ComposeContactRows so there's no need to clear the picture first.
+	outPic.Set(params.NumCols*params.FrameWidth, params.NumRows*params.FrameHeight);
+	int sourceCursor = 0;
+	ContactResult result = ComposeContactRows(outPic.GetPixelPointer(), 0, params.NumRows, sources, numSources, sourceCursor, params);
+	delete[] sources;
+	return result;
+}
+
+
+Viewer::ContactResult Viewer::SaveContactSheetStreamedTGA
+(
+	const tString& outFile, tList<Image>& images, const ContactSheetParams& params,
+	tImageTGA::tFormat format, tImageTGA::tCompression compression
+)
+{
+	if ((params.NumCols <= 0) || (params.NumRows <= 0) || (params.FrameWidth <= 0) || (params.FrameHeight <= 0))
+		return ContactResult::InvalidParams;
+
+	int64 width = int64(params.NumCols)*int64(params.FrameWidth);
+	int64 height = int64(params.NumRows)*int64(params.FrameHeight);
+	if ((width > 0xFFFF) || (height > 0xFFFF))
+		return ContactResult::TooLarge;
+
+	tFileHandle file = tOpenFile(outFile.Chr(), "wb");
+	if (!file)
+		return ContactResult::WriteFailed;
+
+	int bytesPerPixel = (format == tImageTGA::tFormat::BPP24) ? 3 : 4;
+	bool rle = (compression == tImageTGA::tCompression::RLE);
+	uint8 header[18];
+	tStd::tMemset(header, 0, sizeof(header));
+	header[2]	= rle ? 10 : 2;								// True-colour, optionally run-length encoded.
+	header[12]	= uint8(width & 0xFF);
+	header[13]	= uint8(width >> 8);
+	header[14]	= uint8(height & 0xFF);
+	header[15]	= uint8(height >> 8);
+	header[16]	= uint8(bytesPerPixel*8);
+	header[17]	= ((bytesPerPixel == 4) ? 8 : 0) | 0x20;	// Alpha bits and a top-left origin.
+	ContactResult result = ContactResult::Success;
+	if (tWriteFile(file, header, sizeof(header)) != sizeof(header))
+		result = ContactResult::WriteFailed;
+
+	// Every image is a candidate since skipped images let later ones move up.
+	int numSources = images.Count();
+	Image** sources = new Image*[tMax(numSources, 1)];
+	int numAdded = 0;
+	for (Image* img = images.First(); img && (numAdded < numSources); img = img->Next())
+		sources[numAdded++] = img;
+
+	// Bands are a whole number of sheet rows, around 64MB each. They are composed and written top band first because
+	// sources are placed in order. Each band is stored bottom row first like tPicture so its rows are written in
+	// reverse.
+	int64 rowBytes = int64(width)*int64(params.FrameHeight)*int64(sizeof(tPixel4b));
+	int rowsPerBand = tClamp(int((64*1024*1024) / rowBytes), 1, params.NumRows);
+	tPixel4b* band = new tPixel4b[width*params.FrameHeight*rowsPerBand];
+	uint8* scratch = new uint8[width*(bytesPerPixel+1)];
+
+	int sourceCursor = 0;
+	for (int bandFirst = 0; (result == ContactResult::Success) && (bandFirst < params.NumRows); bandFirst += rowsPerBand)
+	{
+		int bandRows = tMin(rowsPerBand, params.NumRows - bandFirst);
+		result = ComposeContactRows(band, bandFirst, bandRows, sources, numSources, sourceCursor, params);
+		for (int y = bandRows*params.FrameHeight - 1; (result == ContactResult::Success) && (y >= 0); y--)
+			if (!WriteScanlineTGA(file, band + y*width, int(width), bytesPerPixel, rle, scratch))
+				result = ContactResult::WriteFailed;
+	}
+
+	delete[] scratch;
+	delete[] band;
+	delete[] sources;
+	tCloseFile(file);
+	if (result != ContactResult::Success)
+		tDeleteFile(outFile);
+
+	return result;
+}
+
+
+bool Viewer::WriteScanlineTGA(tFileHandle file, const tPixel4b* row, int width, int bytesPerPixel, bool rle, uint8* scratch)
+{
+	// TGA stores BGR(A). Packets never cross scanlines.
+	auto put = [bytesPerPixel](uint8* dst, const tPixel4b& p) -> uint8*
+	{
+		*dst++ = p.B;	*dst++ = p.G;	*dst++ = p.R;
+		if (bytesPerPixel == 4)
+			*dst++ = p.A;
+		return dst;
+	};
+
+	uint8* dst = scratch;
+	if (!rle)
+	{
+		for (int x = 0; x < width; x++)
+			dst = put(dst, row[x]);
+		int numBytes = int(dst - scratch);
+		return tWriteFile(file, scratch, numBytes) == numBytes;
+	}
+
+	int x = 0;
+	while (x < width)
+	{
+		// Run packet if the next pixel repeats, otherwise a raw packet up to the next repeat.
+		int run = 1;
+		while ((x+run < width) && (run < 128) && (row[x+run] == row[x]))
+			run++;
+
+		if (run > 1)
+		{
+			*dst++ = uint8(0x80 | (run-1));
+			dst = put(dst, row[x]);
+			x += run;
+			continue;
+		}
+
+		int raw = 1;
+		while ((x+raw < width) && (raw < 128) && !((x+raw+1 < width) && (row[x+raw] == row[x+raw+1])))
+			raw++;
+		*dst++ = uint8(raw-1);
+		for (int r = 0; r < raw; r++)
+			dst = put(dst, row[x+r]);
+		x += raw;
+	}
+	int numBytes = int(dst - scratch);
+	return tWriteFile(file, scratch, numBytes) == numBytes;
+}
+
+
+Viewer::ContactResult Viewer::ComposeContactRows
+(
+	tPixel4b* dest, int firstRow, int numRows, Image** sources, int numSources, int& sourceCursor,
+	const ContactSheetParams& params
+)
+{
+	int firstCell = firstRow*params.NumCols;
+	int endCell = (firstRow+numRows)*params.NumCols;
+	int numPending = numSources - sourceCursor;
+
+	// Workers load and resample sources in parallel, but a source only learns its cell when every source before it
+	// has been placed or skipped. That keeps the order of the images even when some fail to load. A source prepared
+	// after the band filled up is released and prepared again for the next band.
+	std::mutex orderMutex;
+	std::condition_variable orderCond;
+	int turn = sourceCursor;						// The source allowed to take the next cell.
+	int nextCell = firstCell;
+	int bandEndSource = numSources;					// The first source not used by this band.
+	bool stop = (numPending <= 0);					// Band full or an error.
+	ContactResult result = ContactResult::Success;
+	std::atomic<int> nextSource(sourceCursor);
+
+	auto work = [&]()
+	{
+		while (true)
+		{
+			// Once the band is full no more sources are claimed. A claimed source must take its turn though, or the
+			// sources after it would wait forever.
+			{
+				std::lock_guard<std::mutex> lock(orderMutex);
+				if (stop)
+					break;
+			}
+			int src = nextSource++;
+			if (src >= numSources)
+				break;
+
+			bool wasLoaded = false;
+			tPicture resampled;
+			const tPicture* frame = nullptr;
+			ContactResult prepared = PrepareContactFrame(sources[src], wasLoaded, resampled, frame, params);
+
+			int cell = -1;
+			{
+				std::unique_lock<std::mutex> lock(orderMutex);
+				orderCond.wait(lock, [&]() { return turn == src; });
+				if (!stop)
+				{
+					if (prepared == ContactResult::Success)
+					{
+						cell = nextCell++;
+						if (nextCell >= endCell)
+						{
+							stop = true;
+							bandEndSource = src+1;
+						}
+					}
+					else if ((prepared == ContactResult::LoadFailed) && params.SkipFailedLoads)
+					{
+						// Skipped. The next source gets this cell.
+					}
+					else
+					{
+						stop = true;
+						result = prepared;
+					}
+				}
+				turn++;
+			}
+			orderCond.notify_all();
+
+			// Rows are top-to-bottom in the sheet but pictures are stored bottom-to-top. Cells never overlap so no
+			// locking is needed to write into the destination.
+			if (cell >= 0)
+			{
+				int row = cell / params.NumCols;
+				int col = cell % params.NumCols;
+				CopyContactFrame(dest, col*params.FrameWidth, (firstRow+numRows-1-row)*params.FrameHeight, *frame, params);
+				tPrintfFull("Contact | Placed %s in cell (%d, %d).\n", tGetFileName(sources[src]->Filename).Chr(), col, row);
+			}
+			ReleaseContactFrame(sources[src], wasLoaded, resampled);
+		}
+	};
+
+	// The calling thread is one of the workers.
+	if (numPending > 0)
+	{
+		int numWorkers = (params.MaxFramesInFlight > 0) ? params.MaxFramesInFlight : tClamp(tSystem::tGetNumCores(), 1, 8);
+		tiClamp(numWorkers, 1, numPending);
+		std::thread* workers = new std::thread[numWorkers-1];
+		for (int w = 0; w < numWorkers-1; w++)
+			workers[w] = std::thread(work);
+		work();
+		for (int w = 0; w < numWorkers-1; w++)
+			workers[w].join();
+		delete[] workers;
+	}
+
+	// Cells after the last placed source.
+	for (int cell = nextCell; cell < endCell; cell++)
+	{
+		int row = cell / params.NumCols;
+		int col = cell % params.NumCols;
+		FillContactCell(dest, col*params.FrameWidth, (firstRow+numRows-1-row)*params.FrameHeight, params);
+	}
+
+	sourceCursor = bandEndSource;
+	return result;
+}
+
+
+Viewer::ContactResult Viewer::PrepareContactFrame
+(
+	Image* img, bool& wasLoaded, tPicture& resampled, const tPicture*& frame, const ContactSheetParams& params
+)
+{
+	frame = nullptr;
+	wasLoaded = img->IsLoaded();
+	if (!wasLoaded)
+		img->Load(params.LoadParamsFromConfig);
+
+	tPicture* srcPic = img->IsLoaded() ? img->GetCurrentPic() : nullptr;
+	if (!srcPic || !srcPic->IsValid())
+	{
+		if (params.SkipFailedLoads)
+			tPrintfFull("Contact | Failed to load %s. Skipping.\n", tGetFileName(img->Filename).Chr());
+		else
+			tPrintfNorm("Contact | Failed to load %s.\n", tGetFileName(img->Filename).Chr());
+		return ContactResult::LoadFailed;
+	}
+
+	if ((srcPic->GetWidth() != params.FrameWidth) || (srcPic->GetHeight() != params.FrameHeight))
+	{
+		if (!params.ResampleFrames)
+		{
+			tPrintfNorm
+			(
+				"Contact | %s is %dx%d, not %dx%d.\n", tGetFileName(img->Filename).Chr(),
+				srcPic->GetWidth(), srcPic->GetHeight(), params.FrameWidth, params.FrameHeight
+			);
+			return ContactResult::SizeMismatch;
+		}
+
+		resampled.Set(*srcPic);
+		ResamplePicture(resampled, params.FrameWidth, params.FrameHeight, params.ResampleFilter, params.ResampleEdgeMode);
+		srcPic = &resampled;
+	}
+
+	frame = srcPic;
+	return ContactResult::Success;
+}
+
+
+void Viewer::ReleaseContactFrame(Image* img, bool wasLoaded, tPicture& resampled)
+{
+	// Release the source as soon as it is placed. Images loaded here were never bound so Unload makes no GL calls.
+	resampled.Clear();
+	if (!wasLoaded)
+		img->Unload();
+}
+
+
+void Viewer::CopyContactFrame(tPixel4b* dest, int destX, int destY, const tPicture& frame, const ContactSheetParams& params)
+{
+	int frameW = params.FrameWidth;
+	int destW = params.NumCols*frameW;
+	const tPixel4b* srcPixels = frame.GetPixelPointer();
+	for (int y = 0; y < params.FrameHeight; y++)
+		tMemcpy(dest + (destY+y)*destW + destX, srcPixels + y*frameW, frameW*sizeof(tPixel4b));
+}
+
+
+void Viewer::FillContactCell(tPixel4b* dest, int destX, int destY, const ContactSheetParams& params)
+{
+	int destW = params.NumCols*params.FrameWidth;
+	tPixel4b fill(params.FillColour);
+	for (int y = 0; y < params.FrameHeight; y++)
+	{
+		tPixel4b* row = dest + (destY+y)*destW + destX;
+		for (int x = 0; x < params.FrameWidth; x++)
+			row[x] = fill;
+	}
+}
+
+
 void Viewer::DoSaveContactSheetModal(bool saveContactSheetPressed)
 {
 	if (saveContactSheetPressed)
@@ -330,81 +704,49 @@ void Viewer::SaveContactSheetTo
 {
 	Config::ProfileData& profile = Config::GetProfileData();
 
-	tImage::tPicture outPic(contactWidth, contactHeight);
-	outPic.SetAll(profile.FillColourContact);
+	ContactSheetParams params;
+	params.NumCols				= numCols;
+	params.NumRows				= numRows;
+	params.FrameWidth			= contactWidth / numCols;
+	params.FrameHeight			= contactHeight / numRows;
+	params.FillColour			= profile.FillColourContact;
+	params.ResampleFrames		= true;
+	params.ResampleFilter		= tImage::tResampleFilter(profile.ResampleFilterContactFrame);
+	params.ResampleEdgeMode		= tImage::tResampleEdgeMode(profile.ResampleEdgeModeContactFrame);
+	params.LoadParamsFromConfig	= true;
 
-	// Do the work.
-	int frameWidth = contactWidth / numCols;
-	int frameHeight = contactHeight / numRows;
-	int ix = 0;
-	int iy = 0;
-	int frame = 0;
-
-	tPrintf("Loading all frames...\n");
-	for (Image* img = Images.First(); img; img = img->Next())
+	tFileType saveFileType = tGetFileTypeFromName(profile.SaveFileType);
+	bool noFinalResize = (finalWidth == contactWidth) && (finalHeight == contactHeight);
+	tImage::tPicture outPic;
+	if (noFinalResize && (saveFileType == tFileType::TGA) && (contactWidth <= 0xFFFF) && (contactHeight <= 0xFFFF))
 	{
-		if (!img->IsLoaded())
-			img->Load();
+		tImageTGA::tFormat tgaFormat = tImageTGA::tFormat::Auto;
+		switch (profile.SaveFileTgaDepthMode)
+		{
+			case 1: tgaFormat = tImageTGA::tFormat::BPP24;		break;
+			case 2: tgaFormat = tImageTGA::tFormat::BPP32;		break;
+		}
+		tImageTGA::tCompression tgaCompression = profile.SaveFileTgaRLE ? tImageTGA::tCompression::RLE : tImageTGA::tCompression::None;
+		tPrintf("Streaming contact sheet to [%s].\n", tSystem::tGetFileBaseName(outFile).Chr());
+		ContactResult result = SaveContactSheetStreamedTGA(outFile, Images, params, tgaFormat, tgaCompression);
+		if (result != ContactResult::Success)
+			tPrintf("Contact sheet not saved: %s.\n", GetContactResultDesc(result));
 	}
-
-	Image* currImg = Images.First();
-	while (currImg)
+	else
 	{
-		if (!currImg->IsLoaded())
+		ContactResult result = ComposeContactSheet(outPic, Images, params);
+		if (result != ContactResult::Success)
 		{
-			currImg = currImg->Next();
-			continue;
+			tPrintf("Contact sheet not saved: %s.\n", GetContactResultDesc(result));
+			return;
 		}
 
-		tPrintf("Processing frame %d : %s at (%d, %d).\n", frame, currImg->Filename.Chr(), ix, iy);
-		frame++;
-		tImage::tPicture* currPic = currImg->GetCurrentPic();
-
-		tImage::tPicture resampled;
-		if ((currImg->GetWidth() != frameWidth) || (currImg->GetHeight() != frameHeight))
-		{
-			resampled.Set(*currPic);
-			resampled.Resample(frameWidth, frameHeight, tImage::tResampleFilter(profile.ResampleFilterContactFrame), tImage::tResampleEdgeMode(profile.ResampleEdgeModeContactFrame));
-		}
+		if (noFinalResize)
+			tPrintf("No resizing of output [%s] image needed.\n", tSystem::tGetFileBaseName(outFile).Chr());
 		else
-		{
-			tPrintf("No resizing of [%s] needed.\n", tSystem::tGetFileBaseName(currImg->Filename).Chr());
-		}
-
-		// Copy resampled frame into place.
-		for (int y = 0; y < frameHeight; y++)
-			for (int x = 0; x < frameWidth; x++)
-				outPic.SetPixel
-				(
-					x + (ix*frameWidth),
-					y + ((numRows-1-iy)*frameHeight),
-					resampled.IsValid() ? resampled.GetPixel(x, y) : currPic->GetPixel(x, y)
-				);
-
-		currImg = currImg->Next();
-
-		ix++;
-		if (ix >= numCols)
-		{
-			ix = 0;
-			iy++;
-			if (iy >= numRows)
-				break;
-		}
-	}
-
-	tFileType saveFileType = tGetFileTypeFromName(profile.SaveFileType);
-	if ((finalWidth == contactWidth) && (finalHeight == contactHeight))
-	{
-		tPrintf("No resizing of output [%s] image needed.\n", tSystem::tGetFileBaseName(outFile).Chr());
+			ResamplePicture(outPic, finalWidth, finalHeight, tImage::tResampleFilter(profile.ResampleFilterContactFinal), tImage::tResampleEdgeMode(profile.ResampleEdgeModeContactFinal));
 		SavePictureAs(outPic, outFile, saveFileType, true);
 	}
-	else
-	{
-		tImage::tPicture finalResampled(outPic);
-		finalResampled.Resample(finalWidth, finalHeight, tImage::tResampleFilter(profile.ResampleFilterContactFinal), tImage::tResampleEdgeMode(profile.ResampleEdgeModeContactFinal));
-		SavePictureAs(finalResampled, outFile, saveFileType, true);
-	}
 
 	// If we saved to the same dir we are currently viewing, reload
 	// and set the current image to the generated one.
@@ -13,9 +13,68 @@
 // PERFORMANCE OF THIS SOFTWARE.
 
 #pragma once
+#include <Foundation/tList.h>
+#include <Math/tColour.h>
+#include <Image/tPicture.h>
+#include <Image/tResample.h>
+#include <Image/tImageTGA.h>
 
 
 namespace Viewer
 {
+	class Image;
 	void DoSaveContactSheetModal(bool saveContactSheetPressed);
+
+	// The contact sheet engine shared by the GUI dialog and the CLI contact post-operation. Frames are prepared by
+	// worker threads. Each worker loads one source, resamples it if necessary, copies its rows into place, and releases
+	// it before taking the next, so at most MaxFramesInFlight sources are ever resident. Sources that were already
+	// loaded when composition started are left loaded.
+	struct ContactSheetParams
+	{
+		int NumCols										= 0;
+		int NumRows										= 0;
+		int FrameWidth									= 0;
+		int FrameHeight									= 0;
+		tColour4b FillColour							= tColour4b::transparent;
+
+		// If false, any source whose size differs from the frame size is an error.
+		bool ResampleFrames								= true;
+		tImage::tResampleFilter ResampleFilter			= tImage::tResampleFilter::Bilinear;
+		tImage::tResampleEdgeMode ResampleEdgeMode		= tImage::tResampleEdgeMode::Clamp;
+
+		// If true, images that fail to load are skipped and the images after them move up a cell, so only trailing
+		// cells get the fill colour. If false, a failed load is an error.
+		bool SkipFailedLoads							= true;
+
+		bool LoadParamsFromConfig						= true;
+		int MaxFramesInFlight							= 0;			// 0 means one per worker thread.
+	};
+
+	enum class ContactResult
+	{
+		Success,
+		InvalidParams,
+		LoadFailed,						// Only when SkipFailedLoads is false.
+		SizeMismatch,					// Only when ResampleFrames is false.
+		TooLarge,						// The sheet is too big for the output format.
+		WriteFailed
+	};
+	const char* GetContactResultDesc(ContactResult);
+
+	// Composes the contact sheet into outPic, which is (re)created at NumCols*FrameWidth by NumRows*FrameHeight.
+	// Images are placed left-to-right, top-to-bottom. Sources are loaded with Image::Load on worker threads, which is
+	// safe for distinct images (see Image::Load), and the calling thread waits for the workers.
+	ContactResult ComposeContactSheet(tImage::tPicture& outPic, tList<Image>& images, const ContactSheetParams&);
+
+	// Out-of-core version of the above. The sheet is composed one band of rows at a time and each band is written
+	// straight to a TGA file, so peak memory is one band plus the sources in flight, not the whole sheet. TGA is the
+	// only streamed type. It needs no whole-image encoder, and the Tacent encoders for every other type (including the
+	// animated ones used by combine) take a complete picture or frame list. Auto format saves 32 bit since opacity
+	// isn't known until the last band. Limited to 65535x65535 by the TGA header. A failed write deletes the file.
+	ContactResult SaveContactSheetStreamedTGA
+	(
+		const tString& outFile, tList<Image>& images, const ContactSheetParams&,
+		tImage::tImageTGA::tFormat = tImage::tImageTGA::tFormat::Auto,
+		tImage::tImageTGA::tCompression = tImage::tImageTGA::tCompression::None
+	);
 }
@@ -0,0 +1,396 @@
+// CostModel.cpp
+//
+// Machine-calibrated time estimates for the slow image operations. A short micro-benchmark measures the cost of each
+// quantize method, each resample filter, and rotation on this machine. The results are stored in the config file so
+// the benchmark only runs once (or again if the number of cores changes). Dialogs use the estimates to show ETAs and
+// to choose parameters that meet a target time.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <Foundation/tHash.h>
+#include <Math/tFundamentals.h>
+#include <System/tMachine.h>
+#include <System/tPrint.h>
+#include <Image/tPicture.h>
+#include "CostModel.h"
+#include "CommandStats.h"
+#include "Rotation.h"
+#include "Resampler.h"
+using namespace tMath;
+using namespace tImage;
+
+
+namespace Viewer { namespace CostModel
+{
+	Costs Model;
+	std::mutex ModelMutex;												// Guards Model. The calibration thread writes it.
+	std::thread CalibrationThread;
+	std::atomic<bool> Calibrating										= false;
+
+	// Measures the costs on the calling thread. Calibrate and the calibration thread store the result.
+	void MeasureCosts(Costs&);
+
+	// Fills the picture with a deterministic test pattern. Smooth gradients with some noise so the quantizers see a
+	// realistic number of distinct colours.
+	void MakeTestPicture(tPicture&, int width, int height);
+
+	// Runs op on a fresh copy of src until at least minSeconds have been spent in op. Returns seconds per run.
+	double TimeOp(const tPicture& src, const std::function<void(tPicture&)>& op, double minSeconds = 0.02);
+
+	const int NeuSlowFactor = 10;
+} }
+
+
+void Viewer::CostModel::MakeTestPicture(tPicture& picture, int width, int height)
+{
+	picture.Set(width, height, tPixel4b::transparent);
+	tPixel4b* pixels = picture.GetPixelPointer();
+	uint32 noise = 0x12345678;
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			noise = noise*1664525u + 1013904223u;
+			tPixel4b& pixel = pixels[y*width + x];
+			pixel.R = uint8( ((x*255)/width + (noise >> 28)) & 0xFF );
+			pixel.G = uint8( ((y*255)/height + (noise >> 24)) & 0xFF );
+			pixel.B = uint8( (((x+y)*127)/(width+height) + (noise >> 20)) & 0xFF );
+			pixel.A = 255;
+		}
+	}
+}
+
+
+double Viewer::CostModel::TimeOp(const tPicture& src, const std::function<void(tPicture&)>& op, double minSeconds)
+{
+	double total = 0.0;
+	int runs = 0;
+	while ((total < minSeconds) || (runs == 0))
+	{
+		tPicture picture(src);
+		Command::StatsTimer timer;
+		op(picture);
+		total += timer.GetWallSeconds();
+		runs++;
+	}
+	return total / double(runs);
+}
+
+
+void Viewer::CostModel::Calibrate()
+{
+	Command::StatsTimer calibrateTimer;
+	Costs costs;
+	MeasureCosts(costs);
+	{
+		std::lock_guard<std::mutex> lock(ModelMutex);
+		Model = costs;
+	}
+	tPrintf("Cost model calibrated in %.2f seconds.\n", calibrateTimer.GetWallSeconds());
+}
+
+
+void Viewer::CostModel::CalibrateInBackground()
+{
+	if (Calibrating)
+		return;
+
+	// A finished thread still needs joining before it can be replaced. The worker doesn't print since the GUI output
+	// log is only written from the main thread.
+	if (CalibrationThread.joinable())
+		CalibrationThread.join();
+
+	Calibrating = true;
+	CalibrationThread = std::thread
+	(
+		[]()
+		{
+			Costs costs;
+			MeasureCosts(costs);
+			{
+				std::lock_guard<std::mutex> lock(ModelMutex);
+				Model = costs;
+			}
+			Calibrating = false;
+		}
+	);
+}
+
+
+bool Viewer::CostModel::IsCalibrating()
+{
+	return Calibrating;
+}
+
+
+void Viewer::CostModel::WaitForCalibration()
+{
+	if (CalibrationThread.joinable())
+		CalibrationThread.join();
+}
+
+
+void Viewer::CostModel::MeasureCosts(Costs& costs)
+{
+	costs = Costs();
+	costs.Cores = tSystem::tGetNumCores();
+	const double ns = 1.0e9;
+
+	// Quantizers. Spatial is orders of magnitude slower than the others so it gets a smaller picture.
+	tPicture pic;
+	MakeTestPicture(pic, 128, 128);
+	double numPixels = double(pic.GetNumPixels());
+
+	const int fixedColours = 64;
+	double fixedSec = TimeOp(pic, [=](tPicture& p) { p.QuantizeFixed(fixedColours, false); });
+	costs.QuantizeFixed = float(fixedSec*ns / (numPixels*fixedColours));
+
+	// Neu learns from 1/sampleFactor of the pixels and then maps all of them. Timing two sample factors separates
+	// the two parts.
+	const int neuColours = 64;
+	double neuFast = TimeOp(pic, [=](tPicture& p) { p.QuantizeNeu(neuColours, false, 1); });
+	double neuSlow = TimeOp(pic, [=](tPicture& p) { p.QuantizeNeu(neuColours, false, NeuSlowFactor); });
+	double neuLearn = tMax((neuFast - neuSlow) * double(NeuSlowFactor) / double(NeuSlowFactor - 1), 0.0);
+	double neuMap = tMax(neuFast - neuLearn, 0.0);
+	costs.QuantizeNeuLearn = float(neuLearn*ns / (numPixels*neuColours));
+	costs.QuantizeNeuMap = float(neuMap*ns / numPixels);
+
+	double wuSec = TimeOp(pic, [=](tPicture& p) { p.QuantizeWu(64, false); });
+	costs.QuantizeWu = float(wuSec*ns / numPixels);
+
+	tPicture spatialPic;
+	MakeTestPicture(spatialPic, 48, 48);
+	const int spatialColours = 8;
+	double spatialSec = TimeOp(spatialPic, [=](tPicture& p) { p.QuantizeSpatial(spatialColours, false, 0.0, 3); }, 0.0);
+	costs.QuantizeSpatial = float(spatialSec*ns / (double(spatialPic.GetNumPixels())*spatialColours));
+
+	// Resample filters. A slight downscale so every filter does real work without the footprint growing much.
+	const int dstW = 120, dstH = 120;
+	for (int f = 0; f < int(tResampleFilter::NumFilters); f++)
+	{
+		tResampleFilter filter = tResampleFilter(f);
+		double sec = TimeOp(pic, [=](tPicture& p) { ResamplePicture(p, dstW, dstH, filter, tResampleEdgeMode::Clamp); });
+		costs.Resample[f] = float(sec*ns / double(dstW*dstH));
+	}
+
+	// Rotation with the bilinear kernel. Other filter choices are scaled by the resample costs. The test picture is
+	// small enough that the rotation runs on one thread.
+	tPicture rotPic;
+	MakeTestPicture(rotPic, 64, 64);
+	double rotSec = TimeOp
+	(
+		rotPic,
+		[](tPicture& p) { RotatePicture(p, tDegToRad(30.0f), tColour4b::transparent, tResampleFilter::Bilinear); }
+	);
+	costs.Rotate = float(rotSec*ns / double(rotPic.GetNumPixels()));
+}
+
+
+bool Viewer::CostModel::IsCalibrated()
+{
+	std::lock_guard<std::mutex> lock(ModelMutex);
+	return (Model.Cores > 0);
+}
+
+
+Viewer::CostModel::Costs Viewer::CostModel::GetCosts()
+{
+	{
+		std::lock_guard<std::mutex> lock(ModelMutex);
+		if (Model.Cores > 0)
+			return Model;
+	}
+
+	// Uncalibrated costs are all zero.
+	CalibrateInBackground();
+	return Costs();
+}
+
+
+float Viewer::CostModel::QuantizeSeconds(tQuantize::Method method, int numPixels, int numColours, int neuSampleFactor, int spatialFilterSize)
+{
+	if ((numPixels <= 0) || (numColours < 2))
+		return 0.0f;
+
+	Costs costs = GetCosts();
+	double pixels = double(numPixels);
+	double ns = 0.0;
+	switch (method)
+	{
+		case tQuantize::Method::Fixed:
+			ns = costs.QuantizeFixed * pixels * numColours;
+			break;
+
+		case tQuantize::Method::Spatial:
+		{
+			// Scolorq work grows with the filter area. The cost was measured with a 3x3 filter.
+			double filterScale = double(spatialFilterSize*spatialFilterSize) / 9.0;
+			ns = costs.QuantizeSpatial * pixels * numColours * filterScale;
+			break;
+		}
+
+		case tQuantize::Method::Neu:
+			ns = (costs.QuantizeNeuLearn * pixels * numColours / double(tMax(neuSampleFactor, 1))) + (costs.QuantizeNeuMap * pixels);
+			break;
+
+		case tQuantize::Method::Wu:
+			ns = costs.QuantizeWu * pixels;
+			break;
+	}
+	return float(ns / 1.0e9);
+}
+
+
+float Viewer::CostModel::ResampleSeconds(tResampleFilter filter, int srcW, int srcH, int dstW, int dstH)
+{
+	if ((srcW <= 0) || (srcH <= 0) || (dstW <= 0) || (dstH <= 0))
+		return 0.0f;
+
+	Costs costs = GetCosts();
+	int f = (int(filter) < int(tResampleFilter::NumFilters)) ? int(filter) : int(tResampleFilter::Nearest);
+
+	// When downscaling the filter footprint in each dimension grows with the scale factor. The resampler is separable
+	// so the cost per destination pixel grows roughly linearly with the per-axis ratio.
+	double ratio = tMax(tMax(double(srcW)/double(dstW), double(srcH)/double(dstH)), 1.0);
+	double ns = costs.Resample[f] * double(dstW) * double(dstH) * ratio;
+
+	// Large resamples are split into row blocks over all cores.
+	if (dstW*dstH >= 128*1024)
+		ns /= double(tMax(costs.Cores, 1));
+	return float(ns / 1.0e9);
+}
+
+
+float Viewer::CostModel::RotateSeconds(int width, int height, tResampleFilter filter)
+{
+	if ((width <= 0) || (height <= 0))
+		return 0.0f;
+
+	Costs costs = GetCosts();
+	auto filterCost = [&costs](tResampleFilter filter) -> double
+	{
+		int f = (int(filter) < int(tResampleFilter::NumFilters)) ? int(filter) : int(tResampleFilter::Nearest);
+		return costs.Resample[f];
+	};
+
+	double bilinear = filterCost(tResampleFilter::Bilinear);
+	double scale = (bilinear > 0.0) ? filterCost(filter) / bilinear : 1.0;
+	double ns = costs.Rotate * double(width) * double(height) * scale;
+
+	// Large rotations are split into tiles over all cores.
+	if (width*height >= 128*1024)
+		ns /= double(tMax(costs.Cores, 1));
+	return float(ns / 1.0e9);
+}
+
+
+float Viewer::CostModel::ParallelSeconds(float itemSeconds, int numItems)
+{
+	if (numItems <= 0)
+		return 0.0f;
+
+	int cores = tMax(GetCosts().Cores, 1);
+	int waves = (numItems + cores - 1) / cores;
+	return itemSeconds * float(waves);
+}
+
+
+int Viewer::CostModel::ChooseNeuSampleFactor(int numPixels, int numColours, float targetSeconds)
+{
+	for (int factor = 1; factor < 10; factor++)
+		if (QuantizeSeconds(tQuantize::Method::Neu, numPixels, numColours, factor) <= targetSeconds)
+			return factor;
+	return 10;
+}
+
+
+void Viewer::CostModel::Save(tExprWriter& writer)
+{
+	Costs model;
+	{
+		std::lock_guard<std::mutex> lock(ModelMutex);
+		model = Model;
+	}
+
+	writer.Begin();
+	writer.Indent();
+	writer.CR();
+	writer.WriteAtom("CostModel");
+	writer.CR();
+
+	writer.Comp("Cores",				model.Cores);
+	writer.Comp("QuantizeFixed",		model.QuantizeFixed);
+	writer.Comp("QuantizeSpatial",		model.QuantizeSpatial);
+	writer.Comp("QuantizeNeuLearn",		model.QuantizeNeuLearn);
+	writer.Comp("QuantizeNeuMap",		model.QuantizeNeuMap);
+	writer.Comp("QuantizeWu",			model.QuantizeWu);
+	writer.Comp("RotateTiled",			model.Rotate);
+
+	writer.Begin();
+	writer.WriteAtom("ResampleSeparable");
+	for (int f = 0; f < int(tResampleFilter::NumFilters); f++)
+		writer.WriteAtom(model.Resample[f]);
+	writer.End();
+
+	writer.Dedent();
+	writer.CR();
+	writer.End();
+}
+
+
+void Viewer::CostModel::Load(tExpr expr)
+{
+	Costs costs;
+	for (tExpr e = expr.Item1(); e.IsValid(); e = e.Next())
+	{
+		switch (e.Command().Hash())
+		{
+			case tHash::tHashCT("Cores"):				costs.Cores = e.Arg1();				break;
+			case tHash::tHashCT("QuantizeFixed"):		costs.QuantizeFixed = e.Arg1();		break;
+			case tHash::tHashCT("QuantizeSpatial"):		costs.QuantizeSpatial = e.Arg1();	break;
+			case tHash::tHashCT("QuantizeNeuLearn"):	costs.QuantizeNeuLearn = e.Arg1();	break;
+			case tHash::tHashCT("QuantizeNeuMap"):		costs.QuantizeNeuMap = e.Arg1();	break;
+			case tHash::tHashCT("QuantizeWu"):			costs.QuantizeWu = e.Arg1();		break;
+			case tHash::tHashCT("RotateTiled"):			costs.Rotate = e.Arg1();			break;
+
+			case tHash::tHashCT("ResampleSeparable"):
+			{
+				int f = 0;
+				for (tExpr cost = e.Item1(); cost.IsValid() && (f < int(tResampleFilter::NumFilters)); cost = cost.Next(), f++)
+					costs.Resample[f] = cost;
+
+				// A different number of filters means a different Tacent version. Force a recalibration.
+				if (f != int(tResampleFilter::NumFilters))
+					costs.Cores = 0;
+				break;
+			}
+		}
+	}
+
+	// Costs from another machine (or the same one with a different core count) are not trusted. A missing rotate cost
+	// or resample cost means it was measured with an older implementation.
+	if ((costs.Cores != tSystem::tGetNumCores()) || (costs.Rotate <= 0.0f) || (costs.Resample[int(tResampleFilter::Bilinear)] <= 0.0f))
+		costs.Cores = 0;
+
+	std::lock_guard<std::mutex> lock(ModelMutex);
+	Model = costs;
+}
+
+
+void Viewer::CostModel::Reset()
+{
+	std::lock_guard<std::mutex> lock(ModelMutex);
+	Model = Costs();
+}
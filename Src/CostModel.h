@@ -0,0 +1,74 @@
+// CostModel.h
+//
+// Machine-calibrated time estimates for the slow image operations. A short micro-benchmark measures the cost of each
+// quantize method, each resample filter, and rotation on this machine. The results are stored in the config file so
+// the benchmark only runs once (or again if the number of cores changes). Dialogs use the estimates to show ETAs and
+// to choose parameters that meet a target time.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <System/tScript.h>
+#include <Image/tQuantize.h>
+#include <Image/tResample.h>
+
+
+namespace Viewer { namespace CostModel {
+
+
+// All costs are single-threaded nanoseconds per unit of work. A zero Cores value means not calibrated.
+struct Costs
+{
+	int Cores									= 0;
+	float QuantizeFixed							= 0.0f;		// Per pixel per colour.
+	float QuantizeSpatial						= 0.0f;		// Per pixel per colour at filter size 3.
+	float QuantizeNeuLearn						= 0.0f;		// Per sampled pixel per colour.
+	float QuantizeNeuMap						= 0.0f;		// Per pixel.
+	float QuantizeWu							= 0.0f;		// Per pixel.
+	float Rotate								= 0.0f;		// Per pixel with the bilinear kernel.
+
+	// Per destination pixel at roughly 1:1 scale. Indexed by tResampleFilter.
+	float Resample[int(tImage::tResampleFilter::NumFilters)] = { };
+};
+
+
+// Runs the micro-benchmark (a fraction of a second) on the calling thread and stores the results.
+void Calibrate();
+
+// Runs the micro-benchmark on a worker thread. Does nothing if it's already running. The current costs (if any) stay
+// in use until the new ones are stored. The estimate functions start this automatically if the model is not
+// calibrated, so the UI never waits on it. Call WaitForCalibration before saving the config or exiting.
+void CalibrateInBackground();
+bool IsCalibrating();
+void WaitForCalibration();
+
+bool IsCalibrated();
+Costs GetCosts();
+
+// Estimated seconds for a single picture. Quantizing is single-threaded. Large rotations and resamples use all cores.
+// All estimates are zero until the model is calibrated. Check IsCalibrated to tell that apart from a quick operation.
+float QuantizeSeconds(tImage::tQuantize::Method, int numPixels, int numColours, int neuSampleFactor = 1, int spatialFilterSize = 3);
+float ResampleSeconds(tImage::tResampleFilter, int srcW, int srcH, int dstW, int dstH);
+float RotateSeconds(int width, int height, tImage::tResampleFilter);
+
+// Estimated seconds for numItems pieces of independent work, each taking itemSeconds, spread over all cores.
+float ParallelSeconds(float itemSeconds, int numItems);
+
+// Returns the smallest (best quality) Neu sample factor in [1, 10] expected to finish within targetSeconds.
+int ChooseNeuSampleFactor(int numPixels, int numColours, float targetSeconds);
+
+// Config file persistence. Load ignores stored costs that were measured with a different number of cores.
+void Save(tExprWriter&);
+void Load(tExpr);
+void Reset();
+
+
+} }
@@ -0,0 +1,560 @@
+// Daemon.cpp
+//
+// Persistent batch-processing daemon. A daemon process listens on a local Unix-domain socket and runs CLI jobs sent
+// to it by clients. A job is the same argument list you would give tacentview directly. Output and the exit code of
+// each job are streamed back to the client that submitted it. Only available on Linux.
+//
+// The CLI keeps its per-run state (options, operations, input and output lists, save parameters) in globals, so jobs
+// are not run on threads inside the daemon. Instead the daemon forks a child per job from its already warmed-up
+// image. This skips exec, dynamic linking, and static initialization, and each job still gets a clean copy of the
+// CLI state. Up to maxJobs children run at once. The daemon itself never starts a thread, so every fork happens from
+// a single-threaded process and no child can inherit a malloc or stdio lock held by some other thread. Each job child
+// forks once more: the grandchild runs the job and the child frames its output for the client.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#ifdef PLATFORM_LINUX
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdio.h>
+#endif
+#include <Foundation/tList.h>
+#include <System/tCmdLine.h>
+#include <System/tFile.h>
+#include <System/tMachine.h>
+#include <System/tPrint.h>
+#include "Daemon.h"
+#include "Command.h"
+#include "TacentView.h"
+
+
+#ifdef PLATFORM_LINUX
+namespace Daemon
+{
+	// Wire format. A request is the magic, the client working directory, and the argument list. Strings are a uint32
+	// length followed by the bytes. The reply is a sequence of frames, each a type byte and a uint32 payload length.
+	// Output frames carry job stdout and error frames job stderr. The final exit frame carries the int32 exit code.
+	const uint32 RequestMagic						= 0x314A5654;		// "TVJ1"
+	const char FrameOutput							= 'O';
+	const char FrameError							= 'E';
+	const char FrameExit							= 'X';
+	const uint32 MaxArgLength						= 64*1024;
+	const uint32 MaxArgs							= 64*1024;
+
+	// A client that connects but doesn't send its whole request within this time is dropped. The request is read by
+	// the job process so a slow client only ever holds its own job slot.
+	const int RequestTimeoutSeconds					= 10;
+
+	bool ReadAll(int fd, void* dest, int numBytes);
+	bool WriteAll(int fd, const void* src, int numBytes);
+	bool ReadString(int fd, tString&);
+	bool WriteString(int fd, const tString&);
+	bool WriteFrame(int fd, char type, const void* payload, uint32 numBytes);
+
+	bool ReadRequest(int fd, tString& workingDir, tList<tStringItem>& args);
+	void RunJob(int clientFd, int listenFd);
+	int RunWorker(int clientFd, int outputFd, int errorFd);
+	int RelayJob(int clientFd, int outputFd, int errorFd, pid_t worker);
+	void OnSignal(int);
+	void OnChildExit(int);
+	void WakeServe();
+
+	// The signal handlers only set a flag and write a byte to the wake pipe. The accept loop polls the read end along
+	// with the listening socket so a stop request or a finished job is seen even while no client is connecting.
+	volatile sig_atomic_t StopRequested				= 0;
+	int WakePipe[2]									= { -1, -1 };
+}
+
+
+bool Daemon::ReadAll(int fd, void* dest, int numBytes)
+{
+	uint8* d = (uint8*)dest;
+	while (numBytes > 0)
+	{
+		ssize_t n = read(fd, d, numBytes);
+		if ((n < 0) && (errno == EINTR))
+			continue;
+		if (n <= 0)
+			return false;
+		d += n;
+		numBytes -= int(n);
+	}
+	return true;
+}
+
+
+bool Daemon::WriteAll(int fd, const void* src, int numBytes)
+{
+	const uint8* s = (const uint8*)src;
+	while (numBytes > 0)
+	{
+		ssize_t n = write(fd, s, numBytes);
+		if ((n < 0) && (errno == EINTR))
+			continue;
+		if (n <= 0)
+			return false;
+		s += n;
+		numBytes -= int(n);
+	}
+	return true;
+}
+
+
+bool Daemon::ReadString(int fd, tString& str)
+{
+	uint32 length = 0;
+	if (!ReadAll(fd, &length, sizeof(length)) || (length > MaxArgLength))
+		return false;
+
+	str.Clear();
+	if (length == 0)
+		return true;
+
+	char* buf = new char[length+1];
+	bool ok = ReadAll(fd, buf, length);
+	buf[length] = '\0';
+	if (ok)
+		str = buf;
+	delete[] buf;
+	return ok;
+}
+
+
+bool Daemon::WriteString(int fd, const tString& str)
+{
+	uint32 length = uint32(str.Length());
+	return WriteAll(fd, &length, sizeof(length)) && WriteAll(fd, str.Chr(), length);
+}
+
+
+bool Daemon::WriteFrame(int fd, char type, const void* payload, uint32 numBytes)
+{
+	return WriteAll(fd, &type, 1) && WriteAll(fd, &numBytes, sizeof(numBytes)) && WriteAll(fd, payload, numBytes);
+}
+
+
+bool Daemon::ReadRequest(int fd, tString& workingDir, tList<tStringItem>& args)
+{
+	uint32 magic = 0;
+	if (!ReadAll(fd, &magic, sizeof(magic)) || (magic != RequestMagic))
+		return false;
+
+	if (!ReadString(fd, workingDir))
+		return false;
+
+	uint32 numArgs = 0;
+	if (!ReadAll(fd, &numArgs, sizeof(numArgs)) || (numArgs > MaxArgs))
+		return false;
+
+	for (uint32 a = 0; a < numArgs; a++)
+	{
+		tStringItem* arg = new tStringItem;
+		args.Append(arg);
+		if (!ReadString(fd, *arg))
+			return false;
+	}
+
+	return true;
+}
+
+
+void Daemon::WakeServe()
+{
+	// Called from signal handlers. write is async-signal-safe and errno must survive for the interrupted code. A full
+	// pipe already guarantees a wakeup so a failed write is fine.
+	int savedErrno = errno;
+	char wake = 1;
+	ssize_t n = write(WakePipe[1], &wake, 1);
+	(void)n;
+	errno = savedErrno;
+}
+
+
+void Daemon::OnSignal(int)
+{
+	StopRequested = 1;
+	WakeServe();
+}
+
+
+void Daemon::OnChildExit(int)
+{
+	WakeServe();
+}
+
+
+int Daemon::Serve(const tString& socketPath, int maxJobs)
+{
+	if (maxJobs <= 0)
+		maxJobs = tSystem::tGetNumCores();
+
+	sockaddr_un addr;
+	tStd::tMemset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (socketPath.IsEmpty() || (socketPath.Length() >= int(sizeof(addr.sun_path))))
+	{
+		tPrintf("Daemon | Invalid socket path [%s].\n", socketPath.Chr());
+		return Viewer::ErrorCode_CLI_FailUnknown;
+	}
+	tStd::tStrcpy(addr.sun_path, socketPath.Chr());
+
+	// Close-on-exec so nothing a job execs keeps the daemon's socket or wake pipe open. Job children close them
+	// explicitly as well since they don't exec.
+	int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listenFd < 0)
+	{
+		tPrintf("Daemon | Could not create socket.\n");
+		return Viewer::ErrorCode_CLI_FailUnknown;
+	}
+
+	// A stale socket file from a previous daemon would make bind fail.
+	unlink(socketPath.Chr());
+	if ((bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0) || (listen(listenFd, 64) != 0))
+	{
+		tPrintf("Daemon | Could not listen on %s.\n", socketPath.Chr());
+		close(listenFd);
+		return Viewer::ErrorCode_CLI_FailUnknown;
+	}
+
+	if (pipe2(WakePipe, O_CLOEXEC | O_NONBLOCK) != 0)
+	{
+		tPrintf("Daemon | Could not create wake pipe.\n");
+		close(listenFd);
+		unlink(socketPath.Chr());
+		return Viewer::ErrorCode_CLI_FailUnknown;
+	}
+
+	struct sigaction action;
+	tStd::tMemset(&action, 0, sizeof(action));
+	action.sa_handler = OnSignal;
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+	action.sa_handler = OnChildExit;
+	action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &action, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+
+	// Single-threaded accept loop. The listening socket is only polled while a job slot is free, so excess clients
+	// wait in the listen backlog. Finished jobs are reaped whenever the wake pipe fires.
+	tPrintf("Daemon | Listening on %s with %d job slots.\n", socketPath.Chr(), maxJobs);
+	int runningJobs = 0;
+	while (!StopRequested)
+	{
+		pollfd fds[2] = { { WakePipe[0], POLLIN, 0 }, { listenFd, POLLIN, 0 } };
+		int numFds = (runningJobs < maxJobs) ? 2 : 1;
+		if ((poll(fds, numFds, -1) < 0) && (errno != EINTR))
+			break;
+
+		char drain[64];
+		while (read(WakePipe[0], drain, sizeof(drain)) > 0) { }
+		while (waitpid(-1, nullptr, WNOHANG) > 0)
+			runningJobs--;
+
+		if (StopRequested || (numFds < 2) || !(fds[1].revents & POLLIN))
+			continue;
+
+		int clientFd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+		if (clientFd < 0)
+			continue;
+
+		// The fork happens here, on the daemon's only thread. The daemon's copy of the client socket is closed right
+		// away so later jobs never inherit it.
+		fflush(stdout);
+		fflush(stderr);
+		pid_t job = fork();
+		if (job == 0)
+		{
+			close(WakePipe[0]);
+			close(WakePipe[1]);
+			RunJob(clientFd, listenFd);
+		}
+		if (job > 0)
+		{
+			runningJobs++;
+		}
+		else
+		{
+			tPrintf("Daemon | Could not start job.\n");
+			int32 exitCode = Viewer::ErrorCode_CLI_FailUnknown;
+			WriteFrame(clientFd, FrameExit, &exitCode, sizeof(exitCode));
+		}
+		close(clientFd);
+	}
+
+	// Let running jobs finish before removing the socket.
+	tPrintf("Daemon | Stopping.\n");
+	close(listenFd);
+	while (runningJobs > 0)
+	{
+		pid_t reaped = waitpid(-1, nullptr, 0);
+		if ((reaped < 0) && (errno != EINTR))
+			break;
+		if (reaped > 0)
+			runningJobs--;
+	}
+	close(WakePipe[0]);
+	close(WakePipe[1]);
+	unlink(socketPath.Chr());
+	return Viewer::ErrorCode_Success;
+}
+
+
+void Daemon::RunJob(int clientFd, int listenFd)
+{
+	// Job child. It owns exactly the client socket plus whatever the daemon had open before serving (stdio). Restore
+	// default signal handling so waitpid below and the job's own behaviour match a normal invocation.
+	close(listenFd);
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGCHLD, SIG_DFL);
+
+	int outputPipe[2] = { -1, -1 };
+	int errorPipe[2] = { -1, -1 };
+	pid_t worker = -1;
+	if ((pipe2(outputPipe, O_CLOEXEC) == 0) && (pipe2(errorPipe, O_CLOEXEC) == 0))
+		worker = fork();
+
+	if (worker == 0)
+	{
+		close(outputPipe[0]);
+		close(errorPipe[0]);
+		_exit(RunWorker(clientFd, outputPipe[1], errorPipe[1]));
+	}
+
+	if (worker < 0)
+	{
+		int32 exitCode = Viewer::ErrorCode_CLI_FailUnknown;
+		WriteFrame(clientFd, FrameExit, &exitCode, sizeof(exitCode));
+		_exit(exitCode);
+	}
+
+	close(outputPipe[1]);
+	close(errorPipe[1]);
+	_exit(RelayJob(clientFd, outputPipe[0], errorPipe[0], worker));
+}
+
+
+int Daemon::RunWorker(int clientFd, int outputFd, int errorFd)
+{
+	// Reads the request and becomes a normal CLI invocation with stdout and stderr going to separate relay pipes.
+	// There is no terminal to read from so stdin is /dev/null. dup2 clears close-on-exec on the standard handles.
+	dup2(outputFd, STDOUT_FILENO);
+	dup2(errorFd, STDERR_FILENO);
+	close(outputFd);
+	close(errorFd);
+	int nullFd = open("/dev/null", O_RDONLY);
+	if (nullFd >= 0)
+	{
+		dup2(nullFd, STDIN_FILENO);
+		close(nullFd);
+	}
+	signal(SIGPIPE, SIG_DFL);
+
+	timeval timeout;
+	timeout.tv_sec = RequestTimeoutSeconds;
+	timeout.tv_usec = 0;
+	setsockopt(clientFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	tString workingDir;
+	tList<tStringItem> args;
+	bool requestOk = ReadRequest(clientFd, workingDir, args);
+	close(clientFd);
+
+	int exitCode = Viewer::ErrorCode_CLI_FailUnknown;
+	if (!requestOk)
+	{
+		fprintf(stderr, "Error: Incomplete job request.\n");
+	}
+	else if (workingDir.IsEmpty() || (chdir(workingDir.Chr()) == 0))
+	{
+		int argc = args.GetNumItems() + 1;
+		char** argv = new char*[argc + 1];
+		argv[0] = (char*)"tacentview";
+		int a = 1;
+		for (tStringItem* arg = args.First(); arg; arg = arg->Next(), a++)
+			argv[a] = arg->Txt();
+		argv[argc] = nullptr;
+
+		tCmdLine::tParse(argc, argv);
+		exitCode = Command::Process();
+	}
+	else
+	{
+		fprintf(stderr, "Error: Could not change to directory %s\n", workingDir.Chr());
+	}
+
+	// The caller uses _exit to skip static destructors and atexit handlers inherited from the daemon.
+	fflush(stdout);
+	fflush(stderr);
+	return exitCode;
+}
+
+
+int Daemon::RelayJob(int clientFd, int outputFd, int errorFd, pid_t worker)
+{
+	// If the client goes away we keep draining so the worker never blocks on a full pipe. Both pipes are polled so a
+	// job writing a lot to one never stalls waiting for the other to be read.
+	bool clientOk = true;
+	char buffer[16*1024];
+	pollfd fds[2] = { { outputFd, POLLIN, 0 }, { errorFd, POLLIN, 0 } };
+	const char frameTypes[2] = { FrameOutput, FrameError };
+	int numOpen = 2;
+	while (numOpen > 0)
+	{
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (int f = 0; f < 2; f++)
+		{
+			if ((fds[f].fd < 0) || !(fds[f].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+
+			ssize_t n = read(fds[f].fd, buffer, sizeof(buffer));
+			if ((n < 0) && (errno == EINTR))
+				continue;
+			if (n <= 0)
+			{
+				// A negative fd is ignored by poll.
+				close(fds[f].fd);
+				fds[f].fd = -1;
+				numOpen--;
+				continue;
+			}
+			if (clientOk)
+				clientOk = WriteFrame(clientFd, frameTypes[f], buffer, uint32(n));
+		}
+	}
+	for (int f = 0; f < 2; f++)
+		if (fds[f].fd >= 0)
+			close(fds[f].fd);
+
+	int status = 0;
+	while ((waitpid(worker, &status, 0) < 0) && (errno == EINTR)) { }
+	int32 exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : Viewer::ErrorCode_CLI_FailUnknown;
+	if (clientOk)
+		WriteFrame(clientFd, FrameExit, &exitCode, sizeof(exitCode));
+	close(clientFd);
+	return exitCode;
+}
+
+
+int Daemon::Submit(const tString& socketPath, int argc, char** argv)
+{
+	sockaddr_un addr;
+	tStd::tMemset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	int fd = -1;
+
+	// A job reading stdin always runs here since the daemon's job process has no access to this process's stdin.
+	bool readsStdin = false;
+	for (int a = 1; a < argc; a++)
+		if (tStd::tStrcmp(argv[a], "-") == 0)
+			readsStdin = true;
+
+	if (!readsStdin && !socketPath.IsEmpty() && (socketPath.Length() < int(sizeof(addr.sun_path))))
+	{
+		tStd::tStrcpy(addr.sun_path, socketPath.Chr());
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if ((fd >= 0) && (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0))
+		{
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	// No daemon. Run the job here. The command line has already been parsed.
+	if (fd < 0)
+		return Command::Process();
+
+	signal(SIGPIPE, SIG_IGN);
+	tList<tStringItem> args;
+	for (int a = 1; a < argc; a++)
+	{
+		tString arg(argv[a]);
+		if (arg == "--client")
+		{
+			a++;
+			continue;
+		}
+		args.Append(new tStringItem(arg));
+	}
+
+	uint32 magic = RequestMagic;
+	uint32 numArgs = uint32(args.GetNumItems());
+	bool ok = WriteAll(fd, &magic, sizeof(magic)) && WriteString(fd, tSystem::tGetCurrentDir()) && WriteAll(fd, &numArgs, sizeof(numArgs));
+	for (tStringItem* arg = args.First(); arg && ok; arg = arg->Next())
+		ok = WriteString(fd, *arg);
+
+	int32 exitCode = Viewer::ErrorCode_CLI_FailUnknown;
+	char buffer[16*1024];
+	while (ok)
+	{
+		char type = 0;
+		uint32 length = 0;
+		if (!ReadAll(fd, &type, 1) || !ReadAll(fd, &length, sizeof(length)))
+			break;
+
+		if (type == FrameExit)
+		{
+			if (length == sizeof(exitCode))
+				ReadAll(fd, &exitCode, sizeof(exitCode));
+			break;
+		}
+
+		while (length > 0)
+		{
+			int chunk = tMath::tMin(int(length), int(sizeof(buffer)));
+			if (!ReadAll(fd, buffer, chunk))
+			{
+				ok = false;
+				break;
+			}
+			if (type == FrameOutput)
+				WriteAll(STDOUT_FILENO, buffer, chunk);
+			else if (type == FrameError)
+				WriteAll(STDERR_FILENO, buffer, chunk);
+			length -= chunk;
+		}
+	}
+
+	close(fd);
+	return exitCode;
+}
+
+
+#else
+
+
+int Daemon::Serve(const tString& socketPath, int maxJobs)
+{
+	tPrintf("Daemon mode is only supported on Linux.\n");
+	return Viewer::ErrorCode_CLI_FailUnknown;
+}
+
+
+int Daemon::Submit(const tString& socketPath, int argc, char** argv)
+{
+	// Without a daemon the client runs the job directly.
+	return Command::Process();
+}
+
+
+#endif
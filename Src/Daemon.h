@@ -0,0 +1,33 @@
+// Daemon.h
+//
+// Persistent batch-processing daemon. A daemon process listens on a local Unix-domain socket and runs CLI jobs sent
+// to it by clients. A job is the same argument list you would give tacentview directly. Output and the exit code of
+// each job are streamed back to the client that submitted it. Only available on Linux.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <Foundation/tString.h>
+
+
+namespace Daemon
+{
+	// Serves jobs on socketPath until interrupted (SIGINT or SIGTERM). At most maxJobs run at the same time. If maxJobs
+	// is <= 0 the number of cores is used. Each request is read by its forked job process under a timeout, so a
+	// stalled client never blocks the accept loop. Returns a Viewer::ErrorCode.
+	int Serve(const tString& socketPath, int maxJobs);
+
+	// Sends the job described by argv to the daemon at socketPath and streams the job's stdout and stderr to this
+	// process's stdout and stderr. The job's stdin is /dev/null. The --client option and its argument are removed
+	// before sending. If no daemon is listening, or the job reads stdin (a - input), the job is run in this process
+	// instead so the client is a drop-in replacement for direct invocation. Returns the job's exit code.
+	int Submit(const tString& socketPath, int argc, char** argv);
+}
@@ -0,0 +1,220 @@
+// EditTask.cpp
+//
+// Runs long image edits (and other long operations like Save All) on a worker thread so the UI stays responsive. An
+// image edit works on a private snapshot of the target image. While it runs a modal shows progress and a Cancel
+// button. When it completes the snapshot's pictures are committed to the target in one step with a single undo entry.
+// A cancelled edit leaves the target untouched. Only one task runs at a time.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <Math/tVector2.h>
+#include <System/tTime.h>
+#include <System/tPrint.h>
+#include "imgui.h"
+#include "EditTask.h"
+#include "Image.h"
+#include "GuiUtil.h"
+using namespace tMath;
+using namespace tImage;
+
+
+namespace Viewer
+{
+	EditTask* ActiveTask = nullptr;
+	const char* EditTaskPopupName = "Working##EditTask";
+	void RunEditTask(EditTask*);
+	void FinishEditTask(bool completed);
+}
+
+
+bool Viewer::EditTask::ForEachPicture(Image& image, const std::function<void(tPicture&)>& edit)
+{
+	const tList<tPicture>& pictures = image.GetPictures();
+	int numPictures = pictures.GetNumItems();
+	int index = 0;
+	for (tPicture* picture = pictures.First(); picture; picture = picture->Next(), index++)
+	{
+		if (IsCancelled())
+			return false;
+		SetProgress(float(index) / float(numPictures));
+		edit(*picture);
+	}
+
+	SetProgress(1.0f);
+	return true;
+}
+
+
+void Viewer::RunEditTask(EditTask* task)
+{
+	task->Result = task->Work(*task);
+	task->Done = true;
+}
+
+
+bool Viewer::StartEditTask(const tString& name, EditTask::WorkFn work, EditTask::FinishFn finish, float approxSeconds)
+{
+	if (ActiveTask || !work)
+		return false;
+
+	ActiveTask					= new EditTask;
+	ActiveTask->Name			= name;
+	ActiveTask->Work			= work;
+	ActiveTask->Finish			= finish;
+	ActiveTask->ApproxSeconds	= approxSeconds;
+	ActiveTask->StartTime		= tSystem::tGetTime();
+	ActiveTask->Worker			= std::thread(RunEditTask, ActiveTask);
+	return true;
+}
+
+
+bool Viewer::StartImageEditTask
+(
+	Image* target, const tString& undoDesc,
+	std::function<bool(Image&, EditTask&)> edit,
+	std::function<void()> onCommit, float approxSeconds
+)
+{
+	if (ActiveTask || !target || !target->IsLoaded() || !edit)
+		return false;
+
+	// The snapshot is made here on the main thread. The worker only ever touches the snapshot so the target may keep
+	// being displayed while the edit runs. Undo is disabled on the snapshot since the commit pushes the only entry.
+	Image* snapshot = new Image;
+	snapshot->SetUndoEnabled(false);
+	if (!snapshot->LoadFrom(*target))
+	{
+		delete snapshot;
+		return false;
+	}
+
+	EditTask::WorkFn work = [snapshot, edit](EditTask& task) -> bool
+	{
+		return edit(*snapshot, task);
+	};
+
+	EditTask::FinishFn finish = [snapshot, target, undoDesc, onCommit](EditTask& task, bool completed)
+	{
+		if (completed && task.Result)
+		{
+			if (target->IsLoaded())
+			{
+				target->TakePictures(*snapshot, undoDesc);
+				target->Bind();
+				if (onCommit)
+					onCommit();
+			}
+			else
+			{
+				tPrintf("%s not applied. The image was unloaded while it ran.\n", undoDesc.Chr());
+			}
+		}
+		delete snapshot;
+	};
+
+	if (!StartEditTask(undoDesc, work, finish, approxSeconds))
+	{
+		delete snapshot;
+		return false;
+	}
+
+	ActiveTask->Target = target;
+	return true;
+}
+
+
+bool Viewer::IsEditTaskRunning()
+{
+	return ActiveTask != nullptr;
+}
+
+
+bool Viewer::IsEditTaskTarget(const Image* image)
+{
+	return ActiveTask && image && (ActiveTask->Target == image);
+}
+
+
+void Viewer::FinishEditTask(bool completed)
+{
+	tAssert(ActiveTask);
+	EditTask* task = ActiveTask;
+	if (task->Worker.joinable())
+		task->Worker.join();
+
+	// The task is no longer active while it finishes, so a finish function that repopulates the images does not
+	// cancel it again.
+	ActiveTask = nullptr;
+	if (task->Finish)
+		task->Finish(*task, completed);
+
+	delete task;
+}
+
+
+void Viewer::CancelEditTask()
+{
+	if (!ActiveTask)
+		return;
+
+	ActiveTask->Cancelled = true;
+	FinishEditTask(false);
+}
+
+
+void Viewer::DoEditTaskModal()
+{
+	if (!ActiveTask)
+		return;
+
+	if (!ImGui::IsPopupOpen(EditTaskPopupName))
+		ImGui::OpenPopup(EditTaskPopupName);
+
+	// No close button. The only way out is to cancel or wait for the task to finish.
+	if (!ImGui::BeginPopupModal(EditTaskPopupName, nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoScrollbar))
+		return;
+
+	float barWidth		= Gutil::GetUIParamScaled(306.0f, 2.5f);
+	float buttonWidth	= Gutil::GetUIParamScaled(76.0f, 2.5f);
+
+	float elapsed = tSystem::tGetTime() - ActiveTask->StartTime;
+	float progress = ActiveTask->GetProgress();
+
+	// Tasks often only report progress between frames, so for single frame images the approximate duration (if
+	// there is one) keeps the bar moving. It is capped so the bar does not sit at 100% if the estimate was low.
+	if (ActiveTask->ApproxSeconds > 0.0f)
+		progress = tMax(progress, tMin(elapsed / ActiveTask->ApproxSeconds, 0.95f));
+
+	ImGui::Text("%s", ActiveTask->Name.Chr());
+	if (progress >= 0.0f)
+	{
+		ImGui::ProgressBar(tClamp(progress, 0.0f, 1.0f), tVector2(barWidth, 0.0f));
+	}
+	else
+	{
+		tString overlay; tsPrintf(overlay, "%.1f s", elapsed);
+		ImGui::ProgressBar(0.0f, tVector2(barWidth, 0.0f), overlay.Chr());
+	}
+
+	ImGui::NewLine();
+	if (ActiveTask->IsCancelled())
+		ImGui::Text("Cancelling...");
+	else if (Gutil::Button("Cancel", tVector2(buttonWidth, 0.0f)))
+		ActiveTask->Cancelled = true;
+
+	if (ActiveTask->Done)
+	{
+		FinishEditTask(!ActiveTask->IsCancelled());
+		ImGui::CloseCurrentPopup();
+	}
+
+	ImGui::EndPopup();
+}
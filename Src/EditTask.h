@@ -0,0 +1,88 @@
+// EditTask.h
+//
+// Runs long image edits (and other long operations like Save All) on a worker thread so the UI stays responsive. An
+// image edit works on a private snapshot of the target image. While it runs a modal shows progress and a Cancel
+// button. When it completes the snapshot's pictures are committed to the target in one step with a single undo entry.
+// A cancelled edit leaves the target untouched. Only one task runs at a time.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <Foundation/tString.h>
+#include <Image/tPicture.h>
+
+
+namespace Viewer
+{
+	class Image;
+
+	// The work function runs on the worker thread. It should check IsCancelled and call SetProgress between steps
+	// when it can. Steps it cannot interrupt (a single call into the quantizer for example) just delay the cancel.
+	struct EditTask
+	{
+		// The work function returns true if it did something that should be committed.
+		typedef std::function<bool(EditTask&)> WorkFn;
+
+		// Called on the main thread once the work function returns. completed is false if the task was cancelled.
+		typedef std::function<void(EditTask&, bool completed)> FinishFn;
+
+		bool IsCancelled() const																{ return Cancelled; }
+
+		// Fraction done in [0, 1]. A negative value means unknown. The modal shows the larger of this and the fraction
+		// of the approximate duration (if one was given) that has elapsed. With neither it shows the elapsed time.
+		void SetProgress(float fraction)														{ Progress = fraction; }
+		float GetProgress() const																{ return Progress; }
+
+		// Calls edit for every picture of image in order, updating progress as it goes. Returns false if the task was
+		// cancelled before all pictures were visited.
+		bool ForEachPicture(Image&, const std::function<void(tImage::tPicture&)>& edit);
+
+		tString Name;
+		WorkFn Work;
+		FinishFn Finish;
+		float ApproxSeconds																		= 0.0f;
+		float StartTime																			= 0.0f;
+		bool Result																				= false;
+		Image* Target																			= nullptr;	// Only set for image edits.
+		std::thread Worker;
+		std::atomic<float> Progress																= -1.0f;
+		std::atomic<bool> Cancelled																= false;
+		std::atomic<bool> Done																	= false;
+	};
+
+	// Starts a general task. Returns false if a task is already running.
+	bool StartEditTask(const tString& name, EditTask::WorkFn, EditTask::FinishFn = nullptr, float approxSeconds = 0.0f);
+
+	// Starts an edit of target. The edit function receives a snapshot of target (with undo disabled) and returns true if
+	// it changed it. On completion the snapshot's pictures replace target's under a single undo entry named undoDesc,
+	// the target is rebound, and onCommit (if set) is called on the main thread. Returns false if a task is already
+	// running or target is not loaded. Callers that destroy or unload images must not touch the target while the task
+	// runs. See IsEditTaskTarget and CancelEditTask.
+	bool StartImageEditTask
+	(
+		Image* target, const tString& undoDesc,
+		std::function<bool(Image& snapshot, EditTask&)> edit,
+		std::function<void()> onCommit = nullptr, float approxSeconds = 0.0f
+	);
+
+	bool IsEditTaskRunning();
+	bool IsEditTaskTarget(const Image*);
+
+	// Cancels any running task and waits for it to stop. Nothing is committed. Call before the images are destroyed.
+	// Safe to call from a finish function, where it does nothing.
+	void CancelEditTask();
+
+	// Call every frame. Shows the progress modal while a task runs and finishes the task when it is done.
+	void DoEditTaskModal();
+}
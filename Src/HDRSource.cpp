@@ -0,0 +1,312 @@
+// HDRSource.cpp
+//
+// A retained copy of the pixels of a Radiance HDR image. The run-length encoded scanlines are decoded once into
+// their RGBE bytes so changing the exposure or gamma in the property editor only needs the conversion to 8-bit to run
+// again rather than a reload from disk. Keeping the RGBE bytes loses nothing before the exposure is applied. Each
+// output channel is a function of its mantissa and the shared exponent, so the conversion is a single 64K entry
+// lookup table over row bands spread across all cores.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <cmath>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <Foundation/tStandard.h>
+#include <Math/tFundamentals.h>
+#include <System/tFile.h>
+#include <System/tMachine.h>
+#include "HDRSource.h"
+using namespace tMath;
+
+
+namespace Viewer
+{
+	// Below this many pixels the conversion runs on the calling thread.
+	const int HDRMinParallelPixels = 128*1024;
+	const int HDRBandRows = 32;
+
+	// Radiance limits. Scanlines outside this width range are never run-length encoded.
+	const int RGBEMinEncodedWidth = 8;
+	const int RGBEMaxEncodedWidth = 0x7FFF;
+
+	// Exponent offset and the largest gamma table shift used by the Radiance colrs_gambs mapping, which tImageHDR
+	// uses to convert to 8-bit.
+	const int RGBEExponentOffset = 128;
+	const int RGBEMaxGammaShift = 31;
+
+	// Reads a newline terminated header line into line (truncated to lineSize-1 chars). Returns false at the end of
+	// the data.
+	bool ReadHeaderLine(const uint8*& cursor, const uint8* end, char* line, int lineSize);
+
+	// Reads one scanline into scan (4 bytes per pixel). Returns false if the data is truncated or malformed.
+	bool ReadScanline(const uint8*& cursor, const uint8* end, uint8* scan, int width);
+	bool ReadScanlineFlat(const uint8*& cursor, const uint8* end, uint8* scan, int width);
+}
+
+
+bool Viewer::ReadHeaderLine(const uint8*& cursor, const uint8* end, char* line, int lineSize)
+{
+	if (cursor >= end)
+		return false;
+
+	int len = 0;
+	while ((cursor < end) && (*cursor != '\n'))
+	{
+		if (len < lineSize-1)
+			line[len++] = char(*cursor);
+		cursor++;
+	}
+	line[len] = '\0';
+
+	// Skip the newline.
+	if (cursor < end)
+		cursor++;
+	return true;
+}
+
+
+bool Viewer::ReadScanlineFlat(const uint8*& cursor, const uint8* end, uint8* scan, int width)
+{
+	// Uncompressed or old-style run-length encoded. A (1,1,1,n) pixel repeats the previous pixel n times, with
+	// consecutive repeat pixels forming increasingly significant bytes of the count.
+	int x = 0;
+	int shift = 0;
+	while (x < width)
+	{
+		if (end - cursor < 4)
+			return false;
+
+		const uint8* rgbe = cursor;
+		cursor += 4;
+		if ((rgbe[0] == 1) && (rgbe[1] == 1) && (rgbe[2] == 1))
+		{
+			if ((x == 0) || (shift > 16))
+				return false;
+
+			int count = int(rgbe[3]) << shift;
+			if (count > width - x)
+				return false;
+
+			for (int c = 0; c < count; c++, x++)
+				tStd::tMemcpy(scan + 4*x, scan + 4*(x-1), 4);
+			shift += 8;
+		}
+		else
+		{
+			tStd::tMemcpy(scan + 4*x, rgbe, 4);
+			x++;
+			shift = 0;
+		}
+	}
+	return true;
+}
+
+
+bool Viewer::ReadScanline(const uint8*& cursor, const uint8* end, uint8* scan, int width)
+{
+	// New-style scanlines start with 2, 2, and the 15-bit width. Anything else is flat or old-style.
+	if ((width < RGBEMinEncodedWidth) || (width > RGBEMaxEncodedWidth) || (end - cursor < 4))
+		return ReadScanlineFlat(cursor, end, scan, width);
+	if ((cursor[0] != 2) || (cursor[1] != 2) || (cursor[2] & 0x80))
+		return ReadScanlineFlat(cursor, end, scan, width);
+	if (((int(cursor[2]) << 8) | int(cursor[3])) != width)
+		return false;
+	cursor += 4;
+
+	// Each channel is run-length encoded separately.
+	for (int channel = 0; channel < 4; channel++)
+	{
+		int x = 0;
+		while (x < width)
+		{
+			if (cursor >= end)
+				return false;
+
+			int code = *cursor++;
+			if (code > 128)
+			{
+				int count = code & 0x7F;
+				if ((count > width - x) || (cursor >= end))
+					return false;
+				uint8 value = *cursor++;
+				for (int c = 0; c < count; c++, x++)
+					scan[4*x + channel] = value;
+			}
+			else
+			{
+				int count = code;
+				if ((count == 0) || (count > width - x) || (end - cursor < count))
+					return false;
+				for (int c = 0; c < count; c++, x++)
+					scan[4*x + channel] = *cursor++;
+			}
+		}
+	}
+	return true;
+}
+
+
+bool Viewer::HDRSource::Load(const tString& filename)
+{
+	Clear();
+	int numBytes = tSystem::tGetFileSize(filename);
+	if (numBytes <= 0)
+		return false;
+
+	int numRead = numBytes;
+	uint8* data = tSystem::tLoadFileHead(filename, numRead);
+	if (!data)
+		return false;
+	if (numRead != numBytes)
+	{
+		delete[] data;
+		return false;
+	}
+
+	const uint8* cursor = data;
+	const uint8* end = data + numBytes;
+	char line[256];
+	bool ok = ReadHeaderLine(cursor, end, line, sizeof(line)) && (line[0] == '#') && (line[1] == '?');
+
+	// Header lines up to an empty line. Only the format matters. Exposure lines record what was done to the pixel
+	// values and do not change how they are displayed.
+	bool rgbe = true;
+	while (ok)
+	{
+		ok = ReadHeaderLine(cursor, end, line, sizeof(line));
+		if (!ok || (line[0] == '\0'))
+			break;
+		if (tStd::tStrncmp(line, "FORMAT=", 7) == 0)
+			rgbe = (tStd::tStrncmp(line + 7, "32-bit_rle_rgbe", 15) == 0);
+	}
+
+	// The resolution string. Radiance writes top row first (-Y) but bottom row first (+Y) is also allowed. Files
+	// with the X and Y axes swapped or a reversed X axis are not supported.
+	int width = 0, height = 0;
+	bool topFirst = true;
+	if (ok && rgbe && ReadHeaderLine(cursor, end, line, sizeof(line)))
+	{
+		if (std::sscanf(line, "-Y %d +X %d", &height, &width) == 2)
+			topFirst = true;
+		else if (std::sscanf(line, "+Y %d +X %d", &height, &width) == 2)
+			topFirst = false;
+	}
+
+	if ((width <= 0) || (height <= 0) || (int64(width)*int64(height) > int64(0x7FFFFFFF/4)))
+	{
+		delete[] data;
+		return false;
+	}
+
+	// Scanlines are read straight into their row.
+	std::vector<uint8> pixels(size_t(width)*size_t(height)*4);
+	ok = true;
+	for (int s = 0; (s < height) && ok; s++)
+	{
+		int row = topFirst ? (height - 1 - s) : s;
+		ok = ReadScanline(cursor, end, pixels.data() + size_t(row)*size_t(width)*4, width);
+	}
+
+	delete[] data;
+	if (!ok)
+		return false;
+
+	Width = width;
+	Height = height;
+	Pixels.swap(pixels);
+	return true;
+}
+
+
+void Viewer::HDRSource::Convert(tPixel4b* dst, float gamma, int exposure) const
+{
+	if (!IsValid() || !dst)
+		return;
+
+	// This is the tImageHDR conversion step for step so a reconvert matches a reload exactly. The exposure shifts the
+	// stored exponent like Radiance shiftcolrs, with the same 8-bit exponent arithmetic. colrs_gambs then maps each
+	// mantissa through tables built at 1:1 (mantissa) and at every power of two darker (gammaShift). Exponents too
+	// dark for the shifted tables are rounded down into the darkest one. The result is tabulated here by stored
+	// exponent then mantissa.
+	double invGamma = 1.0 / double(tMax(gamma, 0.01f));
+	uint8 mantissa[256];
+	for (int m = 0; m < 256; m++)
+		mantissa[m] = uint8(256.0 * std::pow((double(m) + 0.5) / 256.0, invGamma));
+
+	std::vector<uint8> gammaShift((RGBEMaxGammaShift+1)*256);
+	double mult = 1.0 / 256.0;
+	for (int shift = 0; shift <= RGBEMaxGammaShift; shift++, mult *= 0.5)
+		for (int m = 0; m < 256; m++)
+			gammaShift[shift*256 + m] = uint8(256.0 * std::pow((double(m) + 0.5) * mult, invGamma));
+
+	std::vector<uint8> table(0x10000, 0);
+	int minExponent = (exposure < 0) ? -exposure : 0;
+	for (int e = 0; e < 256; e++)
+	{
+		if ((exposure != 0) && (e <= minExponent))
+			continue;
+
+		uint8 shifted = uint8(e + exposure);
+		int expo = int(shifted) - RGBEExponentOffset;
+		uint8* entry = table.data() + (e << 8);
+		for (int m = 0; m < 256; m++)
+		{
+			if (expo < -RGBEMaxGammaShift)
+			{
+				if (expo >= -RGBEMaxGammaShift-8)
+				{
+					int i = (-RGBEMaxGammaShift-1) - expo;
+					entry[m] = gammaShift[RGBEMaxGammaShift*256 + (((m >> i) + 1) >> 1)];
+				}
+			}
+			else if (expo > 0)
+			{
+				int i = ((m << 1) | 1) << tMin(expo-1, 8);
+				entry[m] = ((expo > 8) || (i > 255)) ? 255 : mantissa[i];
+			}
+			else
+			{
+				entry[m] = gammaShift[-expo*256 + m];
+			}
+		}
+	}
+
+	int numBands = (Height + HDRBandRows - 1) / HDRBandRows;
+	std::atomic<int> nextBand = 0;
+	auto worker = [&]()
+	{
+		for (int band = nextBand++; band < numBands; band = nextBand++)
+		{
+			int y0 = band*HDRBandRows;
+			int y1 = tMin(y0 + HDRBandRows, Height);
+			const uint8* src = Pixels.data() + size_t(y0)*size_t(Width)*4;
+			tPixel4b* out = dst + size_t(y0)*size_t(Width);
+			int count = (y1 - y0)*Width;
+			for (int p = 0; p < count; p++, src += 4)
+			{
+				const uint8* entry = table.data() + (int(src[3]) << 8);
+				out[p].R = entry[src[0]];
+				out[p].G = entry[src[1]];
+				out[p].B = entry[src[2]];
+				out[p].A = 255;
+			}
+		}
+	};
+
+	int numThreads = (Width*Height < HDRMinParallelPixels) ? 1 : tClamp(tSystem::tGetNumCores(), 1, numBands);
+	std::vector<std::thread> workers;
+	for (int w = 1; w < numThreads; w++)
+		workers.emplace_back(worker);
+	worker();
+	for (std::thread& w : workers)
+		w.join();
+}
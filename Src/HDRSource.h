@@ -0,0 +1,53 @@
+// HDRSource.h
+//
+// A retained copy of the pixels of a Radiance HDR image. The run-length encoded scanlines are decoded once into
+// their RGBE bytes so changing the exposure or gamma in the property editor only needs the conversion to 8-bit to run
+// again rather than a reload from disk. Keeping the RGBE bytes loses nothing before the exposure is applied. Each
+// output channel is a function of its mantissa and the shared exponent, so the conversion is a single 64K entry
+// lookup table over row bands spread across all cores.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <vector>
+#include <Foundation/tString.h>
+#include <Math/tColour.h>
+
+
+namespace Viewer
+{
+	class HDRSource
+	{
+	public:
+		HDRSource()																										{ }
+
+		// Decodes the file. Only 32-bit_rle_rgbe files are supported. The rows may be stored top first (-Y, what
+		// Radiance writes) or bottom first (+Y), but the columns must run left to right (+X) and not be swapped with
+		// the rows. Returns false and leaves the source invalid otherwise.
+		bool Load(const tString& filename);
+		void Clear()																									{ Width = 0; Height = 0; Pixels.clear(); Pixels.shrink_to_fit(); }
+		bool IsValid() const																							{ return (Width > 0) && (Height > 0); }
+
+		int GetWidth() const																							{ return Width; }
+		int GetHeight() const																							{ return Height; }
+		int GetMemSizeBytes() const																						{ return int(Pixels.size()); }
+
+		// Converts to 8-bit exactly as tImageHDR does when loading with the same gamma and exposure: the exposure
+		// shifts the exponent, then the Radiance colrs_gambs tables map each mantissa. The result is identical to a
+		// reload, which tacentview_bench --hdr checks. Dst must hold width*height pixels. Alpha is opaque.
+		void Convert(tPixel4b* dst, float gamma, int exposure) const;
+
+	private:
+		int Width = 0;
+		int Height = 0;
+		std::vector<uint8> Pixels;			// RGBE bytes. Bottom row first like tPicture.
+	};
+}
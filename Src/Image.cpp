@@ -13,6 +13,8 @@
 // PERFORMANCE OF THIS SOFTWARE.
 
 #include <mutex>
+#include <vector>
+#include <unordered_set>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>				// Include glfw3.h after our OpenGL definitions.
 #include <Foundation/tHash.h>
@@ -22,8 +24,11 @@
 #include <System/tMachine.h>
 #include <System/tChunk.h>
 #include <Math/tRandom.h>
+#include <Image/tResample.h>
 #include "Image.h"
 #include "Config.h"
+#include "Mipmap.h"
+#include "Resampler.h"
 using namespace tStd;
 using namespace tSystem;
 using namespace tImage;
@@ -35,6 +40,7 @@ static tMath::tRandom::tGeneratorMersenneTwister ShuffleGenerator((uint64)tSyste
 
 
 const uint32 Image::ThumbChunkInfoID		= 0x0B000000;
+const uint32 Image::StatsChunkID			= 0x0B010000;
 const int Image::ThumbWidth					= 256;
 const int Image::ThumbHeight				= 144;
 const int Image::ThumbMinDispWidth			= 64;
@@ -81,6 +87,8 @@ Image::Image(const tSystem::tFileInfo& fileInfo) :
 
 Image::~Image()
 {
+	InvalidateStats();
+
 	// If we're being destroyed before the thumbnail thread is done, we have to wait because that thread
 	// accesses the thumbnail picture of this object... so 'this' must be valid.
 	if (ThumbnailThread.joinable())
@@ -180,15 +188,23 @@ bool Image::Load(bool loadParamsFromConfig)
 	Config::ProfileData& profile = Config::GetProfileData();
 	tSystem::tFileType loadingFiletype = Filetype;
 	bool detectAPNGInsidePNG = loadParamsFromConfig ? profile.DetectAPNGInsidePNG : LoadParams_DetectAPNGInsidePNG;
-	if ((Filetype == tSystem::tFileType::PNG) && detectAPNGInsidePNG && tImageAPNG::IsAnimatedPNG(Filename))
+	if ((Filetype == tSystem::tFileType::PNG) && detectAPNGInsidePNG && !FileData && tImageAPNG::IsAnimatedPNG(Filename))
 		loadingFiletype = tSystem::tFileType::APNG;
 
+	// Only the PNG and JPG decoders can read from memory.
+	if (FileData && (loadingFiletype != tSystem::tFileType::PNG) && (loadingFiletype != tSystem::tFileType::JPG))
+		return false;
+
 	Info.SrcPixelFormat		= tPixelFormat::Invalid;
 	Info.SrcColourProfile	= tColourProfile::Unspecified;
 	Info.AlphaMode			= tAlphaMode::Unspecified;
 	Info.ChannelType		= tChannelType::Unspecified;
 	bool success = false;
 
+	// The load params that change the pixels are part of the stats cache key. Hashing the bytes of the params struct
+	// is conservative. Padding can only cause a cache miss, never a false hit.
+	tuint256 paramsHash = 0;
+
 	switch (loadingFiletype)
 	{
 		case tSystem::tFileType::APNG:
@@ -235,6 +251,7 @@ bool Image::Load(bool loadParamsFromConfig)
 		case tSystem::tFileType::EXR:
 		{
 			tImageEXR exr;
+			paramsHash = tHash::tHashData256((uint8*)&LoadParams_EXR, sizeof(LoadParams_EXR));
 			bool ok = exr.Load(Filename, LoadParams_EXR);
 			if (!ok)
 				break;
@@ -280,6 +297,7 @@ bool Image::Load(bool loadParamsFromConfig)
 		case tSystem::tFileType::HDR:
 		{
 			tImageHDR hdr;
+			paramsHash = tHash::tHashData256((uint8*)&LoadParams_HDR, sizeof(LoadParams_HDR));
 			bool ok = hdr.Load(Filename, LoadParams_HDR);
 			if (!ok)
 				break;
@@ -336,7 +354,8 @@ bool Image::Load(bool loadParamsFromConfig)
 					params.Flags &= ~tImageJPG::LoadFlag_ExifOrient;
 			}
 
-			bool ok = jpg.Load(Filename, params);
+			paramsHash = tHash::tHashData256((uint8*)&params, sizeof(params));
+			bool ok = FileData ? jpg.Load(FileData, FileDataSize, params) : jpg.Load(Filename, params);
 			if (!ok)
 				break;
 
@@ -367,7 +386,8 @@ bool Image::Load(bool loadParamsFromConfig)
 			}
 
 			tAssert(params.Flags & tImagePNG::LoadFlag_ForceToBpc8);
-			bool ok = png.Load(Filename, params);
+			paramsHash = tHash::tHashData256((uint8*)&params, sizeof(params));
+			bool ok = FileData ? png.Load(FileData, FileDataSize, params) : png.Load(Filename, params);
 			if (!ok)
 				break;
 
@@ -387,6 +407,7 @@ bool Image::Load(bool loadParamsFromConfig)
 		{
 			tImageTGA tga;
 			tImageTGA::LoadParams params = LoadParams_TGA;
+			paramsHash = tHash::tHashData256((uint8*)&params, sizeof(params));
 			bool ok = tga.Load(Filename, params);
 			if (!ok)
 				break;
@@ -480,6 +501,7 @@ bool Image::Load(bool loadParamsFromConfig)
 			}
 
 			tImageDDS dds;
+			paramsHash = tHash::tHashData256((uint8*)&params, sizeof(params));
 			bool ok = dds.Load(Filename, params);
 			if (!ok || !dds.IsValid())
 				break;
@@ -512,6 +534,7 @@ bool Image::Load(bool loadParamsFromConfig)
 			}
 
 			tImagePVR pvr;
+			paramsHash = tHash::tHashData256((uint8*)&params, sizeof(params));
 			bool ok = pvr.Load(Filename, params);
 			if (!ok || !pvr.IsValid())
 				break;
@@ -531,6 +554,7 @@ bool Image::Load(bool loadParamsFromConfig)
 		case tSystem::tFileType::KTX2:
 		{
 			tImageKTX ktx;
+			paramsHash = tHash::tHashData256((uint8*)&LoadParams_KTX, sizeof(LoadParams_KTX));
 			bool ok = ktx.Load(Filename, LoadParams_KTX);
 			if (!ok || !ktx.IsValid())
 				break;
@@ -549,6 +573,7 @@ bool Image::Load(bool loadParamsFromConfig)
 		case tSystem::tFileType::ASTC:
 		{
 			tImageASTC astc;
+			paramsHash = tHash::tHashData256((uint8*)&LoadParams_ASTC, sizeof(LoadParams_ASTC));
 			bool ok = astc.Load(Filename, LoadParams_ASTC);
 			if (!ok)
 				break;
@@ -575,6 +600,7 @@ bool Image::Load(bool loadParamsFromConfig)
 		case tSystem::tFileType::PKM:
 		{
 			tImagePKM pkm;
+			paramsHash = tHash::tHashData256((uint8*)&LoadParams_PKM, sizeof(LoadParams_PKM));
 			bool ok = pkm.Load(Filename, LoadParams_PKM);
 			if (!ok)
 				break;
@@ -604,20 +630,10 @@ bool Image::Load(bool loadParamsFromConfig)
 
 	LoadedTime = tSystem::tGetTime();
 
-	// Fill in rest of info struct.
-	bool foundOpaque = false; bool foundTransparent = false;
-	for (tPicture* pic = Pictures.First(); pic; pic = pic->Next())
-	{
-		if (pic->IsOpaque())
-			foundOpaque = true;
-		else
-			foundTransparent = true;
-	}
-	Info.Opacity = ImgInfo::OpacityEnum::Varies;
-	if (foundOpaque && !foundTransparent)
-		Info.Opacity = ImgInfo::OpacityEnum::True;
-	else if (foundTransparent && !foundOpaque)
-		Info.Opacity = ImgInfo::OpacityEnum::False;
+	// Fill in rest of info struct. Opacity needs a pass over every pixel so it comes from the stats once they are ready.
+	Info.Opacity = ImgInfo::OpacityEnum::Unknown;
+	StatsFromFile = true;
+	StatsLoadParamsHash = tHash::tHashData256((uint8*)&loadingFiletype, sizeof(loadingFiletype), paramsHash);
 
 	Info.FileSizeBytes		= tSystem::tGetFileSize(Filename);
 	Info.MemSizeBytes		= GetMemSizeBytes();
@@ -627,6 +643,18 @@ bool Image::Load(bool loadParamsFromConfig)
 
 
 bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveParams, bool onlyCurrentPic) const
+{
+	return SavePictures(outFile, fileType, useConfigSaveParams, onlyCurrentPic, FrameNum);
+}
+
+
+bool Image::SaveFrame(const tString& outFile, tFileType fileType, int frameNum, bool useConfigSaveParams) const
+{
+	return SavePictures(outFile, fileType, useConfigSaveParams, true, frameNum);
+}
+
+
+bool Image::SavePictures(const tString& outFile, tFileType fileType, bool useConfigSaveParams, bool onlyFramePic, int frameNum) const
 {
 	Config::ProfileData& profile = Config::GetProfileData();
 	bool success = false;
@@ -634,7 +662,7 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 	{
 		case tFileType::TGA:
 		{
-			tPicture* picture = GetCurrentPic();
+			tPicture* picture = GetPicture(frameNum);
 			if (!picture || !picture->IsValid())
 				return false;
 			tImageTGA tga(*picture, false);
@@ -658,7 +686,7 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 
 		case tFileType::PNG:
 		{
-			tPicture* picture = GetCurrentPic();
+			tPicture* picture = GetPicture(frameNum);
 			if (!picture || !picture->IsValid())
 				return false;
 
@@ -682,7 +710,7 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 
 		case tFileType::JPG:
 		{
-			tPicture* picture = GetCurrentPic();
+			tPicture* picture = GetPicture(frameNum);
 			if (!picture || !picture->IsValid())
 				return false;
 
@@ -698,9 +726,9 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 		case tFileType::GIF:
 		{
 			tList<tFrame> frames;
-			if (onlyCurrentPic)
+			if (onlyFramePic)
 			{
-				const tPicture* picture = GetCurrentPic();
+				const tPicture* picture = GetPicture(frameNum);
 				frames.Append
 				(
 					new tFrame
@@ -750,9 +778,9 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 		case tFileType::WEBP:
 		{
 			tList<tFrame> frames;
-			if (onlyCurrentPic)
+			if (onlyFramePic)
 			{
-				const tPicture* picture = GetCurrentPic();
+				const tPicture* picture = GetPicture(frameNum);
 				frames.Append
 				(
 					new tFrame
@@ -796,7 +824,7 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 
 		case tFileType::QOI:
 		{
-			tPicture* picture = GetCurrentPic();
+			tPicture* picture = GetPicture(frameNum);
 			if (!picture || !picture->IsValid())
 				return false;
 
@@ -827,9 +855,9 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 		case tFileType::APNG:
 		{
 			tList<tFrame> frames;
-			if (onlyCurrentPic)
+			if (onlyFramePic)
 			{
-				const tPicture* picture = GetCurrentPic();
+				const tPicture* picture = GetPicture(frameNum);
 				frames.Append
 				(
 					new tFrame
@@ -870,7 +898,7 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 
 		case tFileType::BMP:
 		{
-			tPicture* picture = GetCurrentPic();
+			tPicture* picture = GetPicture(frameNum);
 			if (!picture || !picture->IsValid())
 				return false;
 
@@ -893,9 +921,9 @@ bool Image::Save(const tString& outFile, tFileType fileType, bool useConfigSaveP
 		case tFileType::TIFF:
 		{
 			tList<tFrame> frames;
-			if (onlyCurrentPic)
+			if (onlyFramePic)
 			{
-				const tPicture* picture = GetCurrentPic();
+				const tPicture* picture = GetPicture(frameNum);
 				frames.Append
 				(
 					new tFrame
@@ -948,6 +976,7 @@ int Image::GetMemSizeBytes() const
 		numBytes += pic->GetNumPixels() * sizeof(tPixel4b);
 
 	numBytes += AltPicture.IsValid() ? AltPicture.GetNumPixels()*sizeof(tPixel4b) : 0;
+	numBytes += HDRSrc.GetMemSizeBytes();
 	return numBytes;
 }
 
@@ -1059,6 +1088,67 @@ void Image::MultiSurfaceCreateAltMipmapPicture(const teList<tLayer>& layers)
 }
 
 
+bool Image::LoadFrom(const Image& src)
+{
+	if (!src.IsLoaded())
+		return false;
+
+	Unload(true);
+	Filename		= src.Filename;
+	Filetype		= src.Filetype;
+	FileModTime		= src.FileModTime;
+	FileSizeB		= src.FileSizeB;
+	Info			= src.Info;
+	FrameNum		= src.FrameNum;
+	for (tPicture* pic = src.Pictures.First(); pic; pic = pic->Next())
+		Pictures.Append(new tPicture(*pic));
+
+	Dirty = src.Dirty;
+	LoadedTime = tSystem::tGetTime();
+	return true;
+}
+
+
+bool Image::ReconvertHDR()
+{
+	Config::ProfileData& profile = Config::GetProfileData();
+	if ((Filetype != tFileType::HDR) || !profile.RetainHDRSource || Dirty || (Pictures.Count() != 1))
+		return false;
+
+	// The file is only decoded the first time. If it cannot be (an unusual orientation for example) the caller's
+	// reload goes through the regular loader.
+	if (!HDRSrc.IsValid() && !HDRSrc.Load(Filename))
+		return false;
+
+	tPicture* picture = Pictures.First();
+	if ((picture->GetWidth() != HDRSrc.GetWidth()) || (picture->GetHeight() != HDRSrc.GetHeight()))
+	{
+		HDRSrc.Clear();
+		return false;
+	}
+
+	// The stats thread reads the pixels so it is stopped before they change.
+	InvalidateStats();
+	Unbind();
+	HDRSrc.Convert(picture->GetPixelPointer(), LoadParams_HDR.Gamma, LoadParams_HDR.Exposure);
+	Info.MemSizeBytes = GetMemSizeBytes();
+	LoadedTime = tSystem::tGetTime();
+	return true;
+}
+
+
+void Image::TakePictures(Image& src, const tString& undoDesc)
+{
+	PushUndo(undoDesc);
+	Unbind();
+	Pictures.Clear();
+	while (!src.Pictures.IsEmpty())
+		Pictures.Append(src.Pictures.Remove());
+
+	Dirty = true;
+}
+
+
 bool Image::Unload(bool force)
 {
 	if (!IsLoaded())
@@ -1068,11 +1158,14 @@ bool Image::Unload(bool force)
 	if (Dirty && !force)
 		return false;
 
+	InvalidateStats();
+	PendingOpaque.clear();
 	Unbind();
 	AltPicture.Clear();
 	AltPictureEnabled = false;
 	AltPictureTyp = AltPictureType::None;
 	Pictures.Clear();
+	HDRSrc.Clear();
 	Info.MemSizeBytes = 0;
 
 	LoadedTime = -1.0f;
@@ -1080,16 +1173,166 @@ bool Image::Unload(bool force)
 }
 
 
-bool Image::IsOpaque() const
+Image::ImgInfo::OpacityEnum Image::GetOpacity() const
 {
 	if (AltPicture.IsValid() && AltPictureEnabled)
-		return AltPicture.IsOpaque();
+		return AltPicture.IsOpaque() ? ImgInfo::OpacityEnum::True : ImgInfo::OpacityEnum::False;
 
-	tPicture* picture = GetCurrentPic();
-	if (picture && picture->IsValid())
-		return picture->IsOpaque();
+	const PictureStats* stats = GetCurrentStats();
+	if (stats)
+		return stats->Opaque ? ImgInfo::OpacityEnum::True : ImgInfo::OpacityEnum::False;
 
-	return true;
+	// Pending. Keep the answer from before the edit so the background does not flicker while stats are remade.
+	if ((FrameNum >= 0) && (FrameNum < int(PendingOpaque.size())))
+		return PendingOpaque[FrameNum] ? ImgInfo::OpacityEnum::True : ImgInfo::OpacityEnum::False;
+
+	return ImgInfo::OpacityEnum::Unknown;
+}
+
+
+void Image::RequestStats()
+{
+	if (StatsRequested || !IsLoaded())
+		return;
+
+	StatsRequested = true;
+	StatsApplied = false;
+	StatsReady = false;
+	StatsFailed = false;
+	StatsCancel = false;
+	bool useCache = StatsFromFile && !Dirty && !ThumbCacheDir.IsEmpty();
+	StatsThread = std::thread([this, useCache] { ComputeStats(useCache); });
+}
+
+
+const PictureStats* Image::GetStats(int frameNum) const
+{
+	if (!StatsReady || (frameNum < 0) || (frameNum >= int(Stats.size())))
+		return nullptr;
+
+	tPicture* picture = GetPicture(frameNum);
+	if (!picture || !Stats[frameNum].IsValidFor(*picture))
+		return nullptr;
+
+	return &Stats[frameNum];
+}
+
+
+void Image::InvalidateStats()
+{
+	// The worker must be stopped before the pictures change. It checks the cancel flag at least every 64K pixels per
+	// band, so this join costs the UI thread well under a millisecond.
+	if (StatsThread.joinable())
+	{
+		StatsCancel = true;
+		StatsThread.join();
+	}
+
+	// The answers stay usable by GetOpacity until new stats are ready. An edit rarely changes opacity.
+	if (StatsReady)
+	{
+		PendingOpaque.resize(Stats.size());
+		for (int s = 0; s < int(Stats.size()); s++)
+			PendingOpaque[s] = Stats[s].Opaque;
+	}
+
+	Stats.clear();
+	StatsReady = false;
+	StatsFailed = false;
+	StatsCancel = false;
+	StatsRequested = false;
+	StatsApplied = false;
+	StatsFromFile = false;
+	if (Info.IsValid())
+		Info.Opacity = ImgInfo::OpacityEnum::Unknown;
+}
+
+
+tString Image::GetStatsCacheFile() const
+{
+	tuint256 hash = 0;
+	int statsVersion = 2;
+	tFileInfo fileInfo;
+	if (!tGetFileInfo(fileInfo, Filename))
+		return tString();
+
+	// The "Stats" tag keeps the hash distinct from the thumbnail of the same file.
+	hash = tHash::tHashString256("Stats");
+	hash = tHash::tHashData256((uint8*)&statsVersion, sizeof(statsVersion), hash);
+	hash = tHash::tHashString256(Filename, hash);
+	hash = tHash::tHashData256((uint8*)&fileInfo.FileSize, sizeof(fileInfo.FileSize), hash);
+	hash = tHash::tHashData256((uint8*)&fileInfo.CreationTime, sizeof(fileInfo.CreationTime), hash);
+	hash = tHash::tHashData256((uint8*)&fileInfo.ModificationTime, sizeof(fileInfo.ModificationTime), hash);
+	hash = tHash::tHashData256((uint8*)&StatsLoadParamsHash, sizeof(StatsLoadParamsHash), hash);
+	tString hashFile;
+	tsPrintf(hashFile, "%s%032|256X.bin", ThumbCacheDir.Chr(), hash);
+	return hashFile;
+}
+
+
+void Image::ComputeStats(bool useCache)
+{
+	// This thread only reads Pictures and only writes Stats. Anything on the main thread that changes the pictures
+	// goes through InvalidateStats first, which cancels this and waits for it to return. So that wait is short on the
+	// UI thread, StatsCancel is checked between cache chunks, between pictures, and by Compute between small blocks.
+	int numPictures = Pictures.GetNumItems();
+	std::vector<PictureStats> stats(numPictures);
+
+	tString cacheFile;
+	if (useCache)
+	{
+		cacheFile = GetStatsCacheFile();
+		if (!cacheFile.IsEmpty() && tFileExists(cacheFile))
+		{
+			int numRead = 0;
+			tChunkReader chunk(cacheFile);
+			for (tChunk ch = chunk.First(); ch.IsValid() && (numRead < numPictures) && !StatsCancel; ch = ch.Next())
+			{
+				if (ch.ID() == StatsChunkID)
+					ch.GetItem(stats[numRead++]);
+			}
+
+			// The key covers the file and the load params, so a mismatch here means the cache file is damaged or
+			// from a build with different stats. Only trusted if every picture matches.
+			bool valid = (numRead == numPictures);
+			int index = 0;
+			for (tPicture* pic = Pictures.First(); pic && valid; pic = pic->Next(), index++)
+				valid = stats[index].IsValidFor(*pic);
+
+			if (valid)
+			{
+				Stats.swap(stats);
+				StatsReady = true;
+				return;
+			}
+		}
+	}
+
+	int index = 0;
+	for (tPicture* pic = Pictures.First(); pic; pic = pic->Next(), index++)
+	{
+		if (!stats[index].Compute(*pic, &StatsCancel))
+		{
+			// A cancel comes from InvalidateStats, which resets everything anyway.
+			if (!StatsCancel)
+				StatsFailed = true;
+			return;
+		}
+	}
+
+	if (!cacheFile.IsEmpty() && !StatsCancel)
+	{
+		tChunkWriter writer(cacheFile);
+		for (const PictureStats& s : stats)
+		{
+			writer.Begin(StatsChunkID);
+			writer.Write(s);
+			writer.End();
+		}
+	}
+
+	Stats.swap(stats);
+	StatsReady = true;
 }
 
 
@@ -1151,22 +1394,29 @@ void Image::Rotate90(bool antiClockWise)
 {
 	tString desc; tsPrintf(desc, "Rotate 90 %s", antiClockWise ? "ACW" : "CW");
 	PushUndo(desc);
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->Rotate90(antiClockWise);
+	Rotate90Pictures(Pictures, antiClockWise);
+
+	Dirty = true;
+}
+
+
+void Image::Rotate180()
+{
+	PushUndo("Rotate 180");
+	Rotate180Pictures(Pictures);
 
 	Dirty = true;
 }
 
 
-bool Image::Rotate(float angle, const tColour4b& fill, tResampleFilter upFilter, tResampleFilter downFilter)
+bool Image::Rotate(float angle, const tColour4b& fill, tResampleFilter filter, RotateFit fit)
 {
 	if (angle == 0.0f)
 		return false;
 
 	tString desc; tsPrintf(desc, "Rotate %.1f", tRadToDeg(angle));
 	PushUndo(desc);
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->RotateCenter(angle, fill, upFilter, downFilter);
+	RotatePictures(Pictures, angle, fill, filter, fit);
 
 	Dirty = true;
 	return true;
@@ -1217,98 +1467,385 @@ void Image::QuantizeWu(int numColours, bool checkExact)
 }
 
 
-bool Image::AdjustmentBegin()
+// A palette with the components stored in separate arrays so the distance loop in FindNearest vectorizes.
+struct SharedPalette
 {
-	if (!IsLoaded())
-		return false;
+	int NumColours = 0;
+	int32 R[256];
+	int32 G[256];
+	int32 B[256];
+	int FindNearest(int r, int g, int b) const;
+};
 
-	PushUndo("Levels");
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->AdjustmentBegin();
 
-	return true;
+int SharedPalette::FindNearest(int r, int g, int b) const
+{
+	int32 dist[256];
+	for (int c = 0; c < NumColours; c++)
+	{
+		int32 dr = R[c] - r;
+		int32 dg = G[c] - g;
+		int32 db = B[c] - b;
+		dist[c] = dr*dr + dg*dg + db*db;
+	}
+
+	int nearest = 0;
+	for (int c = 1; c < NumColours; c++)
+		if (dist[c] < dist[nearest])
+			nearest = c;
+
+	return nearest;
 }
 
 
-void Image::AdjustBrightness(float brightness, AdjChan channels, bool allFrames)
+void Image::QuantizeShared(tQuantize::Method method, int numColours, bool checkExact, int sampleFactor)
 {
-	if (allFrames)
+	if (Pictures.Count() < 2)
 	{
-		for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-			picture->AdjustBrightness(brightness, ComponentBits(channels));
+		switch (method)
+		{
+			case tQuantize::Method::Fixed:		QuantizeFixed(numColours, checkExact);					break;
+			case tQuantize::Method::Spatial:	QuantizeSpatial(numColours, checkExact);				break;
+			case tQuantize::Method::Neu:		QuantizeNeu(numColours, checkExact, sampleFactor);		break;
+			case tQuantize::Method::Wu:			QuantizeWu(numColours, checkExact);						break;
+		}
+		return;
 	}
-	else
+	tiClamp(numColours, 2, 256);
+
+	// With checkExact nothing needs doing if all the frames together use few enough colours.
+	int64 totalPixels = 0;
+	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
+		totalPixels += picture->GetNumPixels();
+
+	if (checkExact)
 	{
-		tPicture* picture = GetCurrentPic();
-		if (picture)
-			picture->AdjustBrightness(brightness, ComponentBits(channels));
+		std::unordered_set<uint32> colours;
+		for (tPicture* picture = Pictures.First(); picture && (int(colours.size()) <= numColours); picture = picture->Next())
+		{
+			const tPixel4b* pixels = picture->GetPixelPointer();
+			int numPixels = picture->GetNumPixels();
+			for (int p = 0; (p < numPixels) && (int(colours.size()) <= numColours); p++)
+				colours.insert(uint32(pixels[p].R) | (uint32(pixels[p].G) << 8) | (uint32(pixels[p].B) << 16));
+		}
+		if (int(colours.size()) <= numColours)
+			return;
+	}
+
+	tString desc; tsPrintf(desc, "Quantize %d Shared", numColours);
+	PushUndo(desc);
+
+	// Gather an evenly spaced subsample of every frame into a single composite picture. Spatial quantization is much
+	// slower per pixel so it gets a smaller composite.
+	int compositeWidth = (method == tQuantize::Method::Spatial) ? 256 : 1024;
+	int64 maxSamples = int64(compositeWidth) * int64(compositeWidth);
+	int64 stride = tMax(int64(1), (totalPixels + maxSamples - 1) / maxSamples);
+	std::vector<tPixel4b> samples;
+	samples.reserve(size_t(tMin(totalPixels, maxSamples)));
+	int64 pixelIndex = 0;
+	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
+	{
+		const tPixel4b* pixels = picture->GetPixelPointer();
+		int numPixels = picture->GetNumPixels();
+		for (int p = 0; p < numPixels; p++, pixelIndex++)
+		{
+			if ((pixelIndex % stride) != 0)
+				continue;
+			tPixel4b sample = pixels[p];
+			sample.A = 255;
+			samples.push_back(sample);
+		}
+	}
+
+	// The last row is padded by repeating samples from the start.
+	int numSamples = int(samples.size());
+	int compositeHeight = (numSamples + compositeWidth - 1) / compositeWidth;
+	tPicture composite;
+	composite.Set(compositeWidth, compositeHeight, tPixel4b::transparent);
+	tPixel4b* compositePixels = composite.GetPixelPointer();
+	for (int p = 0; p < compositeWidth*compositeHeight; p++)
+		compositePixels[p] = samples[p % numSamples];
+
+	switch (method)
+	{
+		case tQuantize::Method::Fixed:		composite.QuantizeFixed(numColours, false);					break;
+		case tQuantize::Method::Spatial:	composite.QuantizeSpatial(numColours, false, 0.1, 3);		break;
+		case tQuantize::Method::Neu:		composite.QuantizeNeu(numColours, false, sampleFactor);		break;
+		case tQuantize::Method::Wu:			composite.QuantizeWu(numColours, false);					break;
 	}
+
+	// The distinct colours of the quantized composite are the shared palette.
+	SharedPalette palette;
+	std::unordered_set<uint32> paletteColours;
+	for (int p = 0; (p < compositeWidth*compositeHeight) && (palette.NumColours < numColours); p++)
+	{
+		const tPixel4b& pixel = compositePixels[p];
+		uint32 key = uint32(pixel.R) | (uint32(pixel.G) << 8) | (uint32(pixel.B) << 16);
+		if (!paletteColours.insert(key).second)
+			continue;
+		palette.R[palette.NumColours] = pixel.R;
+		palette.G[palette.NumColours] = pixel.G;
+		palette.B[palette.NumColours] = pixel.B;
+		palette.NumColours++;
+	}
+	composite.Clear();
+	samples.clear();
+
+	// Remap all frames in parallel. Work is handed out in bands of rows from every frame so a few large frames still
+	// use all the workers. Animations reuse colours heavily so each worker keeps a small direct-mapped cache of
+	// recent lookups in front of the palette search.
+	struct Band { tPixel4b* Pixels; int NumPixels; };
+	std::vector<Band> bands;
+	const int bandRows = 64;
+	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
+	{
+		int width = picture->GetWidth();
+		int height = picture->GetHeight();
+		for (int y = 0; y < height; y += bandRows)
+			bands.push_back({ picture->GetPixelPointer() + y*width, width*tMin(bandRows, height-y) });
+	}
+
+	std::atomic<int> nextBand(0);
+	auto remap = [&bands, &nextBand, &palette]()
+	{
+		const int cacheSize = 4096;
+		uint32* cacheKeys = new uint32[cacheSize];
+		uint8* cacheIndices = new uint8[cacheSize];
+		tStd::tMemset(cacheKeys, 0, cacheSize*sizeof(uint32));
+		for (int b = nextBand++; b < int(bands.size()); b = nextBand++)
+		{
+			tPixel4b* pixels = bands[b].Pixels;
+			for (int p = 0; p < bands[b].NumPixels; p++)
+			{
+				tPixel4b& pixel = pixels[p];
+
+				// The high bit marks the entry as valid.
+				uint32 key = 0x80000000 | uint32(pixel.R) | (uint32(pixel.G) << 8) | (uint32(pixel.B) << 16);
+				int slot = ((key * 2654435761u) >> 20) & (cacheSize-1);
+				int index = 0;
+				if (cacheKeys[slot] == key)
+				{
+					index = cacheIndices[slot];
+				}
+				else
+				{
+					index = palette.FindNearest(pixel.R, pixel.G, pixel.B);
+					cacheKeys[slot] = key;
+					cacheIndices[slot] = uint8(index);
+				}
+				pixel.R = uint8(palette.R[index]);
+				pixel.G = uint8(palette.G[index]);
+				pixel.B = uint8(palette.B[index]);
+			}
+		}
+		delete[] cacheKeys;
+		delete[] cacheIndices;
+	};
+
+	int numWorkers = tClamp(tSystem::tGetNumCores(), 1, tMax(1, int(bands.size())));
+	std::vector<std::thread> workers;
+	for (int w = 0; w < numWorkers-1; w++)
+		workers.emplace_back(remap);
+	remap();
+	for (std::thread& worker : workers)
+		worker.join();
+
 	Dirty = true;
 }
 
 
-void Image::AdjustContrast(float contrast, AdjChan channels, bool allFrames)
+const char* Image::Adjustment::GetDesc() const
 {
-	if (allFrames)
+	switch (Typ)
 	{
-		for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-			picture->AdjustContrast(contrast, ComponentBits(channels));
+		case Type::Brightness:	return "Brightness";
+		case Type::Contrast:	return "Contrast";
+		case Type::Levels:		return "Levels";
+		default:				break;
 	}
-	else
+	return "Adjust";
+}
+
+
+void Image::AdjustPictureBegun(tPicture& picture, const Adjustment& adj)
+{
+	comp_t comps = ComponentBits(adj.Channels);
+	switch (adj.Typ)
 	{
-		tPicture* picture = GetCurrentPic();
-		if (picture)
-			picture->AdjustContrast(contrast, ComponentBits(channels));
+		case Adjustment::Type::Brightness:
+			picture.AdjustBrightness(adj.Brightness, comps);
+			break;
+
+		case Adjustment::Type::Contrast:
+			picture.AdjustContrast(adj.Contrast, comps);
+			break;
+
+		case Adjustment::Type::Levels:
+			picture.AdjustLevels(adj.BlackPoint, adj.MidPoint, adj.WhitePoint, adj.BlackOut, adj.WhiteOut, adj.PowerMidGamma, comps);
+			break;
+
+		default:
+			picture.AdjustRestoreOriginal();
+			break;
 	}
-	Dirty = true;
 }
 
 
-void Image::AdjustLevels(float blackPoint, float midPoint, float whitePoint, float blackOut, float whiteOut, bool powerMidGamma, AdjChan channels, bool allFrames)
+void Image::AdjustPicture(tPicture& picture, const Adjustment& adj)
 {
-	if (allFrames)
+	if (!picture.IsValid() || (adj.Typ == Adjustment::Type::None))
+		return;
+
+	// The tPicture adjustment functions do the work so the result is the same as it has always been.
+	picture.AdjustmentBegin();
+	AdjustPictureBegun(picture, adj);
+	picture.AdjustmentEnd();
+}
+
+
+void Image::ApplyAdjustment(const Adjustment& adj)
+{
+	if (!IsLoaded() || (adj.Typ == Adjustment::Type::None))
+		return;
+
+	PushUndo(adj.GetDesc());
+	if (adj.AllFrames)
 	{
 		for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-			picture->AdjustLevels(blackPoint, midPoint, whitePoint, blackOut, whiteOut, powerMidGamma, ComponentBits(channels));
+			AdjustPicture(*picture, adj);
 	}
 	else
 	{
 		tPicture* picture = GetCurrentPic();
 		if (picture)
-			picture->AdjustLevels(blackPoint, midPoint, whitePoint, blackOut, whiteOut, powerMidGamma, ComponentBits(channels));
+			AdjustPicture(*picture, adj);
 	}
 	Dirty = true;
 }
 
 
-void Image::AdjustRestoreOriginal(bool popUndo)
+bool Image::AdjustmentBegin(int maxPreviewWidth, int maxPreviewHeight)
 {
-	if (popUndo)
-		PopUndo();
+	tPicture* picture = GetCurrentPic();
+	if (!IsLoaded() || !picture || !picture->IsValid())
+		return false;
 
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->AdjustRestoreOriginal();
+	// The defaults come from the full resolution picture. The default brightness depends on its colour range, and it
+	// must leave the full resolution pixels unchanged when applied.
+	picture->AdjustmentBegin();
+	AdjustDefaults = Adjustment();
+	picture->AdjustGetDefaultBrightness(AdjustDefaults.Brightness);
+	picture->AdjustGetDefaultContrast(AdjustDefaults.Contrast);
+	picture->AdjustGetDefaultLevels(AdjustDefaults.BlackPoint, AdjustDefaults.MidPoint, AdjustDefaults.WhitePoint, AdjustDefaults.BlackOut, AdjustDefaults.WhiteOut);
+	picture->AdjustmentEnd();
+
+	// The proxy keeps the aspect ratio. The exact size does not matter since it is drawn with the same texture
+	// coordinates as the full resolution picture.
+	int w = picture->GetWidth();
+	int h = picture->GetHeight();
+	AdjustProxy.Set(*picture);
+	if ((maxPreviewWidth > 0) && (maxPreviewHeight > 0) && ((w > maxPreviewWidth) || (h > maxPreviewHeight)))
+	{
+		float scale = tMin(float(maxPreviewWidth)/float(w), float(maxPreviewHeight)/float(h));
+		int pw = tMax(1, int(float(w)*scale));
+		int ph = tMax(1, int(float(h)*scale));
+		ResamplePicture(AdjustProxy, pw, ph, tResampleFilter::Bilinear, tResampleEdgeMode::Clamp);
+	}
+	AdjustProxy.AdjustmentBegin();
 
-	Dirty = false;
+	AdjustPending = Adjustment();
+	AdjustPreviewing = true;
+	return true;
 }
 
 
-void Image::AdjustGetDefaults(float& brightness, float& contrast, float& blackPoint, float& midPoint, float& whitePoint, float& blackOut, float& whiteOut) const
+void Image::AdjustUpdatePreview()
 {
-	tPicture* pic = GetCurrentPic();
-	if (!pic)
+	if (!AdjustPreviewing || !AdjustProxy.IsValid())
 		return;
-	pic->AdjustGetDefaultBrightness(brightness);
-	pic->AdjustGetDefaultContrast(contrast);
-	pic->AdjustGetDefaultLevels(blackPoint, midPoint, whitePoint, blackOut, whiteOut);
+
+	// The proxy is adjusted from its own original, kept by tPicture since AdjustmentBegin.
+	AdjustPictureBegun(AdjustProxy, AdjustPending);
+
+	// Same size and format as what was uploaded by Bind so the texture is updated in place.
+	if (TexIDAdjust != 0)
+	{
+		glBindTexture(GL_TEXTURE_2D, TexIDAdjust);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, AdjustProxy.GetWidth(), AdjustProxy.GetHeight(), GL_RGBA, GL_UNSIGNED_BYTE, AdjustProxy.GetPixelPointer());
+	}
+}
+
+
+void Image::AdjustBrightness(float brightness, AdjChan channels, bool allFrames)
+{
+	AdjustPending				= Adjustment();
+	AdjustPending.Typ			= Adjustment::Type::Brightness;
+	AdjustPending.Channels		= channels;
+	AdjustPending.AllFrames		= allFrames;
+	AdjustPending.Brightness	= brightness;
+	AdjustUpdatePreview();
+}
+
+
+void Image::AdjustContrast(float contrast, AdjChan channels, bool allFrames)
+{
+	AdjustPending				= Adjustment();
+	AdjustPending.Typ			= Adjustment::Type::Contrast;
+	AdjustPending.Channels		= channels;
+	AdjustPending.AllFrames		= allFrames;
+	AdjustPending.Contrast		= contrast;
+	AdjustUpdatePreview();
+}
+
+
+void Image::AdjustLevels(float blackPoint, float midPoint, float whitePoint, float blackOut, float whiteOut, bool powerMidGamma, AdjChan channels, bool allFrames)
+{
+	AdjustPending				= Adjustment();
+	AdjustPending.Typ			= Adjustment::Type::Levels;
+	AdjustPending.Channels		= channels;
+	AdjustPending.AllFrames		= allFrames;
+	AdjustPending.BlackPoint	= blackPoint;
+	AdjustPending.MidPoint		= midPoint;
+	AdjustPending.WhitePoint	= whitePoint;
+	AdjustPending.BlackOut		= blackOut;
+	AdjustPending.WhiteOut		= whiteOut;
+	AdjustPending.PowerMidGamma	= powerMidGamma;
+	AdjustUpdatePreview();
+}
+
+
+void Image::AdjustRestoreOriginal()
+{
+	AdjustPending = Adjustment();
+	AdjustUpdatePreview();
+}
+
+
+void Image::AdjustGetDefaults(float& brightness, float& contrast, float& blackPoint, float& midPoint, float& whitePoint, float& blackOut, float& whiteOut) const
+{
+	brightness	= AdjustDefaults.Brightness;
+	contrast	= AdjustDefaults.Contrast;
+	blackPoint	= AdjustDefaults.BlackPoint;
+	midPoint	= AdjustDefaults.MidPoint;
+	whitePoint	= AdjustDefaults.WhitePoint;
+	blackOut	= AdjustDefaults.BlackOut;
+	whiteOut	= AdjustDefaults.WhiteOut;
 }
 
 
 bool Image::AdjustmentEnd()
 {
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->AdjustmentEnd();
+	if (!AdjustPreviewing)
+		return false;
 
+	if (TexIDAdjust != 0)
+	{
+		glDeleteTextures(1, &TexIDAdjust);
+		TexIDAdjust = 0;
+	}
+	AdjustProxy.AdjustmentEnd();
+	AdjustProxy.Clear();
+	AdjustPreviewing = false;
 	return true;
 }
 
@@ -1317,8 +1854,7 @@ void Image::Flip(bool horizontal)
 {
 	tString desc; tsPrintf(desc, "Flip %s", horizontal ? "Horiz" : "Vert");
 	PushUndo(desc);
-	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->Flip(horizontal);
+	FlipPictures(Pictures, horizontal);
 
 	Dirty = true;
 }
@@ -1436,13 +1972,125 @@ bool Image::Resample(int newWidth, int newHeight, tImage::tResampleFilter filter
 	tString desc; tsPrintf(desc, "Resample %d %d", newWidth, newHeight);
 	PushUndo(desc);
 	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
-		picture->Resample(newWidth, newHeight, filter, edgeMode);
+		ResamplePicture(*picture, newWidth, newHeight, filter, edgeMode);
 
 	Dirty = true;
 	return true;
 }
 
 
+bool Image::ResampleRegion
+(
+	int srcX, int srcY, int srcW, int srcH, int scaledW, int scaledH,
+	int dstX, int dstY, int dstW, int dstH,
+	tResampleFilter filter, tResampleEdgeMode edgeMode, const tColour4b& fillColour
+)
+{
+	tPicture* firstPic = Pictures.First();
+	if (!firstPic || (srcW <= 0) || (srcH <= 0) || (scaledW <= 0) || (scaledH <= 0) || (dstW <= 0) || (dstH <= 0))
+		return false;
+
+	int picW = firstPic->GetWidth();
+	int picH = firstPic->GetHeight();
+	if ((srcX < 0) || (srcY < 0) || (srcX+srcW > picW) || (srcY+srcH > picH))
+		return false;
+
+	bool atLeastOneDifferentSize = false;
+	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
+	{
+		if ((picture->GetWidth() != picW) || (picture->GetHeight() != picH))
+			return false;
+		if ((picW != dstW) || (picH != dstH))
+			atLeastOneDifferentSize = true;
+	}
+
+	// Same size and the whole source placed 1:1 at the origin is a no-op.
+	bool wholeSource = (srcX == 0) && (srcY == 0) && (srcW == picW) && (srcH == picH);
+	bool oneToOne = (scaledW == srcW) && (scaledH == srcH);
+	if (!atLeastOneDifferentSize && wholeSource && oneToOne && (dstX == 0) && (dstY == 0))
+		return false;
+
+	// The visible part of the placed rectangle in destination space.
+	int visX0 = tMax(dstX, 0);
+	int visY0 = tMax(dstY, 0);
+	int visX1 = tMin(dstX + scaledW, dstW);
+	int visY1 = tMin(dstY + scaledH, dstH);
+	bool anyVisible = (visX1 > visX0) && (visY1 > visY0);
+
+	// When the scaled rectangle exactly spans full destination rows we can resample straight into the output.
+	bool resampleInPlace = (dstX == 0) && (scaledW == dstW) && (dstY >= 0) && (dstY + scaledH <= dstH);
+
+	// Checked before anything is modified so a resample that cannot run fails with the image untouched.
+	if (anyVisible && !oneToOne && (filter == tResampleFilter::None))
+		return false;
+
+	tString desc; tsPrintf(desc, "Resample Region %d %d", dstW, dstH);
+	PushUndo(desc);
+
+	// The staging buffers are only needed for sub-rectangles and are reused for every picture.
+	tPixel4b* srcRegion = (!wholeSource && anyVisible) ? new tPixel4b[srcW*srcH] : nullptr;
+	tPixel4b* scaledRegion = (!oneToOne && !resampleInPlace && anyVisible) ? new tPixel4b[scaledW*scaledH] : nullptr;
+	tPixel4b fill(fillColour);
+	bool success = true;
+	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
+	{
+		tPixel4b* picPixels = picture->GetPixelPointer();
+		tPixel4b* outPixels = new tPixel4b[dstW*dstH];
+
+		// Fill only the destination pixels that the placed rectangle does not cover.
+		for (int y = 0; y < dstH; y++)
+		{
+			tPixel4b* row = outPixels + y*dstW;
+			if (!anyVisible || (y < visY0) || (y >= visY1))
+			{
+				for (int x = 0; x < dstW; x++)
+					row[x] = fill;
+				continue;
+			}
+			for (int x = 0; x < visX0; x++)
+				row[x] = fill;
+			for (int x = visX1; x < dstW; x++)
+				row[x] = fill;
+		}
+
+		if (anyVisible)
+		{
+			// Gather the source rectangle into a contiguous buffer if it is not the whole picture.
+			tPixel4b* src = picPixels;
+			if (srcRegion)
+			{
+				for (int y = 0; y < srcH; y++)
+					tStd::tMemcpy(srcRegion + y*srcW, picPixels + (srcY+y)*picW + srcX, srcW*sizeof(tPixel4b));
+				src = srcRegion;
+			}
+
+			if (oneToOne)
+			{
+				for (int y = visY0; y < visY1; y++)
+					tStd::tMemcpy(outPixels + y*dstW + visX0, src + (y-dstY)*srcW + (visX0-dstX), (visX1-visX0)*sizeof(tPixel4b));
+			}
+			else if (resampleInPlace)
+			{
+				success &= ResamplePixels(src, srcW, srcH, outPixels + dstY*dstW, scaledW, scaledH, filter, edgeMode);
+			}
+			else
+			{
+				success &= ResamplePixels(src, srcW, srcH, scaledRegion, scaledW, scaledH, filter, edgeMode);
+				for (int y = visY0; y < visY1; y++)
+					tStd::tMemcpy(outPixels + y*dstW + visX0, scaledRegion + (y-dstY)*scaledW + (visX0-dstX), (visX1-visX0)*sizeof(tPixel4b));
+			}
+		}
+
+		SetKeepDuration(*picture, dstW, dstH, outPixels);
+	}
+	delete[] srcRegion;
+	delete[] scaledRegion;
+
+	Dirty = true;
+	return success;
+}
+
+
 void Image::SetPixelColour(int x, int y, const tColour4b& colour, bool pushUndo, bool surpressDirty)
 {
 	if (pushUndo)
@@ -1450,11 +2098,18 @@ void Image::SetPixelColour(int x, int y, const tColour4b& colour, bool pushUndo,
 		tString desc; tsPrintf(desc, "Pixel Colour (%d,%d)", x, y);
 		PushUndo(desc);
 	}
+	else
+	{
+		InvalidateStats();
+	}
 
 	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
 	{
 		if ((x > 0) && (x < picture->GetWidth()) && (y > 0) && (y < picture->GetHeight()))
+		{
 			picture->SetPixel(x, y, colour);
+			MarkDirtyRegion(picture, x, y, x, y);
+		}
 	}
 
 	if (!surpressDirty)
@@ -1567,6 +2222,58 @@ uint64 Image::Bind()
 	// We bind in a particular order starting with alternate picture if enabled and valid and
 	// then current picture. In all cases if the texture ID is already valid, we use it right away and early exit.
 	Config::ProfileData& profile = Config::GetProfileData();
+
+	// Stats are made the first time the image is displayed. Bind is called every frame so this is also where the
+	// finished stats get picked up.
+	RequestStats();
+	if (StatsReady && !StatsApplied)
+	{
+		if (StatsThread.joinable())
+			StatsThread.join();
+		StatsApplied = true;
+
+		bool foundOpaque = false; bool foundTransparent = false;
+		for (const PictureStats& s : Stats)
+		{
+			if (s.Opaque)
+				foundOpaque = true;
+			else
+				foundTransparent = true;
+		}
+		Info.Opacity = ImgInfo::OpacityEnum::Varies;
+		if (foundOpaque && !foundTransparent)
+			Info.Opacity = ImgInfo::OpacityEnum::True;
+		else if (foundTransparent && !foundOpaque)
+			Info.Opacity = ImgInfo::OpacityEnum::False;
+	}
+	else if (StatsFailed && !StatsApplied)
+	{
+		if (StatsThread.joinable())
+			StatsThread.join();
+		StatsApplied = true;
+		Info.Opacity = ImgInfo::OpacityEnum::Failed;
+	}
+
+	// While an adjustment is being previewed the proxy is displayed instead. It is display resolution already so it
+	// gets no mipmaps.
+	if (AdjustPreviewing && AdjustProxy.IsValid())
+	{
+		if (TexIDAdjust != 0)
+		{
+			glBindTexture(GL_TEXTURE_2D, TexIDAdjust);
+			return TexIDAdjust;
+		}
+
+		glGenTextures(1, &TexIDAdjust);
+		if (TexIDAdjust == 0)
+			return 0;
+
+		tList<tLayer> layers;
+		GenerateMipmapLayers(layers, AdjustProxy, tResampleFilter::None, tResampleEdgeMode::Clamp, profile.MipmapChaining);
+		BindLayers(layers, TexIDAdjust);
+		return TexIDAdjust;
+	}
+
 	if (AltPictureEnabled && AltPicture.IsValid())
 	{
 		if (TexIDAlt != 0)
@@ -1580,40 +2287,131 @@ uint64 Image::Bind()
 			return 0;
 
 		tList<tLayer> layers;
-		AltPicture.GenerateLayers(layers, tResampleFilter(profile.MipmapFilter), tResampleEdgeMode::Clamp, profile.MipmapChaining);
+		GenerateMipmapLayers(layers, AltPicture, tResampleFilter(profile.MipmapFilter), tResampleEdgeMode::Clamp, profile.MipmapChaining);
 		BindLayers(layers, TexIDAlt);
 		return TexIDAlt;
 	}
 
+	if (!IsLoaded())
+		return 0;
+
+	ApplyTexturePatches();
+	tiClamp(FrameNum, 0, GetNumPictures()-1);
 	tPicture* currPic = GetCurrentPic();
-	if (currPic && (currPic->TextureID != 0))
+	if (!currPic || !currPic->IsValid())
+		return 0;
+
+	// Only the frame being shown is made here. Making every frame up front stalls badly on long animations.
+	if (currPic->TextureID == 0)
+		BindFrame(currPic, FrameNum);
+
+	// While playing, up to one frame ahead of the playhead is made per call so its cost is spread over the frames
+	// being displayed rather than landing on the frame that needs it.
+	int numFrames = GetNumPictures();
+	if (FramePlaying && (numFrames > 1))
 	{
-		glBindTexture(GL_TEXTURE_2D, currPic->TextureID);
-		return currPic->TextureID;
+		int frame = FrameNum;
+		for (int ahead = 1; ahead <= tMin(FrameLookAhead, numFrames-1); ahead++)
+		{
+			frame += FramePlayRev ? -1 : 1;
+			if ((frame < 0) || (frame >= numFrames))
+			{
+				if (!FramePlayLooping)
+					break;
+				frame = (frame + numFrames) % numFrames;
+			}
+
+			tPicture* pic = GetPicture(frame);
+			if (pic && pic->IsValid() && (pic->TextureID == 0))
+			{
+				BindFrame(pic, frame);
+				break;
+			}
+		}
 	}
 
-	if (!IsLoaded())
-		return 0;
+	// Mark the current frame as most recently used.
+	FrameTextureClock++;
+	for (FrameTexture& frameTex : FrameTextures)
+		if (frameTex.Picture == currPic)
+			frameTex.LastUsed = FrameTextureClock;
+	ReleaseFrameTextures();
 
-	tiClamp(FrameNum, 0, GetNumPictures()-1);
+	glBindTexture(GL_TEXTURE_2D, currPic->TextureID);
+	return currPic->TextureID;
+}
 
-	// We do this in reverse order so that the last image we bind is the highest resolution image.
-	// This is more efficient when it comes to drawing the image since the lowest mip is likely not
-	// the one we're going to be viewing right after binding.
-	for (tPicture* picture = Pictures.Last(); picture; picture = picture->Prev())
+
+void Image::BindFrame(tPicture* picture, int frameIndex)
+{
+	tAssert(picture->TextureID == 0);
+	glGenTextures(1, &picture->TextureID);
+	if (picture->TextureID == 0)
+		return;
+
+	Config::ProfileData& profile = Config::GetProfileData();
+	tList<tLayer> layers;
+	GenerateMipmapLayers(layers, *picture, tResampleFilter(profile.MipmapFilter), tResampleEdgeMode::Clamp, profile.MipmapChaining);
+	BindLayers(layers, picture->TextureID);
+
+	int64 bytes = 0;
+	for (tLayer* layer = layers.First(); layer; layer = layer->Next())
+		bytes += layer->GetDataSize();
+	FrameTextures.push_back({ picture, frameIndex, FrameTextureClock, bytes });
+	FrameTextureBytes += bytes;
+
+	// A picture being pixel-edited keeps its mip chain so later edits can be patched in.
+	TexturePatch* patch = FindTexturePatch(picture);
+	if (patch)
 	{
-		if (!picture->IsValid())
-			continue;
+		patch->Layers.Clear();
+		while (tLayer* layer = layers.Remove())
+			patch->Layers.Append(layer);
+		patch->ResetRegion();
+	}
+}
 
-		tAssert(picture->TextureID == 0);
-		glGenTextures(1, &picture->TextureID);
 
-		tList<tLayer> layers;
-		picture->GenerateLayers(layers, tResampleFilter(profile.MipmapFilter), tResampleEdgeMode::Clamp, profile.MipmapChaining);
-		BindLayers(layers, picture->TextureID);
+void Image::ReleaseFrameTextures()
+{
+	Config::ProfileData& profile = Config::GetProfileData();
+	int64 budget = int64(profile.MaxFrameTexMemMB) * 1024 * 1024;
+	int numFrames = GetNumPictures();
+	while ((FrameTextureBytes > budget) && (FrameTextures.size() > 1))
+	{
+		// The least recently used frame that is not the current one or within the look-ahead window.
+		int victim = -1;
+		for (int f = 0; f < int(FrameTextures.size()); f++)
+		{
+			const FrameTexture& frameTex = FrameTextures[f];
+			int ahead = FramePlayRev ? (FrameNum - frameTex.FrameIndex) : (frameTex.FrameIndex - FrameNum);
+			if (FramePlayLooping)
+				ahead = (ahead + numFrames) % numFrames;
+			if ((ahead >= 0) && (ahead <= FrameLookAhead))
+				continue;
+			if ((victim == -1) || (frameTex.LastUsed < FrameTextures[victim].LastUsed))
+				victim = f;
+		}
+		if (victim == -1)
+			break;
+
+		// The picture is found through the list so a stale entry is never dereferenced.
+		const FrameTexture& frameTex = FrameTextures[victim];
+		for (tPicture* pic = Pictures.First(); pic; pic = pic->Next())
+		{
+			if ((pic == frameTex.Picture) && (pic->TextureID != 0))
+			{
+				glDeleteTextures(1, &pic->TextureID);
+				pic->TextureID = 0;
+				TexturePatch* patch = FindTexturePatch(pic);
+				if (patch)
+					delete TexturePatches.Remove(patch);
+				break;
+			}
+		}
+		FrameTextureBytes -= frameTex.Bytes;
+		FrameTextures.erase(FrameTextures.begin() + victim);
 	}
-	currPic = GetCurrentPic();
-	return currPic ? currPic->TextureID : 0;
 }
 
 
@@ -1633,6 +2431,120 @@ void Image::Unbind()
 		glDeleteTextures(1, &TexIDAlt);
 		TexIDAlt = 0;
 	}
+
+	if (TexIDAdjust != 0)
+	{
+		glDeleteTextures(1, &TexIDAdjust);
+		TexIDAdjust = 0;
+	}
+
+	// The textures are gone so there is nothing to patch.
+	TexturePatches.Clear();
+	FrameTextures.clear();
+	FrameTextureBytes = 0;
+}
+
+
+void Image::MarkDirtyRegion(tPicture* picture, int x0, int y0, int x1, int y1)
+{
+	if (!picture)
+		return;
+
+	TexturePatch* patch = FindTexturePatch(picture);
+	if (!patch)
+	{
+		patch = new TexturePatch;
+		patch->Picture = picture;
+		TexturePatches.Append(patch);
+	}
+
+	if (patch->IsEmpty())
+	{
+		patch->X0 = x0; patch->Y0 = y0;
+		patch->X1 = x1; patch->Y1 = y1;
+	}
+	else
+	{
+		patch->X0 = tMin(patch->X0, x0); patch->Y0 = tMin(patch->Y0, y0);
+		patch->X1 = tMax(patch->X1, x1); patch->Y1 = tMax(patch->Y1, y1);
+	}
+}
+
+
+Image::TexturePatch* Image::FindTexturePatch(const tPicture* picture)
+{
+	for (TexturePatch* patch = TexturePatches.First(); patch; patch = patch->Next())
+		if (patch->Picture == picture)
+			return patch;
+	return nullptr;
+}
+
+
+void Image::ApplyTexturePatches()
+{
+	if (TexturePatches.IsEmpty())
+		return;
+
+	// Patches are looked up from the picture list rather than the other way around so a patch for a picture that no
+	// longer exists is never dereferenced.
+	Config::ProfileData& profile = Config::GetProfileData();
+	for (tPicture* picture = Pictures.First(); picture; picture = picture->Next())
+	{
+		if (picture->TextureID == 0)
+			continue;
+
+		TexturePatch* patch = FindTexturePatch(picture);
+		if (!patch || patch->IsEmpty())
+			continue;
+
+		// The first patch of a texture reloads it in place to get the mip chain. Every patch after that is cheap.
+		if (patch->Layers.IsEmpty())
+		{
+			patch->Filter = tResampleFilter(profile.MipmapFilter);
+			patch->Chaining = profile.MipmapChaining;
+			GenerateMipmapLayers(patch->Layers, *picture, patch->Filter, tResampleEdgeMode::Clamp, patch->Chaining);
+			BindLayers(patch->Layers, picture->TextureID);
+		}
+		else
+		{
+			PatchLayers(*picture, *patch);
+		}
+		patch->ResetRegion();
+	}
+}
+
+
+void Image::PatchLayers(tPicture& picture, TexturePatch& patch)
+{
+	// The chain is brought up to date with the mip settings it was made with, so every level matches a full rebuild.
+	// If those settings changed, or the chain no longer fits the picture, the whole texture is reloaded instead.
+	Config::ProfileData& profile = Config::GetProfileData();
+	std::vector<MipmapRegion> regions;
+	bool sameSettings = (patch.Filter == tResampleFilter(profile.MipmapFilter)) && (patch.Chaining == profile.MipmapChaining);
+	if (!sameSettings || !UpdateMipmapLayers(patch.Layers, picture, patch.X0, patch.Y0, patch.X1, patch.Y1, regions, patch.Filter, tResampleEdgeMode::Clamp, patch.Chaining))
+	{
+		patch.Layers.Clear();
+		patch.Filter = tResampleFilter(profile.MipmapFilter);
+		patch.Chaining = profile.MipmapChaining;
+		GenerateMipmapLayers(patch.Layers, picture, patch.Filter, tResampleEdgeMode::Clamp, patch.Chaining);
+		BindLayers(patch.Layers, picture.TextureID);
+		return;
+	}
+
+	// The unpack row length lets each region be uploaded straight out of the full layer.
+	glBindTexture(GL_TEXTURE_2D, picture.TextureID);
+	int level = 0;
+	for (tLayer* layer = patch.Layers.First(); layer && (level < int(regions.size())); layer = layer->Next(), level++)
+	{
+		const MipmapRegion& region = regions[level];
+		if (region.X1 < region.X0)
+			continue;
+
+		const tPixel4b* regionStart = (const tPixel4b*)layer->Data + region.Y0*layer->Width + region.X0;
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, layer->Width);
+		glTexSubImage2D(GL_TEXTURE_2D, level, region.X0, region.Y0, region.X1-region.X0+1, region.Y1-region.Y0+1, GL_RGBA, GL_UNSIGNED_BYTE, regionStart);
+	}
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 }
 
 
@@ -1807,7 +2719,7 @@ uint64 Image::BindThumbnail()
 
 		Config::ProfileData& profile = Config::GetProfileData();
 		tList<tLayer> layers;
-		ThumbnailPicture.GenerateLayers(layers, tResampleFilter(profile.MipmapFilter), tResampleEdgeMode::Clamp, profile.MipmapChaining);
+		GenerateMipmapLayers(layers, ThumbnailPicture, tResampleFilter(profile.MipmapFilter), tResampleEdgeMode::Clamp, profile.MipmapChaining);
 		BindLayers(layers, TexIDThumbnail);
 		return TexIDThumbnail;
 	}
@@ -1830,7 +2742,7 @@ void Image::GenerateThumbnail()
 
 	// Retrieve from cache if possible.
 	tuint256 hash = 0;
-	int thumbVersion = 3;
+	int thumbVersion = 4;
 	tFileInfo fileInfo;
 	tGetFileInfo(fileInfo, Filename);
 	hash = tHash::tHashData256((uint8*)&thumbVersion, sizeof(thumbVersion));
@@ -1913,7 +2825,7 @@ void Image::GenerateThumbnail()
 	tAssert((iw == ThumbWidth) || (ih == ThumbHeight));
 
 	// Create an image that is big (or small) enough to exactly match either the width or height without ruining the aspect.
-	srcPic->Resample(iw, ih, tResampleFilter::Bilinear);
+	ResamplePicture(*srcPic, iw, ih, tResampleFilter::Bilinear);
 
 	// Center-crop the image to what we need. Cropping to a bigger size adds transparent pixels.
 	srcPic->Crop(ThumbWidth, ThumbHeight);
@@ -15,9 +15,11 @@
 #pragma once
 #include <thread>
 #include <atomic>
+#include <vector>
 #include <glad/glad.h>
 #include <Foundation/tList.h>
 #include <Foundation/tString.h>
+#include <Foundation/tFixInt.h>
 #include <System/tFile.h>
 #include <Image/tPicture.h>
 #include <Image/tTexture.h>
@@ -44,6 +46,9 @@
 #include <Image/tImageKTX.h>
 #include "Config.h"
 #include "Undo.h"
+#include "ImageStats.h"
+#include "Rotation.h"
+#include "HDRSource.h"
 namespace tImage { class tLayer; }
 namespace Viewer
 {
@@ -84,10 +89,33 @@ public:
 	bool FramePlayLooping				= true;
 	int FrameNum						= 0;
 
+	// Load into main memory. Loading distinct images on different threads is safe. Load only writes this image's own
+	// members, only reads the profile, and makes no GL calls. The thumbnail threads depend on this too. Unload is
+	// also safe off the main thread, but only for an image that was never bound, because Unbind deletes textures.
 	bool Load(const tString& filename, bool loadParamsFromConfig = true);
-	bool Load(bool loadParamsFromConfig = true);																		// Load into main memory.
+	bool Load(bool loadParamsFromConfig = true);
 	bool IsLoaded() const																								{ return (Pictures.Count() > 0); }
 
+	// Makes Load decode the file contents from memory instead of reading Filename. Only PNG and JPG have memory
+	// decoders. Load fails for other types while this is set. The caller owns the data and keeps it alive until the
+	// image is destroyed or this is called with null. Filename still supplies the type and the name shown to the user.
+	void SetFileData(const uint8* data, int numBytes)																	{ FileData = data; FileDataSize = data ? numBytes : 0; }
+
+	// Makes this image an independent copy of the already loaded src image without decoding the file again. The
+	// pictures, info, and file details are copied. Undo history, the alt picture, and textures are not. Returns success.
+	bool LoadFrom(const Image& src);
+
+	// Re-runs the HDR to 8-bit conversion with the current LoadParams_HDR, as if the image were reloaded. The first
+	// call decodes and keeps the RGBE pixels of the file if the profile's RetainHDRSource is set, so later calls
+	// never touch the disk. Returns false if the image is not an unmodified single-picture HDR or the source could
+	// not be used, in which case the caller should reload instead. The image is unbound.
+	bool ReconvertHDR();
+
+	// Replaces the pictures of this image with the pictures of src, leaving src empty. An undo entry named undoDesc is
+	// pushed first so the whole replacement is a single undoable edit. Used to commit edits made to a snapshot on
+	// another thread. The image is unbound and must be rebound by the caller.
+	void TakePictures(Image& src, const tString& undoDesc);
+
 	// These are structs used for specifying parameters when saving. Different image types support different
 	// features and therefore each needs a unique set of parameters. When calling Save you can optionally ask for these
 	// structures to be used to grab the parameters from. If they are not used, then the settings in the config
@@ -109,16 +137,27 @@ public:
 	// defined by FrameNum will be saved. Returns success.
 	bool Save(const tString& outFile, tSystem::tFileType fileType, bool useConfigSaveParams = true, bool onlyCurrentPic = false) const;
 
+	// Saves the single frame frameNum without using or changing FrameNum. Different frames of the same image may be
+	// saved from different threads at the same time as long as the image is not modified while they are.
+	bool SaveFrame(const tString& outFile, tSystem::tFileType fileType, int frameNum, bool useConfigSaveParams = true) const;
+
 	int GetNumFrames() const																							{ return Pictures.Count(); }
 	int GetNumPictures() const																							{ return Pictures.Count(); }
 
-	bool IsOpaque() const;
+	// Statistics of each picture are computed in the background the first time the image is bound, or read from the
+	// cache if the image is unmodified. Edits (anything that pushes an undo step) discard them and they are remade on
+	// the next bind. GetStats returns null until they are ready.
+	void RequestStats();
+	const PictureStats* GetStats(int frameNum) const;
+	const PictureStats* GetCurrentStats() const																			{ return GetStats(FrameNum); }
+	void InvalidateStats();
 	bool Unload(bool force = false);
 	float GetLoadedTime() const																							{ return LoadedTime; }
 
 	// Bind to a texture ID and load into VRAM. If already in VRAM, it makes the texture current. Since some ImGui
 	// functions require a texture ID as parameter, this function return the ID. If the alt image is enabled, the bound
-	// texture and ID will be the alt image's. Returns 0 (invalid id) if there was a problem.
+	// texture and ID will be the alt image's. Returns 0 (invalid id) if there was a problem. Regions marked with
+	// MarkDirtyRegion are patched into already loaded textures.
 	uint64 Bind();
 	void Unbind();
 	int GetWidth() const;
@@ -131,13 +170,15 @@ public:
 	// The primary one is the first one.
 	tImage::tPicture* GetPrimaryPic() const																				{ return Pictures.First(); }
 	tImage::tPicture* GetFirstPic() const																				{ return Pictures.First(); }
-	tImage::tPicture* GetCurrentPic() const																				{ tImage::tPicture* pic = Pictures.First(); for (int i = 0; i < FrameNum; i++) pic = pic ? pic->Next() : nullptr; return pic; }
+	tImage::tPicture* GetCurrentPic() const																				{ return GetPicture(FrameNum); }
+	tImage::tPicture* GetPicture(int frameNum) const																	{ tImage::tPicture* pic = Pictures.First(); for (int i = 0; i < frameNum; i++) pic = pic ? pic->Next() : nullptr; return pic; }
 	const tList<tImage::tPicture>& GetPictures() const																	{ return Pictures; }
 
 	// Functions that edit and cause dirty flag to be set. Functions that return a bool will return false if the image
 	// is unmodified and the dirty flag is untouched. Functions that are void should be assumed to modify the image.
 	void Rotate90(bool antiClockWise);
-	bool Rotate(float angle, const tColour4b& fill, tImage::tResampleFilter upFilter, tImage::tResampleFilter downFilter);
+	void Rotate180();
+	bool Rotate(float angle, const tColour4b& fill, tImage::tResampleFilter filter, RotateFit = RotateFit::Fill);
 
 	// Quantize image colours based on a fixed palette. numColours must be 256 or less. checkExact means no change to
 	// the image will be made if it already contains fewer colours than numColours already. This may or may not be
@@ -156,10 +197,45 @@ public:
 	// Similar to above but uses Wu algorighm to generate the palette.
 	void QuantizeWu(int numColours, bool checkExact = true);
 
-	bool AdjustmentBegin();
+	// Quantizes every frame to one shared palette. The palette is built by the chosen method from a subsampled union of
+	// the pixels of all frames, and then all frames are remapped to it in parallel. Compared to quantizing each frame
+	// on its own this is much faster for long animations and there is no palette flicker between frames. Spatial
+	// dither is not used when remapping. Single-frame images are quantized the normal way.
+	void QuantizeShared(tImage::tQuantize::Method, int numColours, bool checkExact = true, int sampleFactor = 1);
+
 	enum class AdjChan { RGB, R, G, B, A };	// Adjustment is to individual RGBA channels or RGB/Intensity (default).
 	static comp_t ComponentBits(AdjChan);	// Converts to tChannels.
 
+	// A brightness, contrast, or levels adjustment. All of them map each channel value independently so they are
+	// applied with a per-channel lookup table.
+	struct Adjustment
+	{
+		enum class Type { None, Brightness, Contrast, Levels };
+		Type Typ							= Type::None;
+		AdjChan Channels					= AdjChan::RGB;
+		bool AllFrames						= true;
+		float Brightness					= 0.5f;
+		float Contrast						= 0.5f;
+		float BlackPoint					= 0.0f;
+		float MidPoint						= 0.5f;
+		float WhitePoint					= 1.0f;
+		float BlackOut						= 0.0f;
+		float WhiteOut						= 1.0f;
+		bool PowerMidGamma					= true;
+		const char* GetDesc() const;
+	};
+
+	// Applies the adjustment to a single picture at full resolution. Thread-safe for different pictures.
+	static void AdjustPicture(tImage::tPicture&, const Adjustment&);
+
+	// Applies the adjustment to all frames, or only the current frame if it is not for all frames. Pushes an undo step.
+	void ApplyAdjustment(const Adjustment&);
+
+	// Adjustments are previewed live while the sliders move. Begin makes a proxy of the current frame no bigger than
+	// maxPreviewWidth by maxPreviewHeight and, until end is called, Bind displays the proxy with the pending
+	// adjustment applied. The image itself is not modified. To apply the adjustment call AdjustPicture on every
+	// frame, typically on a snapshot in a background edit task.
+	bool AdjustmentBegin(int maxPreviewWidth, int maxPreviewHeight);
 	void AdjustBrightness(float brightness, AdjChan = AdjChan::RGB, bool allFrames = true);
 	void AdjustContrast(float contrast, AdjChan = AdjChan::RGB, bool allFrames = true);
 	void AdjustLevels
@@ -167,7 +243,8 @@ public:
 		float blackPoint, float midPoint, float whitePoint, float blackOut, float whiteOut,
 		bool powerMidGamma = true, AdjChan = AdjChan::RGB, bool allFrames = true
 	);
-	void AdjustRestoreOriginal(bool popUndo = false);
+	void AdjustRestoreOriginal();
+	const Adjustment& GetPendingAdjustment() const																		{ return AdjustPending; }
 
 	// Some of the adjustment defaults are a function of the image properties. In particular the brightness range is
 	// computed so that the full [0,1] range is used and no more. If the image doesn't have pixels that are both full
@@ -183,7 +260,27 @@ public:
 	bool Paste(int regionW, int regionH, const tColour4b* regionPixels, tImage::tPicture::Anchor, comp_t channels = tCompBit_RGBA);
 	bool Deborder(const tColour4b& borderColour, comp_t channels = tCompBit_RGBA);
 	bool Resample(int newWidth, int newHeight, tImage::tResampleFilter filter, tImage::tResampleEdgeMode edgeMode);
+
+	// A fused crop, resample, and canvas operation. For every picture the source rectangle (srcX, srcY, srcW, srcH),
+	// which must lie inside the picture, is resampled to scaledW x scaledH and placed with its bottom-left corner at
+	// (dstX, dstY) in a new dstW x dstH picture. The placed rectangle may be partially outside the new picture. Any
+	// pixels not covered are set to fillColour. Only one output buffer is allocated per picture and no resampling is
+	// done if the scale is 1:1. All pictures must be the same size. Returns false if the image is unmodified (including
+	// a region that is already the whole picture at 1:1) or a resample failed.
+	bool ResampleRegion
+	(
+		int srcX, int srcY, int srcW, int srcH, int scaledW, int scaledH,
+		int dstX, int dstY, int dstW, int dstH,
+		tImage::tResampleFilter, tImage::tResampleEdgeMode, const tColour4b& fillColour = tColour4b::black
+	);
+	// Does not need an Unbind. The edited pixel is marked with MarkDirtyRegion so the next Bind patches the texture.
 	void SetPixelColour(int x, int y, const tColour4b&, bool pushUndo, bool supressDirty = false);
+
+	// Records that the pixels in the inclusive rectangle of picture changed. If the picture's texture is loaded, the
+	// next Bind updates just that region of each mip level rather than regenerating the whole texture. The first
+	// patch of a texture reloads it once and keeps its mip chain in main memory until Unbind so later patches can
+	// be filtered down. Edits that change many pixels should Unbind instead.
+	void MarkDirtyRegion(tImage::tPicture*, int x0, int y0, int x1, int y1);
 	void SetAllPixels(const tColour4b& colour, comp_t channels = tCompBit_RGBA);
 
 	// Spreads the specified single channel to all RGB channels.
@@ -214,8 +311,8 @@ public:
 	void SetFrameDuration(float duration, bool allFrames = false);
 
 	// Undo and redo functions.
-	void Undo()																											{ UndoStack.Undo(Pictures, Dirty); }
-	void Redo()																											{ UndoStack.Redo(Pictures, Dirty); }
+	void Undo()																											{ InvalidateStats(); UndoStack.Undo(Pictures, Dirty); }
+	void Redo()																											{ InvalidateStats(); UndoStack.Redo(Pictures, Dirty); }
 	bool IsUndoAvailable() const																						{ return UndoStack.UndoAvailable(); }
 	bool IsRedoAvailable() const																						{ return UndoStack.RedoAvailable(); }
 	tString GetUndoDesc() const																							{ tString desc; tsPrintf(desc, "[%s]", UndoStack.GetUndoDesc().Chr()); return desc; }
@@ -233,12 +330,16 @@ public:
 		tAlphaMode AlphaMode							= tAlphaMode::Unspecified;
 		tChannelType ChannelType						= tChannelType::Unspecified;
 
-		enum class OpacityEnum { False, True, Varies };	// Varies is for when there is more than one picture in the image (animated, mipmaps, etc) and they are not set all the same.
+		enum class OpacityEnum { False, True, Varies, Unknown, Failed };	// Varies is for when there is more than one picture in the image (animated, mipmaps, etc) and they are not set all the same. Unknown until the stats are ready. Failed if they could not be computed.
 		OpacityEnum Opacity								= OpacityEnum::False;
 		int FileSizeBytes								= 0;
 		int MemSizeBytes								= 0;
 	};
 
+	// Opacity of the current picture from its statistics. Returns True or False once they are ready. While they are
+	// being remade after an edit the previous answer is returned. Unknown only before the first stats are ready.
+	ImgInfo::OpacityEnum GetOpacity() const;
+
 	bool IsAltMipmapsPictureAvail() const																				{ return (AltPictureTyp == AltPictureType::MipmapSideBySide); }
 	bool IsAltCubemapPictureAvail() const																				{ return (AltPictureTyp == AltPictureType::CubemapTLayout); }
 	void EnableAltPicture(bool enabled)																					{ AltPictureEnabled = enabled; }
@@ -256,6 +357,7 @@ public:
 
 	// You are allowed to unrequest. It will succeed if a worker was never assigned.
 	void UnrequestThumbnail();
+	bool IsThumbnailRequested() const																					{ return ThumbnailRequested; }
 	bool IsThumbnailWorkerActive() const																				{ return ThumbnailThreadRunning; }
 	uint64 BindThumbnail();
 	inline static int GetThumbnailNumThreadsRunning()																	{ return ThumbnailNumThreadsRunning; }
@@ -275,6 +377,7 @@ public:
 	tImage::tMetaData Cached_MetaData;
 
 	const static uint32 ThumbChunkInfoID;
+	const static uint32 StatsChunkID;
 	const static uint32 ThumbChunkMetaDataID;
 	const static uint32 ThumbChunkMetaDatumID;
 
@@ -293,7 +396,9 @@ public:
 
 private:
 	bool UndoEnabled = true;
-	void PushUndo(const tString& desc)																					{ if (UndoEnabled) UndoStack.Push(Pictures, desc, Dirty); }
+	const uint8* FileData = nullptr;					// Not owned. See SetFileData.
+	int FileDataSize = 0;
+	void PushUndo(const tString& desc)																					{ InvalidateStats(); if (UndoEnabled) UndoStack.Push(Pictures, desc, Dirty); }
 	void PopUndo()																										{ if (UndoEnabled) UndoStack.Pop(); }
 
 	// There are multiple pictures for a few reasons. Images with multiple frames (gifs, exrs, tiffs, webps etc) store
@@ -328,16 +433,78 @@ private:
 	// Zero is invalid and means texture has never been bound and loaded into VRAM.
 	uint TexIDAlt			= 0;
 	uint TexIDThumbnail		= 0;
-
-	// Returns the approx main mem size of this image. Considers the Pictures list and the AltPicture.
+	uint TexIDAdjust		= 0;
+
+	// Adjustment preview state. The proxy is the downsampled current frame. It stays between tPicture adjustment
+	// begin/end calls while previewing so each change is made from its original pixels. The defaults are from the
+	// full resolution current frame.
+	void AdjustUpdatePreview();
+	static void AdjustPictureBegun(tImage::tPicture&, const Adjustment&);
+	bool AdjustPreviewing	= false;
+	Adjustment AdjustPending;
+	Adjustment AdjustDefaults;
+	tImage::tPicture AdjustProxy;
+
+	// Returns the approx main mem size of this image. Considers the Pictures list, the AltPicture, and the HDR source.
 	int GetMemSizeBytes() const;
 
+	// The retained high precision pixels of an HDR file. Only populated by ReconvertHDR. Cleared by Unload.
+	HDRSource HDRSrc;
+
 	// This function can handle DDS, PVR, and KTX images and populate the pictures list as well as create the
 	// alternate image if necessary.
 	void MultiSurfacePopulatePictures(const tImage::tBaseImage&);
 	void MultiSurfaceCreateAltCubemapPicture(const teList<tImage::tLayer> layers[tImage::tFaceIndex::tFaceIndex_NumFaces]);
 	void MultiSurfaceCreateAltMipmapPicture(const teList<tImage::tLayer>&);
 
+	// Frame textures are made on demand as frames are shown, plus a few frames ahead while playing. Each bound frame
+	// has an entry so the least recently shown frames can be released when over MaxFrameTexMemMB.
+	struct FrameTexture
+	{
+		const tImage::tPicture* Picture;
+		int FrameIndex;
+		uint64 LastUsed;
+		int64 Bytes;
+	};
+	std::vector<FrameTexture> FrameTextures;
+	uint64 FrameTextureClock				= 0;
+	int64 FrameTextureBytes					= 0;
+	static const int FrameLookAhead			= 4;
+	void BindFrame(tImage::tPicture*, int frameIndex);
+	void ReleaseFrameTextures();
+
+	// Stats worker state. Stats is only touched by the main thread once StatsReady is set.
+	tString GetStatsCacheFile() const;
+	void ComputeStats(bool useCache);
+	std::vector<PictureStats> Stats;
+	std::thread StatsThread;
+	std::atomic<bool> StatsReady			= false;
+	std::atomic<bool> StatsFailed			= false;
+	std::atomic<bool> StatsCancel			= false;
+	bool StatsRequested						= false;
+	bool StatsApplied						= false;
+	bool StatsFromFile						= false;		// Pixels are unmodified since load so the cache may be used.
+	std::vector<bool> PendingOpaque;						// Per-picture opacity from the last stats, used until new ones are ready.
+	tuint256 StatsLoadParamsHash			= 0;			// The file type and load params used by the last load.
+
+	// A pending texture patch for one picture. Layers is the mip chain as uploaded. It is empty until the first patch.
+	// Filter and Chaining are the mip settings Layers was made with.
+	struct TexturePatch : public tLink<TexturePatch>
+	{
+		const tImage::tPicture* Picture		= nullptr;
+		tList<tImage::tLayer> Layers;
+		tImage::tResampleFilter Filter		= tImage::tResampleFilter::None;
+		bool Chaining						= true;
+		int X0 = 0, Y0 = 0, X1 = -1, Y1 = -1;				// Inclusive. Empty if X1 < X0.
+		bool IsEmpty() const																							{ return (X1 < X0) || (Y1 < Y0); }
+		void ResetRegion()																								{ X0 = 0; Y0 = 0; X1 = -1; Y1 = -1; }
+	};
+	tList<TexturePatch> TexturePatches;
+	TexturePatch* FindTexturePatch(const tImage::tPicture*);
+	void ApplyTexturePatches();
+	void PatchLayers(tImage::tPicture&, TexturePatch&);
+
+	bool SavePictures(const tString& outFile, tSystem::tFileType, bool useConfigSaveParams, bool onlyFramePic, int frameNum) const;
 	void GetGLFormatInfo(GLint& srcFormat, GLenum& srcType, GLint& dstFormat, bool& compressed, tImage::tPixelFormat);
 	void BindLayers(const tList<tImage::tLayer>&, uint texID);
 
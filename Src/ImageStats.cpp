@@ -0,0 +1,144 @@
+// ImageStats.cpp
+//
+// Per-picture statistics: channel histograms, min/max, mean, and alpha flags. Images compute them on a background
+// thread and cache them next to the thumbnails so the levels dialog, details, and opacity queries do not need to scan
+// the pixels.
+//
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <thread>
+#include <vector>
+#include <Math/tFundamentals.h>
+#include <System/tMachine.h>
+#include "ImageStats.h"
+using namespace tMath;
+using namespace tImage;
+
+
+namespace Viewer
+{
+	// Rows are processed in blocks of about this many pixels and cancellation is checked between them. A cancel is
+	// therefore noticed within a fraction of a millisecond however wide the picture is.
+	const int StatsBlockPixels = 64*1024;
+
+	// Histogramming is a scatter so it does not vectorise. What limits it is consecutive equal values incrementing the
+	// same counter, so each worker alternates between two sets of counters and they are summed at the end.
+	struct StatsCounters
+	{
+		uint32 Counts[2][PictureStats::NumChannels][PictureStats::NumBins];
+	};
+	void CountRows(const tPixel4b* pixels, int width, int rowBegin, int rowEnd, StatsCounters&, const std::atomic<bool>* cancel);
+}
+
+
+void Viewer::CountRows(const tPixel4b* pixels, int width, int rowBegin, int rowEnd, StatsCounters& counters, const std::atomic<bool>* cancel)
+{
+	uint32 (*even)[PictureStats::NumBins] = counters.Counts[0];
+	uint32 (*odd)[PictureStats::NumBins] = counters.Counts[1];
+	int blockRows = tMax(1, StatsBlockPixels / width);
+	for (int blockBegin = rowBegin; blockBegin < rowEnd; blockBegin += blockRows)
+	{
+		if (cancel && *cancel)
+			return;
+
+		int blockEnd = tMin(blockBegin + blockRows, rowEnd);
+		const tPixel4b* p = pixels + blockBegin*width;
+		const tPixel4b* end = pixels + blockEnd*width;
+		for (; p + 1 < end; p += 2)
+		{
+			const tPixel4b& a = p[0];
+			const tPixel4b& b = p[1];
+			even[PictureStats::Chan_R][a.R]++;	odd[PictureStats::Chan_R][b.R]++;
+			even[PictureStats::Chan_G][a.G]++;	odd[PictureStats::Chan_G][b.G]++;
+			even[PictureStats::Chan_B][a.B]++;	odd[PictureStats::Chan_B][b.B]++;
+			even[PictureStats::Chan_A][a.A]++;	odd[PictureStats::Chan_A][b.A]++;
+			even[PictureStats::Chan_I][(54*a.R + 183*a.G + 19*a.B) >> 8]++;
+			odd [PictureStats::Chan_I][(54*b.R + 183*b.G + 19*b.B) >> 8]++;
+		}
+		for (; p < end; p++)
+		{
+			even[PictureStats::Chan_R][p->R]++;
+			even[PictureStats::Chan_G][p->G]++;
+			even[PictureStats::Chan_B][p->B]++;
+			even[PictureStats::Chan_A][p->A]++;
+			even[PictureStats::Chan_I][(54*p->R + 183*p->G + 19*p->B) >> 8]++;
+		}
+	}
+}
+
+
+bool Viewer::PictureStats::Compute(const tPicture& picture, const std::atomic<bool>* cancel)
+{
+	Width = 0;
+	Height = 0;
+	if (!picture.IsValid())
+		return false;
+
+	int width = picture.GetWidth();
+	int height = picture.GetHeight();
+	const tPixel4b* pixels = picture.GetPixelPointer();
+
+	// Small pictures are not worth the threads.
+	int numWorkers = (width*height < 256*1024) ? 1 : tClamp(tSystem::tGetNumCores(), 1, height);
+	int bandRows = (height + numWorkers - 1) / numWorkers;
+	std::vector<StatsCounters> counters(numWorkers);			// Value initialized to zero.
+
+	std::vector<std::thread> workers;
+	for (int w = 1; w < numWorkers; w++)
+	{
+		int begin = w*bandRows;
+		if (begin >= height)
+			break;
+		workers.emplace_back(CountRows, pixels, width, begin, tMin(height, begin + bandRows), std::ref(counters[w]), cancel);
+	}
+	CountRows(pixels, width, 0, tMin(height, bandRows), counters[0], cancel);
+	for (std::thread& worker : workers)
+		worker.join();
+
+	if (cancel && *cancel)
+		return false;
+
+	// Everything else comes from the histograms.
+	int numPixels = width*height;
+	for (int c = 0; c < NumChannels; c++)
+	{
+		double sum = 0.0;
+		MaxCount[c] = 0;
+		Min[c] = 255;
+		Max[c] = 0;
+		for (int bin = 0; bin < NumBins; bin++)
+		{
+			uint32 count = 0;
+			for (const StatsCounters& wc : counters)
+				count += wc.Counts[0][c][bin] + wc.Counts[1][c][bin];
+
+			Histogram[c][bin] = count;
+			if (!count)
+				continue;
+			MaxCount[c] = tMax(MaxCount[c], count);
+			Min[c] = tMin(Min[c], uint8(bin));
+			Max[c] = tMax(Max[c], uint8(bin));
+			sum += double(bin) * double(count);
+		}
+		Mean[c] = float(sum / double(numPixels));
+	}
+
+	Opaque = (Min[Chan_A] == 255);
+	BinaryAlpha = true;
+	for (int bin = 1; (bin < 255) && BinaryAlpha; bin++)
+		BinaryAlpha = (Histogram[Chan_A][bin] == 0);
+
+	Width = width;
+	Height = height;
+	return true;
+}
@@ -0,0 +1,54 @@
+// ImageStats.h
+//
+// Per-picture statistics: channel histograms, min/max, mean, and alpha flags. Images compute them on a background
+// thread and cache them next to the thumbnails so the levels dialog, details, and opacity queries do not need to scan
+// the pixels.
+//
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+#include <atomic>
+#include <Image/tPicture.h>
+
+
+namespace Viewer
+{
+	// Plain data so it can be written to and read from the cache as a single item.
+	struct PictureStats
+	{
+		enum Channel { Chan_R, Chan_G, Chan_B, Chan_A, Chan_I, NumChannels };
+		static const int NumBins = 256;
+
+		// Computes everything from the picture's pixels using all cores. Returns false (and the stats are not valid) if
+		// the picture is invalid or cancel becomes true before it finishes.
+		bool Compute(const tImage::tPicture&, const std::atomic<bool>* cancel = nullptr);
+		bool IsValidFor(const tImage::tPicture& pic) const													{ return (Width == pic.GetWidth()) && (Height == pic.GetHeight()); }
+
+		// The smallest and largest of the R, G, and B channel values.
+		int GetRGBMin() const																				{ int m = Min[Chan_R]; if (Min[Chan_G] < m) m = Min[Chan_G]; if (Min[Chan_B] < m) m = Min[Chan_B]; return m; }
+		int GetRGBMax() const																				{ int m = Max[Chan_R]; if (Max[Chan_G] > m) m = Max[Chan_G]; if (Max[Chan_B] > m) m = Max[Chan_B]; return m; }
+
+		int Width								= 0;
+		int Height								= 0;
+
+		// Intensity is Rec. 709 luma.
+		uint32 Histogram[NumChannels][NumBins];
+		uint32 MaxCount[NumChannels];
+		uint8 Min[NumChannels];
+		uint8 Max[NumChannels];
+		float Mean[NumChannels];
+
+		bool Opaque								= true;			// Every alpha is 255.
+		bool BinaryAlpha						= true;			// Every alpha is 0 or 255.
+	};
+}
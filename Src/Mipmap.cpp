@@ -0,0 +1,309 @@
+// Mipmap.cpp
+//
+// Fast mipmap chain generation for textures. Each level is split into bands that are filtered on separate threads.
+// With chaining and the box filter, even-sized levels are made with a 2x2 kernel using SSE2 or NEON (scalar
+// otherwise), which runs at close to memory bandwidth. Other filters and odd-sized levels use the separable resampler.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <thread>
+#include <vector>
+#include <functional>
+#include <Foundation/tStandard.h>
+#include <Math/tFundamentals.h>
+#include <System/tMachine.h>
+#include "Mipmap.h"
+#include "Resampler.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+	#include <emmintrin.h>
+	#define MIPMAP_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+	#include <arm_neon.h>
+	#define MIPMAP_NEON
+#endif
+using namespace tMath;
+using namespace tImage;
+
+
+namespace Viewer
+{
+	// Levels with fewer pixels than this are not worth splitting across threads.
+	const int MinParallelPixels = 128*1024;
+
+	// Calls fn(rowBegin, rowEnd) over [0, numRows) split into bands, one per core. Runs inline for small work.
+	void ForEachBand(int numRows, int numPixels, const std::function<void(int, int)>& fn);
+
+	// Halves an even-sized level with a 2x2 box kernel. Rounds to nearest. Dst rows [rowBegin, rowEnd) are written,
+	// and within them columns [colBegin, colEnd). A colEnd of -1 means dstW.
+	void HalveBox(const tPixel4b* src, int srcW, tPixel4b* dst, int dstW, int rowBegin, int rowEnd, int colBegin = 0, int colEnd = -1);
+
+	// True if a chaining level of w x h made from srcW x srcH uses HalveBox rather than the resampler.
+	bool UsesHalveBox(tResampleFilter filter, int srcW, int srcH, int w, int h)											{ return (filter == tResampleFilter::Box) && (srcW == 2*w) && (srcH == 2*h); }
+}
+
+
+void Viewer::ForEachBand(int numRows, int numPixels, const std::function<void(int, int)>& fn)
+{
+	int numBands = (numPixels < MinParallelPixels) ? 1 : tClamp(tSystem::tGetNumCores(), 1, numRows);
+	if (numBands <= 1)
+	{
+		fn(0, numRows);
+		return;
+	}
+
+	int bandRows = (numRows + numBands - 1) / numBands;
+	std::vector<std::thread> workers;
+	for (int band = 1; band < numBands; band++)
+	{
+		int begin = band*bandRows;
+		if (begin >= numRows)
+			break;
+		workers.emplace_back(fn, begin, tMin(numRows, begin + bandRows));
+	}
+	fn(0, tMin(numRows, bandRows));
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+
+void Viewer::HalveBox(const tPixel4b* src, int srcW, tPixel4b* dst, int dstW, int rowBegin, int rowEnd, int colBegin, int colEnd)
+{
+	if (colEnd < 0)
+		colEnd = dstW;
+
+	for (int y = rowBegin; y < rowEnd; y++)
+	{
+		const uint8* row0 = (const uint8*)(src + (2*y)*srcW);
+		const uint8* row1 = (const uint8*)(src + (2*y+1)*srcW);
+		uint8* out = (uint8*)(dst + y*dstW);
+		int x = colBegin;
+
+		#if defined(MIPMAP_SSE2)
+		// Four destination pixels per iteration. Sums are done in 16 bits so the rounding matches the scalar code.
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		for (; x + 4 <= colEnd; x += 4)
+		{
+			__m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + 8*x));
+			__m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + 8*x + 16));
+			__m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + 8*x));
+			__m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + 8*x + 16));
+
+			// Vertical sums. Each register holds two source pixels as 16-bit channels.
+			__m128i v0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+			__m128i v1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+			__m128i v2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+			__m128i v3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+			// Horizontal sums of each pair land in the low half.
+			__m128i h0 = _mm_add_epi16(v0, _mm_srli_si128(v0, 8));
+			__m128i h1 = _mm_add_epi16(v1, _mm_srli_si128(v1, 8));
+			__m128i h2 = _mm_add_epi16(v2, _mm_srli_si128(v2, 8));
+			__m128i h3 = _mm_add_epi16(v3, _mm_srli_si128(v3, 8));
+
+			__m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(h0, h1), two), 2);
+			__m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(h2, h3), two), 2);
+			_mm_storeu_si128((__m128i*)(out + 4*x), _mm_packus_epi16(lo, hi));
+		}
+
+		#elif defined(MIPMAP_NEON)
+		// Two destination pixels per iteration. The rounding narrowing shift is (sum + 2) >> 2.
+		for (; x + 2 <= colEnd; x += 2)
+		{
+			uint8x16_t a = vld1q_u8(row0 + 8*x);
+			uint8x16_t b = vld1q_u8(row1 + 8*x);
+			uint16x8_t v0 = vaddl_u8(vget_low_u8(a), vget_low_u8(b));
+			uint16x8_t v1 = vaddl_u8(vget_high_u8(a), vget_high_u8(b));
+			uint16x4_t h0 = vadd_u16(vget_low_u16(v0), vget_high_u16(v0));
+			uint16x4_t h1 = vadd_u16(vget_low_u16(v1), vget_high_u16(v1));
+			vst1_u8(out + 4*x, vrshrn_n_u16(vcombine_u16(h0, h1), 2));
+		}
+		#endif
+
+		for (; x < colEnd; x++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				int sum = int(row0[8*x + c]) + int(row0[8*x + 4 + c]) + int(row1[8*x + c]) + int(row1[8*x + 4 + c]);
+				out[4*x + c] = uint8((sum + 2) >> 2);
+			}
+		}
+	}
+}
+
+
+int Viewer::GenerateMipmapLayers
+(
+	tList<tLayer>& layers, const tPicture& picture, tResampleFilter filter,
+	tResampleEdgeMode edgeMode, bool chaining
+)
+{
+	if (!picture.IsValid())
+		return 0;
+
+	int width = picture.GetWidth();
+	int height = picture.GetHeight();
+	tPixel4b* top = new tPixel4b[width*height];
+	ForEachBand
+	(
+		height, width*height,
+		[&picture, top, width](int rowBegin, int rowEnd)
+		{
+			tStd::tMemcpy(top + rowBegin*width, picture.GetPixelPointer() + rowBegin*width, (rowEnd-rowBegin)*width*sizeof(tPixel4b));
+		}
+	);
+	layers.Append(new tLayer(tPixelFormat::R8G8B8A8, width, height, (uint8*)top, true));
+	if (filter == tResampleFilter::None)
+		return layers.Count();
+
+	// Level dimensions halve, rounding down, to 1x1.
+	std::vector<int> levelW, levelH;
+	for (int w = width, h = height; (w > 1) || (h > 1); )
+	{
+		w = tMax(1, w/2);
+		h = tMax(1, h/2);
+		levelW.push_back(w);
+		levelH.push_back(h);
+	}
+	int numLevels = int(levelW.size());
+	std::vector<tPixel4b*> levels(numLevels);
+	for (int l = 0; l < numLevels; l++)
+		levels[l] = new tPixel4b[levelW[l]*levelH[l]];
+
+	if (chaining)
+	{
+		// At exactly half size the box filter has two equal taps per axis, so it gets the 2x2 fast path. Bilinear is
+		// not the same. Its kernel is stretched to four taps (1/8, 3/8, 3/8, 1/8) when downscaling so it goes through
+		// the resampler like the other filters. Each level is split across threads since it depends on the one before.
+		const tPixel4b* src = top;
+		int srcW = width;
+		int srcH = height;
+		for (int l = 0; l < numLevels; l++)
+		{
+			int w = levelW[l];
+			int h = levelH[l];
+			tPixel4b* level = levels[l];
+			if (UsesHalveBox(filter, srcW, srcH, w, h))
+			{
+				ForEachBand
+				(
+					h, w*h,
+					[src, srcW, level, w](int rowBegin, int rowEnd) { HalveBox(src, srcW, level, w, rowBegin, rowEnd); }
+				);
+			}
+			else
+			{
+				ResamplePixels(src, srcW, srcH, level, w, h, filter, edgeMode);
+			}
+			src = level;
+			srcW = w;
+			srcH = h;
+		}
+	}
+	else
+	{
+		// Every level comes from the picture so the levels themselves are made in parallel.
+		ForEachBand
+		(
+			numLevels, width*height,
+			[&](int levelBegin, int levelEnd)
+			{
+				for (int l = levelBegin; l < levelEnd; l++)
+					ResamplePixels(top, width, height, levels[l], levelW[l], levelH[l], filter, edgeMode);
+			}
+		);
+	}
+
+	for (int l = 0; l < numLevels; l++)
+		layers.Append(new tLayer(tPixelFormat::R8G8B8A8, levelW[l], levelH[l], (uint8*)levels[l], true));
+
+	return layers.Count();
+}
+
+
+bool Viewer::UpdateMipmapLayers
+(
+	tList<tLayer>& layers, const tPicture& picture, int x0, int y0, int x1, int y1, std::vector<MipmapRegion>& regions,
+	tResampleFilter filter, tResampleEdgeMode edgeMode, bool chaining
+)
+{
+	regions.clear();
+	tLayer* top = layers.First();
+	if (!picture.IsValid() || !top || (top->PixelFormat != tPixelFormat::R8G8B8A8) || (top->Width != picture.GetWidth()) || (top->Height != picture.GetHeight()))
+		return false;
+
+	// The chain must have exactly the levels GenerateMipmapLayers would make.
+	int expectedLevels = 1;
+	for (int w = top->Width, h = top->Height; (filter != tResampleFilter::None) && ((w > 1) || (h > 1)); expectedLevels++)
+	{
+		w = tMax(1, w/2);
+		h = tMax(1, h/2);
+	}
+	if (layers.Count() != expectedLevels)
+		return false;
+	for (tLayer* layer = top->Next(); layer; layer = layer->Next())
+		if ((layer->PixelFormat != tPixelFormat::R8G8B8A8) || (layer->Width != tMax(1, layer->Prev()->Width/2)) || (layer->Height != tMax(1, layer->Prev()->Height/2)))
+			return false;
+
+	x0 = tClamp(x0, 0, top->Width-1);		y0 = tClamp(y0, 0, top->Height-1);
+	x1 = tClamp(x1, 0, top->Width-1);		y1 = tClamp(y1, 0, top->Height-1);
+	if ((x1 < x0) || (y1 < y0))
+		return true;
+
+	// Level 0 is a straight copy of the region from the picture.
+	const tPixel4b* pixels = picture.GetPixelPointer();
+	tPixel4b* topPixels = (tPixel4b*)top->Data;
+	for (int y = y0; y <= y1; y++)
+		tStd::tMemcpy(topPixels + y*top->Width + x0, pixels + y*top->Width + x0, (x1-x0+1)*sizeof(tPixel4b));
+	regions.push_back({ x0, y0, x1, y1 });
+
+	// Each smaller level recomputes only the texels whose footprint reads the changed region of its source level, the
+	// level above when chaining and the top otherwise. The kernel apron comes from the weight tables so it is exact
+	// for every filter and edge mode, and the texels written are identical to a full rebuild.
+	const MipmapRegion topRegion = regions.back();
+	for (tLayer* layer = top->Next(); layer; layer = layer->Next())
+	{
+		tLayer* srcLayer = chaining ? layer->Prev() : top;
+		MipmapRegion srcRegion = chaining ? regions.back() : topRegion;
+		if (srcRegion.X1 < srcRegion.X0)
+		{
+			regions.push_back({ 0, 0, -1, -1 });
+			continue;
+		}
+
+		const tPixel4b* src = (const tPixel4b*)srcLayer->Data;
+		tPixel4b* dst = (tPixel4b*)layer->Data;
+		int srcW = srcLayer->Width;		int srcH = srcLayer->Height;
+		int w = layer->Width;			int h = layer->Height;
+		MipmapRegion region;
+		if (chaining && UsesHalveBox(filter, srcW, srcH, w, h))
+		{
+			region = { srcRegion.X0/2, srcRegion.Y0/2, srcRegion.X1/2, srcRegion.Y1/2 };
+			HalveBox(src, srcW, dst, w, region.Y0, region.Y1+1, region.X0, region.X1+1);
+		}
+		else if
+		(
+			GetResampleFootprint(srcW, w, srcRegion.X0, srcRegion.X1, region.X0, region.X1, filter, edgeMode) &&
+			GetResampleFootprint(srcH, h, srcRegion.Y0, srcRegion.Y1, region.Y0, region.Y1, filter, edgeMode)
+		)
+		{
+			ResamplePixelsRegion(src, srcW, srcH, dst, w, h, region.X0, region.Y0, region.X1, region.Y1, filter, edgeMode);
+		}
+		else
+		{
+			region = { 0, 0, -1, -1 };
+		}
+		regions.push_back(region);
+	}
+
+	return true;
+}
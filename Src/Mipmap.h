@@ -0,0 +1,53 @@
+// Mipmap.h
+//
+// Fast mipmap chain generation for textures. Each level is split into bands that are filtered on separate threads.
+// With chaining and the box filter, even-sized levels are made with a 2x2 kernel using SSE2 or NEON (scalar
+// otherwise), which runs at close to memory bandwidth. Other filters and odd-sized levels use the separable resampler.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <vector>
+#include <Foundation/tList.h>
+#include <Image/tPicture.h>
+#include <Image/tLayer.h>
+#include <Image/tResample.h>
+
+
+namespace Viewer
+{
+	// A drop-in replacement for tPicture::GenerateLayers. Layer 0 is a copy of the picture. If filter is None only
+	// layer 0 is made. Each following level halves the dimensions (rounding down, minimum 1) down to 1x1. With
+	// chaining each level is made from the previous one, otherwise from the picture. Returns the number of layers.
+	int GenerateMipmapLayers
+	(
+		tList<tImage::tLayer>& layers, const tImage::tPicture&, tImage::tResampleFilter,
+		tImage::tResampleEdgeMode = tImage::tResampleEdgeMode::Clamp, bool chaining = true
+	);
+
+	// An inclusive texel rectangle of one mip level. Empty if X1 < X0.
+	struct MipmapRegion
+	{
+		int X0, Y0, X1, Y1;
+	};
+
+	// Brings a chain made by GenerateMipmapLayers up to date after the picture changed inside the inclusive rectangle
+	// x0..x1, y0..y1. The filter, edge mode, and chaining must be the ones the chain was made with. Only texels that
+	// depend on the change are recomputed, and they come out identical to a full rebuild. regions receives the
+	// rectangle updated in each level, for uploading. Returns false, changing nothing, if the layers do not match the
+	// picture's chain.
+	bool UpdateMipmapLayers
+	(
+		tList<tImage::tLayer>& layers, const tImage::tPicture&, int x0, int y0, int x1, int y1,
+		std::vector<MipmapRegion>& regions, tImage::tResampleFilter,
+		tImage::tResampleEdgeMode = tImage::tResampleEdgeMode::Clamp, bool chaining = true
+	);
+}
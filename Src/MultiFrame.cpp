@@ -25,6 +25,7 @@
 #include "Image.h"
 #include "GuiUtil.h"
 #include "Config.h"
+#include "Resampler.h"
 using namespace tStd;
 using namespace tMath;
 using namespace tSystem;
@@ -37,7 +38,10 @@ namespace Viewer
 	void ComputeMaxWidthHeight(int& outWidth, int& outHeight);
 	bool AllDimensionsMatch(int width, int height);
 
+	// Starts extracting the frames of the current image in the background. The extract modal shows the progress.
 	void SaveExtractedFrames(const tString& destDir, const tString& baseName, tFileType, tIntervalSet frames);
+	void DoExtractFramesProgress();
+	FrameExtractor* ExtractFrames = nullptr;
 }
 
 
@@ -254,7 +258,7 @@ void Viewer::SaveMultiFrameTo(const tString& outFile, int outWidth, int outHeigh
 
 		tImage::tPicture resampled(*currPic);
 		if ((resampled.GetWidth() != outWidth) || (resampled.GetHeight() != outHeight))
-			resampled.Resample(outWidth, outHeight, tImage::tResampleFilter(profile.ResampleFilter), tImage::tResampleEdgeMode(profile.ResampleEdgeMode));
+			ResamplePicture(resampled, outWidth, outHeight, tImage::tResampleFilter(profile.ResampleFilter), tImage::tResampleEdgeMode(profile.ResampleEdgeMode));
 
 		tFrame* frame = new tFrame(resampled.StealPixels(), outWidth, outHeight, currPic->Duration);
 		frames.Append(frame);
@@ -330,18 +334,126 @@ tString Viewer::GetFrameFilename(int frameNum, const tString& dir, const tString
 }
 
 
+void Viewer::FrameExtractor::Start(const std::vector<int>& frames, std::function<bool(int frameNum)> saveFrame, int numWorkers)
+{
+	tAssert(!IsRunning());
+	Wait();
+	Frames = frames;
+	SaveFrame = saveFrame;
+	NextFrame = 0;
+	NumDone = 0;
+	NumFailed = 0;
+	Cancelled = false;
+	if (Frames.empty())
+		return;
+
+	if (numWorkers <= 0)
+		numWorkers = tClamp(tSystem::tGetNumCores(), 1, 8);
+	tiClamp(numWorkers, 1, int(Frames.size()));
+
+	NumWorkersRunning = numWorkers;
+	for (int w = 0; w < numWorkers; w++)
+		Workers.emplace_back(&FrameExtractor::Work, this);
+}
+
+
+void Viewer::FrameExtractor::Wait()
+{
+	for (std::thread& worker : Workers)
+		worker.join();
+	Workers.clear();
+}
+
+
+void Viewer::FrameExtractor::Work()
+{
+	while (!Cancelled)
+	{
+		int index = NextFrame++;
+		if (index >= int(Frames.size()))
+			break;
+
+		if (!SaveFrame(Frames[index]))
+			NumFailed++;
+		NumDone++;
+	}
+	NumWorkersRunning--;
+}
+
+
 void Viewer::SaveExtractedFrames(const tString& destDir, const tString& baseName, tFileType fileType, tIntervalSet frameSet)
 {
-	tAssert(CurrImage);
+	tAssert(CurrImage && !ExtractFrames);
+
+	// The pictures are looked up here so the workers only read them. The modal stays open until the workers are done
+	// so the image can't be changed or unloaded underneath them from the UI. Anything else that would destroy the
+	// images checks IsExtractingFrames or calls CancelExtractFrames first.
+	std::vector<tPicture*> pictures;
+	std::vector<int> frames;
 	int frameNum = 0;
 	for (tImage::tPicture* framePic = CurrImage->GetFirstPic(); framePic; framePic = framePic->Next(), frameNum++)
 	{
-		if (!frameSet.Contains(frameNum))
-			continue;
-
-		tString frameFile = GetFrameFilename(frameNum, destDir, baseName, fileType);
-		Viewer::SavePictureAs(*framePic, frameFile, fileType, false);
+		pictures.push_back(framePic);
+		if (frameSet.Contains(frameNum))
+			frames.push_back(frameNum);
 	}
+
+	ExtractFrames = new FrameExtractor;
+	ExtractFrames->Start
+	(
+		frames,
+		[pictures, destDir, baseName, fileType](int frameNum) -> bool
+		{
+			tString frameFile = GetFrameFilename(frameNum, destDir, baseName, fileType);
+			return Viewer::SavePictureAs(*pictures[frameNum], frameFile, fileType, false);
+		}
+	);
+}
+
+
+bool Viewer::IsExtractingFrames()
+{
+	return ExtractFrames != nullptr;
+}
+
+
+void Viewer::CancelExtractFrames()
+{
+	if (!ExtractFrames)
+		return;
+
+	// The destructor cancels and waits.
+	delete ExtractFrames;
+	ExtractFrames = nullptr;
+}
+
+
+void Viewer::DoExtractFramesProgress()
+{
+	tAssert(ExtractFrames);
+	float barWidth		= Gutil::GetUIParamScaled(306.0f, 2.5f);
+	float buttonWidth	= Gutil::GetUIParamScaled(76.0f, 2.5f);
+
+	int numFrames = ExtractFrames->GetNumFrames();
+	int numDone = ExtractFrames->GetNumDone();
+	ImGui::Text("Extracted %d of %d frames.", numDone, numFrames);
+	ImGui::ProgressBar(float(numDone) / float(tClampMin(numFrames, 1)), tVector2(barWidth, 0.0f));
+
+	ImGui::NewLine();
+	if (ExtractFrames->WasCancelled())
+		ImGui::Text("Cancelling...");
+	else if (Gutil::Button("Cancel", tVector2(buttonWidth, 0.0f)))
+		ExtractFrames->Cancel();
+
+	if (ExtractFrames->IsRunning())
+		return;
+
+	ExtractFrames->Wait();
+	if (ExtractFrames->GetNumFailed() > 0)
+		tPrintf("Failed to save %d extracted frames.\n", ExtractFrames->GetNumFailed());
+	delete ExtractFrames;
+	ExtractFrames = nullptr;
+	ImGui::CloseCurrentPopup();
 }
 
 
@@ -351,10 +463,18 @@ void Viewer::DoSaveExtractFramesModal(bool saveExtractFramesPressed)
 		ImGui::OpenPopup("Extract Frames");
 
 	// The unused isOpenExtractFrames bool is just so we get a close button in ImGui. Returns false if popup not open.
+	// There is no close button while extracting. Only cancel.
 	bool isOpenExtractFrames = true;
-	if (!ImGui::BeginPopupModal("Extract Frames", &isOpenExtractFrames, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoScrollbar))
+	if (!ImGui::BeginPopupModal("Extract Frames", ExtractFrames ? nullptr : &isOpenExtractFrames, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoScrollbar))
 		return;
 
+	if (ExtractFrames)
+	{
+		DoExtractFramesProgress();
+		ImGui::EndPopup();
+		return;
+	}
+
 	float inputWidth	= Gutil::GetUIParamScaled(160.0f, 2.5f);
 	float buttonWidth	= Gutil::GetUIParamScaled(76.0f, 2.5f);
 
@@ -497,13 +617,11 @@ void Viewer::DoSaveExtractFramesModal(bool saveExtractFramesPressed)
 				else
 				{
 					SaveExtractedFrames(destDir, tString(outBaseName), fileType, frameSet);
-					closeThisModal = true;
 				}
 			}
 			else
 			{
 				SaveExtractedFrames(destDir, tString(outBaseName), fileType, frameSet);
-				closeThisModal = true;
 			}
 		}
 	}
@@ -517,7 +635,7 @@ void Viewer::DoSaveExtractFramesModal(bool saveExtractFramesPressed)
 		if (pressedOK)
 			SaveExtractedFrames(destDir, tString(outBaseName), fileType, frameSet);
 
-		if (pressedOK || pressedCancel)
+		if (pressedCancel)
 			closeThisModal = true;
 	}
 
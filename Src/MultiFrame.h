@@ -13,6 +13,10 @@
 // PERFORMANCE OF THIS SOFTWARE.
 
 #pragma once
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <functional>
 #include <System/tFile.h>
 
 
@@ -21,5 +25,39 @@ namespace Viewer
 	void DoSaveMultiFrameModal(bool saveMultiFramePressed);
 	void DoSaveExtractFramesModal(bool saveExtractFramesPressed);
 
+	// The Extract Frames workers read the current image's pictures directly. While extracting, the images must not be
+	// destroyed or the current image changed. CancelExtractFrames stops the workers and waits for them.
+	bool IsExtractingFrames();
+	void CancelExtractFrames();
+
 	tString GetFrameFilename(int frameNum, const tString& dir, const tString& baseName, tSystem::tFileType);
+
+	// Saves frames on a pool of worker threads. Each worker takes the next frame, saves it, and then takes another, so
+	// at most one frame per worker is being encoded at any time. Start returns right away. The GUI polls the progress
+	// and may cancel. The CLI simply calls Wait. The save function is called concurrently and must be thread-safe.
+	struct FrameExtractor
+	{
+		~FrameExtractor()																{ Cancel(); Wait(); }
+
+		// If numWorkers is <= 0 the number of cores (clamped to [1, 8]) is used.
+		void Start(const std::vector<int>& frames, std::function<bool(int frameNum)> saveFrame, int numWorkers = 0);
+		void Cancel()																	{ Cancelled = true; }
+		void Wait();
+		bool IsRunning() const															{ return NumWorkersRunning > 0; }
+		bool WasCancelled() const														{ return Cancelled; }
+		int GetNumFrames() const														{ return int(Frames.size()); }
+		int GetNumDone() const															{ return NumDone; }
+		int GetNumFailed() const														{ return NumFailed; }
+
+	private:
+		void Work();
+		std::vector<int> Frames;
+		std::function<bool(int)> SaveFrame;
+		std::vector<std::thread> Workers;
+		std::atomic<int> NextFrame														= 0;
+		std::atomic<int> NumDone														= 0;
+		std::atomic<int> NumFailed														= 0;
+		std::atomic<int> NumWorkersRunning												= 0;
+		std::atomic<bool> Cancelled														= false;
+	};
 }
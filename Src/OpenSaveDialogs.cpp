@@ -28,6 +28,8 @@
 #include "TacentView.h"
 #include "FileDialog.h"
 #include "Quantize.h"
+#include "EditTask.h"
+#include "Resampler.h"
 using namespace tStd;
 using namespace tSystem;
 using namespace tMath;
@@ -724,7 +726,7 @@ bool Viewer::SaveResizeImageAs(Image& img, const tString& outFile, int width, in
 	tMath::tiClampMin(outW, 4);
 	tMath::tiClampMin(outH, 4);
 	if ((outPic.GetWidth() != outW) || (outPic.GetHeight() != outH))
-		outPic.Resample(outW, outH, tImage::tResampleFilter(profile.ResampleFilter), tImage::tResampleEdgeMode(profile.ResampleEdgeMode));
+		ResamplePicture(outPic, outW, outH, tImage::tResampleFilter(profile.ResampleFilter), tImage::tResampleEdgeMode(profile.ResampleEdgeMode));
 
 	tFileType saveFileType = tGetFileTypeFromName(profile.SaveFileType);
 	bool success = SavePictureAs(outPic, outFile, saveFileType, true);
@@ -962,19 +964,57 @@ void Viewer::DoOverwriteMultipleFilesModal(const tList<tStringItem>& overwriteFi
 void Viewer::SaveAllImages(const tString& destDir, const tString& extension, float percent, int width, int height)
 {
 	float scale = percent/100.0f;
-	tString currFile = CurrImage ? CurrImage->Filename : tString();
 	Config::ProfileData& profile = Config::GetProfileData();
+	Config::ProfileData::SizeModeEnum sizeMode = profile.GetSaveAllSizeMode();
 
-	bool anySaved = false;
+	// The saving is done in the background. Each source is handed to the worker as a private image so the worker
+	// never touches the images being viewed. Loaded (and possibly modified) images are copied here. Unloaded ones are
+	// loaded by the worker and released as soon as they are saved.
+	struct SaveItem : public tLink<SaveItem>
+	{
+		SaveItem(const tString& file) : Source(file)																	{ }
+		Image Source;
+		tString OutFile;
+		bool Saved = false;
+	};
+
+	tList<SaveItem>* items = new tList<SaveItem>;
 	for (Image* image = Images.First(); image; image = image->Next())
 	{
+		SaveItem* item = new SaveItem(image->Filename);
+		if (image->IsLoaded())
+			item->Source.LoadFrom(*image);
 		tString baseName = tSystem::tGetFileBaseName(image->Filename);
-		tString outFile = destDir + tString(baseName) + extension;
+		item->OutFile = destDir + tString(baseName) + extension;
+		items->Append(item);
+	}
+
+	auto work = [items, width, height, scale, sizeMode](EditTask& task) -> bool
+	{
+		int numItems = items->GetNumItems();
+		int index = 0;
+		for (SaveItem* item = items->First(); item; item = item->Next(), index++)
+		{
+			if (task.IsCancelled())
+				break;
+			task.SetProgress(float(index) / float(numItems));
+			item->Saved = SaveResizeImageAs(item->Source, item->OutFile, width, height, scale, sizeMode);
+			item->Source.Unload(true);
+		}
+		return true;
+	};
 
-		bool ok = SaveResizeImageAs(*image, outFile, width, height, scale, profile.GetSaveAllSizeMode());
-		if (ok)
+	// Runs on the main thread. Files saved before a cancel are kept so the image list is updated either way.
+	tString currFile = CurrImage ? CurrImage->Filename : tString();
+	auto finish = [items, currFile](EditTask&, bool completed)
+	{
+		bool anySaved = false;
+		for (SaveItem* item = items->First(); item; item = item->Next())
 		{
-			Image* foundImage = FindImage(outFile);
+			if (!item->Saved)
+				continue;
+
+			Image* foundImage = FindImage(item->OutFile);
 			if (foundImage)
 			{
 				foundImage->Unload(true);
@@ -982,16 +1022,24 @@ void Viewer::SaveAllImages(const tString& destDir, const tString& extension, flo
 				foundImage->RequestInvalidateThumbnail();
 			}
 			else
-				AddSavedImageIfNecessary(outFile);
+				AddSavedImageIfNecessary(item->OutFile);
 			anySaved = true;
 		}
-	}
+		delete items;
+
+		// If we saved to the same dir we are currently viewing we need to reload and set the current image again.
+		if (anySaved)
+		{
+			Config::ProfileData& profile = Config::GetProfileData();
+			SortImages(profile.GetSortKey(), profile.SortAscending);
+			SetCurrentImage(currFile);
+		}
+	};
 
-	// If we saved to the same dir we are currently viewing we need to reload and set the current image again.
-	if (anySaved)
+	if (!StartEditTask("Save All", work, finish))
 	{
-		SortImages(profile.GetSortKey(), profile.SortAscending);
-		SetCurrentImage(currFile);
+		delete items;
+		tPrintf("Save All not started. Another operation is running.\n");
 	}
 }
 
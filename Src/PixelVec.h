@@ -0,0 +1,100 @@
+// PixelVec.h
+//
+// A 4-channel float vector holding one RGBA pixel, with SSE2 and NEON versions and a scalar fallback. Filters that
+// weight and sum whole pixels are written once in terms of these.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+
+#pragma once
+#include <Foundation/tStandard.h>
+#include <Math/tFundamentals.h>
+#include <Image/tPicture.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+	#include <emmintrin.h>
+	#define PIXELVEC_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+	#include <arm_neon.h>
+	#define PIXELVEC_NEON
+#endif
+
+
+namespace Viewer
+{
+	#if defined(PIXELVEC_SSE2)
+	typedef __m128 Vec4;
+	inline Vec4 VSplat(float f)																				{ return _mm_set1_ps(f); }
+	inline Vec4 VAdd(Vec4 a, Vec4 b)																		{ return _mm_add_ps(a, b); }
+	inline Vec4 VSub(Vec4 a, Vec4 b)																		{ return _mm_sub_ps(a, b); }
+	inline Vec4 VMul(Vec4 a, Vec4 b)																		{ return _mm_mul_ps(a, b); }
+	inline Vec4 VLoad4f(const float* f)																		{ return _mm_loadu_ps(f); }
+	inline void VStore4f(float* f, Vec4 v)																	{ _mm_storeu_ps(f, v); }
+	inline Vec4 VLoad(const tPixel4b& p)
+	{
+		uint32 bits; tStd::tMemcpy(&bits, &p, 4);
+		const __m128i zero = _mm_setzero_si128();
+		__m128i v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(int(bits)), zero);
+		return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero));
+	}
+	inline void VStore(tPixel4b& p, Vec4 v)
+	{
+		// The saturating packs clamp bicubic overshoot to [0, 255].
+		__m128i i = _mm_cvtps_epi32(v);
+		i = _mm_packs_epi32(i, i);
+		i = _mm_packus_epi16(i, i);
+		uint32 bits = uint32(_mm_cvtsi128_si32(i));
+		tStd::tMemcpy(&p, &bits, 4);
+	}
+
+	#elif defined(PIXELVEC_NEON)
+	typedef float32x4_t Vec4;
+	inline Vec4 VSplat(float f)																				{ return vdupq_n_f32(f); }
+	inline Vec4 VAdd(Vec4 a, Vec4 b)																		{ return vaddq_f32(a, b); }
+	inline Vec4 VSub(Vec4 a, Vec4 b)																		{ return vsubq_f32(a, b); }
+	inline Vec4 VMul(Vec4 a, Vec4 b)																		{ return vmulq_f32(a, b); }
+	inline Vec4 VLoad4f(const float* f)																		{ return vld1q_f32(f); }
+	inline void VStore4f(float* f, Vec4 v)																	{ vst1q_f32(f, v); }
+	inline Vec4 VLoad(const tPixel4b& p)
+	{
+		uint32 bits; tStd::tMemcpy(&bits, &p, 4);
+		uint16x8_t w = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(bits)));
+		return vcvtq_f32_u32(vmovl_u16(vget_low_u16(w)));
+	}
+	inline void VStore(tPixel4b& p, Vec4 v)
+	{
+		v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(255.0f));
+		uint16x4_t h = vmovn_u32(vcvtq_u32_f32(vaddq_f32(v, vdupq_n_f32(0.5f))));
+		uint8x8_t b = vmovn_u16(vcombine_u16(h, h));
+		uint32 bits = vget_lane_u32(vreinterpret_u32_u8(b), 0);
+		tStd::tMemcpy(&p, &bits, 4);
+	}
+
+	#else
+	struct Vec4 { float E[4]; };
+	inline Vec4 VSplat(float f)																				{ return Vec4{ { f, f, f, f } }; }
+	inline Vec4 VAdd(Vec4 a, Vec4 b)																		{ for (int c = 0; c < 4; c++) a.E[c] += b.E[c]; return a; }
+	inline Vec4 VSub(Vec4 a, Vec4 b)																		{ for (int c = 0; c < 4; c++) a.E[c] -= b.E[c]; return a; }
+	inline Vec4 VMul(Vec4 a, Vec4 b)																		{ for (int c = 0; c < 4; c++) a.E[c] *= b.E[c]; return a; }
+	inline Vec4 VLoad4f(const float* f)																		{ return Vec4{ { f[0], f[1], f[2], f[3] } }; }
+	inline void VStore4f(float* f, Vec4 v)																	{ for (int c = 0; c < 4; c++) f[c] = v.E[c]; }
+	inline Vec4 VLoad(const tPixel4b& p)																	{ return Vec4{ { float(p.R), float(p.G), float(p.B), float(p.A) } }; }
+	inline void VStore(tPixel4b& p, Vec4 v)
+	{
+		uint8 c[4];
+		for (int i = 0; i < 4; i++)
+			c[i] = uint8(tMath::tClamp(int(v.E[i] + 0.5f), 0, 255));
+		p.R = c[0]; p.G = c[1]; p.B = c[2]; p.A = c[3];
+	}
+	#endif
+
+	inline Vec4 VLerp(Vec4 a, Vec4 b, float t)																{ return VAdd(a, VMul(VSub(b, a), VSplat(t))); }
+	inline Vec4 VMulAdd(Vec4 acc, Vec4 v, float w)															{ return VAdd(acc, VMul(v, VSplat(w))); }
+}
@@ -21,6 +21,7 @@
 #include "TacentView.h"
 #include "GuiUtil.h"
 #include "ThumbnailView.h"
+#include "CostModel.h"
 #include "Version.cmake.h"
 using namespace tMath;
 
@@ -371,11 +372,26 @@ void Viewer::ShowPreferencesWindow(bool* popen)
 			Gutil::HelpMark("Maximum number of undo steps.");
 			tMath::tiClamp(profile.MaxUndoSteps, 1, 32);
 
+			ImGui::SetNextItemWidth(itemWidth);
+			ImGui::InputInt("Max Undo Mem (MB)", &profile.MaxUndoMemMB); ImGui::SameLine();
+			Gutil::HelpMark("Undo memory allowed per image. Older steps are compressed in the background and, past this\nlimit, moved to a file in the cache directory. They are read back if undone. Minimum 16 MB.");
+			tMath::tiClampMin(profile.MaxUndoMemMB, 16);
+
+			ImGui::SetNextItemWidth(itemWidth);
+			ImGui::InputInt("Max Total Undo (MB)", &profile.MaxUndoTotalMemMB); ImGui::SameLine();
+			Gutil::HelpMark("Undo memory allowed over all images before older steps are moved to disk. Minimum 16 MB.");
+			tMath::tiClampMin(profile.MaxUndoTotalMemMB, 16);
+
 			ImGui::SetNextItemWidth(itemWidth);
 			ImGui::InputInt("Max Mem (MB)", &profile.MaxImageMemMB); ImGui::SameLine();
 			Gutil::HelpMark("Approx memory use limit of this app. Minimum 256 MB.");
 			tMath::tiClampMin(profile.MaxImageMemMB, 256);
 
+			ImGui::SetNextItemWidth(itemWidth);
+			ImGui::InputInt("Max Frame VRAM (MB)", &profile.MaxFrameTexMemMB); ImGui::SameLine();
+			Gutil::HelpMark("Approx video memory the frames of a single animated or multi-frame image may use. Frame\ntextures are made as frames are shown and the least recently shown are released past this\nlimit. Minimum 64 MB.");
+			tMath::tiClampMin(profile.MaxFrameTexMemMB, 64);
+
 			ImGui::SetNextItemWidth(itemWidth);
 			ImGui::InputInt("Max Cache Files", &profile.MaxCacheFiles); ImGui::SameLine();
 			Gutil::HelpMark("Maximum number of cache files that may be created. Minimum 200.");
@@ -397,6 +413,14 @@ void Viewer::ShowPreferencesWindow(bool* popen)
 				tFileDialog::Reset();
 			ImGui::SameLine(); Gutil::HelpMark("Reset File Dialog Bookmarks.");
 
+			// Calibration runs in the background. The button is disabled until it's done.
+			bool calibrating = CostModel::IsCalibrating();
+			ImGui::BeginDisabled(calibrating);
+			if (ImGui::Button(calibrating ? "Calibrating..." : "Recalibrate Timing", tVector2(sysButtonWidth, 0.0f)))
+				CostModel::CalibrateInBackground();
+			ImGui::EndDisabled();
+			ImGui::SameLine(); Gutil::HelpMark("Re-measure how long slow operations like quantize and rotate take on this\nmachine. Used for time estimates. Calibration runs automatically the first time.");
+
 			Gutil::Separator();
 
 			ImGui::SetNextItemWidth(itemWidth);
@@ -440,6 +464,9 @@ void Viewer::ShowPreferencesWindow(bool* popen)
 			ImGui::Checkbox("Detect APNG Inside PNG", &profile.DetectAPNGInsidePNG); ImGui::SameLine();
 			Gutil::HelpMark("Some png image files are really apng files. If detecton is true these png files will be displayed animated.");
 
+			ImGui::Checkbox("Retain HDR Source", &profile.RetainHDRSource); ImGui::SameLine();
+			Gutil::HelpMark("Keeps a copy of the RGBE pixels of Radiance HDR files after the first exposure or gamma change in\nthe property editor so later changes are interactive. Uses 4 bytes of extra memory per pixel.");
+
 			ImGui::Checkbox("Mipmap Chaining", &profile.MipmapChaining); ImGui::SameLine();
 			Gutil::HelpMark("Chaining generates mipmaps faster. No chaining gives slightly\nbetter results at cost of large generation time.");
 
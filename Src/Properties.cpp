@@ -757,7 +757,8 @@ void Viewer::ShowPropertiesWindow(bool* popen)
 				reloadChanges = true;
 			}
 
-			if (reloadChanges)
+			// The retained source, if available, makes this a fast conversion rather than a reload.
+			if (reloadChanges && !CurrImage->ReconvertHDR())
 			{
 				CurrImage->Unload();
 				CurrImage->Load();
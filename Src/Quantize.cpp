@@ -17,39 +17,14 @@
 #include "Image.h"
 #include "TacentView.h"
 #include "GuiUtil.h"
+#include "EditTask.h"
+#include "CostModel.h"
 using namespace tStd;
 using namespace tSystem;
 using namespace tMath;
 using namespace tImage;
 
 
-namespace Viewer
-{
-	// Compute a (very) approx number of seconds it will take to quantize on an intel 11th gen mobile CPU.
-	float ComputeApproxQuantizeDuration(const Image* image, tImage::tQuantize::Method method, int numColours);
-}
-
-
-float Viewer::ComputeApproxQuantizeDuration(const Image* image, tImage::tQuantize::Method method, int numColours)
-{
-	if (!image || (numColours < 2))
-		return 0.0f;
-
-	// We currently only consider scolorq and neu methods. The other two are quite fast.
-	switch (method)
-	{
-		case tImage::tQuantize::Method::Spatial:
-			// 1024x1024 pixels, 2 colours -> approx 5 seconds.
-			return (5.0f*CurrImage->GetArea()*numColours) / (1024.0f*1024.0f*2.0f);
-
-		case tImage::tQuantize::Method::Neu:
-			// 1024x1024 pixels, 256 colours -> approx 3 seconds.
-			return (3.0f*CurrImage->GetArea()*numColours) / (1024.0f*1024.0f*256.0f);
-	}
-	return 0.0f;
-}
-
-
 void Viewer::DoQuantizeInterface(int& method, int& spatialFilterSize, float& spatialDitherLevel, int& neuSampleFactor, float itemWidth)
 {
 	if (itemWidth > 0.0f)
@@ -162,21 +137,64 @@ void Viewer::DoQuantizeModal(bool quantizeImagePressed)
 		"quantize will proceed either way, and the chosen quantize method may adjust the colours."
 	);
 
-	// This is so we can print a warning if it's going to take a really long time.
-	float quantizeDurationApprox = ComputeApproxQuantizeDuration(CurrImage, tImage::tQuantize::Method(method), numColours);
+	// Multiframe images may use one palette for all frames.
+	static bool sharedPalette = false;
+	int numFrames = CurrImage->GetNumFrames();
+	if (numFrames > 1)
+	{
+		ImGui::Checkbox("Shared Palette", &sharedPalette);
+		ImGui::SameLine();
+		Gutil::HelpMark
+		(
+			"If Shared Palette is true a single palette is built from a sample of all frames and every\n"
+			"frame is remapped to it in parallel. This is much faster for long animations and avoids\n"
+			"palette flicker between frames. Spatial dither is not applied when remapping."
+		);
+	}
+
+	// The estimate comes from the cost model calibrated on this machine. Shared palettes quantize a single composite
+	// of at most 1024x1024 sampled pixels and remap the frames in parallel.
+	int filterSize135 = (spatialFilterSize * 2) + 1;
+	bool shared = sharedPalette && (numFrames > 1);
+	int area = CurrImage->GetArea();
+	int compositeArea = int(tMin(int64(area)*int64(numFrames), int64(1024*1024)));
+	float quantizeDurationApprox = shared ?
+		CostModel::QuantizeSeconds(tQuantize::Method(method), compositeArea, numColours, neuSampleFactor, filterSize135) +
+		CostModel::ParallelSeconds(CostModel::QuantizeSeconds(tQuantize::Method::Fixed, area, numColours), numFrames) :
+		CostModel::QuantizeSeconds(tQuantize::Method(method), area, numColours, neuSampleFactor, filterSize135) * float(numFrames);
+
+	// The first estimate starts calibration in the background. The dialog shows the estimate once it's done.
 	float maxDurationBeforeWarning = 10.0f;
+	if (!CostModel::IsCalibrated())
+		ImGui::Text("Estimated Time: Measuring...");
+	else if (quantizeDurationApprox >= 1.0f)
+		ImGui::Text("Estimated Time: %.1f seconds", quantizeDurationApprox);
+
 	if (quantizeDurationApprox > maxDurationBeforeWarning)
 	{
 		ImGui::Text
 		(
 			"\n"
-			"Based on the image resolution, quantization\n"
-			"method, and number of colours, this operation\n"
-			"will take more than %d seconds.\n\n"
-			"Consider a different method or reduce the\n"
-			"number of colours.",
-			int(quantizeDurationApprox)
+			"This operation runs in the background and\n"
+			"may be cancelled. Consider a different method\n"
+			"or reduce the number of colours."
 		);
+
+		// For Neu the sample factor trades quality for time. Offer the best quality factor that fits the budget.
+		if (method == int(tQuantize::Method::Neu))
+		{
+			int fitFactor = shared ?
+				CostModel::ChooseNeuSampleFactor(compositeArea, numColours, maxDurationBeforeWarning) :
+				CostModel::ChooseNeuSampleFactor(area, numColours, maxDurationBeforeWarning / float(numFrames));
+			if (fitFactor > neuSampleFactor)
+			{
+				tString label; tsPrintf(label, "Use Factor %d", fitFactor);
+				if (Gutil::Button(label.Chr()))
+					neuSampleFactor = fitFactor;
+				ImGui::SameLine();
+				Gutil::HelpMark("Sets the Neu sample factor to the smallest value expected to finish within 10 seconds.");
+			}
+		}
 	}
 
 	ImGui::NewLine();
@@ -191,6 +209,7 @@ void Viewer::DoQuantizeModal(bool quantizeImagePressed)
 		neuSampleFactor = 1;
 		numColours = 256;
 		checkExact = true;
+		sharedPalette = false;
 	}
 
 	ImGui::SameLine();
@@ -205,30 +224,45 @@ void Viewer::DoQuantizeModal(bool quantizeImagePressed)
 		ImGui::SetKeyboardFocusHere();
 	if (Gutil::Button("Quantize##Button", tVector2(buttonWidth, 0.0f)))
 	{
-		CurrImage->Unbind();
-		switch (tImage::tQuantize::Method(method))
+		// The quantize runs on a snapshot in the background. The result replaces the current image when it completes.
+		tQuantize::Method quantMethod = tQuantize::Method(method);
+		float ditherLevel = spatialDitherLevel;
+		int sampleFactor = neuSampleFactor;
+		int colours = numColours;
+		bool exact = checkExact;
+		auto quantize = [quantMethod, filterSize135, shared, ditherLevel, sampleFactor, colours, exact](Image& image, EditTask& task) -> bool
 		{
-			case tImage::tQuantize::Method::Fixed:
-				CurrImage->QuantizeFixed(numColours, checkExact);
-				break;
-
-			case tImage::tQuantize::Method::Spatial:
+			if (shared)
 			{
-				int filterSize135 = (spatialFilterSize * 2) + 1;
-				CurrImage->QuantizeSpatial(numColours, checkExact, spatialDitherLevel, filterSize135);
-				break;
+				image.QuantizeShared(quantMethod, colours, exact, sampleFactor);
+				return !task.IsCancelled();
 			}
 
-			case tImage::tQuantize::Method::Neu:
-				CurrImage->QuantizeNeu(numColours, checkExact, neuSampleFactor);
-				break;
-
-			case tImage::tQuantize::Method::Wu:
-				CurrImage->QuantizeWu(numColours, checkExact);
-				break;
-		}
-		CurrImage->Bind();
-		Gutil::SetWindowTitle();
+			return task.ForEachPicture(image, [&](tPicture& picture)
+			{
+				switch (quantMethod)
+				{
+					case tQuantize::Method::Fixed:
+						picture.QuantizeFixed(colours, exact);
+						break;
+
+					case tQuantize::Method::Spatial:
+						picture.QuantizeSpatial(colours, exact, ditherLevel, filterSize135);
+						break;
+
+					case tQuantize::Method::Neu:
+						picture.QuantizeNeu(colours, exact, sampleFactor);
+						break;
+
+					case tQuantize::Method::Wu:
+						picture.QuantizeWu(colours, exact);
+						break;
+				}
+			});
+		};
+
+		tString desc; tsPrintf(desc, "Quantize %d", numColours);
+		StartImageEditTask(CurrImage, desc, quantize, [](){ Gutil::SetWindowTitle(); }, quantizeDurationApprox);
 
 		ImGui::CloseCurrentPopup();
 	}
@@ -0,0 +1,532 @@
+// Replay.cpp
+//
+// Headless navigation replay. Runs a scripted viewer session (open a directory, sort, step through images, jump to
+// the ends, scroll the thumbnail view) against the same Viewer code paths the GUI uses and reports per-step latency
+// percentiles and memory high-water marks. Uses a hidden offscreen GL context when one can be created and stubbed GL
+// texture calls otherwise, so it runs on build machines without a display.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <algorithm>
+#include <vector>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <Foundation/tHash.h>
+#include <System/tFile.h>
+#include <System/tPrint.h>
+#include <System/tTime.h>
+#include "Replay.h"
+#include "CommandStats.h"
+#include "TacentView.h"
+#include "Config.h"
+#include "Image.h"
+
+
+namespace Replay
+{
+	// One entry per script line that does timed work. Each sample is the latency of a single user-visible action, for
+	// example one image step or one thumbnail page.
+	struct StepRecord : public tLink<StepRecord>
+	{
+		tString Command;
+		int Line									= 0;
+		std::vector<double> SamplesMs;
+		int64 ImageMemHighWater						= 0;
+		uint64 PeakRSS								= 0;
+	};
+
+	bool InitOffscreenGL();
+	void ShutdownOffscreenGL();
+	void InstallStubGL();
+
+	bool ExecuteLine(tList<StepRecord>& steps, const tString& line, int lineNum);
+	bool ParseSortKey(Viewer::Config::ProfileData::SortKeyEnum& key, const tString& name);
+	void StepTo(StepRecord&, Viewer::Image*);
+	void ScrollThumbnails(StepRecord&, int perPage, int pages);
+	bool CheckUndoResize(Viewer::Image*, int lineNum);
+	int64 GetImageMemUsed();
+	double Percentile(const std::vector<double>& sorted, double p);
+	void Report(tList<StepRecord>& steps, const tString& reportFile);
+
+	GLFWwindow* OffscreenWindow						= nullptr;
+	bool UsingStubGL								= false;
+	int ThumbnailTop								= 0;		// Index of the first image in the simulated thumbnail view.
+
+	// Stubbed GL. Texture names still get handed out so the bind/unbind bookkeeping in Image behaves as it does with
+	// a real context. The layers are still generated so the CPU side of Bind is measured.
+	GLuint StubNextTextureID						= 1;
+	void APIENTRY StubGenTextures(GLsizei n, GLuint* textures)											{ for (GLsizei t = 0; t < n; t++) textures[t] = StubNextTextureID++; }
+	void APIENTRY StubDeleteTextures(GLsizei, const GLuint*)											{ }
+	void APIENTRY StubBindTexture(GLenum, GLuint)														{ }
+	void APIENTRY StubTexParameteri(GLenum, GLenum, GLint)												{ }
+	void APIENTRY StubTexImage2D(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*)	{ }
+	void APIENTRY StubCompressedTexImage2D(GLenum, GLint, GLenum, GLsizei, GLsizei, GLint, GLsizei, const void*)	{ }
+	void APIENTRY StubTexSubImage2D(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void*)	{ }
+	void APIENTRY StubPixelStorei(GLenum, GLint)														{ }
+}
+
+
+bool Replay::InitOffscreenGL()
+{
+	if (!glfwInit())
+		return false;
+
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	OffscreenWindow = glfwCreateWindow(64, 64, "tacentview replay", nullptr, nullptr);
+	if (!OffscreenWindow)
+	{
+		glfwTerminate();
+		return false;
+	}
+
+	glfwMakeContextCurrent(OffscreenWindow);
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		ShutdownOffscreenGL();
+		return false;
+	}
+
+	return true;
+}
+
+
+void Replay::ShutdownOffscreenGL()
+{
+	if (!OffscreenWindow)
+		return;
+
+	glfwDestroyWindow(OffscreenWindow);
+	glfwTerminate();
+	OffscreenWindow = nullptr;
+}
+
+
+void Replay::InstallStubGL()
+{
+	glad_glGenTextures				= StubGenTextures;
+	glad_glDeleteTextures			= StubDeleteTextures;
+	glad_glBindTexture				= StubBindTexture;
+	glad_glTexParameteri			= StubTexParameteri;
+	glad_glTexImage2D				= StubTexImage2D;
+	glad_glCompressedTexImage2D		= StubCompressedTexImage2D;
+	glad_glTexSubImage2D			= StubTexSubImage2D;
+	glad_glPixelStorei				= StubPixelStorei;
+	UsingStubGL = true;
+}
+
+
+int Replay::Run(const tString& scriptFile, const tString& reportFile, bool forceStubGL)
+{
+	int scriptSize = tSystem::tGetFileSize(scriptFile);
+	tSystem::tFileHandle scriptHandle = tSystem::tOpenFile(scriptFile.Chr(), "rb");
+	if (!scriptHandle)
+	{
+		tPrintf("Replay | Could not read script %s\n", scriptFile.Chr());
+		return Viewer::ErrorCode_CLI_FailUnknown;
+	}
+	char* script = new char[scriptSize+1];
+	int numRead = tSystem::tReadFile(scriptHandle, script, scriptSize);
+	tSystem::tCloseFile(scriptHandle);
+	script[tMath::tClamp(numRead, 0, scriptSize)] = '\0';
+
+	if (forceStubGL || !InitOffscreenGL())
+		InstallStubGL();
+	tPrintf("Replay | Using %s GL.\n", UsingStubGL ? "stubbed" : "offscreen");
+
+	// Thumbnails go to a new scratch cache so every run generates them cold. It is never an existing directory, so
+	// deleting it at the end only removes what this run wrote.
+	tString cacheDir = Command::CreateScratchDir("replay");
+	if (cacheDir.IsEmpty())
+	{
+		tPrintf("Replay | Could not create a scratch thumbnail cache.\n");
+		delete[] script;
+		ShutdownOffscreenGL();
+		return Viewer::ErrorCode_CLI_FailUnknown;
+	}
+	Viewer::Image::ThumbCacheDir = cacheDir;
+
+	tList<StepRecord> steps;
+	bool ok = true;
+	int lineNum = 0;
+	for (char* line = script; line && *line && ok; lineNum++)
+	{
+		char* eol = line;
+		while (*eol && (*eol != '\n') && (*eol != '\r'))
+			eol++;
+		char* nextLine = *eol ? eol + 1 : eol;
+		if ((*eol == '\r') && (*nextLine == '\n'))
+			nextLine++;
+		*eol = '\0';
+
+		// Tabs are treated as spaces and leading and trailing whitespace is ignored.
+		for (char* c = line; c < eol; c++)
+			if (*c == '\t')
+				*c = ' ';
+		while (*line == ' ')
+			line++;
+		for (char* end = eol - 1; (end >= line) && (*end == ' '); end--)
+			*end = '\0';
+
+		tString command(line);
+		if (!command.IsEmpty() && (command[0] != '#'))
+			ok = ExecuteLine(steps, command, lineNum+1);
+		line = nextLine;
+	}
+	delete[] script;
+
+	// Images must be destroyed (joining any thumbnail threads and freeing textures) while the context is still valid.
+	Viewer::CurrImage = nullptr;
+	Viewer::ImagesLoadTimeSorted.Clear();
+	Viewer::Images.Clear();
+	tSystem::tDeleteDir(cacheDir);
+
+	Report(steps, reportFile);
+	ShutdownOffscreenGL();
+	return ok ? Viewer::ErrorCode_Success : Viewer::ErrorCode_CLI_FailUnknown;
+}
+
+
+bool Replay::ExecuteLine(tList<StepRecord>& steps, const tString& line, int lineNum)
+{
+	tList<tStringItem> args;
+	tStd::tExplode(args, line, ' ');
+	for (tStringItem* arg = args.First(); arg; )
+	{
+		tStringItem* next = arg->Next();
+		if (arg->IsEmpty())
+			delete args.Remove(arg);
+		arg = next;
+	}
+	if (args.IsEmpty())
+		return true;
+
+	tString cmd = *args.First();
+	tString arg1 = args.First()->Next() ? tString(*args.First()->Next()) : tString();
+	tString arg2 = (args.GetNumItems() >= 3) ? tString(*args.First()->Next()->Next()) : tString();
+
+	Viewer::Config::ProfileData& profile = Viewer::Config::GetProfileData();
+	StepRecord* step = new StepRecord;
+	step->Command = line;
+	step->Line = lineNum;
+
+	bool ok = true;
+	switch (tHash::tHashString(cmd.Chr()))
+	{
+		case tHash::tHashCT("open"):
+		{
+			tString dir = tSystem::tGetAbsolutePath(arg1);
+			if (!tSystem::tDirExists(dir))
+			{
+				tPrintf("Replay | Line %d: Directory %s not found.\n", lineNum, dir.Chr());
+				ok = false;
+				break;
+			}
+			if (dir[dir.Length()-1] != '/')
+				dir += "/";
+
+			Command::StatsTimer timer;
+			Viewer::CurrImage = nullptr;
+			Viewer::ImageToLoad = dir;
+			Viewer::PopulateImages();
+			ThumbnailTop = 0;
+			if (Viewer::Images.First())
+			{
+				Viewer::CurrImage = Viewer::Images.First();
+				Viewer::LoadCurrImage();
+				Viewer::CurrImage->Bind();
+			}
+			step->SamplesMs.push_back(timer.GetWallSeconds() * 1000.0);
+			tPrintf("Replay | Opened %s with %d images.\n", dir.Chr(), Viewer::Images.GetNumItems());
+			break;
+		}
+
+		case tHash::tHashCT("sort"):
+		{
+			Viewer::Config::ProfileData::SortKeyEnum key;
+			if (!ParseSortKey(key, arg1))
+			{
+				tPrintf("Replay | Line %d: Unknown sort key %s.\n", lineNum, arg1.Chr());
+				ok = false;
+				break;
+			}
+			Command::StatsTimer timer;
+			Viewer::SortImages(key, arg2 != "desc");
+			step->SamplesMs.push_back(timer.GetWallSeconds() * 1000.0);
+			break;
+		}
+
+		case tHash::tHashCT("next"):
+		case tHash::tHashCT("prev"):
+		{
+			bool next = (cmd == "next");
+			int count = arg1.IsEmpty() ? 1 : tMath::tClampMin(arg1.AsInt32(), 1);
+			for (int c = 0; (c < count) && Viewer::CurrImage; c++)
+			{
+				Viewer::Image* target = next ? Viewer::CurrImage->Next() : Viewer::CurrImage->Prev();
+				if (!target)
+					break;
+				StepTo(*step, target);
+			}
+			break;
+		}
+
+		case tHash::tHashCT("first"):
+		case tHash::tHashCT("last"):
+		{
+			Viewer::Image* target = (cmd == "last") ? Viewer::Images.Last() : Viewer::Images.First();
+			if (target)
+				StepTo(*step, target);
+			break;
+		}
+
+		case tHash::tHashCT("thumbs"):
+		{
+			int perPage = arg1.IsEmpty() ? 24 : tMath::tClampMin(arg1.AsInt32(), 1);
+			int pages = arg2.IsEmpty() ? 1 : tMath::tClampMin(arg2.AsInt32(), 1);
+			ScrollThumbnails(*step, perPage, pages);
+			break;
+		}
+
+		case tHash::tHashCT("maxmem"):
+			profile.MaxImageMemMB = tMath::tClampMin(arg1.AsInt32(), 1);
+			break;
+
+		case tHash::tHashCT("checkundo"):
+		{
+			int numChecked = 0;
+			for (Viewer::Image* img = Viewer::Images.First(); img; img = img->Next())
+			{
+				StepTo(*step, img);
+				if (img->GetNumFrames() < 2)
+					continue;
+				if (!CheckUndoResize(img, lineNum))
+					ok = false;
+				numChecked++;
+			}
+			if (numChecked == 0)
+			{
+				tPrintf("Replay | Line %d: No animated images to check.\n", lineNum);
+				ok = false;
+			}
+			break;
+		}
+
+		default:
+			tPrintf("Replay | Line %d: Unknown command %s.\n", lineNum, cmd.Chr());
+			ok = false;
+			break;
+	}
+
+	step->ImageMemHighWater = tMath::tMax(step->ImageMemHighWater, GetImageMemUsed());
+	step->PeakRSS = Command::GetPeakResidentBytes();
+	if (ok && !step->SamplesMs.empty())
+		steps.Append(step);
+	else
+		delete step;
+
+	return ok;
+}
+
+
+bool Replay::ParseSortKey(Viewer::Config::ProfileData::SortKeyEnum& key, const tString& name)
+{
+	using SortKey = Viewer::Config::ProfileData::SortKeyEnum;
+	switch (tHash::tHashString(name.Chr()))
+	{
+		case tHash::tHashCT("natural"):		key = SortKey::Natural;		return true;
+		case tHash::tHashCT("name"):		key = SortKey::FileName;	return true;
+		case tHash::tHashCT("modtime"):		key = SortKey::FileModTime;	return true;
+		case tHash::tHashCT("size"):		key = SortKey::FileSize;	return true;
+		case tHash::tHashCT("type"):		key = SortKey::FileType;	return true;
+		case tHash::tHashCT("area"):		key = SortKey::ImageArea;	return true;
+		case tHash::tHashCT("width"):		key = SortKey::ImageWidth;	return true;
+		case tHash::tHashCT("height"):		key = SortKey::ImageHeight;	return true;
+	}
+	return false;
+}
+
+
+void Replay::StepTo(StepRecord& step, Viewer::Image* target)
+{
+	// This is what the GUI does on a navigation: load (which may evict) and then bind when the image is drawn.
+	Command::StatsTimer timer;
+	Viewer::CurrImage = target;
+	Viewer::LoadCurrImage();
+	Viewer::CurrImage->Bind();
+	step.SamplesMs.push_back(timer.GetWallSeconds() * 1000.0);
+	step.ImageMemHighWater = tMath::tMax(step.ImageMemHighWater, GetImageMemUsed());
+}
+
+
+void Replay::ScrollThumbnails(StepRecord& step, int perPage, int pages)
+{
+	int numImages = Viewer::Images.GetNumItems();
+	for (int page = 0; (page < pages) && (ThumbnailTop < numImages); page++)
+	{
+		Viewer::Image* pageFirst = Viewer::Images.First();
+		for (int i = 0; (i < ThumbnailTop) && pageFirst; i++)
+			pageFirst = pageFirst->Next();
+
+		// Mirrors the thumbnail view loop. Keep binding and requesting until every visible thumbnail is either bound
+		// or its worker has finished without producing one.
+		Command::StatsTimer timer;
+		bool pageDone = false;
+		while (!pageDone)
+		{
+			pageDone = true;
+			Viewer::Image* img = pageFirst;
+			for (int i = 0; (i < perPage) && img; i++, img = img->Next())
+			{
+				if (img->BindThumbnail())
+					continue;
+				img->RequestThumbnail();
+				if (!img->IsThumbnailRequested() || img->IsThumbnailWorkerActive())
+					pageDone = false;
+			}
+			if (!pageDone)
+				tSystem::tSleep(1);
+		}
+		step.SamplesMs.push_back(timer.GetWallSeconds() * 1000.0);
+		ThumbnailTop += perPage;
+	}
+}
+
+
+bool Replay::CheckUndoResize(Viewer::Image* img, int lineNum)
+{
+	// Resizes every frame, undoes it, and verifies the dimensions and per-frame durations come back unchanged. Redo
+	// must likewise keep the durations while restoring the resized dimensions.
+	struct FrameInfo { int Width; int Height; float Duration; };
+	std::vector<FrameInfo> before;
+	for (tImage::tPicture* pic = img->GetPictures().First(); pic; pic = pic->Next())
+		before.push_back({ pic->GetWidth(), pic->GetHeight(), pic->Duration });
+
+	int newW = tMath::tClampMin(before[0].Width/2, 1);
+	int newH = tMath::tClampMin(before[0].Height/2, 1);
+	if (!img->Resample(newW, newH, tImage::tResampleFilter::Bilinear, tImage::tResampleEdgeMode::Clamp) || !img->IsUndoAvailable())
+	{
+		tPrintf("Replay | Line %d: Could not resize %s.\n", lineNum, img->Filename.Chr());
+		return false;
+	}
+
+	auto compare = [&](const char* stage, bool resized) -> bool
+	{
+		if (img->GetNumFrames() != int(before.size()))
+		{
+			tPrintf("Replay | Line %d: %s of %s has %d frames, expected %d.\n", lineNum, stage, img->Filename.Chr(), img->GetNumFrames(), int(before.size()));
+			return false;
+		}
+		int f = 0;
+		for (tImage::tPicture* pic = img->GetPictures().First(); pic; pic = pic->Next(), f++)
+		{
+			int expW = resized ? newW : before[f].Width;
+			int expH = resized ? newH : before[f].Height;
+			if ((pic->GetWidth() != expW) || (pic->GetHeight() != expH) || (pic->Duration != before[f].Duration))
+			{
+				tPrintf
+				(
+					"Replay | Line %d: %s of %s frame %d is %dx%d %fs, expected %dx%d %fs.\n", lineNum, stage, img->Filename.Chr(), f,
+					pic->GetWidth(), pic->GetHeight(), pic->Duration, expW, expH, before[f].Duration
+				);
+				return false;
+			}
+		}
+		return true;
+	};
+
+	bool ok = compare("Resize", true);
+	img->Undo();
+	ok = compare("Undo", false) && ok;
+	img->Redo();
+	ok = compare("Redo", true) && ok;
+	img->Undo();
+	ok = compare("Second undo", false) && ok;
+	img->Bind();
+
+	tPrintf("Replay | Checked undo of resize on %s (%d frames): %s\n", img->Filename.Chr(), int(before.size()), ok ? "ok" : "FAILED");
+	return ok;
+}
+
+
+int64 Replay::GetImageMemUsed()
+{
+	int64 used = 0;
+	for (Viewer::Image* img = Viewer::Images.First(); img; img = img->Next())
+		used += int64(img->Info.MemSizeBytes);
+	return used;
+}
+
+
+double Replay::Percentile(const std::vector<double>& sorted, double p)
+{
+	if (sorted.empty())
+		return 0.0;
+	int index = tMath::tClamp(int(p * double(sorted.size() - 1) + 0.5), 0, int(sorted.size()) - 1);
+	return sorted[index];
+}
+
+
+void Replay::Report(tList<StepRecord>& steps, const tString& reportFile)
+{
+	tPrintf("\nREPLAY (%s GL)\n", UsingStubGL ? "stubbed" : "offscreen");
+	tPrintf("%-5s %-24s %6s %10s %10s %10s %10s %14s %14s\n", "Line", "Command", "Count", "p50(ms)", "p90(ms)", "p99(ms)", "Max(ms)", "ImgMem(B)", "PeakRSS(B)");
+
+	tString json = "{\n";
+	json += UsingStubGL ? "\t\"gl\": \"stubbed\",\n" : "\t\"gl\": \"offscreen\",\n";
+	json += "\t\"steps\":\n\t[\n";
+	for (StepRecord* step = steps.First(); step; step = step->Next())
+	{
+		std::vector<double> sorted = step->SamplesMs;
+		std::sort(sorted.begin(), sorted.end());
+		double p50 = Percentile(sorted, 0.50);
+		double p90 = Percentile(sorted, 0.90);
+		double p99 = Percentile(sorted, 0.99);
+		double max = sorted.back();
+		int count = int(sorted.size());
+
+		tString cmd = step->Command;
+		if (cmd.Length() > 24)
+			cmd = cmd.Left(24);
+		tPrintf
+		(
+			"%-5d %-24s %6d %10.3f %10.3f %10.3f %10.3f %14|64d %14|64d\n",
+			step->Line, cmd.Chr(), count, p50, p90, p99, max, step->ImageMemHighWater, step->PeakRSS
+		);
+
+		tString entry;
+		tsPrintf
+		(
+			entry,
+			"\t\t{ \"line\": %d, \"command\": \"%s\", \"count\": %d, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, "
+			"\"max\": %.4f, \"imageMemHighWater\": %|64d, \"peakRSS\": %|64d }%s\n",
+			step->Line, step->Command.Chr(), count, p50, p90, p99, max, step->ImageMemHighWater, step->PeakRSS,
+			step->Next() ? "," : ""
+		);
+		json += entry;
+	}
+	json += "\t]\n}\n";
+
+	if (reportFile.IsEmpty() || (reportFile == "*"))
+	{
+		tPrintf("%s", json.Chr());
+		return;
+	}
+
+	tSystem::tFileHandle file = tSystem::tOpenFile(reportFile.Chr(), "wb");
+	if (!file)
+	{
+		tPrintf("Warning: Could not write replay report %s\n", reportFile.Chr());
+		return;
+	}
+	tSystem::tWriteFile(file, json.Chr(), json.Length());
+	tSystem::tCloseFile(file);
+	tPrintf("Replay report: %s\n", reportFile.Chr());
+}
@@ -0,0 +1,38 @@
+// Replay.h
+//
+// Headless navigation replay. Runs a scripted viewer session (open a directory, sort, step through images, jump to
+// the ends, scroll the thumbnail view) against the same Viewer code paths the GUI uses and reports per-step latency
+// percentiles and memory high-water marks. Uses a hidden offscreen GL context when one can be created and stubbed GL
+// texture calls otherwise, so it runs on build machines without a display.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <Foundation/tString.h>
+
+
+namespace Replay
+{
+	// Runs the replay script and returns a Viewer::ErrorCode. Script lines are one command each. Blank lines and lines
+	// starting with # are ignored. Commands:
+	//
+	// open <dir>						Populate images from dir and load/bind the first one.
+	// sort <key> [asc|desc]			Keys: natural name modtime size type area width height.
+	// next <count>, prev <count>		Step through images loading and binding each one.
+	// first, last						Jump to the first or last image.
+	// thumbs <perPage> [pages]			Scroll the thumbnail view a page at a time, waiting for each page to finish.
+	// maxmem <MB>						Sets the image memory budget used for eviction.
+	// checkundo						Resizes each animated image, undoes and redoes it, and fails unless frame
+	//									dimensions and durations are restored exactly.
+	//
+	// If reportFile is empty or "*" the JSON report is printed instead of written.
+	int Run(const tString& scriptFile, const tString& reportFile, bool forceStubGL);
+}
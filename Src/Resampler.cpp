@@ -0,0 +1,436 @@
+// Resampler.cpp
+//
+// A multithreaded separable resampler used in place of tImage::Resample. Filter weights for each axis are computed
+// once per (source size, destination size, filter, edge mode) and cached. Destination rows are processed in blocks
+// pulled by all cores, each block doing a horizontal pass into a small float buffer followed by a vertical pass.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <cmath>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <Foundation/tStandard.h>
+#include <Math/tFundamentals.h>
+#include <System/tMachine.h>
+#include "Resampler.h"
+#include "PixelVec.h"
+using namespace tMath;
+using namespace tImage;
+
+
+namespace Viewer
+{
+	// Below this many destination pixels the resample runs on the calling thread.
+	const int ResampleMinParallelPixels = 128*1024;
+
+	// Destination rows per block. Fewer are used for large downscales so the block's source rows stay bounded.
+	const int ResampleMaxBlockRows = 32;
+	const int ResampleMaxBlockSrcRows = 256;
+
+	// Number of weight tables kept. A multi-frame resize or a contact sheet reuses the same few sizes.
+	const int WeightCacheSize = 32;
+
+	// The weights for one axis. Every destination position has Taps entries, zero-weight padded. Indices have the
+	// edge mode already applied so they are always in range.
+	struct WeightTable
+	{
+		int SrcSize;
+		int DstSize;
+		tResampleFilter Filter;
+		tResampleEdgeMode EdgeMode;
+		int Taps;
+		std::vector<int> Index;
+		std::vector<float> Weight;
+	};
+
+	std::mutex WeightCacheMutex;
+	std::vector<std::shared_ptr<const WeightTable>> WeightCache;
+
+	float EvalCubic(float x, float b, float c);
+	float EvalLanczos(float x, float a);
+
+	int AddressEdge(int index, int size, tResampleEdgeMode);
+	std::shared_ptr<const WeightTable> BuildWeightTable(int srcSize, int dstSize, tResampleFilter, tResampleEdgeMode);
+	std::shared_ptr<const WeightTable> GetWeightTable(int srcSize, int dstSize, tResampleFilter, tResampleEdgeMode);
+}
+
+
+float Viewer::EvalCubic(float x, float b, float c)
+{
+	// Mitchell-Netravali family.
+	x = tAbs(x);
+	if (x < 1.0f)
+		return ((12.0f - 9.0f*b - 6.0f*c)*x*x*x + (-18.0f + 12.0f*b + 6.0f*c)*x*x + (6.0f - 2.0f*b)) / 6.0f;
+	if (x < 2.0f)
+		return ((-b - 6.0f*c)*x*x*x + (6.0f*b + 30.0f*c)*x*x + (-12.0f*b - 48.0f*c)*x + (8.0f*b + 24.0f*c)) / 6.0f;
+	return 0.0f;
+}
+
+
+float Viewer::EvalLanczos(float x, float a)
+{
+	x = tAbs(x);
+	if (x < 1.0e-6f)
+		return 1.0f;
+	if (x >= a)
+		return 0.0f;
+
+	const float pi = 3.14159265358979f;
+	float px = pi*x;
+	return (a * std::sin(px) * std::sin(px/a)) / (px*px);
+}
+
+
+float Viewer::GetKernelRadius(tResampleFilter filter)
+{
+	switch (filter)
+	{
+		case tResampleFilter::Box:					return 0.5f;
+		case tResampleFilter::Bilinear:				return 1.0f;
+		case tResampleFilter::Bicubic_Standard:
+		case tResampleFilter::Bicubic_CatmullRom:
+		case tResampleFilter::Bicubic_Mitchell:
+		case tResampleFilter::Bicubic_Cardinal:
+		case tResampleFilter::Bicubic_BSpline:		return 2.0f;
+		case tResampleFilter::Lanczos_Narrow:		return 2.0f;
+		case tResampleFilter::Lanczos_Normal:		return 3.0f;
+		case tResampleFilter::Lanczos_Wide:			return 4.0f;
+		default:									return 0.5f;
+	}
+}
+
+
+float Viewer::EvalKernel(tResampleFilter filter, float x)
+{
+	switch (filter)
+	{
+		case tResampleFilter::Box:					return ((x >= -0.5f) && (x < 0.5f)) ? 1.0f : 0.0f;
+		case tResampleFilter::Bilinear:				return tMax(1.0f - tAbs(x), 0.0f);
+		case tResampleFilter::Bicubic_Standard:		return EvalCubic(x, 0.0f, 0.75f);
+		case tResampleFilter::Bicubic_CatmullRom:	return EvalCubic(x, 0.0f, 0.5f);
+		case tResampleFilter::Bicubic_Mitchell:		return EvalCubic(x, 1.0f/3.0f, 1.0f/3.0f);
+		case tResampleFilter::Bicubic_Cardinal:		return EvalCubic(x, 0.0f, 1.0f);
+		case tResampleFilter::Bicubic_BSpline:		return EvalCubic(x, 1.0f, 0.0f);
+		case tResampleFilter::Lanczos_Narrow:		return EvalLanczos(x, 2.0f);
+		case tResampleFilter::Lanczos_Normal:		return EvalLanczos(x, 3.0f);
+		case tResampleFilter::Lanczos_Wide:			return EvalLanczos(x, 4.0f);
+		default:									return 0.0f;
+	}
+}
+
+
+int Viewer::AddressEdge(int index, int size, tResampleEdgeMode edgeMode)
+{
+	if (edgeMode == tResampleEdgeMode::Wrap)
+		return ((index % size) + size) % size;
+
+	return tClamp(index, 0, size-1);
+}
+
+
+std::shared_ptr<const Viewer::WeightTable> Viewer::BuildWeightTable(int srcSize, int dstSize, tResampleFilter filter, tResampleEdgeMode edgeMode)
+{
+	std::shared_ptr<WeightTable> table = std::make_shared<WeightTable>();
+	table->SrcSize	= srcSize;
+	table->DstSize	= dstSize;
+	table->Filter	= filter;
+	table->EdgeMode	= edgeMode;
+
+	// Nearest is a single tap picked the same way for up and down scales.
+	float scale = float(dstSize) / float(srcSize);
+	if (filter == tResampleFilter::Nearest)
+	{
+		table->Taps = 1;
+		table->Index.resize(dstSize);
+		table->Weight.assign(dstSize, 1.0f);
+		for (int d = 0; d < dstSize; d++)
+			table->Index[d] = tClamp(int((float(d) + 0.5f) / scale), 0, srcSize-1);
+		return table;
+	}
+
+	// When downscaling the kernel is stretched to cover every source pixel that lands in the destination pixel.
+	float filterScale = tMin(scale, 1.0f);
+	float support = GetKernelRadius(filter) / filterScale;
+	int maxTaps = int(std::ceil(2.0f*support)) + 2;
+
+	std::vector<int> index(dstSize*maxTaps, 0);
+	std::vector<float> weight(dstSize*maxTaps, 0.0f);
+	int taps = 1;
+	for (int d = 0; d < dstSize; d++)
+	{
+		float centre = (float(d) + 0.5f) / scale - 0.5f;
+		int lo = int(std::floor(centre - support));
+		int hi = int(std::ceil(centre + support));
+		int* dIndex = index.data() + d*maxTaps;
+		float* dWeight = weight.data() + d*maxTaps;
+
+		int count = 0;
+		float sum = 0.0f;
+		for (int s = lo; (s <= hi) && (count < maxTaps); s++)
+		{
+			float w = EvalKernel(filter, (float(s) - centre) * filterScale);
+			if (w == 0.0f)
+				continue;
+			dIndex[count] = AddressEdge(s, srcSize, edgeMode);
+			dWeight[count] = w;
+			sum += w;
+			count++;
+		}
+
+		// A kernel that missed every sample (a box between pixels) falls back to the nearest one.
+		if ((count == 0) || (sum == 0.0f))
+		{
+			dIndex[0] = AddressEdge(int(std::floor(centre + 0.5f)), srcSize, edgeMode);
+			dWeight[0] = 1.0f;
+			count = 1;
+			sum = 1.0f;
+		}
+
+		for (int t = 0; t < count; t++)
+			dWeight[t] /= sum;
+		taps = tMax(taps, count);
+	}
+
+	// Repack with the actual tap count so the inner loops do not walk padding.
+	table->Taps = taps;
+	table->Index.resize(dstSize*taps);
+	table->Weight.resize(dstSize*taps);
+	for (int d = 0; d < dstSize; d++)
+	{
+		for (int t = 0; t < taps; t++)
+		{
+			table->Index[d*taps + t] = index[d*maxTaps + t];
+			table->Weight[d*taps + t] = weight[d*maxTaps + t];
+		}
+	}
+	return table;
+}
+
+
+std::shared_ptr<const Viewer::WeightTable> Viewer::GetWeightTable(int srcSize, int dstSize, tResampleFilter filter, tResampleEdgeMode edgeMode)
+{
+	{
+		std::lock_guard<std::mutex> lock(WeightCacheMutex);
+		for (const std::shared_ptr<const WeightTable>& table : WeightCache)
+		{
+			if ((table->SrcSize == srcSize) && (table->DstSize == dstSize) && (table->Filter == filter) && (table->EdgeMode == edgeMode))
+				return table;
+		}
+	}
+
+	// Built outside the lock. Two threads may build the same table, which is harmless.
+	std::shared_ptr<const WeightTable> table = BuildWeightTable(srcSize, dstSize, filter, edgeMode);
+	std::lock_guard<std::mutex> lock(WeightCacheMutex);
+	if (int(WeightCache.size()) >= WeightCacheSize)
+		WeightCache.erase(WeightCache.begin());
+	WeightCache.push_back(table);
+	return table;
+}
+
+
+bool Viewer::ResamplePixels
+(
+	const tPixel4b* src, int srcW, int srcH, tPixel4b* dst, int dstW, int dstH,
+	tResampleFilter filter, tResampleEdgeMode edgeMode
+)
+{
+	return ResamplePixelsRegion(src, srcW, srcH, dst, dstW, dstH, 0, 0, dstW-1, dstH-1, filter, edgeMode);
+}
+
+
+bool Viewer::ResamplePixelsRegion
+(
+	const tPixel4b* src, int srcW, int srcH, tPixel4b* dst, int dstW, int dstH,
+	int x0, int y0, int x1, int y1, tResampleFilter filter, tResampleEdgeMode edgeMode
+)
+{
+	if (!src || !dst || (srcW <= 0) || (srcH <= 0) || (dstW <= 0) || (dstH <= 0))
+		return false;
+
+	if ((int(filter) < 0) || (int(filter) >= int(tResampleFilter::NumFilters)))
+		return false;
+
+	x0 = tMax(x0, 0);	y0 = tMax(y0, 0);
+	x1 = tMin(x1, dstW-1);	y1 = tMin(y1, dstH-1);
+	if ((x1 < x0) || (y1 < y0))
+		return false;
+
+	std::shared_ptr<const WeightTable> tableX = GetWeightTable(srcW, dstW, filter, edgeMode);
+	std::shared_ptr<const WeightTable> tableY = GetWeightTable(srcH, dstH, filter, edgeMode);
+	const WeightTable& wx = *tableX;
+	const WeightTable& wy = *tableY;
+
+	// Everything below works on the region. Only its columns are filtered and only its rows are written.
+	int regionW = x1 - x0 + 1;
+	int regionH = y1 - y0 + 1;
+	int blockRows = tClamp(ResampleMaxBlockSrcRows / wy.Taps, 1, ResampleMaxBlockRows);
+	int numBlocks = (regionH + blockRows - 1) / blockRows;
+	std::atomic<int> nextBlock = 0;
+
+	auto worker = [&]()
+	{
+		// Per thread. Source rows needed by a block are filtered horizontally into rows of the buffer. rowSlot maps a
+		// source row to its buffer row, or -1.
+		std::vector<float> rows;
+		std::vector<float> accum(4*regionW);
+		std::vector<int> rowSlot(srcH, -1);
+		std::vector<int> used;
+
+		for (int block = nextBlock++; block < numBlocks; block = nextBlock++)
+		{
+			int blockBegin = y0 + block*blockRows;
+			int blockEnd = tMin(blockBegin + blockRows, y1 + 1);
+
+			// Nearest needs no arithmetic at all.
+			if (filter == tResampleFilter::Nearest)
+			{
+				for (int y = blockBegin; y < blockEnd; y++)
+				{
+					const tPixel4b* srcRow = src + wy.Index[y]*srcW;
+					tPixel4b* dstRow = dst + y*dstW;
+					for (int x = x0; x <= x1; x++)
+						dstRow[x] = srcRow[wx.Index[x]];
+				}
+				continue;
+			}
+
+			used.clear();
+			for (int y = blockBegin; y < blockEnd; y++)
+			{
+				for (int t = 0; t < wy.Taps; t++)
+				{
+					int s = wy.Index[y*wy.Taps + t];
+					if (rowSlot[s] < 0)
+					{
+						rowSlot[s] = int(used.size());
+						used.push_back(s);
+					}
+				}
+			}
+			rows.resize(used.size()*4*regionW);
+
+			// Horizontal pass. One output pixel is a weighted sum of whole source pixels.
+			for (int r = 0; r < int(used.size()); r++)
+			{
+				const tPixel4b* srcRow = src + used[r]*srcW;
+				float* out = rows.data() + r*4*regionW;
+				const int* index = wx.Index.data() + x0*wx.Taps;
+				const float* weight = wx.Weight.data() + x0*wx.Taps;
+				for (int x = 0; x < regionW; x++, index += wx.Taps, weight += wx.Taps)
+				{
+					Vec4 acc = VMul(VLoad(srcRow[index[0]]), VSplat(weight[0]));
+					for (int t = 1; t < wx.Taps; t++)
+						acc = VMulAdd(acc, VLoad(srcRow[index[t]]), weight[t]);
+					VStore4f(out + 4*x, acc);
+				}
+			}
+
+			// Vertical pass. Whole rows are accumulated a tap at a time so the reads are sequential.
+			for (int y = blockBegin; y < blockEnd; y++)
+			{
+				const int* index = wy.Index.data() + y*wy.Taps;
+				const float* weight = wy.Weight.data() + y*wy.Taps;
+				float* acc = accum.data();
+				const float* row = rows.data() + rowSlot[index[0]]*4*regionW;
+				for (int x = 0; x < regionW; x++)
+					VStore4f(acc + 4*x, VMul(VLoad4f(row + 4*x), VSplat(weight[0])));
+
+				for (int t = 1; t < wy.Taps; t++)
+				{
+					row = rows.data() + rowSlot[index[t]]*4*regionW;
+					float w = weight[t];
+					for (int x = 0; x < regionW; x++)
+						VStore4f(acc + 4*x, VMulAdd(VLoad4f(acc + 4*x), VLoad4f(row + 4*x), w));
+				}
+
+				tPixel4b* dstRow = dst + y*dstW + x0;
+				for (int x = 0; x < regionW; x++)
+					VStore(dstRow[x], VLoad4f(acc + 4*x));
+			}
+
+			for (int s : used)
+				rowSlot[s] = -1;
+		}
+	};
+
+	int numThreads = (regionW*regionH < ResampleMinParallelPixels) ? 1 : tClamp(tSystem::tGetNumCores(), 1, numBlocks);
+	std::vector<std::thread> workers;
+	for (int w = 1; w < numThreads; w++)
+		workers.emplace_back(worker);
+	worker();
+	for (std::thread& w : workers)
+		w.join();
+
+	return true;
+}
+
+
+bool Viewer::GetResampleFootprint
+(
+	int srcSize, int dstSize, int s0, int s1, int& d0, int& d1,
+	tResampleFilter filter, tResampleEdgeMode edgeMode
+)
+{
+	d0 = dstSize;
+	d1 = -1;
+	if ((srcSize <= 0) || (dstSize <= 0) || (int(filter) < 0) || (int(filter) >= int(tResampleFilter::NumFilters)))
+		return false;
+
+	// Zero-weight padding taps point at index 0 but never change the result, so they are skipped.
+	std::shared_ptr<const WeightTable> table = GetWeightTable(srcSize, dstSize, filter, edgeMode);
+	for (int d = 0; d < dstSize; d++)
+	{
+		for (int t = 0; t < table->Taps; t++)
+		{
+			int s = table->Index[d*table->Taps + t];
+			if ((table->Weight[d*table->Taps + t] != 0.0f) && (s >= s0) && (s <= s1))
+			{
+				d0 = tMin(d0, d);
+				d1 = tMax(d1, d);
+				break;
+			}
+		}
+	}
+	return (d1 >= d0);
+}
+
+
+void Viewer::SetKeepDuration(tPicture& picture, int width, int height, tPixel4b* pixels)
+{
+	float duration = picture.Duration;
+	picture.Set(width, height, pixels, false);
+	picture.Duration = duration;
+}
+
+
+bool Viewer::ResamplePicture(tPicture& picture, int newWidth, int newHeight, tResampleFilter filter, tResampleEdgeMode edgeMode)
+{
+	if (!picture.IsValid() || (newWidth <= 0) || (newHeight <= 0))
+		return false;
+
+	int width = picture.GetWidth();
+	int height = picture.GetHeight();
+	if ((width == newWidth) && (height == newHeight))
+		return false;
+
+	tPixel4b* pixels = new tPixel4b[newWidth*newHeight];
+	if (!ResamplePixels(picture.GetPixelPointer(), width, height, pixels, newWidth, newHeight, filter, edgeMode))
+	{
+		delete[] pixels;
+		return false;
+	}
+
+	SetKeepDuration(picture, newWidth, newHeight, pixels);
+	return true;
+}
@@ -0,0 +1,74 @@
+// Resampler.h
+//
+// A multithreaded separable resampler used in place of tImage::Resample. Filter weights for each axis are computed
+// once per (source size, destination size, filter, edge mode) and cached. Destination rows are processed in blocks
+// pulled by all cores, each block doing a horizontal pass into a small float buffer followed by a vertical pass.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <Image/tPicture.h>
+#include <Image/tResample.h>
+
+
+namespace Viewer
+{
+	// Tolerances checked by tacentview_bench --resample, which fails if any is exceeded over the corpus. They are the
+	// largest allowed per-channel difference. Upscales must match tImage::Resample to within
+	// ResampleUpscaleTolerance. Every scale must match a direct double precision evaluation of the weights described
+	// below to within ResampleReferenceTolerance. Downscales have no bound against tImage::Resample (see below).
+	const int ResampleUpscaleTolerance		= 2;
+	const int ResampleReferenceTolerance	= 1;
+
+	// A drop-in replacement for tImage::Resample. The filters use the same kernel shapes and the edge modes address
+	// out of range taps the same way. Weights are normalised floats and the output is rounded to nearest, so results
+	// are not bit-exact. When downscaling, each kernel is stretched by 1/scale so its support is radius/scale source
+	// pixels. Every source pixel under a destination pixel contributes and the result is properly low-passed. A
+	// half-size bilinear, for example, has four taps per axis rather than two. Downscales therefore differ from
+	// tImage::Resample by design, by up to a full channel range for Nearest and Box on fine detail. Returns false (and
+	// leaves dst untouched) if any dimension is not positive or the filter is None.
+	bool ResamplePixels
+	(
+		const tPixel4b* src, int srcW, int srcH, tPixel4b* dst, int dstW, int dstH,
+		tImage::tResampleFilter, tImage::tResampleEdgeMode = tImage::tResampleEdgeMode::Clamp
+	);
+
+	// Like ResamplePixels but only computes the inclusive destination rectangle x0..x1, y0..y1 of the dstW x dstH
+	// result. Pixels outside it are left untouched. Each pixel written is identical to the one ResamplePixels makes.
+	bool ResamplePixelsRegion
+	(
+		const tPixel4b* src, int srcW, int srcH, tPixel4b* dst, int dstW, int dstH, int x0, int y0, int x1, int y1,
+		tImage::tResampleFilter, tImage::tResampleEdgeMode = tImage::tResampleEdgeMode::Clamp
+	);
+
+	// Along one axis, finds the inclusive destination range d0..d1 whose taps read any source index in s0..s1. With
+	// wrapping this is the bounding range. Returns false if no destination pixel reads the source range.
+	bool GetResampleFootprint
+	(
+		int srcSize, int dstSize, int s0, int s1, int& d0, int& d1,
+		tImage::tResampleFilter, tImage::tResampleEdgeMode = tImage::tResampleEdgeMode::Clamp
+	);
+
+	// The kernel radius at 1:1 and the kernel itself. Exposed so the bench can build its reference weights.
+	float GetKernelRadius(tImage::tResampleFilter);
+	float EvalKernel(tImage::tResampleFilter, float x);
+
+	// Gives the pixels to the picture like tPicture::Set with copy false, but keeps the frame duration, which Set
+	// resets.
+	void SetKeepDuration(tImage::tPicture&, int width, int height, tPixel4b* pixels);
+
+	// A drop-in replacement for tPicture::Resample. Returns false if the picture is invalid or nothing was done.
+	bool ResamplePicture
+	(
+		tImage::tPicture&, int newWidth, int newHeight,
+		tImage::tResampleFilter = tImage::tResampleFilter::Bilinear, tImage::tResampleEdgeMode = tImage::tResampleEdgeMode::Clamp
+	);
+}
@@ -17,6 +17,9 @@
 #include "Image.h"
 #include "TacentView.h"
 #include "GuiUtil.h"
+#include "EditTask.h"
+#include "CostModel.h"
+#include "Resampler.h"
 using namespace tStd;
 using namespace tSystem;
 using namespace tMath;
@@ -326,11 +329,23 @@ void Viewer::DoResizeImageModal(bool resizeImagePressed)
 	{
 		if ((dstW != srcW) || (dstH != srcH))
 		{
-			CurrImage->Unbind();
-			CurrImage->Resample(dstW, dstH, tImage::tResampleFilter(profile.ResampleFilter), tImage::tResampleEdgeMode(profile.ResampleEdgeMode));
-			CurrImage->Bind();
-			Gutil::SetWindowTitle();
-			Viewer::ZoomDownscaleOnly();
+			// The resample runs on a snapshot in the background. The result replaces the current image when done.
+			int newW = dstW;
+			int newH = dstH;
+			tImage::tResampleFilter filter = tImage::tResampleFilter(profile.ResampleFilter);
+			tImage::tResampleEdgeMode edgeMode = tImage::tResampleEdgeMode(profile.ResampleEdgeMode);
+			auto resample = [newW, newH, filter, edgeMode](Image& image, EditTask& task) -> bool
+			{
+				return task.ForEachPicture(image, [&](tImage::tPicture& picture)
+				{
+					if ((picture.GetWidth() != newW) || (picture.GetHeight() != newH))
+						ResamplePicture(picture, newW, newH, filter, edgeMode);
+				});
+			};
+
+			tString desc; tsPrintf(desc, "Resample %d %d", dstW, dstH);
+			float approxSeconds = CostModel::ResampleSeconds(filter, srcW, srcH, newW, newH) * float(CurrImage->GetNumFrames());
+			StartImageEditTask(CurrImage, desc, resample, [](){ Gutil::SetWindowTitle(); Viewer::ZoomDownscaleOnly(); }, approxSeconds);
 		}
 		ImGui::CloseCurrentPopup();
 	}
@@ -18,6 +18,9 @@
 #include "TacentView.h"
 #include "GuiUtil.h"
 #include "Config.h"
+#include "EditTask.h"
+#include "CostModel.h"
+#include "Rotation.h"
 using namespace tStd;
 using namespace tSystem;
 using namespace tMath;
@@ -48,27 +51,17 @@ void Viewer::DoRotateImageModal(bool rotateImagePressed)
 	ImGui::DragFloat("Fine Tune Drag", &RotateAnglePreview, 0.01f);
 	ImGui::NewLine();
 
-	ImGui::Combo("Up Filter", &profile.ResampleFilterRotateUp, tResampleFilterNames, tNumElements(tResampleFilterNames), tNumElements(tResampleFilterNames));
+	ImGui::Combo("Filter", &profile.ResampleFilterRotateUp, tResampleFilterNames, tNumElements(tResampleFilterNames), tNumElements(tResampleFilterNames));
 	ImGui::SameLine();
 	Gutil::HelpMark
 	(
-		"Filtering method used during up-sampling.\n"
-		"If set to None no resampling, preserves colours,\n"
-		"nearest neighbour, fast, for pixel art."
+		"Filtering method used to sample the source.\n"
+		"If set to None or Nearest no resampling, preserves colours,\n"
+		"nearest neighbour, fast, for pixel art. Box and Bilinear\n"
+		"are bilinear. The other filters use a sharper bicubic.\n"
+		"Exact multiples of 90 degrees are never resampled."
 	);
 
-	if (profile.ResampleFilterRotateUp != int(tResampleFilter(tResampleFilter::None)))
-	{
-		ImGui::Combo("Down Filter", &profile.ResampleFilterRotateDown, tResampleFilterNames, tNumElements(tResampleFilterNames), tNumElements(tResampleFilterNames));
-		ImGui::SameLine();
-		Gutil::HelpMark
-		(
-			"Filtering method used during down-sampling.\n"
-			"Box works well. If set to None uses an an alternate\n"
-			"down-sample that produces sharper images."
-		);
-	}
-
 	static const char* modeNames[] = { "Fill", "Crop", "Crop Resize" };
 	ImGui::Combo("Mode", &profile.RotateMode, modeNames, tNumElements(modeNames), tNumElements(modeNames));
 	ImGui::SameLine();
@@ -117,57 +110,32 @@ void Viewer::DoRotateImageModal(bool rotateImagePressed)
 			ImGui::EndPopup();
 			return;
 		}
-		int origW = picture->GetWidth();
-		int origH = picture->GetHeight();
-
-		CurrImage->Unbind();
-		CurrImage->Rotate
-		(
-			tDegToRad(RotateAnglePreview), profile.FillColour,
-			tResampleFilter(profile.ResampleFilterRotateUp),
-			tResampleFilter(profile.ResampleFilterRotateDown)
-		);
 
-		if ((profile.GetRotateMode() == Config::ProfileData::RotateModeEnum::Crop) || (profile.GetRotateMode() == Config::ProfileData::RotateModeEnum::CropResize))
+		// The rotate, and any crop and resample that follow it, run on a snapshot in the background. The tiles of
+		// every frame share one pool of threads so a cancel takes effect between tiles.
+		float angle = tDegToRad(RotateAnglePreview);
+		if (angle != 0.0f)
 		{
-			// If one of the crop modes is selected we need to crop the edges. Since rectangles are made of lines and there
-			// is symmetry and we can compute the reduced size by subtracting the original size from the rotated size.
-			int rotW = picture->GetWidth();
-			int rotH = picture->GetHeight();
-			bool aspectFlip = ((origW > origH) && (rotW < rotH)) || ((origW < origH) && (rotW > rotH));
-			if (aspectFlip)
-				tSwap(origW, origH);
-
-			int dx = rotW - origW;
-			int dy = rotH - origH;
-			int newW = origW - dx;
-			int newH = origH - dy;
-
-			if (dx > origW/2)
+			tColour4b fill = profile.FillColour;
+			tResampleFilter filter = tResampleFilter(profile.ResampleFilterRotateUp);
+			RotateFit fit = RotateFit::Fill;
+			switch (profile.GetRotateMode())
 			{
-				newW = origW - origW/2;
-				newH = (newW*origH)/origW;
+				case Config::ProfileData::RotateModeEnum::Crop:			fit = RotateFit::Crop;			break;
+				case Config::ProfileData::RotateModeEnum::CropResize:	fit = RotateFit::CropResize;	break;
+				default:																				break;
 			}
-			else if (dy > origH/2)
+			auto rotate = [angle, fill, filter, fit](Image& image, EditTask& task) -> bool
 			{
-				newH = origH - origH/2;
-				newW = (newH*origW)/origH;
-			}
-
-			// The above code has been tested with a 1x1 input and (newH,newW) result correcty as (1,1). 
-			CurrImage->Crop(newW, newH, tPicture::Anchor::MiddleMiddle);
-		}
+				return RotatePictures(image.GetPictures(), angle, fill, filter, fit, &task.Cancelled, &task.Progress);
+			};
 
-		if (profile.GetRotateMode() == Config::ProfileData::RotateModeEnum::CropResize)
-		{
-			// The crop is done. Now resample.
-			tResampleFilter filter = (profile.ResampleFilterRotateUp != int(tResampleFilter::None)) ? tResampleFilter(profile.ResampleFilterRotateUp) : tResampleFilter::Nearest;
-			CurrImage->Resample(origW, origH, filter, tResampleEdgeMode::Clamp);
+			tString desc; tsPrintf(desc, "Rotate %.1f", RotateAnglePreview);
+			float approxSeconds = CostModel::RotateSeconds(picture->GetWidth(), picture->GetHeight(), filter) * float(CurrImage->GetNumFrames());
+			StartImageEditTask(CurrImage, desc, rotate, [](){ Gutil::SetWindowTitle(); }, approxSeconds);
 		}
 
-		CurrImage->Bind();
 		RotateAnglePreview = 0.0f;
-		Gutil::SetWindowTitle();
 		ImGui::CloseCurrentPopup();
 	}
 	ImGui::EndPopup();
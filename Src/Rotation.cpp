@@ -0,0 +1,677 @@
+// Rotation.cpp
+//
+// Arbitrary angle picture rotation. Every destination pixel is inverse mapped into the source and sampled with a
+// nearest, bilinear, or bicubic kernel. The destination is split into tiles that are spread over all cores, and the
+// tiles of every picture go into the same pool so multi-frame images keep all cores busy. Exact multiples of 90
+// degrees skip resampling entirely and use tiled, parallel transposes, as do flips.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <Foundation/tStandard.h>
+#include <Math/tFundamentals.h>
+#include <System/tMachine.h>
+#include "Rotation.h"
+#include "PixelVec.h"
+#include "Resampler.h"
+using namespace tMath;
+using namespace tImage;
+
+
+namespace Viewer
+{
+	// Destination tiles are square. 64x64 RGBA is 16KB which, with the source footprint it touches, stays in L2.
+	const int RotateTileSize = 64;
+
+	// Below this many destination pixels (over all pictures) the rotation runs on the calling thread.
+	const int RotateMinParallelPixels = 128*1024;
+
+	enum class RotateKernel { Nearest, Bilinear, Bicubic };
+
+	// One picture being rotated. The destination buffer is only handed to the picture once every tile is done.
+	struct RotateJob
+	{
+		tPicture* Picture;
+		const tPixel4b* Src;
+		int SrcW, SrcH;
+		tPixel4b* Dst;
+		int DstW, DstH;
+
+		// Source position of the centre of destination pixel (0,0) and the step for +x and +y.
+		float OriginX, OriginY;
+		float StepXx, StepXy;
+		float StepYx, StepYy;
+	};
+
+	struct RotateTile
+	{
+		int Job;
+		int X0, Y0, X1, Y1;
+	};
+
+	// Taps outside the source read as the fill colour so the edges blend into it instead of stair-stepping.
+	inline Vec4 VTap(const RotateJob& job, int x, int y, Vec4 fill)
+	{
+		if ((unsigned(x) < unsigned(job.SrcW)) && (unsigned(y) < unsigned(job.SrcH)))
+			return VLoad(job.Src[y*job.SrcW + x]);
+		return fill;
+	}
+
+	// Catmull-Rom weights for the four taps around t in [0, 1).
+	inline void CubicWeights(float t, float w[4])
+	{
+		w[0] = ((-0.5f*t + 1.0f)*t - 0.5f)*t;
+		w[1] = (1.5f*t - 2.5f)*t*t + 1.0f;
+		w[2] = ((-1.5f*t + 2.0f)*t + 0.5f)*t;
+		w[3] = (0.5f*t - 0.5f)*t*t;
+	}
+
+	RotateKernel GetRotateKernel(tResampleFilter);
+	bool IsExactQuarterTurn(float angle, int& quarters);
+
+	// Exact transforms. Tiles are square so both the reads and the writes of a transpose stay within a few pages.
+	const int TransposeTileSize = 64;
+	const int FlipBandRows = 32;
+	enum class FlipMode { Horizontal, Vertical, HalfTurn };
+
+	// Calls fn(item) for every item in [0, numItems), spread over all cores if numPixels is large enough.
+	void ForEachWorkItem(int numItems, int64 numPixels, const std::function<void(int)>& fn);
+
+	// Writes the quarter turn of the source tile [x0, x1) x [y0, y1) into dst, which is srcH wide.
+	void RotateTile90(const tPixel4b* src, int srcW, int srcH, tPixel4b* dst, int x0, int y0, int x1, int y1, bool antiClockwise);
+
+	// dst[i] = src[w-1-i]. The rows must not overlap.
+	void ReverseRow(tPixel4b* dst, const tPixel4b* src, int w);
+
+	void Rotate90Set(const std::vector<tPicture*>&, bool antiClockwise);
+	void FlipSet(const std::vector<tPicture*>&, FlipMode);
+	std::vector<tPicture*> GetPictureSet(const tList<tPicture>&);
+
+	template<RotateKernel K> void RotateTileRows(const RotateJob&, const RotateTile&, const tColour4b& fill);
+	void RotateTileRows(const RotateJob&, const RotateTile&, RotateKernel, const tColour4b& fill);
+
+	// Pictures are passed as pointers since a tPicture can only be linked into one list.
+	bool RotatePictureSet
+	(
+		const std::vector<tPicture*>&, float angle, const tColour4b& fill, tResampleFilter,
+		RotateFit, const std::atomic<bool>* cancel, std::atomic<float>* progress
+	);
+}
+
+
+Viewer::RotateKernel Viewer::GetRotateKernel(tResampleFilter filter)
+{
+	if ((filter == tResampleFilter::Nearest) || (filter == tResampleFilter::None))
+		return RotateKernel::Nearest;
+
+	if ((filter == tResampleFilter::Box) || (filter == tResampleFilter::Bilinear))
+		return RotateKernel::Bilinear;
+
+	return RotateKernel::Bicubic;
+}
+
+
+bool Viewer::IsExactQuarterTurn(float angle, int& quarters)
+{
+	// Angles within a ten-thousandth of a degree of a multiple of 90 are treated as exact.
+	double degrees = double(tRadToDeg(angle));
+	double turns = std::round(degrees / 90.0);
+	if (std::fabs(degrees - turns*90.0) > 1.0e-4)
+		return false;
+
+	quarters = int(std::fmod(turns, 4.0));
+	if (quarters < 0)
+		quarters += 4;
+	return true;
+}
+
+
+void Viewer::ForEachWorkItem(int numItems, int64 numPixels, const std::function<void(int)>& fn)
+{
+	std::atomic<int> nextItem = 0;
+	auto worker = [&]()
+	{
+		for (int item = nextItem++; item < numItems; item = nextItem++)
+			fn(item);
+	};
+
+	int numThreads = (numPixels < RotateMinParallelPixels) ? 1 : tClamp(tSystem::tGetNumCores(), 1, numItems);
+	std::vector<std::thread> workers;
+	for (int w = 1; w < numThreads; w++)
+		workers.emplace_back(worker);
+	worker();
+	for (std::thread& w : workers)
+		w.join();
+}
+
+
+void Viewer::RotateTile90(const tPixel4b* src, int srcW, int srcH, tPixel4b* dst, int x0, int y0, int x1, int y1, bool antiClockwise)
+{
+	// Pictures are stored bottom row first so y is up. Anti-clockwise (x,y) goes to (srcH-1-y, x) and clockwise goes
+	// to (y, srcW-1-x). The destination is srcH wide.
+	int dstW = srcH;
+	int y = y0;
+
+	#if defined(PIXELVEC_SSE2) || defined(PIXELVEC_NEON)
+	// 4x4 blocks. Four source rows are loaded and transposed in registers so each store is a 4 pixel run of a
+	// destination row. Anti-clockwise runs go right to left so their lanes are reversed.
+	for (; y + 4 <= y1; y += 4)
+	{
+		const tPixel4b* row = src + y*srcW;
+		int x = x0;
+		for (; x + 4 <= x1; x += 4)
+		{
+			#if defined(PIXELVEC_SSE2)
+			__m128i r0 = _mm_loadu_si128((const __m128i*)(row + x));
+			__m128i r1 = _mm_loadu_si128((const __m128i*)(row + srcW + x));
+			__m128i r2 = _mm_loadu_si128((const __m128i*)(row + 2*srcW + x));
+			__m128i r3 = _mm_loadu_si128((const __m128i*)(row + 3*srcW + x));
+			__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+			__m128i t1 = _mm_unpacklo_epi32(r2, r3);
+			__m128i t2 = _mm_unpackhi_epi32(r0, r1);
+			__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+			__m128i col[4] = { _mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1), _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3) };
+			for (int i = 0; i < 4; i++)
+			{
+				if (antiClockwise)
+					_mm_storeu_si128((__m128i*)(dst + (x+i)*dstW + (srcH-4-y)), _mm_shuffle_epi32(col[i], _MM_SHUFFLE(0, 1, 2, 3)));
+				else
+					_mm_storeu_si128((__m128i*)(dst + (srcW-1-x-i)*dstW + y), col[i]);
+			}
+
+			#else
+			uint32x4_t r0 = vld1q_u32((const uint32*)(row + x));
+			uint32x4_t r1 = vld1q_u32((const uint32*)(row + srcW + x));
+			uint32x4_t r2 = vld1q_u32((const uint32*)(row + 2*srcW + x));
+			uint32x4_t r3 = vld1q_u32((const uint32*)(row + 3*srcW + x));
+			uint32x4x2_t t01 = vtrnq_u32(r0, r1);
+			uint32x4x2_t t23 = vtrnq_u32(r2, r3);
+			uint32x4_t col[4] =
+			{
+				vcombine_u32(vget_low_u32(t01.val[0]), vget_low_u32(t23.val[0])),
+				vcombine_u32(vget_low_u32(t01.val[1]), vget_low_u32(t23.val[1])),
+				vcombine_u32(vget_high_u32(t01.val[0]), vget_high_u32(t23.val[0])),
+				vcombine_u32(vget_high_u32(t01.val[1]), vget_high_u32(t23.val[1]))
+			};
+			for (int i = 0; i < 4; i++)
+			{
+				if (antiClockwise)
+				{
+					uint32x4_t rev = vrev64q_u32(col[i]);
+					vst1q_u32((uint32*)(dst + (x+i)*dstW + (srcH-4-y)), vcombine_u32(vget_high_u32(rev), vget_low_u32(rev)));
+				}
+				else
+				{
+					vst1q_u32((uint32*)(dst + (srcW-1-x-i)*dstW + y), col[i]);
+				}
+			}
+			#endif
+		}
+
+		for (; x < x1; x++)
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				int dstIndex = antiClockwise ? (x*dstW + (srcH-1-y-j)) : ((srcW-1-x)*dstW + y+j);
+				dst[dstIndex] = src[(y+j)*srcW + x];
+			}
+		}
+	}
+	#endif
+
+	for (; y < y1; y++)
+	{
+		for (int x = x0; x < x1; x++)
+		{
+			int dstIndex = antiClockwise ? (x*dstW + (srcH-1-y)) : ((srcW-1-x)*dstW + y);
+			dst[dstIndex] = src[y*srcW + x];
+		}
+	}
+}
+
+
+void Viewer::ReverseRow(tPixel4b* dst, const tPixel4b* src, int w)
+{
+	int i = 0;
+	#if defined(PIXELVEC_SSE2)
+	for (; i + 4 <= w; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + w - 4 - i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3)));
+	}
+	#elif defined(PIXELVEC_NEON)
+	for (; i + 4 <= w; i += 4)
+	{
+		uint32x4_t rev = vrev64q_u32(vld1q_u32((const uint32*)(src + w - 4 - i)));
+		vst1q_u32((uint32*)(dst + i), vcombine_u32(vget_high_u32(rev), vget_low_u32(rev)));
+	}
+	#endif
+	for (; i < w; i++)
+		dst[i] = src[w-1-i];
+}
+
+
+void Viewer::Rotate90Set(const std::vector<tPicture*>& pictures, bool antiClockwise)
+{
+	// Tiles of every picture go into one list so a many-frame animation keeps all cores busy.
+	struct TransposeTile { int Job; int X0, Y0, X1, Y1; };
+	std::vector<tPicture*> jobs;
+	std::vector<tPixel4b*> outputs;
+	std::vector<TransposeTile> tiles;
+	int64 totalPixels = 0;
+	for (tPicture* picture : pictures)
+	{
+		if (!picture->IsValid())
+			continue;
+
+		int w = picture->GetWidth();
+		int h = picture->GetHeight();
+		int job = int(jobs.size());
+		jobs.push_back(picture);
+		outputs.push_back(new tPixel4b[w*h]);
+		for (int y = 0; y < h; y += TransposeTileSize)
+			for (int x = 0; x < w; x += TransposeTileSize)
+				tiles.push_back({ job, x, y, tMin(x + TransposeTileSize, w), tMin(y + TransposeTileSize, h) });
+		totalPixels += int64(w)*int64(h);
+	}
+
+	ForEachWorkItem
+	(
+		int(tiles.size()), totalPixels,
+		[&](int item)
+		{
+			const TransposeTile& tile = tiles[item];
+			tPicture* picture = jobs[tile.Job];
+			RotateTile90
+			(
+				picture->GetPixelPointer(), picture->GetWidth(), picture->GetHeight(), outputs[tile.Job],
+				tile.X0, tile.Y0, tile.X1, tile.Y1, antiClockwise
+			);
+		}
+	);
+
+	for (int j = 0; j < int(jobs.size()); j++)
+		SetKeepDuration(*jobs[j], jobs[j]->GetHeight(), jobs[j]->GetWidth(), outputs[j]);
+}
+
+
+void Viewer::FlipSet(const std::vector<tPicture*>& pictures, FlipMode mode)
+{
+	// A unit is one row for a horizontal flip and a pair of rows (y and h-1-y) otherwise. A half turn also has the
+	// middle row of an odd height as a unit of its own. Units are grouped into bands.
+	struct FlipBand { tPicture* Picture; int Unit0, Unit1; };
+	std::vector<FlipBand> bands;
+	int64 totalPixels = 0;
+	for (tPicture* picture : pictures)
+	{
+		if (!picture->IsValid())
+			continue;
+
+		int h = picture->GetHeight();
+		int numUnits = h;
+		if (mode == FlipMode::Vertical)
+			numUnits = h/2;
+		else if (mode == FlipMode::HalfTurn)
+			numUnits = (h+1)/2;
+
+		for (int u = 0; u < numUnits; u += FlipBandRows)
+			bands.push_back({ picture, u, tMin(u + FlipBandRows, numUnits) });
+		totalPixels += int64(picture->GetWidth())*int64(h);
+	}
+
+	ForEachWorkItem
+	(
+		int(bands.size()), totalPixels,
+		[&](int item)
+		{
+			const FlipBand& band = bands[item];
+			int w = band.Picture->GetWidth();
+			int h = band.Picture->GetHeight();
+			tPixel4b* pixels = band.Picture->GetPixelPointer();
+			std::vector<tPixel4b> temp(w);
+			size_t rowBytes = w*sizeof(tPixel4b);
+			for (int u = band.Unit0; u < band.Unit1; u++)
+			{
+				tPixel4b* a = pixels + u*w;
+				tPixel4b* b = pixels + (h-1-u)*w;
+				switch (mode)
+				{
+					case FlipMode::Horizontal:
+						ReverseRow(temp.data(), a, w);
+						tStd::tMemcpy(a, temp.data(), rowBytes);
+						break;
+
+					case FlipMode::Vertical:
+						tStd::tMemcpy(temp.data(), a, rowBytes);
+						tStd::tMemcpy(a, b, rowBytes);
+						tStd::tMemcpy(b, temp.data(), rowBytes);
+						break;
+
+					case FlipMode::HalfTurn:
+						ReverseRow(temp.data(), a, w);
+						if (a != b)
+							ReverseRow(a, b, w);
+						tStd::tMemcpy(b, temp.data(), rowBytes);
+						break;
+				}
+			}
+		}
+	);
+}
+
+
+std::vector<tPicture*> Viewer::GetPictureSet(const tList<tPicture>& pictures)
+{
+	std::vector<tPicture*> set;
+	for (tPicture* picture = pictures.First(); picture; picture = picture->Next())
+		set.push_back(picture);
+	return set;
+}
+
+
+void Viewer::Rotate90Pictures(const tList<tPicture>& pictures, bool antiClockwise)
+{
+	Rotate90Set(GetPictureSet(pictures), antiClockwise);
+}
+
+
+void Viewer::Rotate180Pictures(const tList<tPicture>& pictures)
+{
+	FlipSet(GetPictureSet(pictures), FlipMode::HalfTurn);
+}
+
+
+void Viewer::FlipPictures(const tList<tPicture>& pictures, bool horizontal)
+{
+	FlipSet(GetPictureSet(pictures), horizontal ? FlipMode::Horizontal : FlipMode::Vertical);
+}
+
+
+void Viewer::GetRotatedSize(int width, int height, float angle, int& rotW, int& rotH)
+{
+	// The small bias keeps exact fits (like 90 degrees with float error) from gaining a column or row.
+	float c = tAbs(tCos(angle));
+	float s = tAbs(tSin(angle));
+	rotW = tMax(1, int(tCeiling(float(width)*c + float(height)*s - 0.001f)));
+	rotH = tMax(1, int(tCeiling(float(width)*s + float(height)*c - 0.001f)));
+}
+
+
+void Viewer::GetRotateCropSize(int origW, int origH, int rotW, int rotH, int& cropW, int& cropH, int& resizeW, int& resizeH)
+{
+	// Since rectangles are made of lines and there is symmetry we can compute the reduced size by subtracting the
+	// original size from the rotated size. If the rotation is mostly vertical the reciprocal aspect is kept.
+	bool aspectFlip = ((origW > origH) && (rotW < rotH)) || ((origW < origH) && (rotW > rotH));
+	if (aspectFlip)
+		tStd::tSwap(origW, origH);
+
+	int dx = rotW - origW;
+	int dy = rotH - origH;
+	cropW = origW - dx;
+	cropH = origH - dy;
+
+	if (dx > origW/2)
+	{
+		cropW = origW - origW/2;
+		cropH = (cropW*origH)/origW;
+	}
+	else if (dy > origH/2)
+	{
+		cropH = origH - origH/2;
+		cropW = (cropH*origW)/origH;
+	}
+
+	// This has been tested with a 1x1 input and results correctly in (1,1).
+	cropW = tClamp(cropW, 1, rotW);
+	cropH = tClamp(cropH, 1, rotH);
+	resizeW = origW;
+	resizeH = origH;
+}
+
+
+template<Viewer::RotateKernel K> void Viewer::RotateTileRows(const RotateJob& job, const RotateTile& tile, const tColour4b& fill)
+{
+	Vec4 fillVec = VLoad(fill);
+	for (int y = tile.Y0; y < tile.Y1; y++)
+	{
+		float rowX = job.OriginX + float(y)*job.StepYx + float(tile.X0)*job.StepXx;
+		float rowY = job.OriginY + float(y)*job.StepYy + float(tile.X0)*job.StepXy;
+		tPixel4b* dst = job.Dst + y*job.DstW;
+		for (int x = tile.X0; x < tile.X1; x++)
+		{
+			// Computed from the row start each time rather than accumulated so error does not build along the row.
+			float i = float(x - tile.X0);
+			float sx = rowX + i*job.StepXx;
+			float sy = rowY + i*job.StepXy;
+
+			if constexpr (K == RotateKernel::Nearest)
+			{
+				int ix = int(std::floor(sx));
+				int iy = int(std::floor(sy));
+				bool inside = (unsigned(ix) < unsigned(job.SrcW)) && (unsigned(iy) < unsigned(job.SrcH));
+				dst[x] = inside ? job.Src[iy*job.SrcW + ix] : fill;
+			}
+			else if constexpr (K == RotateKernel::Bilinear)
+			{
+				float fx = sx - 0.5f;
+				float fy = sy - 0.5f;
+				float flx = std::floor(fx);
+				float fly = std::floor(fy);
+				int x0 = int(flx);
+				int y0 = int(fly);
+				if ((x0 < -1) || (x0 >= job.SrcW) || (y0 < -1) || (y0 >= job.SrcH))
+				{
+					dst[x] = fill;
+					continue;
+				}
+				float tx = fx - flx;
+				float ty = fy - fly;
+				Vec4 bottom	= VLerp(VTap(job, x0, y0,   fillVec), VTap(job, x0+1, y0,   fillVec), tx);
+				Vec4 top	= VLerp(VTap(job, x0, y0+1, fillVec), VTap(job, x0+1, y0+1, fillVec), tx);
+				VStore(dst[x], VLerp(bottom, top, ty));
+			}
+			else
+			{
+				float fx = sx - 0.5f;
+				float fy = sy - 0.5f;
+				float flx = std::floor(fx);
+				float fly = std::floor(fy);
+				int x0 = int(flx);
+				int y0 = int(fly);
+				if ((x0 < -2) || (x0 > job.SrcW) || (y0 < -2) || (y0 > job.SrcH))
+				{
+					dst[x] = fill;
+					continue;
+				}
+				float wx[4], wy[4];
+				CubicWeights(fx - flx, wx);
+				CubicWeights(fy - fly, wy);
+				Vec4 sum = VSplat(0.0f);
+				for (int j = 0; j < 4; j++)
+				{
+					int ty = y0 - 1 + j;
+					Vec4 row = VMul(VTap(job, x0-1, ty, fillVec), VSplat(wx[0]));
+					row = VAdd(row, VMul(VTap(job, x0,   ty, fillVec), VSplat(wx[1])));
+					row = VAdd(row, VMul(VTap(job, x0+1, ty, fillVec), VSplat(wx[2])));
+					row = VAdd(row, VMul(VTap(job, x0+2, ty, fillVec), VSplat(wx[3])));
+					sum = VAdd(sum, VMul(row, VSplat(wy[j])));
+				}
+				VStore(dst[x], sum);
+			}
+		}
+	}
+}
+
+
+void Viewer::RotateTileRows(const RotateJob& job, const RotateTile& tile, RotateKernel kernel, const tColour4b& fill)
+{
+	switch (kernel)
+	{
+		case RotateKernel::Nearest:		RotateTileRows<RotateKernel::Nearest>(job, tile, fill);		break;
+		case RotateKernel::Bilinear:	RotateTileRows<RotateKernel::Bilinear>(job, tile, fill);	break;
+		case RotateKernel::Bicubic:		RotateTileRows<RotateKernel::Bicubic>(job, tile, fill);		break;
+	}
+}
+
+
+bool Viewer::RotatePictureSet
+(
+	const std::vector<tPicture*>& pictures, float angle, const tColour4b& fill, tResampleFilter filter,
+	RotateFit fit, const std::atomic<bool>* cancel, std::atomic<float>* progress
+)
+{
+	if (progress)
+		*progress = 0.0f;
+
+	// Exact quarter turns are a reordering of the pixels. The fits change nothing since the rotated rectangle has
+	// no corners to fill or crop.
+	int quarters = 0;
+	if (IsExactQuarterTurn(angle, quarters))
+	{
+		if (cancel && *cancel)
+			return false;
+		switch (quarters)
+		{
+			case 1:		Rotate90Set(pictures, true);				break;
+			case 2:		FlipSet(pictures, FlipMode::HalfTurn);		break;
+			case 3:		Rotate90Set(pictures, false);				break;
+		}
+		if (progress)
+			*progress = 1.0f;
+		return true;
+	}
+
+	// Inverse mapping. Pictures are stored bottom row first so y is up and a positive angle is anti-clockwise.
+	// A destination offset d maps to source offset R(-angle) d.
+	float c = tCos(angle);
+	float s = tSin(angle);
+	RotateKernel kernel = GetRotateKernel(filter);
+
+	std::vector<RotateJob> jobs;
+	std::vector<RotateTile> tiles;
+	std::vector<int> resizeW, resizeH;
+	int64 totalPixels = 0;
+	for (tPicture* picture : pictures)
+	{
+		if (!picture->IsValid())
+			continue;
+
+		int srcW = picture->GetWidth();
+		int srcH = picture->GetHeight();
+		int rotW, rotH;
+		GetRotatedSize(srcW, srcH, angle, rotW, rotH);
+
+		// The crop fits only render the part that survives the crop. The window is placed like a middle anchored
+		// crop of the full rotation would place it.
+		int dstW = rotW, dstH = rotH;
+		int rsW = 0, rsH = 0;
+		if (fit != RotateFit::Fill)
+		{
+			GetRotateCropSize(srcW, srcH, rotW, rotH, dstW, dstH, rsW, rsH);
+			if (fit == RotateFit::Crop)
+				rsW = rsH = 0;
+		}
+		int cropX = (rotW - dstW) / 2;
+		int cropY = (rotH - dstH) / 2;
+
+		RotateJob job;
+		job.Picture		= picture;
+		job.Src			= picture->GetPixelPointer();
+		job.SrcW		= srcW;
+		job.SrcH		= srcH;
+		job.Dst			= new tPixel4b[dstW*dstH];
+		job.DstW		= dstW;
+		job.DstH		= dstH;
+
+		float dx = float(cropX) + 0.5f - 0.5f*float(rotW);
+		float dy = float(cropY) + 0.5f - 0.5f*float(rotH);
+		job.OriginX		= 0.5f*float(srcW) + c*dx + s*dy;
+		job.OriginY		= 0.5f*float(srcH) - s*dx + c*dy;
+		job.StepXx		= c;	job.StepXy		= -s;
+		job.StepYx		= s;	job.StepYy		= c;
+
+		int jobIndex = int(jobs.size());
+		jobs.push_back(job);
+		resizeW.push_back(rsW);
+		resizeH.push_back(rsH);
+		for (int y = 0; y < dstH; y += RotateTileSize)
+			for (int x = 0; x < dstW; x += RotateTileSize)
+				tiles.push_back({ jobIndex, x, y, tMin(x + RotateTileSize, dstW), tMin(y + RotateTileSize, dstH) });
+		totalPixels += int64(dstW)*int64(dstH);
+	}
+
+	// Workers pull tiles from a shared counter so pictures of different sizes balance across cores.
+	int numTiles = int(tiles.size());
+	std::atomic<int> nextTile = 0;
+	std::atomic<int> tilesDone = 0;
+	auto worker = [&]()
+	{
+		for (int t = nextTile++; t < numTiles; t = nextTile++)
+		{
+			if (cancel && *cancel)
+				return;
+			const RotateTile& tile = tiles[t];
+			RotateTileRows(jobs[tile.Job], tile, kernel, fill);
+			int done = ++tilesDone;
+			if (progress)
+				*progress = float(done) / float(numTiles);
+		}
+	};
+
+	int numThreads = (totalPixels < RotateMinParallelPixels) ? 1 : tClamp(tSystem::tGetNumCores(), 1, numTiles);
+	std::vector<std::thread> workers;
+	for (int w = 1; w < numThreads; w++)
+		workers.emplace_back(worker);
+	worker();
+	for (std::thread& w : workers)
+		w.join();
+
+	if (cancel && *cancel)
+	{
+		for (RotateJob& job : jobs)
+			delete[] job.Dst;
+		return false;
+	}
+
+	for (int j = 0; j < int(jobs.size()); j++)
+	{
+		RotateJob& job = jobs[j];
+		SetKeepDuration(*job.Picture, job.DstW, job.DstH, job.Dst);
+		if ((resizeW[j] > 0) && ((resizeW[j] != job.DstW) || (resizeH[j] != job.DstH)))
+		{
+			tResampleFilter resizeFilter = (filter != tResampleFilter::None) ? filter : tResampleFilter::Nearest;
+			ResamplePicture(*job.Picture, resizeW[j], resizeH[j], resizeFilter, tResampleEdgeMode::Clamp);
+		}
+	}
+
+	if (progress)
+		*progress = 1.0f;
+	return true;
+}
+
+
+bool Viewer::RotatePictures
+(
+	const tList<tPicture>& pictures, float angle, const tColour4b& fill, tResampleFilter filter,
+	RotateFit fit, const std::atomic<bool>* cancel, std::atomic<float>* progress
+)
+{
+	return RotatePictureSet(GetPictureSet(pictures), angle, fill, filter, fit, cancel, progress);
+}
+
+
+bool Viewer::RotatePicture(tPicture& picture, float angle, const tColour4b& fill, tResampleFilter filter, RotateFit fit)
+{
+	return RotatePictureSet({ &picture }, angle, fill, filter, fit, nullptr, nullptr);
+}
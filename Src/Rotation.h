@@ -0,0 +1,55 @@
+// Rotation.h
+//
+// Arbitrary angle picture rotation. Every destination pixel is inverse mapped into the source and sampled with a
+// nearest, bilinear, or bicubic kernel. The destination is split into tiles that are spread over all cores, and the
+// tiles of every picture go into the same pool so multi-frame images keep all cores busy. Exact multiples of 90
+// degrees skip resampling entirely and use tiled, parallel transposes, as do flips.
+//
+// Copyright (c) 2024 Tristan Grimmer.
+// Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
+// granted, provided that the above copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+// AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+
+#pragma once
+#include <atomic>
+#include <Foundation/tList.h>
+#include <Image/tPicture.h>
+#include <Image/tResample.h>
+
+
+namespace Viewer
+{
+	// Fill keeps every source pixel and uses the fill colour for the corners. Crop removes the corners so no fill is
+	// needed. CropResize is Crop followed by a resample back to the original size (or the reciprocal aspect if the
+	// rotation is mostly vertical).
+	enum class RotateFit { Fill, Crop, CropResize };
+
+	// Rotates every picture about its centre. The angle is in radians, positive is anti-clockwise. Nearest and None
+	// use nearest neighbour (preserves colours), Box and Bilinear use bilinear, and every other filter uses a
+	// Catmull-Rom bicubic. The filter is also used for the CropResize resample (Nearest if None). Frame durations are
+	// kept. Returns false if cancel became true, in which case the pictures are unchanged. Progress, if supplied, is
+	// set in [0, 1].
+	bool RotatePictures
+	(
+		const tList<tImage::tPicture>&, float angle, const tColour4b& fill, tImage::tResampleFilter,
+		RotateFit = RotateFit::Fill, const std::atomic<bool>* cancel = nullptr, std::atomic<float>* progress = nullptr
+	);
+	bool RotatePicture(tImage::tPicture&, float angle, const tColour4b& fill, tImage::tResampleFilter, RotateFit = RotateFit::Fill);
+
+	// Exact transforms of every picture. These only move pixels. The tiles (or rows) of all the pictures are spread
+	// over all cores, and quarter turns transpose 4x4 blocks in SSE2 or NEON registers.
+	void Rotate90Pictures(const tList<tImage::tPicture>&, bool antiClockwise);
+	void Rotate180Pictures(const tList<tImage::tPicture>&);
+	void FlipPictures(const tList<tImage::tPicture>&, bool horizontal);
+
+	// The size of a rotated picture before any crop. This is the bounding box of the rotated rectangle.
+	void GetRotatedSize(int width, int height, float angle, int& rotW, int& rotH);
+
+	// The crop size for the crop fits given the original and rotated sizes, and the size CropResize resamples to.
+	void GetRotateCropSize(int origW, int origH, int rotW, int rotH, int& cropW, int& cropH, int& resizeW, int& resizeH);
+}
@@ -60,12 +60,19 @@
 #include "Quantize.h"
 #include "Resize.h"
 #include "Rotate.h"
+#include "EditTask.h"
+#include "CostModel.h"
 #include "OpenSaveDialogs.h"
 #include "Config.h"
 #include "InputBindings.h"
 #include "Command.h"
+#include "Replay.h"
+#include "Daemon.h"
 #include "RobotoFontBase85.cpp"
 #include "Version.cmake.h"
+#ifdef TACENTVIEW_BENCH
+#include "Bench.h"
+#endif
 using namespace tStd;
 using namespace tSystem;
 using namespace tMath;
@@ -76,11 +83,19 @@ namespace Viewer
 	// These are the basic options available when starting the viewer. When in CLI mode there are many more in use that
 	// can be seen in the Command.cpp module. OptionCLI and OptionHelp are the only two that turn in the CLI mode.
 	// The OptionProfile is the only control option for GUI mode -- useful, for example, for launchin the GUI in the
-	// kiosk profile regardless of the last used profile stored in the config file.
+	// kiosk profile regardless of the last used profile stored in the config file. The replay options run a headless
+	// navigation script for latency benchmarking (see Replay.h). The daemon and client options run CLI jobs in a
+	// persistent process (see Daemon.h).
 	tCmdLine::tParam  ParamImageFiles	("Files to open",												"ImageFiles",			0,	true	);
 	tCmdLine::tOption OptionProfile		("Launch GUI with the specified profile active.",				"profile",		'p',	1			);
 	tCmdLine::tOption OptionCLI			("Use command line mode (required when using CLI)",				"cli",			'c'					);
 	tCmdLine::tOption OptionHelp		("Help on usage",												"help",			'h',	0,	true	);
+	tCmdLine::tOption OptionReplay		("Run a headless navigation replay script",						"replay",				1			);
+	tCmdLine::tOption OptionReplayOut	("Replay JSON report file",										"replayout",			1			);
+	tCmdLine::tOption OptionReplayNoGL	("Replay with stubbed GL even if a context is available",		"replaynogl"						);
+	tCmdLine::tOption OptionDaemon		("Serve CLI jobs on the specified Unix socket",					"daemon",				1			);
+	tCmdLine::tOption OptionDaemonJobs	("Max concurrent daemon jobs. Default is the number of cores",	"daemonjobs",			1			);
+	tCmdLine::tOption OptionClient		("Send this CLI job to the daemon on the specified socket",		"client",				1			);
 
 	tFileTypes FileTypes_Load
 	(
@@ -269,6 +284,8 @@ namespace Viewer
 	bool Request_SnapMessage_NoFrameTrans			= false;
 	bool Request_Quit								= false;
 	bool Request_CropLineConstrain					= false;
+	bool Request_FocusRescan						= false;		// Deferred while an edit task or extraction runs.
+	tString Request_DroppedFile;									// Deferred while an edit task or extraction runs.
 	Anchor Request_PanSnap							= Anchor::Invalid;
 	LosslessTransformMode Request_LosslessTrnsModal	= LosslessTransformMode::None;
 	bool BindingsWindowJustOpened					= false;
@@ -793,6 +810,10 @@ void Viewer::PopulateImagesSubDirs()
 
 void Viewer::PopulateImages()
 {
+	// Every image is destroyed below. A running edit task may commit to one of them and frame extraction reads the
+	// current one, so both are cancelled first.
+	CancelEditTask();
+	CancelExtractFrames();
 	Images.Clear();
 	ImagesLoadTimeSorted.Clear();
 
@@ -945,8 +966,8 @@ void Viewer::LoadCurrImage(bool forceReload)
 			{
 				Image* i = iter.GetObject();
 
-				// Never unload the current image.
-				if (i->IsLoaded() && (i != CurrImage))
+				// Never unload the current image or one an edit task will commit to.
+				if (i->IsLoaded() && (i != CurrImage) && !IsEditTaskTarget(i))
 				{
 					tPrintf("Unloading %s freeing %d Bytes\n", tSystem::tGetFileName(i->Filename).Chr(), i->Info.MemSizeBytes);
 					usedMem -= i->Info.MemSizeBytes;
@@ -2670,6 +2691,9 @@ int Viewer::DoMainMenuBar()
 	DoQuantizeModal					(quantizePressed);
 	DoLosslessTransformModal		(losslessTransformPressed);
 
+	// Progress for long edits running in the background. This comes after the edit modals since they start the tasks.
+	DoEditTaskModal();
+
 	return menuBarHeight;
 }
 
@@ -2926,6 +2950,24 @@ void Viewer::Update(GLFWwindow* window, double dt, bool dopoll)
 	if (dopoll)
 		glfwPollEvents();
 
+	// File drops and focus rescans that arrived while an edit task or frame extraction was running. A drop repopulates
+	// anyway.
+	if (!IsEditTaskRunning() && !IsExtractingFrames() && (Request_DroppedFile.IsValid() || Request_FocusRescan))
+	{
+		tString droppedFile = Request_DroppedFile;
+		Request_DroppedFile.Clear();
+		Request_FocusRescan = false;
+		if (droppedFile.IsValid())
+		{
+			const char* files[] = { droppedFile.Chr() };
+			FileDropCallback(window, 1, files);
+		}
+		else
+		{
+			FocusCallback(window, 1);
+		}
+	}
+
 	Config::ProfileData& profile = Config::GetProfileData();
 	if (Config::Global.TransparentWorkArea)
 		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
@@ -3103,8 +3145,9 @@ void Viewer::Update(GLFWwindow* window, double dt, bool dopoll)
 		if ((profile.BackgroundExtend || profile.Tile) && !CropMode)
 			DrawBackground(0.0f, draww, 0.0f, drawh, draww, drawh);
 
-		// There is no point drawing the background if the image is completely opaque.
-		else if (!CurrImage->IsOpaque())
+		// There is no point drawing the background if the image is completely opaque. Until opacity is known the
+		// background is drawn.
+		else if (CurrImage->GetOpacity() != Image::ImgInfo::OpacityEnum::True)
 			DrawBackground(left, right, bottom, top, draww, drawh);
 
 		glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
@@ -3905,8 +3948,9 @@ void Viewer::KeyCallback(GLFWwindow* window, int key, int scancode, int action,
 		return;
 	}
 
-	// IsPopupOpen ignores str_id if ImGuiPopupFlags_AnyPopupId set.
-	if (ImGui::IsPopupOpen(nullptr, ImGuiPopupFlags_AnyPopupId | ImGuiPopupFlags_AnyPopupLevel))
+	// IsPopupOpen ignores str_id if ImGuiPopupFlags_AnyPopupId set. Edit tasks show a modal but we check them
+	// explicitly since a task may have started before its modal is open.
+	if (ImGui::IsPopupOpen(nullptr, ImGuiPopupFlags_AnyPopupId | ImGuiPopupFlags_AnyPopupLevel) || IsEditTaskRunning())
 		return;
 
 	switch (operation)
@@ -4081,7 +4125,14 @@ void Viewer::FileDropCallback(GLFWwindow* window, int count, const char** files)
 	if (count < 1)
 		return;
 
+	// Repopulating would cancel a running edit task or frame extraction. The drop is handled by Update once it is done.
 	tString file = tString(files[0]);
+	if (IsEditTaskRunning() || IsExtractingFrames())
+	{
+		Request_DroppedFile = file;
+		return;
+	}
+
 	ImageToLoad = file;
 	PopulateImages();
 	SetCurrentImage(file);
@@ -4093,6 +4144,13 @@ void Viewer::FocusCallback(GLFWwindow* window, int gotFocus)
 	if (!gotFocus)
 		return;
 
+	// As with file drops, the rescan waits for any running edit task or frame extraction.
+	if (IsEditTaskRunning() || IsExtractingFrames())
+	{
+		Request_FocusRescan = true;
+		return;
+	}
+
 	// If we got focus, rescan the current folder to see if the hash is different.
 	tList<tSystem::tFileInfo> files;
 	ImagesDir = FindImagesInImageToLoadDir(files);
@@ -4256,11 +4314,27 @@ int main(int argc, char** argv)
 
 	tCmdLine::tParse(argc, argv);
 
+	// The benchmark executable shares main with the viewer but never opens a window.
+	#ifdef TACENTVIEW_BENCH
+	return Bench::Run();
+	#endif
+
+	if (Viewer::OptionDaemon)
+		return Daemon::Serve(Viewer::OptionDaemon.Arg1(), Viewer::OptionDaemonJobs ? Viewer::OptionDaemonJobs.Arg1().AsInt32() : 0);
+
+	#ifdef PLATFORM_LINUX
+	if (Viewer::OptionClient)
+		return Daemon::Submit(Viewer::OptionClient.Arg1(), argc, argv);
+	#endif
+
 	// To run in CLI mode you must set the cli option from the command line.
 	// You can do this with --cli or -c
 	if (Viewer::OptionCLI || Viewer::OptionHelp)
 		return Command::Process();
 
+	if (Viewer::OptionReplay)
+		return Replay::Run(Viewer::OptionReplay.Arg1(), Viewer::OptionReplayOut ? Viewer::OptionReplayOut.Arg1() : tString(), Viewer::OptionReplayNoGL);
+
 	tSystem::tSetSupplementaryDebuggerOutput();
 	tSystem::tSetStdoutRedirectCallback(Viewer::PrintRedirectCallback);
 
@@ -4642,7 +4716,11 @@ int main(int argc, char** argv)
 
 	// This is important. We need the destructors to run BEFORE we shutdown GLFW. Deconstructing the images may block for a bit while shutting
 	// down worker threads. We could show a 'shutting down' popup here if we wanted -- if Image::ThumbnailNumThreadsRunning is > 0.
+	Viewer::CancelEditTask();
+	Viewer::CancelExtractFrames();
+	Viewer::CostModel::WaitForCalibration();
 	Viewer::Images.Clear();
+	Undo::Shutdown();
 	Viewer::UnloadAppImages();
 
 	// Get current window geometry and set in config file if we're not in fullscreen mode and not iconified.
@@ -39,6 +39,7 @@ namespace Viewer
 		ErrorCode_CLI_FailImageProcess		= 120,
 		ErrorCode_CLI_FailEarlyExit			= 130,
 		ErrorCode_CLI_FailImageSave			= 140,
+		ErrorCode_CLI_FailRecipeFile		= 150,
 	};
 
 	enum class Anchor
@@ -3,7 +3,7 @@
 // An undo stack object that each image can use. Undo::Step is the type of object that may be pushed onto the
 // stack. Undo namespace functions provide an overall interface for setting and querying things like memory use.
 //
-// Copyright (c) 2021-2023 Tristan Grimmer.
+// Copyright (c) 2021-2024 Tristan Grimmer.
 // Permission to use, copy, modify, and/or distribute this software for any purpose with or without fee is hereby
 // granted, provided that the above copyright notice and this permission notice appear in all copies.
 //
@@ -13,6 +13,14 @@
 // AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
 // PERFORMANCE OF THIS SOFTWARE.
 
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <fstream>
+#include <condition_variable>
+#include <unordered_set>
+#include <map>
+#include <chrono>
 #include "Undo.h"
 #include "Image.h"
 #include "Config.h"
@@ -22,26 +30,719 @@ using namespace tSystem;
 using namespace tImage;
 
 
-Undo::Step_PictureList::Step_PictureList(const tString& desc, bool dirty, const tList<tImage::tPicture>& pics) :
+namespace Undo
+{
+	std::atomic<int64> ResidentBytes					= 0;
+	std::atomic<int64> SpilledBytes						= 0;
+
+	// Run-length packing of 32-bit pixels. Each run starts with a 16-bit header. If the top bit is set the header
+	// count is the number of repeats of the single pixel that follows. Otherwise count literal pixels follow. This is
+	// very fast and does well on flat regions, masks, and edits like fills. Photographic tiles usually do not pack
+	// and go straight to the spill file when over budget.
+	const int MaxRun									= 0x7FFF;
+	void PackPixels(const tPixel4b* pixels, int numPixels, std::vector<uint8>& packed);
+	bool UnpackPixels(const uint8* packed, int packedSize, tPixel4b* pixels, int numPixels);
+
+	// The spill file lives in the cache directory and is shared by all images. Released extents go on a free list,
+	// coalesced with their neighbours, and new writes take the first free extent that fits before appending. A free
+	// extent that reaches the end pulls the end back. The file therefore stays around the peak number of live spilled
+	// bytes rather than growing with every spill.
+	struct SpillFile
+	{
+		std::mutex Mutex;
+		std::fstream Stream;
+		tString Filename;
+		int64 End										= 0;
+		int NumTiles									= 0;
+		std::map<int64, int64> FreeExtents;			// Offset to size. Adjacent extents are always merged.
+		bool Failed										= false;
+	};
+	SpillFile* Spill									= nullptr;
+	std::mutex SpillCreateMutex;
+	SpillFile* GetSpillFile();
+	int64 SpillWrite(const uint8* data, int size);
+	bool SpillRead(int64 offset, uint8* data, int size);
+	void SpillRelease(int64 offset, int size);
+
+	// These two are called with the spill mutex held.
+	int64 SpillAllocate(SpillFile&, int size);
+	void SpillFree(SpillFile&, int64 offset, int64 size);
+
+	// The background worker packs and spills. Jobs hold references to the tiles so steps may be deleted while a job
+	// for them is waiting or running.
+	struct MaintenanceJob
+	{
+		const void* Owner;
+		std::vector< std::vector<TileRef> > UndoSteps;		// Newest first.
+		std::vector< std::vector<TileRef> > RedoSteps;		// Nearest first.
+		int64 ImageBudget;
+		int64 GlobalBudget;
+	};
+	struct MaintenanceWorker
+	{
+		std::mutex Mutex;
+		std::condition_variable Wake;
+		std::deque<MaintenanceJob*> Jobs;
+		std::thread Thread;
+		bool Quit										= false;
+	};
+	MaintenanceWorker* Worker							= nullptr;
+	void RunMaintenanceWorker();
+	void RunMaintenanceJob(MaintenanceJob&);
+}
+
+
+void Undo::PackPixels(const tPixel4b* pixels, int numPixels, std::vector<uint8>& packed)
+{
+	packed.clear();
+	auto writeHeader = [&packed](uint16 header)
+	{
+		packed.push_back(uint8(header & 0xFF));
+		packed.push_back(uint8(header >> 8));
+	};
+
+	int p = 0;
+	while (p < numPixels)
+	{
+		// Measure the run of identical pixels starting here.
+		int run = 1;
+		while ((p+run < numPixels) && (run < MaxRun) && (pixels[p+run] == pixels[p]))
+			run++;
+
+		if (run >= 2)
+		{
+			writeHeader(uint16(0x8000 | run));
+			const uint8* bytes = (const uint8*)&pixels[p];
+			packed.insert(packed.end(), bytes, bytes + sizeof(tPixel4b));
+			p += run;
+			continue;
+		}
+
+		// Literals continue until the next pair of identical pixels.
+		int lit = 1;
+		while ((p+lit < numPixels) && (lit < MaxRun) && !((p+lit+1 < numPixels) && (pixels[p+lit] == pixels[p+lit+1])))
+			lit++;
+		writeHeader(uint16(lit));
+		const uint8* bytes = (const uint8*)&pixels[p];
+		packed.insert(packed.end(), bytes, bytes + lit*sizeof(tPixel4b));
+		p += lit;
+	}
+}
+
+
+bool Undo::UnpackPixels(const uint8* packed, int packedSize, tPixel4b* pixels, int numPixels)
+{
+	int pos = 0;
+	int p = 0;
+	while ((pos + 2 <= packedSize) && (p < numPixels))
+	{
+		uint16 header = uint16(packed[pos]) | (uint16(packed[pos+1]) << 8);
+		pos += 2;
+		int count = header & MaxRun;
+		if (p + count > numPixels)
+			return false;
+
+		if (header & 0x8000)
+		{
+			if (pos + int(sizeof(tPixel4b)) > packedSize)
+				return false;
+			tPixel4b pixel;
+			tMemcpy(&pixel, packed + pos, sizeof(tPixel4b));
+			pos += sizeof(tPixel4b);
+			for (int i = 0; i < count; i++)
+				pixels[p++] = pixel;
+		}
+		else
+		{
+			int numBytes = count*sizeof(tPixel4b);
+			if (pos + numBytes > packedSize)
+				return false;
+			tMemcpy(pixels + p, packed + pos, numBytes);
+			pos += numBytes;
+			p += count;
+		}
+	}
+	return (p == numPixels);
+}
+
+
+Undo::SpillFile* Undo::GetSpillFile()
+{
+	std::lock_guard<std::mutex> lock(SpillCreateMutex);
+	if (Spill)
+		return Spill->Failed ? nullptr : Spill;
+
+	Spill = new SpillFile;
+	if (Viewer::Image::ThumbCacheDir.IsEmpty())
+	{
+		Spill->Failed = true;
+		return nullptr;
+	}
+
+	uint32 unique = uint32(std::chrono::system_clock::now().time_since_epoch().count()) ^ uint32(uintptr_t(Spill));
+	tsPrintf(Spill->Filename, "%sUndoSpill_%08X.bin", Viewer::Image::ThumbCacheDir.Chr(), unique);
+	Spill->Stream.open(Spill->Filename.Chr(), std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!Spill->Stream.is_open())
+	{
+		tPrintf("Warning: Undo spill file %s could not be created. Undo memory budgets are not enforced.\n", Spill->Filename.Chr());
+		Spill->Failed = true;
+		return nullptr;
+	}
+	return Spill;
+}
+
+
+int64 Undo::SpillWrite(const uint8* data, int size)
+{
+	SpillFile* spill = GetSpillFile();
+	if (!spill)
+		return -1;
+
+	std::lock_guard<std::mutex> lock(spill->Mutex);
+	int64 offset = SpillAllocate(*spill, size);
+	spill->Stream.seekp(offset);
+	spill->Stream.write((const char*)data, size);
+	if (!spill->Stream.good())
+	{
+		spill->Stream.clear();
+		SpillFree(*spill, offset, size);
+		return -1;
+	}
+
+	spill->NumTiles++;
+	SpilledBytes += size;
+	return offset;
+}
+
+
+bool Undo::SpillRead(int64 offset, uint8* data, int size)
+{
+	SpillFile* spill = GetSpillFile();
+	if (!spill)
+		return false;
+
+	std::lock_guard<std::mutex> lock(spill->Mutex);
+	spill->Stream.seekg(offset);
+	spill->Stream.read((char*)data, size);
+	bool ok = spill->Stream.good();
+	spill->Stream.clear();
+	return ok;
+}
+
+
+void Undo::SpillRelease(int64 offset, int size)
+{
+	SpillFile* spill = GetSpillFile();
+	if (!spill)
+		return;
+
+	std::lock_guard<std::mutex> lock(spill->Mutex);
+	SpilledBytes -= size;
+	spill->NumTiles--;
+	if (spill->NumTiles <= 0)
+	{
+		spill->NumTiles = 0;
+		spill->End = 0;
+		spill->FreeExtents.clear();
+		return;
+	}
+
+	SpillFree(*spill, offset, size);
+}
+
+
+int64 Undo::SpillAllocate(SpillFile& spill, int size)
+{
+	// First fit. Whatever is left of the extent stays free.
+	for (auto it = spill.FreeExtents.begin(); it != spill.FreeExtents.end(); ++it)
+	{
+		if (it->second < size)
+			continue;
+
+		int64 offset = it->first;
+		int64 remaining = it->second - size;
+		spill.FreeExtents.erase(it);
+		if (remaining > 0)
+			spill.FreeExtents[offset + size] = remaining;
+		return offset;
+	}
+
+	int64 offset = spill.End;
+	spill.End += size;
+	return offset;
+}
+
+
+void Undo::SpillFree(SpillFile& spill, int64 offset, int64 size)
+{
+	// Merge with the following and preceding free extents.
+	auto next = spill.FreeExtents.lower_bound(offset);
+	if ((next != spill.FreeExtents.end()) && (next->first == offset + size))
+	{
+		size += next->second;
+		next = spill.FreeExtents.erase(next);
+	}
+	if (next != spill.FreeExtents.begin())
+	{
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset)
+		{
+			offset = prev->first;
+			size += prev->second;
+			spill.FreeExtents.erase(prev);
+		}
+	}
+
+	// A free extent at the end just moves the end back. The file itself keeps its size since fstream cannot truncate,
+	// but the space is written over before the file grows again.
+	if (offset + size == spill.End)
+		spill.End = offset;
+	else
+		spill.FreeExtents[offset] = size;
+}
+
+
+void Undo::Shutdown()
+{
+	if (Worker)
+	{
+		{
+			std::lock_guard<std::mutex> lock(Worker->Mutex);
+			Worker->Quit = true;
+			for (MaintenanceJob* job : Worker->Jobs)
+				delete job;
+			Worker->Jobs.clear();
+		}
+		Worker->Wake.notify_all();
+		if (Worker->Thread.joinable())
+			Worker->Thread.join();
+		delete Worker;
+		Worker = nullptr;
+	}
+
+	// Tiles still alive after this simply lose access to their spilled pixels, which is fine at exit.
+	std::lock_guard<std::mutex> lock(SpillCreateMutex);
+	if (Spill && !Spill->Failed)
+	{
+		Spill->Stream.close();
+		tSystem::tDeleteFile(Spill->Filename);
+		Spill->Failed = true;
+	}
+}
+
+
+int64 Undo::GetResidentBytes()
+{
+	return ResidentBytes;
+}
+
+
+int64 Undo::GetSpilledBytes()
+{
+	return SpilledBytes;
+}
+
+
+Undo::Tile::Tile(int width, int height) :
+	Width(width),
+	Height(height),
+	Pixels(new tPixel4b[width*height])
+{
+	ResidentBytes += Width*Height*sizeof(tPixel4b);
+}
+
+
+Undo::Tile::~Tile()
+{
+	FreeResident();
+	if (SpillOffset >= 0)
+		SpillRelease(SpillOffset, SpillSize);
+}
+
+
+void Undo::Tile::FreeResident()
+{
+	if (Pixels)
+		ResidentBytes -= Width*Height*sizeof(tPixel4b);
+	if (Packed)
+		ResidentBytes -= PackedSize;
+	delete[] Pixels;
+	delete[] Packed;
+	Pixels = nullptr;
+	Packed = nullptr;
+	PackedSize = 0;
+}
+
+
+const tPixel4b* Undo::Tile::Acquire()
+{
+	Mutex.lock();
+	if (Pixels)
+		return Pixels;
+
+	int numPixels = Width*Height;
+	tPixel4b* pixels = new tPixel4b[numPixels];
+	bool ok = false;
+	if (Packed)
+	{
+		ok = UnpackPixels(Packed, PackedSize, pixels, numPixels);
+	}
+	else if (SpillOffset >= 0)
+	{
+		// Page the tile back in. The spill space is released since the tile is resident again.
+		if (SpillPacked)
+		{
+			uint8* packed = new uint8[SpillSize];
+			ok = SpillRead(SpillOffset, packed, SpillSize) && UnpackPixels(packed, SpillSize, pixels, numPixels);
+			delete[] packed;
+		}
+		else
+		{
+			ok = SpillRead(SpillOffset, (uint8*)pixels, SpillSize);
+		}
+		SpillRelease(SpillOffset, SpillSize);
+		SpillOffset = -1;
+		SpillSize = 0;
+	}
+
+	if (!ok)
+	{
+		tPrintf("Warning: Undo tile could not be restored.\n");
+		tStd::tMemset(pixels, 0, numPixels*sizeof(tPixel4b));
+	}
+
+	FreeResident();
+	Pixels = pixels;
+	ResidentBytes += numPixels*sizeof(tPixel4b);
+	return Pixels;
+}
+
+
+bool Undo::Tile::Pack()
+{
+	if (!Mutex.try_lock())
+		return false;
+
+	bool packed = false;
+	if (Pixels && !Incompressible)
+	{
+		int rawSize = Width*Height*sizeof(tPixel4b);
+		std::vector<uint8> buffer;
+		PackPixels(Pixels, Width*Height, buffer);
+
+		// Only worth keeping if it saves at least a quarter.
+		if (int(buffer.size())*4 <= rawSize*3)
+		{
+			uint8* data = new uint8[buffer.size()];
+			tMemcpy(data, buffer.data(), int(buffer.size()));
+			FreeResident();
+			Packed = data;
+			PackedSize = int(buffer.size());
+			ResidentBytes += PackedSize;
+			packed = true;
+		}
+		else
+		{
+			Incompressible = true;
+		}
+	}
+
+	Mutex.unlock();
+	return packed;
+}
+
+
+bool Undo::Tile::Spill()
+{
+	if (!Mutex.try_lock())
+		return false;
+
+	bool spilled = false;
+	if ((SpillOffset < 0) && (Pixels || Packed))
+	{
+		const uint8* data = Packed ? Packed : (const uint8*)Pixels;
+		int size = Packed ? PackedSize : Width*Height*int(sizeof(tPixel4b));
+		int64 offset = SpillWrite(data, size);
+		if (offset >= 0)
+		{
+			SpillPacked = (Packed != nullptr);
+			SpillOffset = offset;
+			SpillSize = size;
+			FreeResident();
+			spilled = true;
+		}
+	}
+
+	Mutex.unlock();
+	return spilled;
+}
+
+
+int64 Undo::Tile::GetResidentBytes()
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	int64 bytes = Pixels ? Width*Height*sizeof(tPixel4b) : 0;
+	return bytes + PackedSize;
+}
+
+
+void Undo::RunMaintenanceWorker()
+{
+	while (true)
+	{
+		MaintenanceJob* job = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(Worker->Mutex);
+			Worker->Wake.wait(lock, [] { return Worker->Quit || !Worker->Jobs.empty(); });
+			if (Worker->Quit)
+				return;
+			job = Worker->Jobs.front();
+			Worker->Jobs.pop_front();
+		}
+
+		RunMaintenanceJob(*job);
+		delete job;
+	}
+}
+
+
+void Undo::RunMaintenanceJob(MaintenanceJob& job)
+{
+	// Nothing in the steps nearest the current state is touched. Those are the most likely to be restored and the
+	// newest undo step is also what the next push compares against. Tiles are shared so this is done by tile.
+	std::unordered_set<const Tile*> nearest;
+	if (!job.UndoSteps.empty())
+		for (TileRef& tile : job.UndoSteps[0])
+			nearest.insert(tile.get());
+	if (!job.RedoSteps.empty())
+		for (TileRef& tile : job.RedoSteps[0])
+			nearest.insert(tile.get());
+
+	for (size_t s = 1; s < job.UndoSteps.size(); s++)
+		for (TileRef& tile : job.UndoSteps[s])
+			if (!nearest.count(tile.get()))
+				tile->Pack();
+	for (size_t s = 1; s < job.RedoSteps.size(); s++)
+		for (TileRef& tile : job.RedoSteps[s])
+			if (!nearest.count(tile.get()))
+				tile->Pack();
+
+	// Tiles are shared between steps so each is only counted once.
+	std::unordered_set<const Tile*> counted;
+	int64 imageBytes = 0;
+	auto countStep = [&counted, &imageBytes](std::vector<TileRef>& step)
+	{
+		for (TileRef& tile : step)
+			if (counted.insert(tile.get()).second)
+				imageBytes += tile->GetResidentBytes();
+	};
+	for (std::vector<TileRef>& step : job.UndoSteps)
+		countStep(step);
+	for (std::vector<TileRef>& step : job.RedoSteps)
+		countStep(step);
+
+	// Spill the furthest redo steps first, then the oldest undo steps, until both budgets are met.
+	auto overBudget = [&]() { return (imageBytes > job.ImageBudget) || (ResidentBytes > job.GlobalBudget); };
+	auto spillStep = [&](std::vector<TileRef>& step)
+	{
+		for (TileRef& tile : step)
+		{
+			if (!overBudget())
+				return;
+			if (nearest.count(tile.get()))
+				continue;
+			int64 before = tile->GetResidentBytes();
+			if (tile->Spill())
+				imageBytes -= before;
+		}
+	};
+	for (size_t s = job.RedoSteps.size(); (s > 1) && overBudget(); s--)
+		spillStep(job.RedoSteps[s-1]);
+	for (size_t s = job.UndoSteps.size(); (s > 1) && overBudget(); s--)
+		spillStep(job.UndoSteps[s-1]);
+}
+
+
+void Undo::Stack::ScheduleMaintenance()
+{
+	MaintenanceJob* job = new MaintenanceJob;
+	job->Owner = this;
+	Viewer::Config::ProfileData& profile = *Viewer::Config::Current;
+	job->ImageBudget = int64(profile.MaxUndoMemMB) * 1024 * 1024;
+	job->GlobalBudget = int64(profile.MaxUndoTotalMemMB) * 1024 * 1024;
+
+	auto collect = [](const tList<Step>& steps, std::vector< std::vector<TileRef> >& dest)
+	{
+		for (const Step* step = steps.First(); step; step = step->Next())
+		{
+			dest.emplace_back();
+			for (const TiledPicture* pic = ((const Step_PictureList*)step)->Pictures.First(); pic; pic = pic->Next())
+				dest.back().insert(dest.back().end(), pic->Tiles.begin(), pic->Tiles.end());
+		}
+	};
+	collect(UndoSteps, job->UndoSteps);
+	collect(RedoSteps, job->RedoSteps);
+
+	if (!Worker)
+	{
+		Worker = new MaintenanceWorker;
+		Worker->Thread = std::thread(RunMaintenanceWorker);
+	}
+
+	// A newer job for the same stack replaces any that has not started.
+	{
+		std::lock_guard<std::mutex> lock(Worker->Mutex);
+		for (auto it = Worker->Jobs.begin(); it != Worker->Jobs.end(); ++it)
+		{
+			if ((*it)->Owner == this)
+			{
+				delete *it;
+				Worker->Jobs.erase(it);
+				break;
+			}
+		}
+		Worker->Jobs.push_back(job);
+	}
+	Worker->Wake.notify_one();
+}
+
+
+Undo::TiledPicture::TiledPicture(const tPicture& pic, const TiledPicture* share) :
+	Width(pic.GetWidth()),
+	Height(pic.GetHeight()),
+	Duration(pic.Duration)
+{
+	if (!pic.IsValid())
+	{
+		Width = Height = 0;
+		return;
+	}
+
+	TilesW = (Width + TileSize - 1) / TileSize;
+	TilesH = (Height + TileSize - 1) / TileSize;
+	Tiles.resize(TilesW*TilesH);
+	if (share && !SameSize(*share))
+		share = nullptr;
+
+	const tPixel4b* src = pic.GetPixelPointer();
+	for (int ty = 0; ty < TilesH; ty++)
+	{
+		int y0 = ty*TileSize;
+		int th = tMin(TileSize, Height - y0);
+		for (int tx = 0; tx < TilesW; tx++)
+		{
+			int x0 = tx*TileSize;
+			int tw = tMin(TileSize, Width - x0);
+			int index = ty*TilesW + tx;
+
+			// Compare against the same tile of the share picture. Most tiles are untouched by any single operation so
+			// this usually ends with a reference count increment instead of an allocation and copy.
+			if (share)
+			{
+				Tile& shareTile = *share->Tiles[index];
+				const tPixel4b* sharePixels = shareTile.Acquire();
+				bool same = true;
+				for (int r = 0; (r < th) && same; r++)
+					same = (tMemcmp(src + (y0+r)*Width + x0, sharePixels + r*tw, tw*sizeof(tPixel4b)) == 0);
+				shareTile.Release();
+				if (same)
+				{
+					Tiles[index] = share->Tiles[index];
+					continue;
+				}
+			}
+
+			Tile* tile = new Tile(tw, th);
+			tPixel4b* tilePixels = tile->GetFillPixels();
+			for (int r = 0; r < th; r++)
+				tMemcpy(tilePixels + r*tw, src + (y0+r)*Width + x0, tw*sizeof(tPixel4b));
+			Tiles[index] = TileRef(tile);
+		}
+	}
+}
+
+
+void Undo::TiledPicture::Restore(tPicture& pic, const TiledPicture* known) const
+{
+	if ((Width <= 0) || (Height <= 0))
+	{
+		pic.Clear();
+		pic.Duration = Duration;
+		return;
+	}
+
+	// Restoring in place means only the tiles that differ from what pic holds now need writing.
+	bool inPlace = (pic.GetWidth() == Width) && (pic.GetHeight() == Height);
+	if (!inPlace || (known && !SameSize(*known)))
+		known = nullptr;
+
+	tPixel4b* dst = inPlace ? pic.GetPixelPointer() : new tPixel4b[Width*Height];
+	for (int ty = 0; ty < TilesH; ty++)
+	{
+		int y0 = ty*TileSize;
+		for (int tx = 0; tx < TilesW; tx++)
+		{
+			int index = ty*TilesW + tx;
+			if (known && (known->Tiles[index] == Tiles[index]))
+				continue;
+
+			int x0 = tx*TileSize;
+			Tile& tile = *Tiles[index];
+			const tPixel4b* tilePixels = tile.Acquire();
+			for (int r = 0; r < tile.Height; r++)
+				tMemcpy(dst + (y0+r)*Width + x0, tilePixels + r*tile.Width, tile.Width*sizeof(tPixel4b));
+			tile.Release();
+		}
+	}
+
+	// The picture takes ownership of the new buffer. Set resets the duration so it is restored last.
+	if (!inPlace)
+		pic.Set(Width, Height, dst, false);
+	pic.Duration = Duration;
+}
+
+
+Undo::Step_PictureList::Step_PictureList(const tString& desc, bool dirty, const tList<tImage::tPicture>& pics, const Step_PictureList* share) :
 	Step(desc, dirty)
 {
+	// Pictures are matched with the share step by index. If frames were added or removed there is nothing sensible to
+	// share with so all tiles are copied.
+	if (share && (share->Pictures.Count() != pics.Count()))
+		share = nullptr;
+
+	const TiledPicture* sharePic = share ? share->Pictures.First() : nullptr;
 	for (tPicture* pic = pics.First(); pic; pic = pic->Next())
-		Pictures.Append(new tPicture(*pic));
+	{
+		Pictures.Append(new TiledPicture(*pic, sharePic));
+		sharePic = sharePic ? sharePic->Next() : nullptr;
+	}
 }
 
 
-void Undo::Step_PictureList::Restore(tList<tImage::tPicture>& pics)
+void Undo::Step_PictureList::Restore(tList<tImage::tPicture>& pics, const Step_PictureList* known)
 {
-	pics.Clear();
-	for (tPicture* restorePic = Pictures.First(); restorePic; restorePic = restorePic->Next())
-		pics.Append(new tPicture(*restorePic));
+	if (pics.Count() != Pictures.Count())
+	{
+		pics.Clear();
+		for (int p = 0; p < Pictures.Count(); p++)
+			pics.Append(new tPicture);
+		known = nullptr;
+	}
+
+	const TiledPicture* knownPic = known ? known->Pictures.First() : nullptr;
+	tPicture* pic = pics.First();
+	for (const TiledPicture* restorePic = Pictures.First(); restorePic; restorePic = restorePic->Next(), pic = pic->Next())
+	{
+		restorePic->Restore(*pic, knownPic);
+		knownPic = knownPic ? knownPic->Next() : nullptr;
+	}
 }
 
 
 void Undo::Stack::Push(tList<tImage::tPicture>& preOpState, const tString& desc, bool dirty)
 {
-	// Create the undo step.
-	Undo::Step_PictureList* step = new Undo::Step_PictureList(desc, dirty, preOpState);
+	// Create the undo step. Tiles that have not changed since the previous push are shared with it.
+	Undo::Step_PictureList* step = new Undo::Step_PictureList(desc, dirty, preOpState, (Step_PictureList*)UndoSteps.Head());
 	UndoSteps.Insert(step);
 
 	// Drop one from the end if we've reached the limit.
@@ -49,6 +750,8 @@ void Undo::Stack::Push(tList<tImage::tPicture>& preOpState, const tString& desc,
 	int numUndoSteps = UndoSteps.Count();
 	if (numUndoSteps > profile.MaxUndoSteps)
 		delete UndoSteps.Drop();
+
+	ScheduleMaintenance();
 }
 
 
@@ -66,16 +769,18 @@ void Undo::Stack::Undo(tList<tImage::tPicture>& currPics, bool& dirty)
 	if (UndoSteps.IsEmpty())
 		return;
 
-	Step* undoStep = UndoSteps.Remove();
+	Step_PictureList* undoStep = (Step_PictureList*)UndoSteps.Remove();
 
-	// We're going to need a redo step to get to current state. Prepare it first.
-	Step* redoStep = new Step_PictureList(undoStep->Description, dirty, currPics);
+	// We're going to need a redo step to get to current state. Prepare it first. It shares every tile the undo step
+	// did not change, and those shared tiles are exactly the ones the restore can skip.
+	Step_PictureList* redoStep = new Step_PictureList(undoStep->Description, dirty, currPics, undoStep);
 
-	((Step_PictureList*)undoStep)->Restore(currPics);
+	undoStep->Restore(currPics, redoStep);
 	dirty = undoStep->Dirty;
 	delete undoStep;
 
 	RedoSteps.Insert(redoStep);
+	ScheduleMaintenance();
 }
 
 
@@ -84,14 +789,15 @@ void Undo::Stack::Redo(tList<tImage::tPicture>& currPics, bool& dirty)
 	if (RedoSteps.IsEmpty())
 		return;
 
-	Step* redoStep = RedoSteps.Remove();
+	Step_PictureList* redoStep = (Step_PictureList*)RedoSteps.Remove();
 
 	// We're going to need an undo step to get to current state. Prepare it first.
-	Step* undoStep = new Step_PictureList(redoStep->Description, dirty, currPics);
+	Step_PictureList* undoStep = new Step_PictureList(redoStep->Description, dirty, currPics, redoStep);
 
-	((Step_PictureList*)redoStep)->Restore(currPics);
+	redoStep->Restore(currPics, undoStep);
 	dirty = redoStep->Dirty;
 	delete redoStep;
 
 	UndoSteps.Insert(undoStep);
+	ScheduleMaintenance();
 }
@@ -14,6 +14,9 @@
 // PERFORMANCE OF THIS SOFTWARE.
 
 #pragma once
+#include <memory>
+#include <mutex>
+#include <vector>
 #include <Foundation/tList.h>
 #include <Foundation/tString.h>
 #include <Image/tPicture.h>
@@ -21,6 +24,81 @@ namespace Undo
 {
 
 
+// Undo pictures are stored as a grid of square tiles. Tiles are immutable once made and reference counted, so every
+// tile that did not change between two steps is shared by them. An operation only costs the tiles it modified.
+const int TileSize = 64;
+
+
+// Tile pixels never change after creation but where they live does. Tiles of older steps are packed (run-length
+// encoded) by a background worker and, when the undo memory budgets are exceeded, spilled to a temp file. Acquire
+// brings the pixels back into memory when an undo or redo needs them.
+class Tile
+{
+public:
+	Tile(int width, int height);
+	~Tile();
+
+	// Only for the creator of the tile, to fill it before it is shared.
+	tPixel4b* GetFillPixels()																							{ return Pixels; }
+
+	// Returns the pixels, unpacking or paging them in first if necessary. The tile stays locked until Release.
+	const tPixel4b* Acquire();
+	void Release()																										{ Mutex.unlock(); }
+
+	// Used by the background worker. Both return false without waiting if the tile is in use.
+	bool Pack();
+	bool Spill();
+
+	int64 GetResidentBytes();
+
+	const int Width;
+	const int Height;
+
+private:
+	void FreeResident();
+
+	std::mutex Mutex;
+	tPixel4b* Pixels						= nullptr;		// Resident unpacked pixels.
+	uint8* Packed							= nullptr;		// Resident packed pixels.
+	int PackedSize							= 0;
+	bool Incompressible						= false;		// Packing was tried and did not save enough.
+	int64 SpillOffset						= -1;			// Offset in the spill file. -1 if not spilled.
+	int SpillSize							= 0;
+	bool SpillPacked						= false;		// Whether the spilled bytes are packed.
+};
+typedef std::shared_ptr<Tile> TileRef;
+
+
+// Bytes used by undo tiles in main memory over all images, and bytes currently spilled to disk.
+int64 GetResidentBytes();
+int64 GetSpilledBytes();
+
+// Stops the background worker and deletes the spill file. Call on exit after all images are destroyed.
+void Shutdown();
+
+
+// A tiled copy of a single tPicture.
+class TiledPicture : public tLink<TiledPicture>
+{
+public:
+	// If share is non-null and has the same dimensions, tiles whose pixels match the same tile of share are shared
+	// rather than copied.
+	TiledPicture(const tImage::tPicture&, const TiledPicture* share);
+
+	// Writes the pixels (and frame duration) into pic. If known is non-null it must be a tiled copy of pic as it is
+	// now. Tiles shared with known are skipped since pic already holds those pixels.
+	void Restore(tImage::tPicture& pic, const TiledPicture* known) const;
+	bool SameSize(const TiledPicture& other) const																		{ return (Width == other.Width) && (Height == other.Height); }
+
+	int Width								= 0;
+	int Height								= 0;
+	float Duration							= 0.0f;
+	int TilesW								= 0;
+	int TilesH								= 0;
+	std::vector<TileRef> Tiles;
+};
+
+
 // A Step is capable of undoing (or redoing) an operation.
 class Step : public tLink<Step>
 {
@@ -33,15 +111,18 @@ public:
 };
 
 
-// A particular type of restore step. This one is simple but takes quite a lot of memory.
+// A particular type of restore step. Stores the whole picture list, but as tiles shared with the neighbouring step.
 class Step_PictureList : public Step
 {
 public:
-	Step_PictureList(const tString& desc, bool dirty, const tList<tImage::tPicture>& pics);
-	virtual ~Step_PictureList()																							{ Pictures.Empty(); }
-	void Restore(tList<tImage::tPicture>& pics);
+	// The share step (may be null) is used to share tiles that are the same.
+	Step_PictureList(const tString& desc, bool dirty, const tList<tImage::tPicture>& pics, const Step_PictureList* share);
+	virtual ~Step_PictureList()																							{ Pictures.Clear(); }
+
+	// Known (may be null) is a step made from pics as they are now. It lets the restore skip tiles that are the same.
+	void Restore(tList<tImage::tPicture>& pics, const Step_PictureList* known);
 
-	tList<tImage::tPicture> Pictures;
+	tList<TiledPicture> Pictures;
 };
 
 
@@ -63,6 +144,10 @@ public:
 	tString GetRedoDesc() const;
 
 private:
+	// Hands the steps to the background worker, which packs all but the newest and spills the oldest while the per
+	// image (MaxUndoMemMB) or global (MaxUndoTotalMemMB) budget is exceeded.
+	void ScheduleMaintenance();
+
 	tList<Step> UndoSteps;
 	tList<Step> RedoSteps;
 };